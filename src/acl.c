@@ -9,8 +9,11 @@
 #include <isccfg/grammar.h>
 
 #include <isc/buffer.h>
+#include <isc/ht.h>
 #include <isc/log.h>
 #include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/refcount.h>
 #include <isc/result.h>
 #include <isc/types.h>
 #include <isc/util.h>
@@ -22,6 +25,7 @@
 #include <dns/ssu.h>
 #include <dns/zone.h>
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -47,6 +51,42 @@ static cfg_type_t cfg_type_empty_map = {
 
 static cfg_type_t *empty_map_p = &cfg_type_empty_map;
 
+#define ACL_CACHE_HT_BITS	6
+/* Unused ACLs are purged when the cache grows over this limit. */
+#define ACL_CACHE_MAX		256
+/* Value in ssu_ht for policies which depend on zone name. */
+#define SSU_ZONEDEP		((void *)1)
+
+/**
+ * Compiled ACLs shared by all zones of one LDAP instance. Typically
+ * thousands of zones use a handful of distinct idnsAllowQuery and
+ * idnsAllowTransfer values so each value is parsed only once.
+ *
+ * Hash table maps type + normalized ACL string to dns_acl_t. The cache
+ * holds one reference to each ACL, zones attach their own references.
+ * Parsers are not thread-safe so they are guarded by the lock as well.
+ *
+ * Update policies (idnsUpdatePolicy) are cached the same way in ssu_ht.
+ * Policies with 'zonesub' rules depend on zone name so they are only
+ * marked with SSU_ZONEDEP and compiled for each zone.
+ */
+struct acl_cache {
+	isc_mem_t		*mctx;
+	isc_mutex_t		lock;
+	isc_ht_t		*ht;
+	unsigned int		count;
+	isc_ht_t		*ssu_ht;
+	unsigned int		ssu_count;
+	cfg_parser_t		*parser;
+	/* ACL parser requires "configuration context". The parser looks for
+	 * undefined names in this context. We create empty context ("map"
+	 * type), i.e. only built-in named lists "any", "none" etc. are
+	 * supported. */
+	cfg_parser_t		*parser_empty;
+	cfg_obj_t		*cctx;
+	cfg_aclconfctx_t	*aclctx;
+};
+
 const enum_txt_assoc_t acl_type_txts[] = {
 	{ acl_type_query,	"query"		},
 	{ acl_type_transfer,	"transfer"	},
@@ -263,28 +303,172 @@ cleanup:
 	return result;
 }
 
-isc_result_t
-acl_configure_zone_ssutable(const char *policy_str, dns_zone_t *zone)
+/**
+ * Build cache key: prefix followed by ACL string with whitespace
+ * sequences collapsed into single space.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+acl_cache_key(isc_mem_t *mctx, const char *prefix, const char *aclstr,
+	      ld_string_t **keyp)
+{
+	isc_result_t result;
+	ld_string_t *key = NULL;
+	size_t len;
+
+	CHECK(str_new(mctx, &key));
+	CHECK(str_sprintf(key, "%s:", prefix));
+	while (*aclstr != '\0') {
+		while (isspace((unsigned char)*aclstr))
+			aclstr++;
+		for (len = 0; aclstr[len] != '\0'
+			      && !isspace((unsigned char)aclstr[len]); len++)
+			;
+		if (len == 0)
+			break;
+		CHECK(str_cat_char_len(key, aclstr, len));
+		aclstr += len;
+		CHECK(str_cat_char(key, " "));
+	}
+
+	*keyp = key;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	str_destroy(&key);
+	return result;
+}
+
+/**
+ * Parse ACL string and build new dns_acl_t. Cache lock has to be held.
+ *
+ * Please refer to BIND 9 ARM (Administrator Reference Manual) about ACLs.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+acl_compile(acl_cache_t *cache, const char *aclstr, acl_type_t type,
+	    dns_acl_t **aclp)
+{
+	dns_acl_t *acl = NULL;
+	isc_result_t result;
+	ld_string_t *new_aclstr = NULL;
+	cfg_obj_t *aclobj = NULL;
+
+	REQUIRE(aclp != NULL && *aclp == NULL);
+
+	CHECK(bracket_str(cache->mctx, aclstr, &new_aclstr));
+
+	switch (type) {
+	case acl_type_query:
+		CHECK(cfg_parse_strbuf(cache->parser, str_buf(new_aclstr),
+				       &cfg_type_allow_query, &aclobj));
+		break;
+	case acl_type_transfer:
+		CHECK(cfg_parse_strbuf(cache->parser, str_buf(new_aclstr),
+				       &cfg_type_allow_transfer, &aclobj));
+		break;
+	default:
+		/* This is a bug */
+		REQUIRE("Unhandled ACL type in acl_compile" == NULL);
+	}
+
+	CHECK(cfg_acl_fromconfig(aclobj, cache->cctx, dns_lctx, cache->aclctx,
+				 cache->mctx, 0, &acl));
+
+	*aclp = acl;
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	if (result != ISC_R_SUCCESS)
+		log_error_r("%s ACL parsing failed: '%s'",
+			    type == acl_type_query ? "query" : "transfer",
+			    aclstr);
+
+	if (aclobj != NULL)
+		cfg_obj_destroy(cache->parser, &aclobj);
+	str_destroy(&new_aclstr);
+
+	return result;
+}
+
+/**
+ * Drop ACLs which are not used by any zone. Cache lock has to be held.
+ */
+static void ATTR_NONNULLS
+acl_cache_purge(acl_cache_t *cache)
+{
+	isc_result_t result;
+	isc_ht_iter_t *iter = NULL;
+	void *value;
+	dns_acl_t *acl;
+
+	RUNTIME_CHECK(isc_ht_iter_create(cache->ht, &iter) == ISC_R_SUCCESS);
+	result = isc_ht_iter_first(iter);
+	while (result == ISC_R_SUCCESS) {
+		value = NULL;
+		isc_ht_iter_current(iter, &value);
+		acl = value;
+		if (isc_refcount_current(&acl->refcount) == 1) {
+			dns_acl_detach(&acl);
+			cache->count--;
+			result = isc_ht_iter_delcurrent_next(iter);
+		} else {
+			result = isc_ht_iter_next(iter);
+		}
+	}
+	isc_ht_iter_destroy(&iter);
+}
+
+/**
+ * Drop all cached update policies. Zones keep their own references.
+ * Cache lock has to be held.
+ */
+static void ATTR_NONNULLS
+ssu_cache_flush(acl_cache_t *cache)
+{
+	isc_result_t result;
+	isc_ht_iter_t *iter = NULL;
+	void *value;
+	dns_ssutable_t *table;
+
+	RUNTIME_CHECK(isc_ht_iter_create(cache->ssu_ht, &iter)
+		      == ISC_R_SUCCESS);
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_delcurrent_next(iter)) {
+		value = NULL;
+		isc_ht_iter_current(iter, &value);
+		if (value == SSU_ZONEDEP)
+			continue;
+		table = value;
+		dns_ssutable_detach(&table);
+	}
+	isc_ht_iter_destroy(&iter);
+	cache->ssu_count = 0;
+}
+
+/**
+ * Parse update policy and build new SSU table. Cache lock has to be held.
+ *
+ * @param[out] zonedepp ISC_TRUE if the table contains name of the zone.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ssutable_compile(acl_cache_t *cache, const char *policy_str, dns_zone_t *zone,
+		 dns_ssutable_t **tablep, isc_boolean_t *zonedepp)
 {
 	isc_result_t result = ISC_R_SUCCESS;
-	cfg_parser_t *parser = NULL;
 	const cfg_listelt_t *el;
 	cfg_obj_t *policy = NULL;
 	dns_ssutable_t *table = NULL;
 	ld_string_t *new_policy_str = NULL;
-	isc_mem_t *mctx;
+	isc_mem_t *mctx = cache->mctx;
 
-	REQUIRE(zone != NULL);
+	REQUIRE(tablep != NULL && *tablep == NULL);
 
-	mctx = dns_zone_getmctx(zone);
-
-	if (policy_str == NULL)
-		goto cleanup;
+	*zonedepp = ISC_FALSE;
 
 	CHECK(bracket_str(mctx, policy_str, &new_policy_str));
 
-	CHECK(cfg_parser_create(mctx, dns_lctx, &parser));
-	result = cfg_parse_strbuf(parser, str_buf(new_policy_str), &cfg_type_update_policy, &policy);
+	result = cfg_parse_strbuf(cache->parser, str_buf(new_policy_str),
+				  &cfg_type_update_policy, &policy);
 
 	if (result != ISC_R_SUCCESS) {
 		dns_zone_log(zone, ISC_LOG_ERROR,
@@ -314,6 +498,7 @@ acl_configure_zone_ssutable(const char *policy_str, dns_zone_t *zone)
 		result = get_fixed_name(stmt, "name", &fname);
 		if (result == ISC_R_NOTFOUND &&
 		    match_type == DNS_SSUMATCHTYPE_SUBDOMAIN) {
+			*zonedepp = ISC_TRUE;
 			dns_fixedname_init(&fname);
 			CHECK(dns_name_copy(dns_zone_getorigin(zone),
 					    dns_fixedname_name(&fname),
@@ -348,15 +533,13 @@ acl_configure_zone_ssutable(const char *policy_str, dns_zone_t *zone)
 
 	}
 
- cleanup:
-	if (result == ISC_R_SUCCESS)
-		dns_zone_setssutable(zone, table);
+	*tablep = table;
+	table = NULL;
 
+cleanup:
 	str_destroy(&new_policy_str);
 	if (policy != NULL)
-		cfg_obj_destroy(parser, &policy);
-	if (parser != NULL)
-		cfg_parser_destroy(&parser);
+		cfg_obj_destroy(cache->parser, &policy);
 	if (table != NULL)
 		dns_ssutable_detach(&table);
 
@@ -364,66 +547,196 @@ acl_configure_zone_ssutable(const char *policy_str, dns_zone_t *zone)
 }
 
 isc_result_t
-acl_from_ldap(isc_mem_t *mctx, const char *aclstr, acl_type_t type,
-	      dns_acl_t **aclp)
+acl_cache_create(isc_mem_t *mctx, acl_cache_t **cachep)
 {
-	dns_acl_t *acl = NULL;
 	isc_result_t result;
-	ld_string_t *new_aclstr = NULL;
-	cfg_parser_t *parser = NULL;
-	cfg_obj_t *aclobj = NULL;
-	cfg_aclconfctx_t *aclctx = NULL;
-	/* ACL parser requires "configuration context". The parser looks for
-	 * undefined names in this context. We create empty context ("map" type),
-	 * i.e. only built-in named lists "any", "none" etc. are supported. */
-	cfg_obj_t *cctx = NULL;
-	cfg_parser_t *parser_empty = NULL;
+	acl_cache_t *cache = NULL;
 
-	REQUIRE(aclp != NULL && *aclp == NULL);
+	REQUIRE(cachep != NULL && *cachep == NULL);
 
-	CHECK(bracket_str(mctx, aclstr, &new_aclstr));
+	CHECKED_MEM_GET_PTR(mctx, cache);
+	ZERO_PTR(cache);
+	isc_mem_attach(mctx, &cache->mctx);
+	result = isc_mutex_init(&cache->lock);
+	if (result != ISC_R_SUCCESS) {
+		MEM_PUT_AND_DETACH(cache);
+		return result;
+	}
+	CHECK(isc_ht_init(&cache->ht, mctx, ACL_CACHE_HT_BITS));
+	CHECK(isc_ht_init(&cache->ssu_ht, mctx, ACL_CACHE_HT_BITS));
 
-	CHECK(cfg_parser_create(mctx, dns_lctx, &parser));
-	CHECK(cfg_parser_create(mctx, dns_lctx, &parser_empty));
-	CHECK(cfg_parse_strbuf(parser_empty, "{}", &empty_map_p, &cctx));
+	CHECK(cfg_parser_create(mctx, dns_lctx, &cache->parser));
+	CHECK(cfg_parser_create(mctx, dns_lctx, &cache->parser_empty));
+	CHECK(cfg_parse_strbuf(cache->parser_empty, "{}", &empty_map_p,
+			       &cache->cctx));
+	CHECK(cfg_aclconfctx_create(mctx, &cache->aclctx));
 
-	switch (type) {
-	case acl_type_query:
-		CHECK(cfg_parse_strbuf(parser, str_buf(new_aclstr), &cfg_type_allow_query,
-			    &aclobj));
-		break;
-	case acl_type_transfer:
-		CHECK(cfg_parse_strbuf(parser, str_buf(new_aclstr), &cfg_type_allow_transfer,
-			    &aclobj));
-		break;
-	default:
-		/* This is a bug */
-		REQUIRE("Unhandled ACL type in acl_from_ldap" == NULL);
+	*cachep = cache;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	acl_cache_destroy(&cache);
+	return result;
+}
+
+void
+acl_cache_destroy(acl_cache_t **cachep)
+{
+	acl_cache_t *cache;
+	isc_ht_iter_t *iter = NULL;
+	isc_result_t result;
+	void *value;
+	dns_acl_t *acl;
+
+	if (cachep == NULL || *cachep == NULL)
+		return;
+
+	cache = *cachep;
+
+	if (cache->ht != NULL) {
+		RUNTIME_CHECK(isc_ht_iter_create(cache->ht, &iter)
+			      == ISC_R_SUCCESS);
+		for (result = isc_ht_iter_first(iter);
+		     result == ISC_R_SUCCESS;
+		     result = isc_ht_iter_delcurrent_next(iter)) {
+			value = NULL;
+			isc_ht_iter_current(iter, &value);
+			acl = value;
+			dns_acl_detach(&acl);
+		}
+		isc_ht_iter_destroy(&iter);
+		isc_ht_destroy(&cache->ht);
 	}
+	if (cache->ssu_ht != NULL) {
+		ssu_cache_flush(cache);
+		isc_ht_destroy(&cache->ssu_ht);
+	}
+	if (cache->aclctx != NULL)
+		cfg_aclconfctx_detach(&cache->aclctx);
+	if (cache->cctx != NULL)
+		cfg_obj_destroy(cache->parser_empty, &cache->cctx);
+	if (cache->parser_empty != NULL)
+		cfg_parser_destroy(&cache->parser_empty);
+	if (cache->parser != NULL)
+		cfg_parser_destroy(&cache->parser);
+	DESTROYLOCK(&cache->lock);
+
+	MEM_PUT_AND_DETACH(cache);
+	*cachep = NULL;
+}
+
+/**
+ * Get compiled ACL for given ACL string. ACL is compiled only if the same
+ * string (modulo whitespace) was not seen before.
+ *
+ * @param[out] aclp New reference to the ACL, caller has to detach it.
+ */
+isc_result_t
+acl_cache_get(acl_cache_t *cache, const char *aclstr, acl_type_t type,
+	      dns_acl_t **aclp)
+{
+	isc_result_t result;
+	ld_string_t *key = NULL;
+	dns_acl_t *acl = NULL;
+	void *value = NULL;
 
-	CHECK(cfg_aclconfctx_create(mctx, &aclctx));
-	CHECK(cfg_acl_fromconfig(aclobj, cctx, dns_lctx, aclctx, mctx, 0, &acl));
+	REQUIRE(aclp != NULL && *aclp == NULL);
 
-	*aclp = acl;
-	result = ISC_R_SUCCESS;
+	CHECK(acl_cache_key(cache->mctx,
+			    type == acl_type_query ? "query" : "transfer",
+			    aclstr, &key));
+
+	LOCK(&cache->lock);
+	result = isc_ht_find(cache->ht, (const unsigned char *)str_buf(key),
+			     str_len(key), &value);
+	if (result == ISC_R_SUCCESS) {
+		dns_acl_attach(value, aclp);
+	} else if (result == ISC_R_NOTFOUND) {
+		result = acl_compile(cache, aclstr, type, &acl);
+		if (result == ISC_R_SUCCESS) {
+			if (cache->count >= ACL_CACHE_MAX)
+				acl_cache_purge(cache);
+			result = isc_ht_add(cache->ht,
+					    (const unsigned char *)str_buf(key),
+					    str_len(key), acl);
+		}
+		if (result == ISC_R_SUCCESS) {
+			cache->count++;
+			dns_acl_attach(acl, aclp);
+		} else if (acl != NULL) {
+			dns_acl_detach(&acl);
+		}
+	}
+	UNLOCK(&cache->lock);
 
 cleanup:
-	if (result != ISC_R_SUCCESS)
-		log_error_r("%s ACL parsing failed: '%s'",
-			    type == acl_type_query ? "query" : "transfer",
-			    aclstr);
+	str_destroy(&key);
+	return result;
+}
 
-	if (aclctx != NULL)
-		cfg_aclconfctx_detach(&aclctx);
-	if (aclobj != NULL)
-		cfg_obj_destroy(parser, &aclobj);
-	if (parser != NULL)
-		cfg_parser_destroy(&parser);
-	if (cctx != NULL)
-		cfg_obj_destroy(parser_empty, &cctx);
-	if (parser_empty != NULL)
-		cfg_parser_destroy(&parser_empty);
-	str_destroy(&new_aclstr);
+/**
+ * Configure update policy of a zone. SSU table is shared with other zones
+ * using the same policy string unless the policy depends on zone name.
+ *
+ * @param[in] policy_str Policy string or NULL to remove the policy.
+ */
+isc_result_t
+acl_configure_zone_ssutable(acl_cache_t *cache, const char *policy_str,
+			    dns_zone_t *zone)
+{
+	isc_result_t result;
+	ld_string_t *key = NULL;
+	dns_ssutable_t *table = NULL;
+	dns_ssutable_t *cached = NULL;
+	isc_boolean_t zonedep = ISC_FALSE;
+	void *value = NULL;
 
+	if (policy_str == NULL) {
+		dns_zone_setssutable(zone, NULL);
+		return ISC_R_SUCCESS;
+	}
+
+	CHECK(acl_cache_key(cache->mctx, "update", policy_str, &key));
+
+	LOCK(&cache->lock);
+	result = isc_ht_find(cache->ssu_ht, (const unsigned char *)str_buf(key),
+			     str_len(key), &value);
+	if (result == ISC_R_SUCCESS && value != SSU_ZONEDEP) {
+		dns_ssutable_attach(value, &table);
+	} else if (result == ISC_R_SUCCESS) {
+		result = ssutable_compile(cache, policy_str, zone, &table,
+					  &zonedep);
+	} else if (result == ISC_R_NOTFOUND) {
+		result = ssutable_compile(cache, policy_str, zone, &table,
+					  &zonedep);
+		if (result == ISC_R_SUCCESS) {
+			if (cache->ssu_count >= ACL_CACHE_MAX)
+				ssu_cache_flush(cache);
+			if (zonedep == ISC_TRUE) {
+				value = SSU_ZONEDEP;
+			} else {
+				dns_ssutable_attach(table, &cached);
+				value = cached;
+			}
+			if (isc_ht_add(cache->ssu_ht,
+				       (const unsigned char *)str_buf(key),
+				       str_len(key), value) == ISC_R_SUCCESS) {
+				cache->ssu_count++;
+				cached = NULL;
+			}
+			/* failure to cache does not affect the zone */
+			if (cached != NULL)
+				dns_ssutable_detach(&cached);
+		}
+	}
+	UNLOCK(&cache->lock);
+	CHECK(result);
+
+	dns_zone_setssutable(zone, table);
+
+cleanup:
+	if (table != NULL)
+		dns_ssutable_detach(&table);
+	str_destroy(&key);
 	return result;
 }
@@ -17,18 +17,28 @@ typedef enum acl_type {
 	acl_type_transfer
 } acl_type_t;
 
+typedef struct acl_cache acl_cache_t;
+
 extern const enum_txt_assoc_t acl_type_txts[];
 
 isc_result_t
-acl_configure_zone_ssutable(const char *policy_str, dns_zone_t *zone) ATTR_NONNULLS ATTR_CHECKRESULT;
+acl_cache_create(isc_mem_t *mctx, acl_cache_t **cachep)
+		 ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+acl_cache_destroy(acl_cache_t **cachep);
 
 isc_result_t
-acl_from_ldap(isc_mem_t *mctx, const char *aclstr, acl_type_t type,
+acl_cache_get(acl_cache_t *cache, const char *aclstr, acl_type_t type,
 	      dns_acl_t **aclp) ATTR_NONNULLS ATTR_CHECKRESULT;
 /*
- * Converts multiple ACL element.
+ * Returns compiled ACL shared with other zones using the same ACL string.
  *
  * Please refer to BIND 9 ARM (Administrator Reference Manual) about ACLs.
  */
 
+isc_result_t
+acl_configure_zone_ssutable(acl_cache_t *cache, const char *policy_str,
+			    dns_zone_t *zone) ATTR_NONNULL(1,3) ATTR_CHECKRESULT;
+
 #endif /* !_LD_ACL_H_ */
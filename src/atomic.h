@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2016  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Atomic operations used by lock-free readers.
+ *
+ * isc/atomic.h from BIND 9.11 offers only 32-bit exchange-add, store and
+ * compare-and-exchange, each of them optional per platform, and does not
+ * specify memory ordering. Readers of the zone register need acquire and
+ * release semantics for pointers as well, so these wrappers use GCC
+ * __atomic builtins (GCC >= 4.7, clang) which are checked by configure.
+ * All uses of the builtins in the plugin have to go through this header.
+ */
+
+#ifndef ATOMIC_H_
+#define ATOMIC_H_
+
+/** Load with acquire semantics, pairs with ATOMIC_STORE_RELEASE. */
+#define ATOMIC_LOAD_ACQUIRE(ptr) \
+	__atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+
+/** Store with release semantics, pairs with ATOMIC_LOAD_ACQUIRE. */
+#define ATOMIC_STORE_RELEASE(ptr, val) \
+	__atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+
+/** Sequentially consistent load, store, increment and decrement. */
+#define ATOMIC_LOAD(ptr) \
+	__atomic_load_n((ptr), __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(ptr, val) \
+	__atomic_store_n((ptr), (val), __ATOMIC_SEQ_CST)
+#define ATOMIC_INCREMENT(ptr) \
+	__atomic_add_fetch((ptr), 1, __ATOMIC_SEQ_CST)
+#define ATOMIC_DECREMENT(ptr) \
+	__atomic_sub_fetch((ptr), 1, __ATOMIC_SEQ_CST)
+
+/** Decrement which publishes all preceding reads and writes. */
+#define ATOMIC_DECREMENT_RELEASE(ptr) \
+	__atomic_sub_fetch((ptr), 1, __ATOMIC_RELEASE)
+
+/** Increment without ordering guarantees, returns the original value. */
+#define ATOMIC_FETCH_INCREMENT_RELAXED(ptr) \
+	__atomic_fetch_add((ptr), 1, __ATOMIC_RELAXED)
+
+#endif /* ATOMIC_H_ */
@@ -8,6 +8,9 @@
 
 #include <isccfg/grammar.h>
 
+#include <isc/ht.h>
+#include <isc/mutex.h>
+
 #include <dns/forward.h>
 #include <dns/fixedname.h>
 #include <dns/view.h>
@@ -20,6 +23,23 @@
 #include "settings.h"
 #include "zone_register.h"
 
+#define FWD_CACHE_HT_BITS	6
+/* Whole cache is flushed when it grows over this limit. */
+#define FWD_CACHE_MAX		512
+
+/**
+ * Parsed values of setting 'forwarders' keyed by the setting string.
+ * Strings are generated by fwd_print_bracketed_values_buf() so identical
+ * idnsForwarders values produce identical keys. Each value is
+ * a dns_forwarderlist_t allocated from cache mctx; callers get a copy.
+ */
+struct fwd_cache {
+	isc_mem_t		*mctx;
+	isc_mutex_t		lock;
+	isc_ht_t		*ht;
+	unsigned int		count;
+};
+
 const enum_txt_assoc_t forwarder_policy_txts[] = {
 	{ dns_fwdpolicy_none,	"none"	},
 	{ dns_fwdpolicy_first,	"first"	},
@@ -300,6 +320,166 @@ fwdr_list_free(isc_mem_t *mctx, dns_forwarderlist_t *fwdrs) {
 	}
 }
 
+static isc_result_t
+fwdr_list_copy(isc_mem_t *mctx, const dns_forwarderlist_t *from,
+	       dns_forwarderlist_t *to) {
+	isc_result_t result = ISC_R_SUCCESS;
+	dns_forwarder_t *fwdr;
+
+	REQUIRE(ISC_LIST_EMPTY(*to));
+
+	for (const dns_forwarder_t *src = ISC_LIST_HEAD(*from);
+	     src != NULL;
+	     src = ISC_LIST_NEXT(src, link)) {
+		CHECKED_MEM_GET_PTR(mctx, fwdr);
+		fwdr->addr = src->addr;
+		fwdr->dscp = src->dscp;
+		ISC_LINK_INIT(fwdr, link);
+		ISC_LIST_APPEND(*to, fwdr, link);
+	}
+
+cleanup:
+	if (result != ISC_R_SUCCESS)
+		fwdr_list_free(mctx, to);
+	return result;
+}
+
+/**
+ * Compare two lists of forwarders including order of the forwarders.
+ */
+static isc_boolean_t
+fwdr_list_equal(const dns_forwarderlist_t *a, const dns_forwarderlist_t *b) {
+	const dns_forwarder_t *fa, *fb;
+
+	for (fa = ISC_LIST_HEAD(*a), fb = ISC_LIST_HEAD(*b);
+	     fa != NULL && fb != NULL;
+	     fa = ISC_LIST_NEXT(fa, link), fb = ISC_LIST_NEXT(fb, link)) {
+		if (!isc_sockaddr_equal(&fa->addr, &fb->addr)
+		    || fa->dscp != fb->dscp)
+			return ISC_FALSE;
+	}
+	return ISC_TF(fa == NULL && fb == NULL);
+}
+
+/**
+ * Drop all parsed lists. Cache lock has to be held.
+ */
+static void
+fwd_cache_flush(fwd_cache_t *cache) {
+	isc_result_t result;
+	isc_ht_iter_t *iter = NULL;
+	void *value;
+	dns_forwarderlist_t *fwdrs;
+
+	RUNTIME_CHECK(isc_ht_iter_create(cache->ht, &iter) == ISC_R_SUCCESS);
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_delcurrent_next(iter)) {
+		value = NULL;
+		isc_ht_iter_current(iter, &value);
+		fwdrs = value;
+		fwdr_list_free(cache->mctx, fwdrs);
+		SAFE_MEM_PUT_PTR(cache->mctx, fwdrs);
+	}
+	isc_ht_iter_destroy(&iter);
+	cache->count = 0;
+}
+
+isc_result_t
+fwd_cache_create(isc_mem_t *mctx, fwd_cache_t **cachep) {
+	isc_result_t result;
+	fwd_cache_t *cache = NULL;
+
+	REQUIRE(cachep != NULL && *cachep == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, cache);
+	ZERO_PTR(cache);
+	isc_mem_attach(mctx, &cache->mctx);
+	result = isc_mutex_init(&cache->lock);
+	if (result != ISC_R_SUCCESS) {
+		MEM_PUT_AND_DETACH(cache);
+		return result;
+	}
+	result = isc_ht_init(&cache->ht, mctx, FWD_CACHE_HT_BITS);
+	if (result != ISC_R_SUCCESS) {
+		DESTROYLOCK(&cache->lock);
+		MEM_PUT_AND_DETACH(cache);
+		return result;
+	}
+
+	*cachep = cache;
+
+cleanup:
+	return result;
+}
+
+void
+fwd_cache_destroy(fwd_cache_t **cachep) {
+	fwd_cache_t *cache;
+
+	if (cachep == NULL || *cachep == NULL)
+		return;
+
+	cache = *cachep;
+	LOCK(&cache->lock);
+	fwd_cache_flush(cache);
+	isc_ht_destroy(&cache->ht);
+	UNLOCK(&cache->lock);
+	DESTROYLOCK(&cache->lock);
+	MEM_PUT_AND_DETACH(cache);
+	*cachep = NULL;
+}
+
+/**
+ * Get list of forwarders for string from setting 'forwarders'.
+ * The string is parsed by fwd_parse_str() only if it is not in the cache.
+ *
+ * @param[out] fwdrs Empty list, will be filled with copy allocated
+ *                   from mctx.
+ */
+static isc_result_t
+fwd_cache_parse(fwd_cache_t *cache, const char *fwdrs_str, isc_mem_t *mctx,
+		dns_forwarderlist_t *fwdrs) {
+	isc_result_t result;
+	dns_forwarderlist_t *parsed = NULL;
+	void *value = NULL;
+	const unsigned char *key = (const unsigned char *)fwdrs_str;
+	isc_uint32_t keysize = strlen(fwdrs_str);
+
+	REQUIRE(ISC_LIST_EMPTY(*fwdrs));
+
+	LOCK(&cache->lock);
+	result = isc_ht_find(cache->ht, key, keysize, &value);
+	if (result == ISC_R_SUCCESS)
+		result = fwdr_list_copy(mctx, value, fwdrs);
+	UNLOCK(&cache->lock);
+	if (result != ISC_R_NOTFOUND)
+		return result;
+
+	/* parse outside of the lock, conflicts are resolved below */
+	CHECKED_MEM_GET_PTR(cache->mctx, parsed);
+	ISC_LIST_INIT(*parsed);
+	CHECK(fwd_parse_str(fwdrs_str, cache->mctx, parsed));
+	CHECK(fwdr_list_copy(mctx, parsed, fwdrs));
+
+	LOCK(&cache->lock);
+	if (cache->count >= FWD_CACHE_MAX)
+		fwd_cache_flush(cache);
+	if (isc_ht_add(cache->ht, key, keysize, parsed) == ISC_R_SUCCESS) {
+		cache->count++;
+		parsed = NULL;
+	}
+	/* other thread was faster or the cache is full, it does not matter */
+	UNLOCK(&cache->lock);
+
+cleanup:
+	if (parsed != NULL) {
+		fwdr_list_free(cache->mctx, parsed);
+		SAFE_MEM_PUT_PTR(cache->mctx, parsed);
+	}
+	return result;
+}
+
 /**
  * Detect if given set of settings contains explicit forwarding configuration.
  * Explicit configuration is either:
@@ -313,8 +493,8 @@ fwdr_list_free(isc_mem_t *mctx, dns_forwarderlist_t *fwdrs) {
  * @retval other         memory allocation or parsing errors etc.
  */
 static isc_result_t
-fwd_setting_isexplicit(isc_mem_t *mctx, const settings_set_t *set,
-		       isc_boolean_t *isexplicit) {
+fwd_setting_isexplicit(fwd_cache_t *cache, isc_mem_t *mctx,
+		       const settings_set_t *set, isc_boolean_t *isexplicit) {
 	isc_result_t result;
 	setting_t *setting = NULL;
 	dns_fwdpolicy_t	fwdpolicy;
@@ -333,7 +513,7 @@ fwd_setting_isexplicit(isc_mem_t *mctx, const settings_set_t *set,
 
 	setting = NULL;
 	CHECK(setting_find("forwarders", set, ISC_FALSE, ISC_TRUE, &setting));
-	CHECK(fwd_parse_str(setting->value.value_char, mctx, &fwdrs));
+	CHECK(fwd_cache_parse(cache, setting->value.value_char, mctx, &fwdrs));
 
 cleanup:
 	*isexplicit = (result == ISC_R_SUCCESS && !ISC_LIST_EMPTY(fwdrs));
@@ -351,7 +531,8 @@ cleanup:
  * @retval ISC_R_NOTFOUND setting set with explicit configuration does not exist
  */
 static isc_result_t
-fwd_setting_find_explicit(isc_mem_t *mctx, const settings_set_t *start_set,
+fwd_setting_find_explicit(fwd_cache_t *cache, isc_mem_t *mctx,
+			  const settings_set_t *start_set,
 			  const settings_set_t **found) {
 	isc_result_t result;
 	isc_boolean_t isexplicit;
@@ -362,7 +543,7 @@ fwd_setting_find_explicit(isc_mem_t *mctx, const settings_set_t *start_set,
 	     set != NULL;
 	     set = set->parent_set)
 	{
-		CHECK(fwd_setting_isexplicit(mctx, set, &isexplicit));
+		CHECK(fwd_setting_isexplicit(cache, mctx, set, &isexplicit));
 		if (isexplicit == ISC_TRUE) {
 			*found = set;
 			CLEANUP_WITH(ISC_R_SUCCESS);
@@ -391,7 +572,8 @@ cleanup:
  *                               or specified forwarders are invalid.
  */
 isc_result_t
-fwd_parse_ldap(ldap_entry_t *entry, settings_set_t *set) {
+fwd_parse_ldap(ldap_instance_t *inst, ldap_entry_t *entry,
+	       settings_set_t *set) {
 	isc_result_t result;
 	isc_result_t first;
 	ldap_valuelist_t values;
@@ -450,7 +632,8 @@ fwd_parse_ldap(ldap_entry_t *entry, settings_set_t *set) {
 						    &tmp_buf));
 		setting_str = isc_buffer_base(tmp_buf);
 		/* just sanity check, the result is unused */
-		CHECK(fwd_parse_str(setting_str, entry->mctx, &fwdrs));
+		CHECK(fwd_cache_parse(ldap_instance_getfwdcache(inst),
+				      setting_str, entry->mctx, &fwdrs));
 	}
 	if (!ISC_LIST_EMPTY(fwdrs)) {
 		result = setting_set("forwarders", set, setting_str);
@@ -515,8 +698,11 @@ fwd_configure_zone(const settings_set_t *set, ldap_instance_t *inst,
 	const char *forwarders_str = NULL;
 	isc_boolean_t isconfigured;
 	const settings_set_t *explicit_set = NULL;
+	fwd_cache_t *cache = NULL;
+	dns_forwarders_t *installed = NULL;
 
 	REQUIRE(inst != NULL && name != NULL);
+	cache = ldap_instance_getfwdcache(inst);
 	ldap_instance_attachmem(inst, &mctx);
 	ldap_instance_attachview(inst, &view);
 
@@ -540,9 +726,10 @@ fwd_configure_zone(const settings_set_t *set, ldap_instance_t *inst,
 	 * is necessary.
 	 * For all other zones (non-root) zones *do not* use recursive getter
 	 * and let BIND to handle inheritance in fwdtable itself. */
-	CHECK(fwd_setting_isexplicit(mctx, set, &isconfigured));
+	CHECK(fwd_setting_isexplicit(cache, mctx, set, &isconfigured));
 	if (isconfigured == ISC_FALSE && is_global_config == ISC_TRUE) {
-		result = fwd_setting_find_explicit(mctx, set, &explicit_set);
+		result = fwd_setting_find_explicit(cache, mctx, set,
+						   &explicit_set);
 		if (result == ISC_R_SUCCESS) {
 			isconfigured = ISC_TRUE;
 			if (set != explicit_set) {
@@ -555,7 +742,7 @@ fwd_configure_zone(const settings_set_t *set, ldap_instance_t *inst,
 	}
 
 	if (isconfigured == ISC_TRUE) {
-		CHECK(setting_get_str("forward_policy", set, &fwdpolicy_str));
+		CHECK(setting_get_str(SETTING_FORWARD_POLICY, set, &fwdpolicy_str));
 		result = get_enum_value(forwarder_policy_txts,
 					fwdpolicy_str, (int *)&fwdpolicy);
 		INSIST(result == ISC_R_SUCCESS);
@@ -567,14 +754,39 @@ fwd_configure_zone(const settings_set_t *set, ldap_instance_t *inst,
 				  msg_obj_type, set->name);
 			ISC_LIST_INIT(fwdrs);
 		} else {
-			CHECK(setting_get_str("forwarders", set, &forwarders_str));
-			CHECK(fwd_parse_str(forwarders_str, mctx, &fwdrs));
+			CHECK(setting_get_str(SETTING_FORWARDERS, set,
+					      &forwarders_str));
+			CHECK(fwd_cache_parse(cache, forwarders_str, mctx,
+					      &fwdrs));
 		}
 	} else {
 		log_debug(5, "%s %s: no explicit configuration found%s",
 			  msg_obj_type, set->name, msg_use_global_fwds);
 	}
 
+	/* Skip exclusive mode, cache flush and empty zone handling if
+	 * the forwarding table already contains the same configuration.
+	 * Forwarding table is modified only in exclusive mode so it cannot
+	 * change under our hands. */
+	result = dns_fwdtable_find2(view->fwdtable, name,
+				    dns_fixedname_name(&foundname),
+				    &installed);
+	if (result == ISC_R_SUCCESS
+	    && !dns_name_equal(name, dns_fixedname_name(&foundname)))
+		result = ISC_R_NOTFOUND;
+	if (result == DNS_R_PARTIALMATCH)
+		result = ISC_R_NOTFOUND;
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
+		goto cleanup;
+	if ((isconfigured == ISC_FALSE && result == ISC_R_NOTFOUND)
+	    || (isconfigured == ISC_TRUE && result == ISC_R_SUCCESS
+		&& installed->fwdpolicy == fwdpolicy
+		&& fwdr_list_equal(&installed->fwdrs, &fwdrs))) {
+		log_debug(5, "%s %s: forwarder table is up-to-date",
+			  msg_obj_type, set->name);
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	}
+
 	/* update forwarding table */
 	run_exclusive_enter(inst, &lock_state);
 	CHECK(fwd_delete_table(view, name, msg_obj_type, set->name));
@@ -621,6 +833,48 @@ fwd_delete_table(dns_view_t *view, dns_name_t *name,
 	}
 }
 
+/**
+ * Copy forwarding configuration for a name from one view to another.
+ * It is used for LDAP forward zones when an instance moves its data
+ * to the new view after reload, see park_ldap_instance().
+ *
+ * @retval ISC_R_SUCCESS  Forwarders were copied or there was no explicit
+ *                        configuration for the name in the source view.
+ */
+isc_result_t
+fwd_copy_zone(dns_view_t *from, dns_view_t *to, dns_name_t *name)
+{
+	isc_result_t result;
+	dns_forwarders_t *fwdrs = NULL;
+	dns_fixedname_t foundname;
+	char name_txt[DNS_NAME_FORMATSIZE];
+
+	dns_fixedname_init(&foundname);
+	dns_name_format(name, name_txt, DNS_NAME_FORMATSIZE);
+
+	result = dns_fwdtable_find2(from->fwdtable, name,
+				    dns_fixedname_name(&foundname), &fwdrs);
+	if (result == ISC_R_NOTFOUND || result == DNS_R_PARTIALMATCH)
+		return ISC_R_SUCCESS;
+	else if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	if (!dns_name_equal(name, dns_fixedname_name(&foundname)))
+		return ISC_R_SUCCESS;
+
+	CHECK(fwd_delete_table(to, name, "zone", name_txt));
+	CHECK(dns_fwdtable_addfwd(to->fwdtable, name, &fwdrs->fwdrs,
+				  fwdrs->fwdpolicy));
+	CHECK(empty_zone_handle_conflicts(name, to->zonetable,
+					  (fwdrs->fwdpolicy
+					   == dns_fwdpolicy_first)));
+
+cleanup:
+	if (result != ISC_R_SUCCESS)
+		log_error_r("zone '%s': forwarders could not be copied "
+			    "to the new view", name_txt);
+	return result;
+}
+
 /**
  * Reconfigure global forwarder using latest configuration in priority order:
  * - root zone (if it is active)
@@ -639,7 +893,7 @@ fwd_reconfig_global(ldap_instance_t *inst) {
 				      &toplevel_settings);
 	if (result == ISC_R_SUCCESS)
 		/* is root zone active? */
-		CHECK(setting_get_bool("active", toplevel_settings,
+		CHECK(setting_get_bool(SETTING_ACTIVE, toplevel_settings,
 				       &root_zone_is_active));
 	else if (result != ISC_R_NOTFOUND)
 		goto cleanup;
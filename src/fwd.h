@@ -22,8 +22,15 @@ fwd_print_bracketed_values_buf(isc_mem_t *mctx, ldap_valuelist_t *values,
 			       ATTR_NONNULLS ATTR_CHECKRESULT;
 
 isc_result_t
-fwd_parse_ldap(ldap_entry_t *entry, settings_set_t *set)
-	       ATTR_NONNULLS ATTR_CHECKRESULT;
+fwd_cache_create(isc_mem_t *mctx, fwd_cache_t **cachep)
+		 ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+fwd_cache_destroy(fwd_cache_t **cachep);
+
+isc_result_t
+fwd_parse_ldap(ldap_instance_t *inst, ldap_entry_t *entry,
+	       settings_set_t *set) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 isc_result_t
 fwd_configure_zone(const settings_set_t *set, ldap_instance_t *inst, dns_name_t *name)
@@ -34,6 +41,10 @@ fwd_delete_table(dns_view_t *view, dns_name_t *name,
 		 const char *msg_obj_type, const char *logname)
 		 ATTR_NONNULLS ATTR_CHECKRESULT;
 
+isc_result_t
+fwd_copy_zone(dns_view_t *from, dns_view_t *to, dns_name_t *name)
+	      ATTR_NONNULLS ATTR_CHECKRESULT;
+
 isc_result_t
 fwd_reconfig_global(ldap_instance_t *inst)
 		    ATTR_NONNULLS ATTR_CHECKRESULT;
@@ -26,6 +26,62 @@
 #include "util.h"
 #include "zone_register.h"
 
+#define IDNSNAME_PREFIX "idnsName="
+
+/**
+ * Find values of leading idnsName components in DN without allocating
+ * LDAPDN structure. Only simple DNs are handled, e.g.
+ * "idnsName=foo, idnsName=example.org., cn=dns, dc=example, dc=org".
+ * Escaped or quoted values, multi-valued RDNs and other special cases
+ * are left for ldap_str2dn().
+ *
+ * Buffers point into dn_str, no copy is made. Results have to be identical
+ * to values returned by ldap_str2dn(), see tests/dn_convert_test.c.
+ *
+ * @param[out] idxp Number of leading idnsName components found.
+ *
+ * @retval ISC_R_SUCCESS DN was parsed, buffers and *idxp are valid.
+ * @retval ISC_R_IGNORE  DN has to be parsed by generic parser.
+ */
+isc_result_t
+dn_idnsname_fast(const char *dn_str, isc_buffer_t *name_buf,
+		 isc_buffer_t *origin_buf, int *idxp)
+{
+	const char *p = dn_str;
+	const char *value;
+	char *value_rw;
+	size_t len;
+	int idx;
+
+	for (idx = 0; idx < 2; idx++) {
+		while (*p == ' ')
+			p++;
+		if (strncasecmp(p, IDNSNAME_PREFIX,
+				sizeof(IDNSNAME_PREFIX) - 1) != 0)
+			break;
+		value = p + sizeof(IDNSNAME_PREFIX) - 1;
+		len = strcspn(value, ",+;=\\\"<>");
+		if (len == 0 || value[0] == '#' || value[0] == ' '
+		    || value[len - 1] == ' '
+		    || (value[len] != ',' && value[len] != '\0'))
+			return ISC_R_IGNORE;
+
+		DE_CONST(value, value_rw);
+		isc_buffer_init((idx == 0) ? name_buf : origin_buf,
+				value_rw, len);
+		isc_buffer_add((idx == 0) ? name_buf : origin_buf, len);
+		p = value + len;
+		if (*p == ',')
+			p++;
+	}
+	/* let the generic parser report errors */
+	if (idx == 0)
+		return ISC_R_IGNORE;
+
+	*idxp = idx;
+	return ISC_R_SUCCESS;
+}
+
 /**
  * Convert LDAP DN to absolute DNS names.
  *
@@ -75,6 +131,11 @@ dn_to_dnsname(isc_mem_t *mctx, const char *dn_str, dns_name_t *target,
 	isc_buffer_initnull(&name_buf);
 	isc_buffer_initnull(&origin_buf);
 
+	/* most DNs are simple, avoid allocations in ldap_str2dn() */
+	result = dn_idnsname_fast(dn_str, &name_buf, &origin_buf, &idx);
+	if (result == ISC_R_SUCCESS)
+		goto convert;
+
 	/* Example DN: cn=a+sn=b, ou=people */
 
 	ret = ldap_str2dn(dn_str, &dn, LDAP_DN_FORMAT_LDAPV3);
@@ -124,6 +185,7 @@ dn_to_dnsname(isc_mem_t *mctx, const char *dn_str, dns_name_t *target,
 		}
 	}
 
+convert:
 	/* filter out unsupported cases */
 	if (idx <= 0) {
 		log_error("no idnsName component found in DN");
@@ -331,10 +393,16 @@ dnsname_to_dn(zone_register_t *zr, dns_name_t *name, dns_name_t *zone,
 	isc_mem_t * mctx = zr_get_mctx(zr);
 	str_clear(target);
 
+	namereln = dns_name_fullcompare(name, zone, &dummy, &common_labels);
+	if (namereln != dns_namereln_equal) {
+		result = zr_get_owner_dn(zr, zone, name, target);
+		if (result != ISC_R_NOTFOUND)
+			goto cleanup;
+	}
+
 	/* Find the DN of the zone we belong to. */
 	CHECK(zr_get_zone_dn(zr, zone, &zone_dn));
 
-	namereln = dns_name_fullcompare(name, zone, &dummy, &common_labels);
 	if (namereln != dns_namereln_equal) {
 		label_count = dns_name_countlabels(name) - common_labels;
 
@@ -347,12 +415,19 @@ dnsname_to_dn(zone_register_t *zr, dns_name_t *name, dns_name_t *zone,
 		CHECK(str_cat_char(target, escaped_name));
 		/* 
 		 * Modification of following line can affect modify_ldap_common().
-		 * See line with: char *zone_dn = strstr(str_buf(owner_dn),", ") + 1;  
+		 * See line with: zone_dn = strstr(str_buf(owner_dn),", ");
 		 */
 		CHECK(str_cat_char(target, ", "));
 	}
 	CHECK(str_cat_char(target, zone_dn));
 
+	if (namereln != dns_namereln_equal) {
+		/* The cache is only an optimization, ignore failures. */
+		if (zr_set_owner_dn(zr, zone, name, str_buf(target))
+		    != ISC_R_SUCCESS)
+			log_debug(5, "failed to cache DN '%s'", str_buf(target));
+	}
+
 cleanup:
 	if (dns_str)
 		isc_mem_free(mctx, dns_str);
@@ -29,6 +29,10 @@ isc_result_t dn_to_dnsname(isc_mem_t *mctx, const char *dn,
 			   isc_boolean_t *iszone)
 			   ATTR_NONNULL(1, 2, 3) ATTR_CHECKRESULT;
 
+isc_result_t dn_idnsname_fast(const char *dn_str, isc_buffer_t *name_buf,
+			      isc_buffer_t *origin_buf, int *idxp)
+			      ATTR_NONNULLS ATTR_CHECKRESULT;
+
 isc_result_t dn_want_zone(const char * const prefix, const char * const dn,
 			  isc_boolean_t dniszone, isc_boolean_t classiszone)
 			  ATTR_NONNULLS ATTR_CHECKRESULT;
@@ -318,6 +318,10 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, isc_boolean_t commit)
 	if (closed_version == ldapdb->newversion) {
 		ldapdb->newversion = NULL;
 		UNLOCK(&ldapdb->newversion_lock);
+		/* instances in other views might have own copy of the zone */
+		if (commit == ISC_TRUE)
+			ldap_zone_mirror_update(ldapdb->ldap_inst,
+						&ldapdb->common.origin);
 	}
 }
 
@@ -1081,11 +1085,12 @@ cleanup:
 
 /*
  * Driver destroy is called for every instance on every reload and then once
- * during shutdown.
+ * during shutdown. Instances are kept running during reload so they
+ * can be reused by dyndb_init() if their configuration was not changed.
  *
  * @param[out] instp Pointer to instance-specific data (for one dyndb section).
  */
 VISIBLE void
 dyndb_destroy(void **instp) {
-	destroy_ldap_instance((ldap_instance_t **)instp);
+	park_ldap_instance((ldap_instance_t **)instp);
 }
@@ -17,7 +17,6 @@
 #include "ldap_convert.h"
 #include "ldap_entry.h"
 #include "mldap.h"
-#include "metadb.h"
 #include "str.h"
 #include "util.h"
 #include "zone_register.h"
@@ -100,11 +99,70 @@ cleanup:
 }
 
 /**
- * Allocate and initialize empty ldap_entry_t. The new entry will not contain
- * any data, it needs to be filled by ldap_entry_parse or ldap_entry_reconstruct.
+ * Copy attribute name and values. Memory for the copy is allocated
+ * by liblber so the copy can be released in the same way as attributes
+ * returned by ldap_first_attribute() and ldap_get_values().
  */
-isc_result_t
-ldap_entry_init(isc_mem_t *mctx, ldap_entry_t **entryp) {
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_attr_copy(isc_mem_t *mctx, const ldap_attribute_t *src,
+	       ldap_attribute_t **attrp)
+{
+	isc_result_t result;
+	ldap_attribute_t *attr = NULL;
+	ldap_value_t *val;
+	ldap_value_t *new_val;
+	unsigned int count = 0;
+	unsigned int i;
+
+	REQUIRE(attrp != NULL && *attrp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, attr);
+	ZERO_PTR(attr);
+	INIT_LIST(attr->values);
+	INIT_LINK(attr, link);
+
+	attr->name = ber_strdup(src->name);
+	if (attr->name == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+
+	for (val = HEAD(src->values); val != NULL; val = NEXT(val, link))
+		count++;
+	attr->ldap_values = ber_memcalloc(count + 1, sizeof(char *));
+	if (attr->ldap_values == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+
+	for (val = HEAD(src->values), i = 0;
+	     val != NULL;
+	     val = NEXT(val, link), i++) {
+		attr->ldap_values[i] = ber_strdup(val->value);
+		if (attr->ldap_values[i] == NULL)
+			CLEANUP_WITH(ISC_R_NOMEMORY);
+		CHECKED_MEM_GET_PTR(mctx, new_val);
+		new_val->value = attr->ldap_values[i];
+		INIT_LINK(new_val, link);
+		APPEND(attr->values, new_val, link);
+	}
+
+	*attrp = attr;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (attr != NULL) {
+		ldap_valuelist_destroy(mctx, &attr->values);
+		if (attr->ldap_values != NULL)
+			ldap_value_free(attr->ldap_values);
+		if (attr->name != NULL)
+			ldap_memfree(attr->name);
+		SAFE_MEM_PUT_PTR(mctx, attr);
+	}
+	return result;
+}
+
+/**
+ * Allocate empty ldap_entry_t without buffers needed for parsing.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_entry_alloc(isc_mem_t *mctx, ldap_entry_t **entryp) {
 	isc_result_t result;
 	ldap_entry_t *entry = NULL;
 
@@ -119,6 +177,23 @@ ldap_entry_init(isc_mem_t *mctx, ldap_entry_t **entryp) {
 	INIT_BUFFERED_NAME(entry->fqdn);
 	INIT_BUFFERED_NAME(entry->zone_name);
 
+	*entryp = entry;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+/**
+ * Allocate and initialize empty ldap_entry_t. The new entry will not contain
+ * any data, it needs to be filled by ldap_entry_parse or ldap_entry_reconstruct.
+ */
+isc_result_t
+ldap_entry_init(isc_mem_t *mctx, ldap_entry_t **entryp) {
+	isc_result_t result;
+	ldap_entry_t *entry = NULL;
+
+	CHECK(ldap_entry_alloc(mctx, &entry));
 	CHECKED_MEM_GET(mctx, entry->rdata_target_mem, DNS_RDATA_MAXLENGTH);
 	CHECK(isc_lex_create(mctx, TOKENSIZ, &entry->lex));
 
@@ -147,32 +222,27 @@ ldap_entry_reconstruct(isc_mem_t *mctx, mldapdb_t *mldap, struct berval *uuid,
 	isc_result_t result;
 	ldap_entry_t *entry = NULL;
 	ld_string_t *str = NULL;
-	metadb_node_t *node = NULL;
 
 	CHECK(str_new(mctx, &str));
-	result = mldap_entry_read(mldap, uuid, &node);
+	CHECK(ldap_entry_init(mctx, &entry));
+	/* names are not stored for configuration objects */
+	result = mldap_entry_read(mldap, uuid, &entry->class, &entry->fqdn,
+				  &entry->zone_name);
 	if (result != ISC_R_SUCCESS) {
 		log_bug("protocol violation: "
 			"attempt to reconstruct non-existing entry");
 		goto cleanup;
 	}
-	CHECK(ldap_entry_init(mctx, &entry));
 
 	entry->uuid = ber_dupbv(NULL, uuid);
 	if (entry->uuid == NULL)
 		CLEANUP_WITH(ISC_R_NOMEMORY);
 
-	CHECK(mldap_class_get(node, &entry->class));
-	if ((entry->class
-	    & (LDAP_ENTRYCLASS_CONFIG | LDAP_ENTRYCLASS_SERVERCONFIG)) == 0)
-		CHECK(mldap_dnsname_get(node, &entry->fqdn, &entry->zone_name));
-
 	*entryp = entry;
 
 cleanup:
 	if (result != ISC_R_SUCCESS)
 		ldap_entry_destroy(&entry);
-	metadb_node_close(&node);
 	str_destroy(&str);
 	return result;
 }
@@ -223,10 +293,18 @@ ldap_entry_parse(isc_mem_t *mctx, LDAP *ld, LDAPMessage *ldap_entry,
 	CHECK(ldap_entry_parseclass(entry, &entry->class));
 	if ((entry->class & LDAP_ENTRYCLASS_TEMPLATE) != 0
 	    && (entry->class
-		& ~(LDAP_ENTRYCLASS_TEMPLATE | LDAP_ENTRYCLASS_RR)) != 0) {
+		& ~(LDAP_ENTRYCLASS_TEMPLATE | LDAP_ENTRYCLASS_RANGE
+		    | LDAP_ENTRYCLASS_RR)) != 0) {
 		log_bug("idnsTemplateObject is not supported with anything "
 			"else than idnsRecord: %s", ldap_entry_logname(entry));
 	}
+	if ((entry->class & LDAP_ENTRYCLASS_RANGE) != 0
+	    && (entry->class
+		& ~(LDAP_ENTRYCLASS_RANGE | LDAP_ENTRYCLASS_TEMPLATE
+		    | LDAP_ENTRYCLASS_RR)) != 0) {
+		log_bug("idnsRangeObject is not supported with anything "
+			"else than idnsRecord: %s", ldap_entry_logname(entry));
+	}
 
 	if ((entry->class &
 	    (LDAP_ENTRYCLASS_MASTER | LDAP_ENTRYCLASS_FORWARD
@@ -254,6 +332,59 @@ cleanup:
 	return result;
 }
 
+/**
+ * Create deep copy of DN, UUID, class, names and attributes of the entry.
+ * The copy does not share any memory with the original entry.
+ *
+ * @param[in]  parseable Allocate buffers needed for parsing of records.
+ *                       Copies which are only kept for later use
+ *                       do not need them.
+ * @param[out] entryp    Resulting entry. Caller has to free it.
+ */
+isc_result_t
+ldap_entry_copy(isc_mem_t *mctx, const ldap_entry_t *src,
+		isc_boolean_t parseable, ldap_entry_t **entryp)
+{
+	isc_result_t result;
+	ldap_entry_t *entry = NULL;
+	ldap_attribute_t *attr;
+	ldap_attribute_t *new_attr = NULL;
+
+	REQUIRE(entryp != NULL && *entryp == NULL);
+
+	if (parseable == ISC_TRUE)
+		CHECK(ldap_entry_init(mctx, &entry));
+	else
+		CHECK(ldap_entry_alloc(mctx, &entry));
+
+	if (src->dn != NULL) {
+		entry->dn = ber_strdup(src->dn);
+		if (entry->dn == NULL)
+			CLEANUP_WITH(ISC_R_NOMEMORY);
+	}
+	if (src->uuid != NULL) {
+		entry->uuid = ber_dupbv(NULL, src->uuid);
+		if (entry->uuid == NULL)
+			CLEANUP_WITH(ISC_R_NOMEMORY);
+	}
+	entry->class = src->class;
+	CHECK(dns_name_copy(&src->fqdn, &entry->fqdn, NULL));
+	CHECK(dns_name_copy(&src->zone_name, &entry->zone_name, NULL));
+
+	for (attr = HEAD(src->attrs); attr != NULL; attr = NEXT(attr, link)) {
+		CHECK(ldap_attr_copy(mctx, attr, &new_attr));
+		APPEND(entry->attrs, new_attr, link);
+		new_attr = NULL;
+	}
+
+	*entryp = entry;
+
+cleanup:
+	if (result != ISC_R_SUCCESS)
+		ldap_entry_destroy(&entry);
+	return result;
+}
+
 void
 ldap_entry_destroy(ldap_entry_t **entryp)
 {
@@ -452,6 +583,8 @@ ldap_entry_parseclass(ldap_entry_t *entry, ldap_entryclass_t *class)
 			entryclass |= LDAP_ENTRYCLASS_RR;
 		else if (!strcasecmp(val->value, "idnsTemplateObject"))
 			entryclass |= LDAP_ENTRYCLASS_TEMPLATE;
+		else if (!strcasecmp(val->value, "idnsRangeObject"))
+			entryclass |= LDAP_ENTRYCLASS_RANGE;
 		else if (!strcasecmp(val->value, "idnszone"))
 			entryclass |= LDAP_ENTRYCLASS_MASTER;
 		else if (!strcasecmp(val->value, "idnsforwardzone"))
@@ -539,7 +672,8 @@ ldap_entry_getttl(ldap_entry_t *entry, const settings_set_t * settings)
 	return ttl;
 
 cleanup:
-	INSIST(setting_get_uint("default_ttl", settings, &ttl) == ISC_R_SUCCESS);
+	INSIST(setting_get_uint(SETTING_DEFAULT_TTL, settings, &ttl)
+	       == ISC_R_SUCCESS);
 	return ttl;
 }
 
@@ -556,6 +690,9 @@ ldap_entry_getclassname(const ldap_entryclass_t class) {
 		return "config object";
 	else if ((class & LDAP_ENTRYCLASS_SERVERCONFIG) != 0)
 		return "server config object";
+	else if ((class & LDAP_ENTRYCLASS_RR) != 0
+		 && (class & LDAP_ENTRYCLASS_RANGE) != 0)
+		return "resource record range";
 	else if ((class & LDAP_ENTRYCLASS_RR) != 0
 		 && (class & LDAP_ENTRYCLASS_TEMPLATE) != 0)
 		return "resource record template";
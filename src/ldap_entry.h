@@ -69,6 +69,7 @@ struct ldap_attribute {
 #define LDAP_ENTRYCLASS_FORWARD	0x8
 #define LDAP_ENTRYCLASS_SERVERCONFIG	0x10
 #define LDAP_ENTRYCLASS_TEMPLATE	0x20
+#define LDAP_ENTRYCLASS_RANGE	0x40
 
 /* Max type length definitions, from lib/dns/master.c */
 #define TOKENSIZ (8*1024)
@@ -84,6 +85,11 @@ isc_result_t
 ldap_entry_reconstruct(isc_mem_t *mctx, mldapdb_t *mldap, struct berval *uuid,
 		       ldap_entry_t **entryp) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+isc_result_t
+ldap_entry_copy(isc_mem_t *mctx, const ldap_entry_t *src,
+		isc_boolean_t parseable, ldap_entry_t **entryp)
+		ATTR_NONNULLS ATTR_CHECKRESULT;
+
 void
 ldap_entry_destroy(ldap_entry_t **entryp) ATTR_NONNULLS;
 
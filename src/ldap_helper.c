@@ -4,9 +4,12 @@
 
 #include "config.h"
 
+#include <dns/callbacks.h>
+#include <dns/dbiterator.h>
 #include <dns/dyndb.h>
 #include <dns/diff.h>
 #include <dns/journal.h>
+#include <dns/master.h>
 #include <dns/rbt.h>
 #include <dns/rdata.h>
 #include <dns/rdataclass.h>
@@ -26,6 +29,7 @@
 
 #include <isc/buffer.h>
 #include <isc/dir.h>
+#include <isc/file.h>
 #include <isc/mem.h>
 #include <isc/mutex.h>
 #include <isc/region.h>
@@ -45,10 +49,10 @@
 #include <isccfg/grammar.h>
 
 #include <alloca.h>
+#include <ctype.h>
 #define LDAP_DEPRECATED 1
 #include <ldap.h>
 #include <limits.h>
-#include <regex.h>
 #include <sasl/sasl.h>
 #include <signal.h>
 #include <stddef.h>
@@ -57,6 +61,7 @@
 #include <strings.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <uuid/uuid.h>
 
 #include "acl.h"
 #include "empty_zones.h"
@@ -69,8 +74,10 @@
 #include "ldap_helper.h"
 #include "lock.h"
 #include "log.h"
-#include "metadb.h"
 #include "mldap.h"
+#include "rr_range.h"
+#include "rr_schema.h"
+#include "rr_template.h"
 #include "semaphore.h"
 #include "settings.h"
 #include "str.h"
@@ -128,12 +135,58 @@ struct ldap_auth_pair {
 	char *name;	/* String representation used in configuration file */
 };
 
+/** Maximal number of zones created or published in one exclusive section.
+ *  Each zone event in a batch holds one slot from LDAP_CONCURRENCY_LIMIT
+ *  so the batch has to be smaller than the limit. */
+#define LDAP_ZONE_BATCH_SIZE	32
+
+/** Zone waiting for per-zone synchronization or for its records. */
+typedef struct zone_sync_item zone_sync_item_t;
+struct zone_sync_item {
+	dns_fixedname_t			name;
+	char				*dn;
+	LINK(zone_sync_item_t)		link;
+};
+typedef LIST(zone_sync_item_t)		zone_sync_list_t;
+
+/**
+ * SyncRepl session for one LDAP subtree. The primary session runs
+ * in the watcher thread, synchronizes also configuration objects and drives
+ * synchronization state of the instance. Additional sessions configured by
+ * option extra_bases run in their own threads with their own connection.
+ *
+ * Each session has its own state machine in sctx. Additional sessions
+ * wait until the primary session synchronized configuration and then go
+ * through their own data barrier, so zones from one subtree are activated
+ * independently of the other subtrees, see activate_zones().
+ */
+struct ldap_syncsess {
+	ldap_instance_t		*inst;
+	char			*base;
+	isc_boolean_t		primary;
+	isc_thread_t		thread;	/**< 0 for the primary session */
+	sync_ctx_t		*sctx;
+	/** Entries from this subtree, each session sweeps its own
+	 *  dead entries after refresh. */
+	mldapdb_t		*mldapdb;
+
+	/* Zone events collected during SyncRepl refresh, see
+	 * zone_batch_flush(). Accessed only from the session thread. */
+	isc_boolean_t		zone_batch_enabled;
+	ldap_syncreplevent_t	*zone_batch;
+	unsigned int		zone_batch_len;
+
+	LINK(ldap_syncsess_t)	link;
+};
+
 /* These are typedefed in ldap_helper.h */
 struct ldap_instance {
 	isc_mem_t		*mctx;
 
 	/* These are needed for zone creation. */
 	char *			db_name;
+	/* Parameters from dyndb section, see parked_instance_adopt(). */
+	char *			parameters;
 	dns_dbimplementation_t	*db_imp;
 	dns_view_t		*view;
 	dns_zonemgr_t		*zmgr;
@@ -144,6 +197,8 @@ struct ldap_instance {
 	/* Our own list of zones. */
 	zone_register_t		*zone_register;
 	fwd_register_t		*fwd_register;
+	/* Parsed values of setting 'forwarders'. */
+	fwd_cache_t		*fwd_cache;
 
 	/* krb5 kinit mutex */
 	isc_mutex_t		kinit_lock;
@@ -160,8 +215,43 @@ struct ldap_instance {
 	settings_set_t		empty_fwdz_settings;
 	settings_set_t		*server_ldap_settings;
 
+	/* Compiled idnsTemplateAttribute values. */
+	rr_template_cache_t	*rr_templates;
+
+	/* Applied idnsRangeGenerator values. */
+	rr_range_register_t	*rr_ranges;
+
+	/* Compiled idnsAllowQuery and idnsAllowTransfer values. */
+	acl_cache_t		*acl_cache;
+
+	/* Record attributes supported by LDAP schema. */
+	rr_schema_t		*rr_schema;
+
+	/* PTR record changes waiting for reverse zone tasks. */
+	sync_ptrqueue_t		*sync_ptr_queue;
+
 	sync_ctx_t		*sctx;
-	mldapdb_t		*mldapdb;
+
+	/* SyncRepl sessions, the primary one is the first. */
+	LIST(ldap_syncsess_t)	sessions;
+
+	/* Zones served by this instance, see zone_shard_match(). */
+	isc_uint32_t		zone_shards;
+	isc_uint32_t		zone_shard_index;
+
+	/* Zones from per-zone synchronization which wait for activation,
+	 * see zone_ready_publish(). Accessed only from the instance task. */
+	zone_sync_list_t	zones_ready;
+	isc_boolean_t		zones_ready_queued;
+
+	/* Instance in another view which provides zones for this instance
+	 * (option data_source) and instances which use zones from this
+	 * one. Guarded by instances_lock. */
+	ldap_instance_t		*data_source;
+	LIST(ldap_instance_t)	followers;
+	LINK(ldap_instance_t)	follower_link;
+	/* Member of list instances or parked. */
+	LINK(ldap_instance_t)	link;
 };
 
 struct ldap_pool {
@@ -202,6 +292,8 @@ static const setting_t settings_local_default[] = {
 	{ "reconnect_interval",		no_default_uint		},
 	{ "timeout",			no_default_uint		},
 	{ "base",			no_default_string	},
+	{ "extra_bases",		no_default_string	},
+	{ "data_source",		no_default_string	},
 	{ "auth_method",		no_default_string	},
 	{ "auth_method_enum",		no_default_uint		},
 	{ "bind_dn",			no_default_string	},
@@ -217,6 +309,9 @@ static const setting_t settings_local_default[] = {
 	{ "ldap_hostname",		no_default_string	},
 	{ "sync_ptr",			no_default_boolean	},
 	{ "dyn_update",			no_default_boolean	},
+	{ "per_zone_sync",		no_default_boolean	},
+	{ "zone_shards",		no_default_uint		},
+	{ "zone_shard_index",		no_default_uint		},
 	{ "verbose_checks",		no_default_boolean	},
 	{ "directory",			no_default_string	},
 	{ "nsec3param",			default_string("0 0 0 00")	}, /* NSEC only */
@@ -242,11 +337,14 @@ dyndb_ldap_conf_clauses[] = {
 	{ "connections",        &cfg_type_uint32,	0	},
 	{ "directory",          &cfg_type_qstring,	0	},
 	{ "dyn_update",         &cfg_type_boolean,	0	},
+	{ "extra_bases",        &cfg_type_qstring,	0	},
+	{ "data_source",        &cfg_type_qstring,	0	},
 	{ "fake_mname",         &cfg_type_qstring,	0	},
 	{ "krb5_keytab",        &cfg_type_qstring,	0	},
 	{ "krb5_principal",     &cfg_type_qstring,	0	},
 	{ "ldap_hostname",      &cfg_type_qstring,	0	},
 	{ "password",           &cfg_type_sstring,	0	},
+	{ "per_zone_sync",      &cfg_type_boolean,	0	},
 	{ "reconnect_interval", &cfg_type_uint32,	0	},
 	{ "sasl_auth_name",     &cfg_type_qstring,	0	},
 	{ "sasl_mech",          &cfg_type_qstring,	0	},
@@ -258,6 +356,8 @@ dyndb_ldap_conf_clauses[] = {
 	{ "timeout",            &cfg_type_uint32,	0	},
 	{ "uri",                &cfg_type_qstring,	0	},
 	{ "verbose_checks",     &cfg_type_boolean,	0	},
+	{ "zone_shard_index",   &cfg_type_uint32,	0	},
+	{ "zone_shards",        &cfg_type_uint32,	0	},
 	{ NULL,			NULL,			0	}
 };
 
@@ -319,12 +419,14 @@ static isc_result_t parse_rdata(isc_mem_t *mctx, ldap_entry_t *entry,
 static isc_result_t
 ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 			    ldap_instance_t *const inst,
+			    ldap_syncsess_t *const sess,
 			    isc_task_t *const task)
-			    ATTR_NONNULL(1,3,4) ATTR_CHECKRESULT;
+			    ATTR_NONNULL(1,3,4,5) ATTR_CHECKRESULT;
 
 static isc_result_t
 ldap_parse_rrentry(isc_mem_t *mctx, ldap_entry_t *entry, dns_name_t *origin,
 		   const settings_set_t * const settings,
+		   rr_template_cache_t * const templates,
 		   ldapdb_rdatalist_t *rdatalist) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 static isc_result_t ldap_connect(ldap_instance_t *ldap_inst,
@@ -365,17 +467,64 @@ static isc_result_t ldap_pool_connect(ldap_pool_t *pool,
 /* Persistent updates watcher */
 static isc_threadresult_t
 ldap_syncrepl_watcher(isc_threadarg_t arg) ATTR_NONNULLS ATTR_CHECKRESULT;
+static isc_threadresult_t
+ldap_syncrepl_session(isc_threadarg_t arg) ATTR_NONNULLS ATTR_CHECKRESULT;
+static void syncsess_destroy(ldap_syncsess_t **sessp) ATTR_NONNULLS;
+static isc_result_t
+ldap_dn_insubtree(const char *dn_instr, const char *base_instr,
+		  isc_boolean_t *insubtreep) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
 zone_master_reconfigure_nsec3param(settings_set_t *zone_settings,
 				   dns_zone_t *secure);
 
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_import_spool(ldap_instance_t *inst, dns_name_t *name);
+
+static isc_result_t
+refresh_templates(ldap_instance_t *inst, const char *variable)
+		  ATTR_NONNULLS ATTR_CHECKRESULT;
+
+static isc_result_t
+zone_ready_send(ldap_instance_t *inst, dns_name_t *name)
+		ATTR_NONNULLS ATTR_CHECKRESULT;
+
+static isc_result_t
+zone_conf_fanout(ldap_instance_t *inst, unsigned int what)
+		 ATTR_NONNULLS ATTR_CHECKRESULT;
+
+/* Zone configuration derived from inherited settings,
+ * see zone_conf_fanout(). */
+#define ZONE_CONF_SSU	0x01	/* dyn_update */
+#define ZONE_CONF_SOA	0x02	/* fake_mname */
+
+static void
+mirror_zone_publish(ldap_instance_t *inst, dns_zone_t *zone) ATTR_NONNULLS;
+static void
+follower_zone_publish(isc_task_t *task, isc_event_t *event) ATTR_NONNULLS;
+static void
+follower_zone_delete(isc_task_t *task, isc_event_t *event) ATTR_NONNULLS;
+static void
+follower_zone_refresh(isc_task_t *task, isc_event_t *event) ATTR_NONNULLS;
+static isc_result_t
+parked_instance_adopt(const char *db_name, const char *parameters,
+		      const dns_dyndbctx_t *dctx, ldap_instance_t **ldap_instp)
+		      ATTR_NONNULLS ATTR_CHECKRESULT;
+
+/* All LDAP instances in this process, see option data_source. */
+static isc_once_t instances_once = ISC_ONCE_INIT;
+static isc_mutex_t instances_lock;
+static LIST(ldap_instance_t) instances;
+/* Instances kept running during reload, see park_ldap_instance(). */
+static LIST(ldap_instance_t) parked;
+
 #define PRINT_BUFF_SIZE 10 /* for unsigned int 2^32 */
 isc_result_t
 validate_local_instance_settings(ldap_instance_t *inst, settings_set_t *set) {
 	isc_result_t result;
 
 	isc_uint32_t uint;
+	isc_uint32_t shards;
 	const char *sasl_mech = NULL;
 	const char *sasl_user = NULL;
 	const char *sasl_realm = NULL;
@@ -397,7 +546,7 @@ validate_local_instance_settings(ldap_instance_t *inst, settings_set_t *set) {
 
 	/* Use instance name as default working directory */
 	CHECK(str_new(inst->mctx, &buff));
-	CHECK(setting_get_str("directory", inst->local_settings, &dir_name));
+	CHECK(setting_get_str(SETTING_DIRECTORY, inst->local_settings, &dir_name));
 	dir_default = (strlen(dir_name) == 0);
 	if (dir_default == ISC_TRUE) {
 		CHECK(str_cat_char(buff, "dyndb-ldap/"));
@@ -413,25 +562,38 @@ validate_local_instance_settings(ldap_instance_t *inst, settings_set_t *set) {
 				  str_buf(buff)));
 	str_destroy(&buff);
 	dir_name = NULL;
-	CHECK(setting_get_str("directory", inst->local_settings, &dir_name));
+	CHECK(setting_get_str(SETTING_DIRECTORY, inst->local_settings, &dir_name));
 
 	/* Make sure that working directory exists */
 	CHECK(fs_dirs_create(dir_name));
 
 	/* Set timer for deadlock detection inside semaphore_wait_timed . */
-	CHECK(setting_get_uint("timeout", set, &uint));
+	CHECK(setting_get_uint(SETTING_TIMEOUT, set, &uint));
 	if (conn_wait_timeout.seconds < uint*SEM_WAIT_TIMEOUT_MUL)
 		conn_wait_timeout.seconds = uint*SEM_WAIT_TIMEOUT_MUL;
 
-	CHECK(setting_get_uint("connections", set, &uint));
+	CHECK(setting_get_uint(SETTING_CONNECTIONS, set, &uint));
 	if (uint < 2) {
 		log_error("at least two connections are required");
 		/* watcher needs one and update_*() requests second connection */
 		CLEANUP_WITH(ISC_R_RANGE);
 	}
 
+	CHECK(setting_get_uint(SETTING_ZONE_SHARDS, set, &uint));
+	if (uint < 1) {
+		log_error("option 'zone_shards' must be at least 1");
+		CLEANUP_WITH(ISC_R_RANGE);
+	}
+	shards = uint;
+	CHECK(setting_get_uint(SETTING_ZONE_SHARD_INDEX, set, &uint));
+	if (uint >= shards) {
+		log_error("option 'zone_shard_index' must be lower than "
+			  "'zone_shards' (%u)", shards);
+		CLEANUP_WITH(ISC_R_RANGE);
+	}
+
 	/* Select authentication method. */
-	CHECK(setting_get_str("auth_method", set, &auth_method_str));
+	CHECK(setting_get_str(SETTING_AUTH_METHOD, set, &auth_method_str));
 	auth_method_enum = AUTH_INVALID;
 	for (int i = 0; supported_ldap_auth[i].name != NULL; i++) {
 		if (!strcasecmp(auth_method_str, supported_ldap_auth[i].name)) {
@@ -448,13 +610,13 @@ validate_local_instance_settings(ldap_instance_t *inst, settings_set_t *set) {
 	CHECK(setting_set("auth_method_enum", inst->local_settings, print_buff));
 
 	/* check we have the right data when SASL/GSSAPI is selected */
-	CHECK(setting_get_str("sasl_mech", set, &sasl_mech));
-	CHECK(setting_get_str("krb5_principal", set, &krb5_principal));
-	CHECK(setting_get_str("sasl_user", set, &sasl_user));
-	CHECK(setting_get_str("sasl_realm", set, &sasl_realm));
-	CHECK(setting_get_str("sasl_password", set, &sasl_password));
-	CHECK(setting_get_str("bind_dn", set, &bind_dn));
-	CHECK(setting_get_str("password", set, &password));
+	CHECK(setting_get_str(SETTING_SASL_MECH, set, &sasl_mech));
+	CHECK(setting_get_str(SETTING_KRB5_PRINCIPAL, set, &krb5_principal));
+	CHECK(setting_get_str(SETTING_SASL_USER, set, &sasl_user));
+	CHECK(setting_get_str(SETTING_SASL_REALM, set, &sasl_realm));
+	CHECK(setting_get_str(SETTING_SASL_PASSWORD, set, &sasl_password));
+	CHECK(setting_get_str(SETTING_BIND_DN, set, &bind_dn));
+	CHECK(setting_get_str(SETTING_PASSWORD, set, &password));
 
 	if (auth_method_enum != AUTH_SIMPLE &&
 	   (strlen(bind_dn) != 0 || strlen(password) != 0)) {
@@ -524,3289 +686,7339 @@ cleanup:
 }
 #undef PRINT_BUFF_SIZE
 
-#define PRINT_BUFF_SIZE 255
-isc_result_t
-new_ldap_instance(isc_mem_t *mctx, const char *db_name, const char *parameters,
-		  const char *file, unsigned long line,
-		  const dns_dyndbctx_t *dctx, ldap_instance_t **ldap_instp)
+static void ATTR_NONNULLS
+zone_sync_list_free(isc_mem_t *mctx, zone_sync_list_t *zones)
 {
-	isc_result_t result;
-	ldap_instance_t *ldap_inst;
-	dns_forwarders_t *named_conf_forwarders = NULL;
-	isc_buffer_t *forwarders_list = NULL;
-	const char *forward_policy = NULL;
-	isc_uint32_t connections;
-	char settings_name[PRINT_BUFF_SIZE];
-	ldap_globalfwd_handleez_t *gfwdevent = NULL;
-	const char *server_id = NULL;
-
-	REQUIRE(ldap_instp != NULL && *ldap_instp == NULL);
-
-	CHECKED_MEM_GET_PTR(mctx, ldap_inst);
-	ZERO_PTR(ldap_inst);
-	CHECK(isc_refcount_init(&ldap_inst->errors, 0));
-	isc_mem_attach(mctx, &ldap_inst->mctx);
-	CHECKED_MEM_STRDUP(mctx, db_name, ldap_inst->db_name);
-	dns_view_attach(dctx->view, &ldap_inst->view);
-	dns_zonemgr_attach(dctx->zmgr, &ldap_inst->zmgr);
-	isc_task_attach(dctx->task, &ldap_inst->task);
-
-	ldap_inst->watcher = 0;
-	CHECK(sync_ctx_init(ldap_inst->mctx, ldap_inst, &ldap_inst->sctx));
-
-	isc_string_printf_truncate(settings_name, PRINT_BUFF_SIZE,
-				   SETTING_SET_NAME_LOCAL " for database %s",
-				   ldap_inst->db_name);
-	CHECK(settings_set_create(mctx, settings_local_default,
-	      sizeof(settings_local_default), settings_name,
-	      &settings_default_set, &ldap_inst->local_settings));
-
-	isc_string_printf_truncate(settings_name, PRINT_BUFF_SIZE,
-				   SETTING_SET_NAME_GLOBAL " for database %s",
-				   ldap_inst->db_name);
-	CHECK(settings_set_create(mctx, settings_global_default,
-	      sizeof(settings_global_default), settings_name,
-	      ldap_inst->local_settings, &ldap_inst->global_settings));
-
-	CHECK(setting_set_parse_conf(mctx, ldap_inst->db_name,
-				     &cfg_type_dyndb_conf, parameters, file,
-				     line, ldap_inst->local_settings));
-
-	/* copy global forwarders setting for configuration roll back in
-	 * configure_zone_forwarders() */
-	result = dns_fwdtable_find(ldap_inst->view->fwdtable, dns_rootname,
-				   &named_conf_forwarders);
-	if (result == ISC_R_SUCCESS) {
-		/* Copy forwarding config from named.conf into local_settings */
-		CHECK(fwd_print_list_buff(mctx, named_conf_forwarders,
-						  &forwarders_list));
-		CHECK(setting_set("forwarders", ldap_inst->local_settings,
-				  isc_buffer_base(forwarders_list)));
-		CHECK(get_enum_description(forwarder_policy_txts,
-					   named_conf_forwarders->fwdpolicy,
-					   &forward_policy));
-		CHECK(setting_set("forward_policy", ldap_inst->local_settings,
-				  forward_policy));
+	zone_sync_item_t *item;
 
-		/* Make sure we disable conflicting automatic empty zones.
-		 * This will be done in event to prevent the plugin from
-		 * interfering with BIND start-up.
-		 *
-		 * Warn-only semantics is implemented in BIND RT#41441,
-		 * this code can be removed when we rebase to BIND 9.11. */
-		CHECK(sync_task_add(ldap_inst->sctx, ldap_inst->task));
-		gfwdevent = (ldap_globalfwd_handleez_t *)isc_event_allocate(
-					ldap_inst->mctx, ldap_inst,
-					LDAPDB_EVENT_GLOBALFWD_HANDLEEZ,
-					empty_zone_handle_globalfwd_ev,
-					ldap_inst->view->zonetable,
-					sizeof(ldap_globalfwd_handleez_t));
-		if (gfwdevent == NULL)
-			CLEANUP_WITH(ISC_R_NOMEMORY);
-		/* policy == first does not override automatic empty zones */
-		gfwdevent->warn_only = (named_conf_forwarders->fwdpolicy
-					== dns_fwdpolicy_first);
+	while ((item = HEAD(*zones)) != NULL) {
+		UNLINK(*zones, item, link);
+		if (item->dn != NULL)
+			isc_mem_free(mctx, item->dn);
+		SAFE_MEM_PUT_PTR(mctx, item);
+	}
+}
 
-		isc_task_send(ldap_inst->task, (isc_event_t **)&gfwdevent);
+/**
+ * Create SyncRepl session for LDAP subtree base.
+ *
+ * @param[in] primary ISC_TRUE for the session which runs in the watcher
+ *                    thread and uses state machine of the instance.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+syncsess_create(ldap_instance_t *inst, const char *base, isc_boolean_t primary,
+		ldap_syncsess_t **sessp)
+{
+	isc_result_t result;
+	ldap_syncsess_t *sess = NULL;
 
-	} else if (result == ISC_R_NOTFOUND) {
-		/* global forwarders are not configured */
-		CHECK(setting_set("forwarders", ldap_inst->local_settings,
-				  "{ /* empty list of forwarders */ }"));
-		CHECK(setting_set("forward_policy", ldap_inst->local_settings,
-				  "first"));
-	} else {
-		goto cleanup;
-	}
+	REQUIRE(sessp != NULL && *sessp == NULL);
 
-	CHECK(validate_local_instance_settings(ldap_inst,
-					       ldap_inst->local_settings));
-	if (settings_set_isfilled(ldap_inst->global_settings) != ISC_TRUE)
-		CLEANUP_WITH(ISC_R_FAILURE);
+	CHECKED_MEM_GET_PTR(inst->mctx, sess);
+	ZERO_PTR(sess);
+	sess->inst = inst;
+	sess->primary = primary;
+	INIT_LINK(sess, link);
 
-	/* zero-length server_id means undefined value */
-	CHECK(setting_get_str("server_id", ldap_inst->local_settings,
-			      &server_id));
-	if (strlen(server_id) == 0)
-		isc_string_printf_truncate(settings_name, PRINT_BUFF_SIZE,
-					   SETTING_SET_NAME_SERVER
-					   " for undefined server_id");
+	CHECKED_MEM_STRDUP(inst->mctx, base, sess->base);
+	CHECK(mldap_new(inst->mctx, &sess->mldapdb));
+	if (primary == ISC_TRUE)
+		sess->sctx = inst->sctx;
 	else
-		isc_string_printf_truncate(settings_name, PRINT_BUFF_SIZE,
-					   SETTING_SET_NAME_SERVER
-					   " for server id %s", server_id);
+		CHECK(sync_ctx_init(inst->mctx, inst, &sess->sctx));
 
-	CHECK(settings_set_create(mctx, settings_server_ldap_default,
-	      sizeof(settings_server_ldap_default), settings_name,
-	      ldap_inst->global_settings, &ldap_inst->server_ldap_settings));
+	*sessp = sess;
+	return ISC_R_SUCCESS;
 
-	ldap_inst->empty_fwdz_settings = (settings_set_t) {
-			NULL,
-			"dummy LDAP zone forwarding settings",
-			ldap_inst->server_ldap_settings,
-			NULL,
-			(setting_t *) &settings_fwdz_defaults[0]
-	};
+cleanup:
+	syncsess_destroy(&sess);
+	return result;
+}
 
-	CHECK(setting_get_uint("connections", ldap_inst->local_settings, &connections));
+/**
+ * Free SyncRepl session. The session thread has to be terminated already.
+ */
+static void ATTR_NONNULLS
+syncsess_destroy(ldap_syncsess_t **sessp)
+{
+	ldap_syncsess_t *sess = *sessp;
+	isc_mem_t *mctx;
 
-	CHECK(zr_create(mctx, ldap_inst, ldap_inst->server_ldap_settings,
-			&ldap_inst->zone_register));
-	CHECK(fwdr_create(ldap_inst->mctx, &ldap_inst->fwd_register));
-	CHECK(mldap_new(mctx, &ldap_inst->mldapdb));
+	if (sess == NULL)
+		return;
 
-	CHECK(isc_mutex_init(&ldap_inst->kinit_lock));
+	mctx = sess->inst->mctx;
+	/* batch is always flushed when SyncRepl session ends */
+	INSIST(sess->zone_batch == NULL);
+	mldap_destroy(&sess->mldapdb);
+	if (sess->primary == ISC_FALSE)
+		sync_ctx_free(&sess->sctx);
+	if (sess->base != NULL)
+		isc_mem_free(mctx, sess->base);
+	SAFE_MEM_PUT_PTR(mctx, sess);
+	*sessp = NULL;
+}
 
-	CHECK(ldap_pool_create(mctx, connections, &ldap_inst->pool));
-	CHECK(ldap_pool_connect(ldap_inst->pool, ldap_inst));
+/**
+ * Create the primary SyncRepl session for option base and one additional
+ * session for each subtree in semicolon-separated option extra_bases.
+ * Semicolon cannot appear unescaped in LDAP DN. Subtrees cannot overlap,
+ * otherwise one entry would be read by more sessions.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+syncsess_create_all(ldap_instance_t *inst, unsigned int *extra_cntp)
+{
+	isc_result_t result;
+	ldap_syncsess_t *sess = NULL;
+	const char *base = NULL;
+	const char *extra_bases = NULL;
+	char *bases = NULL;
+	char *token;
+	char *saveptr = NULL;
+	char *end;
+	isc_boolean_t inside;
+	isc_boolean_t contains;
+
+	*extra_cntp = 0;
+	CHECK(setting_get_str(SETTING_BASE, inst->local_settings, &base));
+	CHECK(syncsess_create(inst, base, ISC_TRUE, &sess));
+	APPEND(inst->sessions, sess, link);
+
+	CHECK(setting_get_str(SETTING_EXTRA_BASES, inst->local_settings,
+			      &extra_bases));
+	CHECKED_MEM_STRDUP(inst->mctx, extra_bases, bases);
+	for (token = strtok_r(bases, ";", &saveptr);
+	     token != NULL;
+	     token = strtok_r(NULL, ";", &saveptr)) {
+		while (isspace((unsigned char)*token))
+			token++;
+		end = token + strlen(token);
+		while (end > token && isspace((unsigned char)*(end - 1)))
+			*--end = '\0';
+		if (*token == '\0')
+			continue;
 
-	/* Register new DNS DB implementation. */
-	CHECK(dns_db_register(ldap_inst->db_name, &ldapdb_associate, ldap_inst,
-			      mctx, &ldap_inst->db_imp));
+		for (sess = HEAD(inst->sessions);
+		     sess != NULL;
+		     sess = NEXT(sess, link)) {
+			CHECK(ldap_dn_insubtree(token, sess->base, &inside));
+			CHECK(ldap_dn_insubtree(sess->base, token, &contains));
+			if (inside == ISC_TRUE || contains == ISC_TRUE) {
+				log_error("extra_bases: base '%s' overlaps "
+					  "with base '%s'", token, sess->base);
+				CLEANUP_WITH(ISC_R_FAILURE);
+			}
+		}
 
-	/* Start the watcher thread */
-	result = isc_thread_create(ldap_syncrepl_watcher, ldap_inst,
-				   &ldap_inst->watcher);
-	if (result != ISC_R_SUCCESS) {
-		ldap_inst->watcher = 0;
-		log_error("Failed to create syncrepl watcher thread");
-		goto cleanup;
+		sess = NULL;
+		CHECK(syncsess_create(inst, token, ISC_FALSE, &sess));
+		APPEND(inst->sessions, sess, link);
+		(*extra_cntp)++;
+		log_debug(1, "additional SyncRepl session for base '%s'",
+			  token);
 	}
 
 cleanup:
-	if (forwarders_list != NULL)
-		isc_buffer_free(&forwarders_list);
-	if (result != ISC_R_SUCCESS)
-		destroy_ldap_instance(&ldap_inst);
-	else
-		*ldap_instp = ldap_inst;
-
+	if (bases != NULL)
+		isc_mem_free(inst->mctx, bases);
 	return result;
 }
-#undef PRINT_BUFF_SIZE
 
 /**
- * Send SIGUSR1 to the SyncRepl watcher thread and wait for it to terminate.
- *
- * If the thread has already been terminated and a signal can't be sent to it,
- * log an error instead. The thread is still joined, but since it is no longer
- * running, it is instantaneous and doesn't block.
+ * Find SyncRepl session which reads given DN.
+ * Objects outside of all additional bases belong to the primary session.
  *
- * @param[in]  ldap_inst	LDAP instance with ID of watcher thread
+ * @retval NULL Instance does not run its own SyncRepl sessions.
  */
-static void ATTR_NONNULLS
-ldap_syncrepl_watcher_shutdown(ldap_instance_t *ldap_inst)
+static ldap_syncsess_t * ATTR_NONNULLS
+syncsess_for_dn(ldap_instance_t *inst, const char *dn)
 {
-	REQUIRE(ldap_inst != NULL);
-
-	ldap_inst->exiting = ISC_TRUE;
-	/*
-	 * Wake up the watcher thread. This might look like a hack
-	 * but isc_thread_t is actually pthread_t and libisc don't
-	 * have any isc_thread_kill() func.
-	 *
-	 * We use SIGUSR1 to not to interfere with any signal
-	 * used by BIND itself.
-	 */
-	if (pthread_kill(ldap_inst->watcher, SIGUSR1) != 0) {
-		log_error("unable to send signal to SyncRepl watcher thread "
-				  "(already terminated?)");
+	ldap_syncsess_t *sess;
+	isc_boolean_t insubtree;
+
+	if (HEAD(inst->sessions) == NULL)
+		return NULL;
+
+	for (sess = NEXT(HEAD(inst->sessions), link);
+	     sess != NULL;
+	     sess = NEXT(sess, link)) {
+		if (ldap_dn_insubtree(dn, sess->base, &insubtree)
+		    == ISC_R_SUCCESS && insubtree == ISC_TRUE)
+			return sess;
 	}
 
-	RUNTIME_CHECK(isc_thread_join(ldap_inst->watcher, NULL)
-		      == ISC_R_SUCCESS);
+	return HEAD(inst->sessions);
 }
 
-void
-destroy_ldap_instance(ldap_instance_t **ldap_instp)
+/**
+ * Find synchronization context of SyncRepl session which reads given DN.
+ */
+static sync_ctx_t * ATTR_NONNULLS
+sync_ctx_for_dn(ldap_instance_t *inst, const char *dn)
 {
-	ldap_instance_t *ldap_inst;
+	ldap_syncsess_t *sess = syncsess_for_dn(inst, dn);
 
-	REQUIRE(ldap_instp != NULL);
+	if (sess == NULL || sess->primary == ISC_TRUE)
+		return inst->sctx;
 
-	ldap_inst = *ldap_instp;
-	if (ldap_inst == NULL)
-		return;
+	return sess->sctx;
+}
 
-	if (ldap_inst->watcher != 0) {
-		ldap_syncrepl_watcher_shutdown(ldap_inst);
-		ldap_inst->watcher = 0;
-	}
+/**
+ * Find synchronization context of SyncRepl session which reads given zone.
+ */
+static sync_ctx_t * ATTR_NONNULLS
+sync_ctx_for_zone(ldap_instance_t *inst, dns_name_t *zone_name)
+{
+	const char *dn = NULL;
 
-	/* Unregister all zones already registered in BIND. */
-	zr_destroy(&ldap_inst->zone_register);
-	fwdr_destroy(&ldap_inst->fwd_register);
-	mldap_destroy(&ldap_inst->mldapdb);
+	if (HEAD(inst->sessions) == NULL
+	    || NEXT(HEAD(inst->sessions), link) == NULL
+	    || zr_get_zone_dn(inst->zone_register, zone_name, &dn)
+	       != ISC_R_SUCCESS)
+		return inst->sctx;
 
-	ldap_pool_destroy(&ldap_inst->pool);
-	if (ldap_inst->db_imp != NULL)
-		dns_db_unregister(&ldap_inst->db_imp);
-	if (ldap_inst->view != NULL)
-		dns_view_detach(&ldap_inst->view);
-	if (ldap_inst->zmgr != NULL)
-		dns_zonemgr_detach(&ldap_inst->zmgr);
-	if (ldap_inst->task != NULL)
-		isc_task_detach(&ldap_inst->task);
+	return sync_ctx_for_dn(inst, dn);
+}
 
-	DESTROYLOCK(&ldap_inst->kinit_lock);
+#define LDAPDB_EVENT_ZONE_MIRROR	(LDAPDB_EVENTCLASS + 9)
 
-	settings_set_free(&ldap_inst->global_settings);
-	settings_set_free(&ldap_inst->local_settings);
-	settings_set_free(&ldap_inst->server_ldap_settings);
-
-	sync_ctx_free(&ldap_inst->sctx);
-	/* zero out error counter (and do nothing other than that) */
-	ldap_instance_untaint_finish(ldap_inst,
-				     ldap_instance_untaint_start(ldap_inst));
-	isc_refcount_destroy(&ldap_inst->errors);
-
-	if (ldap_inst->db_name != NULL) {
-		log_debug(1, "LDAP instance '%s' destroyed", ldap_inst->db_name);
-		isc_mem_free(ldap_inst->mctx, ldap_inst->db_name);
-	}
-	MEM_PUT_AND_DETACH(ldap_inst);
-
-	*ldap_instp = NULL;
-}
+static void
+instances_init(void)
+{
+	RUNTIME_CHECK(isc_mutex_init(&instances_lock) == ISC_R_SUCCESS);
+	INIT_LIST(instances);
+	INIT_LIST(parked);
+}
 
+/**
+ * Use zones from instance named in option data_source instead of own
+ * SyncRepl. Connection parameters are copied from the source instance
+ * because all writes to LDAP go through it.
+ */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-new_ldap_connection(ldap_pool_t *pool, ldap_connection_t **ldap_connp)
+data_source_attach(ldap_instance_t *inst, const char *source_name)
 {
 	isc_result_t result;
-	ldap_connection_t *ldap_conn;
-
-	REQUIRE(pool != NULL);
-	REQUIRE(ldap_connp != NULL && *ldap_connp == NULL);
-
-	CHECKED_MEM_GET_PTR(pool->mctx, ldap_conn);
-	ZERO_PTR(ldap_conn);
-
-	result = isc_mutex_init(&ldap_conn->lock);
-	if (result != ISC_R_SUCCESS) {
-		SAFE_MEM_PUT_PTR(pool->mctx, ldap_conn);
-		return result;
+	ldap_instance_t *source;
+	const char *value = NULL;
+
+	LOCK(&instances_lock);
+	for (source = HEAD(instances);
+	     source != NULL;
+	     source = NEXT(source, link)) {
+		if (source->exiting == ISC_FALSE
+		    && strcmp(source->db_name, source_name) == 0)
+			break;
+	}
+	if (source == NULL) {
+		log_error("data source '%s' for LDAP instance '%s' not found: "
+			  "it has to be defined before this instance",
+			  source_name, inst->db_name);
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+	}
+	if (source->data_source != NULL) {
+		log_error("LDAP instance '%s' cannot be used as data source: "
+			  "it uses data from '%s'", source_name,
+			  source->data_source->db_name);
+		CLEANUP_WITH(ISC_R_FAILURE);
+	}
+	if (source->view == inst->view) {
+		log_error("LDAP instance '%s' cannot use data source '%s' "
+			  "from the same view", inst->db_name, source_name);
+		CLEANUP_WITH(ISC_R_EXISTS);
 	}
 
-	isc_mem_attach(pool->mctx, &ldap_conn->mctx);
-
-	*ldap_connp = ldap_conn;
+	CHECK(setting_get_str(SETTING_URI, source->local_settings, &value));
+	CHECK(setting_set("uri", inst->local_settings, value));
+	CHECK(setting_get_str(SETTING_BASE, source->local_settings, &value));
+	CHECK(setting_set("base", inst->local_settings, value));
 
-	return ISC_R_SUCCESS;
+	inst->data_source = source;
+	APPEND(source->followers, inst, follower_link);
+	log_info("LDAP instance '%s' uses data from instance '%s'",
+		 inst->db_name, source_name);
 
 cleanup:
-	destroy_ldap_connection(&ldap_conn);
-
+	UNLOCK(&instances_lock);
 	return result;
 }
 
-static void
-destroy_ldap_connection(ldap_connection_t **ldap_connp)
+/**
+ * Remove instance from list of instances and detach it from data source
+ * so no more zones are published in its view.
+ */
+static void ATTR_NONNULLS
+instance_unregister(ldap_instance_t *inst)
 {
-	ldap_connection_t *ldap_conn;
-
-	REQUIRE(ldap_connp != NULL);
+	LOCK(&instances_lock);
+	if (ISC_LINK_LINKED(inst, link))
+		UNLINK(instances, inst, link);
+	if (inst->data_source != NULL) {
+		UNLINK(inst->data_source->followers, inst, follower_link);
+		inst->data_source = NULL;
+	}
+	UNLOCK(&instances_lock);
+}
 
-	ldap_conn = *ldap_connp;
-	if (ldap_conn == NULL)
-		return;
+/**
+ * Instances which used this one as data source do not get new data anymore,
+ * removal of their zones was scheduled by zr_destroy(),
+ * see mirror_zone_delete().
+ */
+static void ATTR_NONNULLS
+followers_detach(ldap_instance_t *inst)
+{
+	ldap_instance_t *follower;
+
+	LOCK(&instances_lock);
+	while ((follower = HEAD(inst->followers)) != NULL) {
+		UNLINK(inst->followers, follower, follower_link);
+		follower->data_source = NULL;
+		log_info("LDAP instance '%s' lost its data source '%s'",
+			 follower->db_name, inst->db_name);
+	}
+	UNLOCK(&instances_lock);
+}
 
-	DESTROYLOCK(&ldap_conn->lock);
-	if (ldap_conn->handle != NULL)
-		ldap_unbind_ext_s(ldap_conn->handle, NULL, NULL);
+/**
+ * Change of a zone in data source which has to be reflected in the view
+ * of a follower instance. The event is processed by task of the follower
+ * so its view is modified only in its own exclusive mode.
+ */
+typedef struct ldap_mirrorev ldap_mirrorev_t;
+struct ldap_mirrorev {
+	ISC_EVENT_COMMON(ldap_mirrorev_t);
+	isc_mem_t		*mctx;
+	ldap_instance_t		*source;
+	ldap_instance_t		*follower;
+	dns_fixedname_t		name;
+	/* Zone database in data source and DN of the zone,
+	 * they are not used for zone removal. */
+	dns_db_t		*ldapdb;
+	char			*dn;
+};
 
-	MEM_PUT_AND_DETACH(*ldap_connp);
+static void ATTR_NONNULLS
+mirror_event_free(ldap_mirrorev_t **meventp)
+{
+	ldap_mirrorev_t *mevent = *meventp;
+	isc_mem_t *mctx = mevent->mctx;
+
+	if (mevent->ldapdb != NULL)
+		dns_db_detach(&mevent->ldapdb);
+	if (mevent->dn != NULL)
+		isc_mem_free(mctx, mevent->dn);
+	isc_event_free((isc_event_t **)meventp);
+	if (mctx != NULL)
+		isc_mem_detach(&mctx);
 }
 
-static isc_result_t ATTR_NONNULLS
-cleanup_zone_files(dns_zone_t *zone) {
+/**
+ * Send change of a zone in data source to task of a follower instance.
+ *
+ * @param[in] ldapdb Zone database in data source or NULL.
+ * @param[in] dn     DN of the zone or NULL.
+ */
+static isc_result_t ATTR_NONNULL(1,2,3,4) ATTR_CHECKRESULT
+mirror_event_send(ldap_instance_t *source, ldap_instance_t *follower,
+		  dns_name_t *name, isc_taskaction_t action,
+		  dns_db_t *ldapdb, const char *dn)
+{
 	isc_result_t result;
-	isc_boolean_t failure = ISC_FALSE;
-	const char *filename = NULL;
-	dns_zone_t *raw = NULL;
-	int namelen;
-	char bck_filename[PATH_MAX];
-
-	dns_zone_getraw(zone, &raw);
-	if (raw != NULL) {
-		result = cleanup_zone_files(raw);
-		dns_zone_detach(&raw);
-		failure = (result != ISC_R_SUCCESS);
-	}
+	ldap_mirrorev_t *mevent = NULL;
+
+	mevent = (ldap_mirrorev_t *)isc_event_allocate(follower->mctx, source,
+						       LDAPDB_EVENT_ZONE_MIRROR,
+						       action, NULL,
+						       sizeof(ldap_mirrorev_t));
+	if (mevent == NULL)
+		return ISC_R_NOMEMORY;
+
+	/* follower might be destroyed before the event is freed */
+	mevent->mctx = NULL;
+	isc_mem_attach(follower->mctx, &mevent->mctx);
+	mevent->source = source;
+	mevent->follower = follower;
+	mevent->ldapdb = NULL;
+	mevent->dn = NULL;
+	dns_fixedname_init(&mevent->name);
+	CHECK(dns_name_copy(name, dns_fixedname_name(&mevent->name), NULL));
+	if (ldapdb != NULL)
+		dns_db_attach(ldapdb, &mevent->ldapdb);
+	if (dn != NULL)
+		CHECKED_MEM_STRDUP(mevent->mctx, dn, mevent->dn);
 
-	filename = dns_zone_getfile(zone);
-	result = fs_file_remove(filename);
-	failure = failure || (result != ISC_R_SUCCESS);
+	isc_task_send(follower->task, (isc_event_t **)&mevent);
 
-	filename = dns_zone_getjournal(zone);
-	result = fs_file_remove(filename);
-	failure = failure || (result != ISC_R_SUCCESS);
+cleanup:
+	if (mevent != NULL)
+		mirror_event_free(&mevent);
+	return result;
+}
 
-	/* Taken from dns_journal_open() from bind-9.9.4-P2:
-	 * Journal backup file name ends with ".jbk" instead of ".jnl". */
-	namelen = strlen(filename);
-	if (namelen > 4 && strcmp(filename + namelen - 4, ".jnl") == 0)
-		namelen -= 4;
-	CHECK(isc_string_printf(bck_filename, sizeof(bck_filename),
-				"%.*s.jbk", namelen, filename));
-	CHECK(fs_file_remove(bck_filename));
+/**
+ * Check that follower instance was not destroyed in the meantime and,
+ * if source is not NULL, that it still uses given data source.
+ */
+static isc_boolean_t ATTR_NONNULL(1)
+follower_isattached(ldap_instance_t *follower, ldap_instance_t *source)
+{
+	ldap_instance_t *inst;
+
+	LOCK(&instances_lock);
+	for (inst = HEAD(instances);
+	     inst != NULL && inst != follower;
+	     inst = NEXT(inst, link))
+		;
+	if (inst != NULL && source != NULL && follower->data_source != source)
+		inst = NULL;
+	UNLOCK(&instances_lock);
+
+	return ISC_TF(inst != NULL);
+}
 
-cleanup:
-	failure = failure || (result != ISC_R_SUCCESS);
-	if (failure == ISC_TRUE)
-		dns_zone_log(zone, ISC_LOG_ERROR,
-			     "unable to remove files, expect problems");
+/**
+ * Send zone from data source to follower instance for publication,
+ * see follower_zone_publish(). In-line signed zones are not shared because
+ * signed data are not in the LDAP database.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+mirror_zone_send(ldap_instance_t *source, ldap_instance_t *follower,
+		 dns_name_t *name)
+{
+	isc_result_t result;
+	dns_zone_t *raw = NULL;
+	dns_zone_t *secure = NULL;
+	dns_db_t *ldapdb = NULL;
+	const char *dn = NULL;
 
-	if (failure == ISC_TRUE && result == ISC_R_SUCCESS)
-		result = ISC_R_FAILURE;
+	CHECK(zr_get_zone_ptr(source->zone_register, name, &raw, &secure));
+	if (secure != NULL) {
+		dns_zone_log(secure, ISC_LOG_DEBUG(1), "in-line signed zone "
+			     "is not shared with instance '%s'",
+			     follower->db_name);
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	}
+	CHECK(zr_get_zone_dbs(source->zone_register, name, &ldapdb, NULL));
+	CHECK(zr_get_zone_dn(source->zone_register, name, &dn));
+	CHECK(mirror_event_send(source, follower, name, follower_zone_publish,
+				ldapdb, dn));
 
+cleanup:
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	if (secure != NULL)
+		dns_zone_detach(&secure);
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
 	return result;
 }
 
 /**
- * Remove zone files and journal files associated with all zones in ZR.
+ * Publish zones which were published by the data source before
+ * the follower instance was created.
+ * Runs in task of the data source instance, zones are published
+ * by task of the follower.
  */
-static isc_result_t ATTR_CHECKRESULT
-cleanup_files(ldap_instance_t *inst) {
+static void ATTR_NONNULLS
+mirror_zones_init(isc_task_t *task, isc_event_t *event)
+{
+	ldap_instance_t *source = event->ev_sender;
+	ldap_instance_t *follower = event->ev_arg;
 	isc_result_t result;
 	rbt_iterator_t *iter = NULL;
+	DECLARE_BUFFERED_NAME(name);
 	dns_zone_t *raw = NULL;
 	dns_zone_t *secure = NULL;
-	DECLARE_BUFFERED_NAME(name);
+	dns_zone_t *zone_in_view = NULL;
+
+	UNUSED(task);
+
+	/* any of the instances might have been destroyed in the meantime */
+	if (!follower_isattached(follower, source)
+	    || source->exiting == ISC_TRUE)
+		goto cleanup;
 
 	INIT_BUFFERED_NAME(name);
-	CHECK(zr_rbt_iter_init(inst->zone_register, &iter, &name));
-	do {
-		CHECK(zr_get_zone_ptr(inst->zone_register, &name, &raw, &secure));
-		cleanup_zone_files(raw);
+	for (result = zr_rbt_iter_init(source->zone_register, &iter, &name);
+	     result == ISC_R_SUCCESS;
+	     dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
+		if (zr_get_zone_ptr(source->zone_register, &name, &raw,
+				    &secure) != ISC_R_SUCCESS)
+			continue;
+		if (dns_view_findzone(source->view, &name, &zone_in_view)
+		    == ISC_R_SUCCESS && (zone_in_view == raw
+					 || zone_in_view == secure)) {
+			result = mirror_zone_send(source, follower, &name);
+			if (result != ISC_R_SUCCESS)
+				dns_zone_log(zone_in_view, ISC_LOG_ERROR,
+					     "publication for instance '%s' "
+					     "failed: %s", follower->db_name,
+					     isc_result_totext(result));
+		}
+		if (zone_in_view != NULL)
+			dns_zone_detach(&zone_in_view);
 		dns_zone_detach(&raw);
-		if (secure != NULL) {
-			cleanup_zone_files(secure);
+		if (secure != NULL)
 			dns_zone_detach(&secure);
-		}
-
-		INIT_BUFFERED_NAME(name);
-		CHECK(rbt_iter_next(&iter, &name));
-	} while (result == ISC_R_SUCCESS);
+	}
 
 cleanup:
-	if (result == ISC_R_NOTFOUND || result == ISC_R_NOMORE)
-		result = ISC_R_SUCCESS;
-	return result;
+	if (iter != NULL)
+		rbt_iter_stop(&iter);
+	isc_event_free(&event);
 }
 
 /**
- * Unload empty zone from given view.
+ * Copy forwarding configuration from named.conf (i.e. from the view)
+ * into local settings of the instance. It is used as the last fallback
+ * for global forwarders, see fwd_reconfig_global().
  *
- * @retval ISC_R_EXISTS   if a zone with given name is not an empty zone
- * @retval ISC_R_SUCCESS  if name was an empty zone
- *                        and it was unloaded successfully
- * @retval ISC_R_NOTFOUND if name does not match any zone in given view
- * @retval other errors
+ * @param[out] named_conf_forwardersp Forwarders configured in named.conf
+ *                                    or NULL if there are none.
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-zone_unload_ifempty(dns_view_t *view, dns_name_t *name) {
+named_conf_forwarders_load(ldap_instance_t *inst,
+			   dns_forwarders_t **named_conf_forwardersp)
+{
 	isc_result_t result;
-	dns_zone_t *zone = NULL;
-	char zone_name[DNS_NAME_FORMATSIZE];
-
-	CHECK(dns_view_findzone(view, name, &zone));
+	dns_forwarders_t *named_conf_forwarders = NULL;
+	isc_buffer_t *forwarders_list = NULL;
+	const char *forward_policy = NULL;
 
-	if (zone_isempty(zone) == ISC_TRUE) {
-		dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
-		result = delete_bind_zone(view->zonetable, &zone);
-		if (result != ISC_R_SUCCESS)
-			log_error_r("unable to unload automatic empty zone "
-				    "%s", zone_name);
-		else
-			log_info("automatic empty zone %s unloaded",
-				 zone_name);
+	result = dns_fwdtable_find(inst->view->fwdtable, dns_rootname,
+				   &named_conf_forwarders);
+	if (result == ISC_R_SUCCESS) {
+		/* Copy forwarding config from named.conf into local_settings */
+		CHECK(fwd_print_list_buff(inst->mctx, named_conf_forwarders,
+					  &forwarders_list));
+		CHECK(setting_set("forwarders", inst->local_settings,
+				  isc_buffer_base(forwarders_list)));
+		CHECK(get_enum_description(forwarder_policy_txts,
+					   named_conf_forwarders->fwdpolicy,
+					   &forward_policy));
+		CHECK(setting_set("forward_policy", inst->local_settings,
+				  forward_policy));
+	} else if (result == ISC_R_NOTFOUND) {
+		/* global forwarders are not configured */
+		named_conf_forwarders = NULL;
+		CHECK(setting_set("forwarders", inst->local_settings,
+				  "{ /* empty list of forwarders */ }"));
+		CHECK(setting_set("forward_policy", inst->local_settings,
+				  "first"));
 	} else {
-		result = ISC_R_EXISTS;
+		goto cleanup;
 	}
 
+	*named_conf_forwardersp = named_conf_forwarders;
+
 cleanup:
-	if (zone != NULL)
-		dns_zone_detach(&zone);
+	if (forwarders_list != NULL)
+		isc_buffer_free(&forwarders_list);
 	return result;
 }
 
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-configure_paths(isc_mem_t *mctx, ldap_instance_t *inst, dns_zone_t *zone,
-		isc_boolean_t issecure) {
+#define PRINT_BUFF_SIZE 255
+isc_result_t
+new_ldap_instance(isc_mem_t *mctx, const char *db_name, const char *parameters,
+		  const char *file, unsigned long line,
+		  const dns_dyndbctx_t *dctx, ldap_instance_t **ldap_instp)
+{
 	isc_result_t result;
-	ld_string_t *file_name = NULL;
-	ld_string_t *key_dir = NULL;
+	ldap_instance_t *ldap_inst;
+	dns_forwarders_t *named_conf_forwarders = NULL;
+	isc_uint32_t connections;
+	char settings_name[PRINT_BUFF_SIZE];
+	ldap_globalfwd_handleez_t *gfwdevent = NULL;
+	const char *server_id = NULL;
+	ldap_syncsess_t *sess;
+	unsigned int extra_cnt;
+	const char *data_source = NULL;
+	isc_event_t *event = NULL;
 
-	CHECK(zr_get_zone_path(mctx, ldap_instance_getsettings_local(inst),
-			       dns_zone_getorigin(zone),
-			       (issecure ? "signed" : "raw"), &file_name));
-	CHECK(dns_zone_setfile(zone, str_buf(file_name)));
-	if (issecure == ISC_TRUE) {
-		CHECK(zr_get_zone_path(mctx,
-				       ldap_instance_getsettings_local(inst),
-				       dns_zone_getorigin(zone), "keys/",
-				       &key_dir));
-		dns_zone_setkeydirectory(zone, str_buf(key_dir));
-	}
-	CHECK(fs_file_remove(dns_zone_getfile(zone)));
-	CHECK(fs_file_remove(dns_zone_getjournal(zone)));
+	REQUIRE(ldap_instp != NULL && *ldap_instp == NULL);
 
-cleanup:
-	str_destroy(&file_name);
-	str_destroy(&key_dir);
-	return result;
-}
+	RUNTIME_CHECK(isc_once_do(&instances_once, instances_init)
+		      == ISC_R_SUCCESS);
 
-/*
- * Create a new zone with origin 'name'. The zone will be added to the
- * ldap_inst->view.
- */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-create_zone(ldap_instance_t * const inst, const char * const dn,
-	    dns_name_t * const name, dns_db_t * const ldapdb,
-	    const isc_boolean_t want_secure, dns_zone_t ** const rawp,
-	    dns_zone_t ** const securep)
-{
-	isc_result_t result;
-	dns_zone_t *raw = NULL;
-	dns_zone_t *secure = NULL;
-	const char *ldap_argv[1] = { inst->db_name };
-	const char *rbt_argv[1] = { "rbt" };
-	sync_state_t sync_state;
-	isc_task_t *task = NULL;
-	char zone_name[DNS_NAME_FORMATSIZE];
-
-	REQUIRE(inst != NULL);
-	REQUIRE(name != NULL);
-	REQUIRE(rawp != NULL && *rawp == NULL);
+	result = settings_check_names();
+	if (result != ISC_R_SUCCESS)
+		return result;
 
-	result = zone_unload_ifempty(inst->view, name);
-	if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
-		goto cleanup;
+	/* keep data from before reload if nothing has changed */
+	result = parked_instance_adopt(db_name, parameters, dctx, ldap_instp);
+	if (result != ISC_R_NOTFOUND)
+		return result;
 
-	CHECK(dns_zone_create(&raw, inst->mctx));
-	CHECK(dns_zone_setorigin(raw, name));
-	dns_zone_setclass(raw, dns_rdataclass_in);
-	dns_zone_settype(raw, dns_zone_master);
-	/* dns_zone_setview(raw, view); */
-	CHECK(dns_zone_setdbtype(raw, sizeof(ldap_argv)/sizeof(ldap_argv[0]),
-				 ldap_argv));
-	CHECK(configure_paths(inst->mctx, inst, raw, ISC_FALSE));
+	CHECKED_MEM_GET_PTR(mctx, ldap_inst);
+	ZERO_PTR(ldap_inst);
+	INIT_LIST(ldap_inst->sessions);
+	INIT_LIST(ldap_inst->followers);
+	INIT_LIST(ldap_inst->zones_ready);
+	INIT_LINK(ldap_inst, follower_link);
+	INIT_LINK(ldap_inst, link);
+	CHECK(isc_refcount_init(&ldap_inst->errors, 0));
+	isc_mem_attach(mctx, &ldap_inst->mctx);
+	CHECKED_MEM_STRDUP(mctx, db_name, ldap_inst->db_name);
+	CHECKED_MEM_STRDUP(mctx, parameters, ldap_inst->parameters);
+	dns_view_attach(dctx->view, &ldap_inst->view);
+	dns_zonemgr_attach(dctx->zmgr, &ldap_inst->zmgr);
+	isc_task_attach(dctx->task, &ldap_inst->task);
 
-	if (want_secure == ISC_FALSE) {
-		CHECK(dns_zonemgr_managezone(inst->zmgr, raw));
-		CHECK(cleanup_zone_files(raw));
-	} else {
-		CHECK(dns_zone_create(&secure, inst->mctx));
-		CHECK(dns_zone_setorigin(secure, name));
-		dns_zone_setclass(secure, dns_rdataclass_in);
-		dns_zone_settype(secure, dns_zone_master);
-		/* dns_zone_setview(secure, view); */
-		CHECK(dns_zone_setdbtype(secure, 1, rbt_argv));
-		CHECK(dns_zonemgr_managezone(inst->zmgr, secure));
-		CHECK(dns_zone_link(secure, raw));
-		dns_zone_rekey(secure, ISC_TRUE);
-		CHECK(configure_paths(inst->mctx, inst, secure, ISC_TRUE));
-		CHECK(cleanup_zone_files(secure));
-	}
+	ldap_inst->watcher = 0;
+	CHECK(sync_ctx_init(ldap_inst->mctx, ldap_inst, &ldap_inst->sctx));
 
-	sync_state_get(inst->sctx, &sync_state);
-	if (sync_state == sync_datainit) {
-		dns_zone_gettask(raw, &task);
-		CHECK(sync_task_add(inst->sctx, task));
-		isc_task_detach(&task);
+	isc_string_printf_truncate(settings_name, PRINT_BUFF_SIZE,
+				   SETTING_SET_NAME_LOCAL " for database %s",
+				   ldap_inst->db_name);
+	CHECK(settings_set_create(mctx, settings_local_default,
+	      sizeof(settings_local_default), settings_name,
+	      &settings_default_set, &ldap_inst->local_settings));
 
-		if (secure != NULL) {
-			dns_zone_gettask(secure, &task);
-			CHECK(sync_task_add(inst->sctx, task));
-			isc_task_detach(&task);
-		}
-	}
+	isc_string_printf_truncate(settings_name, PRINT_BUFF_SIZE,
+				   SETTING_SET_NAME_GLOBAL " for database %s",
+				   ldap_inst->db_name);
+	CHECK(settings_set_create(mctx, settings_global_default,
+	      sizeof(settings_global_default), settings_name,
+	      ldap_inst->local_settings, &ldap_inst->global_settings));
 
-	CHECK(zr_add_zone(inst->zone_register, ldapdb, raw, secure, dn));
+	CHECK(setting_set_parse_conf(mctx, ldap_inst->db_name,
+				     &cfg_type_dyndb_conf, parameters, file,
+				     line, ldap_inst->local_settings));
 
-	*rawp = raw;
-	*securep = secure;
-	return ISC_R_SUCCESS;
+	CHECK(setting_get_str(SETTING_DATA_SOURCE, ldap_inst->local_settings,
+			      &data_source));
+	if (strlen(data_source) != 0)
+		CHECK(data_source_attach(ldap_inst, data_source));
 
-cleanup:
-	dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
-	log_error_r("failed to create new zone '%s'", zone_name);
+	/* copy global forwarders setting for configuration roll back in
+	 * configure_zone_forwarders() */
+	CHECK(named_conf_forwarders_load(ldap_inst, &named_conf_forwarders));
+	if (named_conf_forwarders != NULL) {
+		/* Make sure we disable conflicting automatic empty zones.
+		 * This will be done in event to prevent the plugin from
+		 * interfering with BIND start-up.
+		 *
+		 * Warn-only semantics is implemented in BIND RT#41441,
+		 * this code can be removed when we rebase to BIND 9.11. */
+		CHECK(sync_task_add(ldap_inst->sctx, ldap_inst->task));
+		gfwdevent = (ldap_globalfwd_handleez_t *)isc_event_allocate(
+					ldap_inst->mctx, ldap_inst,
+					LDAPDB_EVENT_GLOBALFWD_HANDLEEZ,
+					empty_zone_handle_globalfwd_ev,
+					ldap_inst->view->zonetable,
+					sizeof(ldap_globalfwd_handleez_t));
+		if (gfwdevent == NULL)
+			CLEANUP_WITH(ISC_R_NOMEMORY);
+		/* policy == first does not override automatic empty zones */
+		gfwdevent->warn_only = (named_conf_forwarders->fwdpolicy
+					== dns_fwdpolicy_first);
 
-	if (raw != NULL) {
-		if (dns_zone_getmgr(raw) != NULL)
-			dns_zonemgr_releasezone(inst->zmgr, raw);
-		dns_zone_detach(&raw);
+		isc_task_send(ldap_inst->task, (isc_event_t **)&gfwdevent);
 	}
-	if (task != NULL)
-		isc_task_detach(&task);
 
-	return result;
-}
+	CHECK(validate_local_instance_settings(ldap_inst,
+					       ldap_inst->local_settings));
+	if (settings_set_isfilled(ldap_inst->global_settings) != ISC_TRUE)
+		CLEANUP_WITH(ISC_R_FAILURE);
 
-/**
- * @warning Never call this on raw part of in-line secure zone.
- */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-load_zone(dns_zone_t *zone, isc_boolean_t log) {
-	isc_result_t result;
-	isc_boolean_t zone_dynamic;
-	isc_uint32_t serial;
-	dns_zone_t *raw = NULL;
+	/* zero-length server_id means undefined value */
+	CHECK(setting_get_str(SETTING_SERVER_ID, ldap_inst->local_settings,
+			      &server_id));
+	if (strlen(server_id) == 0)
+		isc_string_printf_truncate(settings_name, PRINT_BUFF_SIZE,
+					   SETTING_SET_NAME_SERVER
+					   " for undefined server_id");
+	else
+		isc_string_printf_truncate(settings_name, PRINT_BUFF_SIZE,
+					   SETTING_SET_NAME_SERVER
+					   " for server id %s", server_id);
 
-	result = dns_zone_load(zone);
-	if (result != ISC_R_SUCCESS && result != DNS_R_UPTODATE
-	    && result != DNS_R_DYNAMIC && result != DNS_R_CONTINUE)
-		goto cleanup;
-	zone_dynamic = (result == DNS_R_DYNAMIC);
+	CHECK(settings_set_create(mctx, settings_server_ldap_default,
+	      sizeof(settings_server_ldap_default), settings_name,
+	      ldap_inst->global_settings, &ldap_inst->server_ldap_settings));
 
-	dns_zone_getraw(zone, &raw);
-	if (raw == NULL) {
-		dns_zone_attach(zone, &raw);
-		zone = NULL;
-	}
+	ldap_inst->empty_fwdz_settings = (settings_set_t) {
+			NULL,
+			"dummy LDAP zone forwarding settings",
+			ldap_inst->server_ldap_settings,
+			NULL,
+			(setting_t *) &settings_fwdz_defaults[0]
+	};
 
-	CHECK(dns_zone_getserial2(raw, &serial));
-	if (log == ISC_TRUE)
-		dns_zone_log(raw, ISC_LOG_INFO, "loaded serial %u", serial);
-	if (zone != NULL) {
-		result = dns_zone_getserial2(zone, &serial);
-		if (result == ISC_R_SUCCESS && log == ISC_TRUE)
-			dns_zone_log(zone, ISC_LOG_INFO, "loaded serial %u",
-				     serial);
-		/* in-line secure zone is loaded asynchonously in background */
-		else if (result == DNS_R_NOTLOADED) {
-			if (log == ISC_TRUE)
-				dns_zone_log(zone, ISC_LOG_INFO,
-					     "signing in progress");
-			result = ISC_R_SUCCESS;
-		} else
-			goto cleanup;
-	}
+	CHECK(setting_get_uint(SETTING_CONNECTIONS, ldap_inst->local_settings,
+			       &connections));
+	CHECK(setting_get_uint(SETTING_ZONE_SHARDS, ldap_inst->local_settings,
+			       &ldap_inst->zone_shards));
+	CHECK(setting_get_uint(SETTING_ZONE_SHARD_INDEX,
+			       ldap_inst->local_settings,
+			       &ldap_inst->zone_shard_index));
 
-	if (zone_dynamic)
-		dns_zone_notify((zone != NULL) ? zone : raw);
+	CHECK(zr_create(mctx, ldap_inst, ldap_inst->server_ldap_settings,
+			&ldap_inst->zone_register));
+	CHECK(fwdr_create(ldap_inst->mctx, &ldap_inst->fwd_register));
+	CHECK(fwd_cache_create(ldap_inst->mctx, &ldap_inst->fwd_cache));
+	CHECK(rr_template_cache_create(mctx, &ldap_inst->rr_templates));
+	CHECK(rr_range_register_create(mctx, &ldap_inst->rr_ranges));
+	CHECK(acl_cache_create(mctx, &ldap_inst->acl_cache));
+	CHECK(rr_schema_create(mctx, &ldap_inst->rr_schema));
+	CHECK(sync_ptr_queue_create(mctx, &ldap_inst->sync_ptr_queue));
 
-cleanup:
-	if (raw != NULL)
-		dns_zone_detach(&raw);
-	return result;
-}
+	CHECK(isc_mutex_init(&ldap_inst->kinit_lock));
 
-/**
- * Add zone to the view defined in inst->view.
- */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-publish_zone(isc_task_t *task, ldap_instance_t *inst, dns_zone_t *zone)
-{
-	isc_result_t result;
-	isc_boolean_t freeze = ISC_FALSE;
-	dns_zone_t *zone_in_view = NULL;
-	dns_view_t *view_in_zone = NULL;
-	isc_result_t lock_state = ISC_R_IGNORE;
+	/* Register new DNS DB implementation. Instance with data source
+	 * uses it only for zones it has own copy of. */
+	CHECK(dns_db_register(ldap_inst->db_name, &ldapdb_associate, ldap_inst,
+			      mctx, &ldap_inst->db_imp));
 
-	REQUIRE(ISCAPI_TASK_VALID(task));
-	REQUIRE(inst != NULL);
-	REQUIRE(zone != NULL);
+	/* instance with data source does not talk to LDAP at all */
+	if (ldap_inst->data_source != NULL)
+		goto follower;
 
-	/* Return success if the zone is already in the view as expected. */
-	result = dns_view_findzone(inst->view, dns_zone_getorigin(zone),
-				   &zone_in_view);
-	if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
+	/* each additional SyncRepl session needs own connection */
+	CHECK(syncsess_create_all(ldap_inst, &extra_cnt));
+	if (connections < 2 + extra_cnt) {
+		log_error("at least %u connections are required "
+			  "for %u extra bases", 2 + extra_cnt, extra_cnt);
+		CLEANUP_WITH(ISC_R_RANGE);
+	}
+
+	CHECK(ldap_pool_create(mctx, connections, &ldap_inst->pool));
+	CHECK(ldap_pool_connect(ldap_inst->pool, ldap_inst));
+
+	/* Start the watcher thread */
+	result = isc_thread_create(ldap_syncrepl_watcher, ldap_inst,
+				   &ldap_inst->watcher);
+	if (result != ISC_R_SUCCESS) {
+		ldap_inst->watcher = 0;
+		log_error("Failed to create syncrepl watcher thread");
 		goto cleanup;
+	}
 
-	view_in_zone = dns_zone_getview(zone);
-	if (view_in_zone != NULL) {
-		/* Zone has a view set -> view should contain the same zone. */
-		if (zone_in_view == zone) {
-			/* Zone is already published in the right view. */
-			CLEANUP_WITH(ISC_R_SUCCESS);
-		} else if (view_in_zone != inst->view) {
-			/* Un-published inactive zone will have
-			 * inst->view in zone but will not be present
-			 * in the view itself. */
-			dns_zone_log(zone, ISC_LOG_ERROR, "zone->view doesn't "
-				     "match data in the view");
-			CLEANUP_WITH(ISC_R_UNEXPECTED);
+	/* Start additional SyncRepl sessions */
+	for (sess = NEXT(HEAD(ldap_inst->sessions), link);
+	     sess != NULL;
+	     sess = NEXT(sess, link)) {
+		result = isc_thread_create(ldap_syncrepl_session, sess,
+					   &sess->thread);
+		if (result != ISC_R_SUCCESS) {
+			sess->thread = 0;
+			log_error("Failed to create SyncRepl thread "
+				  "for base '%s'", sess->base);
+			goto cleanup;
 		}
 	}
-	if (zone_in_view != NULL) {
-		dns_zone_log(zone, ISC_LOG_ERROR, "cannot publish zone: view "
-			     "already contains another zone with this name");
-		CLEANUP_WITH(ISC_R_UNEXPECTED);
-	} /* else if (zone_in_view == NULL &&
-		      (view_in_zone == NULL || view_in_zone == inst->view))
-	     Publish the zone. */
 
-	run_exclusive_enter(inst, &lock_state);
-	if (inst->view->frozen) {
-		freeze = ISC_TRUE;
-		dns_view_thaw(inst->view);
+follower:
+	if (ldap_inst->data_source != NULL) {
+		/* zones already published by data source */
+		event = isc_event_allocate(mctx, ldap_inst->data_source,
+					   LDAPDB_EVENT_ZONE_MIRROR,
+					   mirror_zones_init, ldap_inst,
+					   sizeof(isc_event_t));
+		if (event == NULL)
+			CLEANUP_WITH(ISC_R_NOMEMORY);
+		isc_task_send(ldap_inst->data_source->task, &event);
 	}
 
-	dns_zone_setview(zone, inst->view);
-	CHECK(dns_view_addzone(inst->view, zone));
+	LOCK(&instances_lock);
+	APPEND(instances, ldap_inst, link);
+	UNLOCK(&instances_lock);
+	result = ISC_R_SUCCESS;
 
 cleanup:
-	if (zone_in_view != NULL)
-		dns_zone_detach(&zone_in_view);
-	if (freeze)
-		dns_view_freeze(inst->view);
-	run_exclusive_exit(inst, lock_state);
+	if (result != ISC_R_SUCCESS)
+		destroy_ldap_instance(&ldap_inst);
+	else
+		*ldap_instp = ldap_inst;
 
 	return result;
 }
+#undef PRINT_BUFF_SIZE
 
 /**
- * Add zone to view and call dns_zone_load().
- */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-activate_zone(isc_task_t *task, ldap_instance_t *inst, dns_name_t *name) {
-	isc_result_t result;
-	dns_zone_t *raw = NULL;
-	dns_zone_t *secure = NULL;
-	dns_zone_t *toview = NULL;
-	settings_set_t *zone_settings = NULL;
-
-	CHECK(zr_get_zone_ptr(inst->zone_register, name, &raw, &secure));
-
-	/* Load only "secure" zone if inline-signing is active.
-	 * It will not work if raw zone is loaded explicitly
-	 * - dns_zone_load() will fail magically. */
-	toview = (secure != NULL) ? secure : raw;
-
+ * Send SIGUSR1 to a SyncRepl thread and wait for it to terminate.
+ *
+ * If the thread has already been terminated and a signal can't be sent to it,
+ * log an error instead. The thread is still joined, but since it is no longer
+ * running, it is instantaneous and doesn't block.
+ */
+static void
+ldap_syncrepl_thread_stop(isc_thread_t thread)
+{
 	/*
-	 * Zone has to be published *before* zone load
-	 * otherwise it will race with zone->view != NULL check
-	 * in zone_maintenance() in zone.c.
+	 * Wake up the thread. This might look like a hack
+	 * but isc_thread_t is actually pthread_t and libisc don't
+	 * have any isc_thread_kill() func.
+	 *
+	 * We use SIGUSR1 to not to interfere with any signal
+	 * used by BIND itself.
 	 */
-	result = publish_zone(task, inst, toview);
-	if (result != ISC_R_SUCCESS) {
-		dns_zone_log(toview, ISC_LOG_ERROR,
-			     "cannot add zone to view: %s",
-			     dns_result_totext(result));
-		goto cleanup;
-	}
-
-	CHECK(load_zone(toview, ISC_TRUE));
-	if (secure != NULL) {
-		CHECK(zr_get_zone_settings(inst->zone_register, name,
-					   &zone_settings));
-		CHECK(zone_master_reconfigure_nsec3param(zone_settings,
-							 secure));
+	if (pthread_kill(thread, SIGUSR1) != 0) {
+		log_error("unable to send signal to SyncRepl watcher thread "
+				  "(already terminated?)");
 	}
 
-cleanup:
-	if (raw != NULL)
-		dns_zone_detach(&raw);
-	if (secure != NULL)
-		dns_zone_detach(&secure);
-	return result;
+	RUNTIME_CHECK(isc_thread_join(thread, NULL) == ISC_R_SUCCESS);
 }
 
 /**
- * Add all active zones in zone register to DNS view specified in inst->view
- * and load zones.
+ * Terminate the SyncRepl watcher thread and threads of all additional
+ * SyncRepl sessions.
+ *
+ * @param[in]  ldap_inst	LDAP instance with ID of watcher thread
  */
-isc_result_t
-activate_zones(isc_task_t *task, ldap_instance_t *inst) {
-	isc_result_t result;
-	rbt_iterator_t *iter = NULL;
-	DECLARE_BUFFERED_NAME(name);
-	unsigned int published_cnt = 0;
-	unsigned int total_cnt = 0;
-	unsigned int active_cnt = 0;
-	settings_set_t *settings;
-	isc_boolean_t active;
-
-	INIT_BUFFERED_NAME(name);
-	for(result = zr_rbt_iter_init(inst->zone_register, &iter, &name);
-	    result == ISC_R_SUCCESS;
-	    dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
-		settings = NULL;
-		result = zr_get_zone_settings(inst->zone_register, &name, &settings);
-		INSIST(result == ISC_R_SUCCESS);
-		result = setting_get_bool("active", settings, &active);
-		INSIST(result == ISC_R_SUCCESS);
+static void ATTR_NONNULLS
+ldap_syncrepl_watcher_shutdown(ldap_instance_t *ldap_inst)
+{
+	ldap_syncsess_t *sess;
 
-		++total_cnt;
-		if (active == ISC_TRUE) {
-			++active_cnt;
-			result = activate_zone(task, inst, &name);
-			if (result == ISC_R_SUCCESS)
-				++published_cnt;
-			result = fwd_configure_zone(settings, inst, &name);
-			if (result != ISC_R_SUCCESS)
-				log_error_r("could not configure forwarding");
+	REQUIRE(ldap_inst != NULL);
 
+	ldap_inst->exiting = ISC_TRUE;
+	ldap_syncrepl_thread_stop(ldap_inst->watcher);
+	for (sess = HEAD(ldap_inst->sessions);
+	     sess != NULL;
+	     sess = NEXT(sess, link)) {
+		if (sess->thread != 0) {
+			ldap_syncrepl_thread_stop(sess->thread);
+			sess->thread = 0;
 		}
-	};
-
-	log_info("%u master zones from LDAP instance '%s' loaded (%u zones "
-		 "defined, %u inactive, %u failed to load)", published_cnt,
-		 inst->db_name, total_cnt, total_cnt - active_cnt,
-		 active_cnt - published_cnt);
-	if (total_cnt < 1)
-		log_info("0 master zones is suspicious number, please check "
-			 "access control instructions on LDAP server");
-	return result;
+	}
 }
 
+void
+destroy_ldap_instance(ldap_instance_t **ldap_instp)
+{
+	ldap_instance_t *ldap_inst;
+	ldap_syncsess_t *sess;
 
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-configure_zone_acl(isc_mem_t *mctx, dns_zone_t *zone,
-		void (acl_setter)(dns_zone_t *zone, dns_acl_t *acl),
-		const char *aclstr, acl_type_t type) {
-	isc_result_t result;
-	isc_result_t result2;
-	dns_acl_t *acl = NULL;
-	const char *type_txt = NULL;
+	REQUIRE(ldap_instp != NULL);
 
-	result = acl_from_ldap(mctx, aclstr, type, &acl);
-	if (result != ISC_R_SUCCESS) {
-		result2 = get_enum_description(acl_type_txts, type, &type_txt);
-		if (result2 != ISC_R_SUCCESS) {
-			log_bug("invalid acl type %u", type);
-			type_txt = "<unknown>";
-		}
+	ldap_inst = *ldap_instp;
+	if (ldap_inst == NULL)
+		return;
 
-		dns_zone_logc(zone, DNS_LOGCATEGORY_SECURITY, ISC_LOG_ERROR,
-			      "%s policy is invalid: %s; configuring most "
-			      "restrictive %s policy as possible",
-			      type_txt, isc_result_totext(result), type_txt);
-		result2 = acl_from_ldap(mctx, "", type, &acl);
-		if (result2 != ISC_R_SUCCESS) {
-			dns_zone_logc(zone, DNS_LOGCATEGORY_SECURITY, ISC_LOG_CRITICAL,
-				      "cannot configure restrictive %s policy: %s",
-				      type_txt, isc_result_totext(result2));
-			FATAL_ERROR(__FILE__, __LINE__,
-				    "insecure state detected");
-		}
+	if (ldap_inst->watcher != 0) {
+		ldap_syncrepl_watcher_shutdown(ldap_inst);
+		ldap_inst->watcher = 0;
 	}
-	acl_setter(zone, acl);
-
-	if (acl != NULL)
-		dns_acl_detach(&acl);
-
-	return result;
-}
 
-/* In BIND9 terminology "ssu" means "Simple Secure Update" */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-configure_zone_ssutable(dns_zone_t *zone, const char *update_str)
-{
-	isc_result_t result;
-	isc_result_t result2;
+	instance_unregister(ldap_inst);
+	/* Unregister all zones already registered in BIND,
+	 * including zones in views of followers. */
+	zr_destroy(&ldap_inst->zone_register);
+	followers_detach(ldap_inst);
+	fwdr_destroy(&ldap_inst->fwd_register);
+	fwd_cache_destroy(&ldap_inst->fwd_cache);
+	rr_template_cache_destroy(&ldap_inst->rr_templates);
+	rr_range_register_destroy(&ldap_inst->rr_ranges);
+	acl_cache_destroy(&ldap_inst->acl_cache);
 
-	REQUIRE(zone != NULL);
+	ldap_pool_destroy(&ldap_inst->pool);
+	rr_schema_destroy(&ldap_inst->rr_schema);
+	sync_ptr_queue_detach(&ldap_inst->sync_ptr_queue);
+	if (ldap_inst->db_imp != NULL)
+		dns_db_unregister(&ldap_inst->db_imp);
+	if (ldap_inst->view != NULL)
+		dns_view_detach(&ldap_inst->view);
+	if (ldap_inst->zmgr != NULL)
+		dns_zonemgr_detach(&ldap_inst->zmgr);
+	if (ldap_inst->task != NULL)
+		isc_task_detach(&ldap_inst->task);
 
-	/*
-	 * This is meant only for debugging.
-	 * DANGEROUS: Do not leave uncommented!
-	 */
-#if 0 
-	{
-		dns_acl_t *any;
-		dns_acl_any(dns_zone_getmctx(zone), &any);
-		dns_zone_setupdateacl(zone, any);
-		dns_acl_detach(&any);
+	DESTROYLOCK(&ldap_inst->kinit_lock);
+	while ((sess = HEAD(ldap_inst->sessions)) != NULL) {
+		UNLINK(ldap_inst->sessions, sess, link);
+		syncsess_destroy(&sess);
 	}
+	zone_sync_list_free(ldap_inst->mctx, &ldap_inst->zones_ready);
 
-	return ISC_R_SUCCESS;
-#endif
+	settings_set_free(&ldap_inst->global_settings);
+	settings_set_free(&ldap_inst->local_settings);
+	settings_set_free(&ldap_inst->server_ldap_settings);
 
-	/* Set simple update table. */
-	result = acl_configure_zone_ssutable(update_str, zone);
-	if (result != ISC_R_SUCCESS) {
-		dns_zone_logc(zone, DNS_LOGCATEGORY_SECURITY, ISC_LOG_ERROR,
-			      "disabling all updates because of error in "
-			      "update policy configuration: %s",
-			      isc_result_totext(result));
-		result2 = acl_configure_zone_ssutable("", zone);
-		if (result2 != ISC_R_SUCCESS) {
-			dns_zone_logc(zone, DNS_LOGCATEGORY_SECURITY, ISC_LOG_CRITICAL,
-				      "cannot disable all updates: %s",
-				      isc_result_totext(result2));
-			FATAL_ERROR(__FILE__, __LINE__,
-				    "insecure state detected");
-		}
+	sync_ctx_free(&ldap_inst->sctx);
+	/* zero out error counter (and do nothing other than that) */
+	ldap_instance_untaint_finish(ldap_inst,
+				     ldap_instance_untaint_start(ldap_inst));
+	isc_refcount_destroy(&ldap_inst->errors);
+
+	if (ldap_inst->parameters != NULL)
+		isc_mem_free(ldap_inst->mctx, ldap_inst->parameters);
+	if (ldap_inst->db_name != NULL) {
+		log_debug(1, "LDAP instance '%s' destroyed", ldap_inst->db_name);
+		isc_mem_free(ldap_inst->mctx, ldap_inst->db_name);
 	}
+	MEM_PUT_AND_DETACH(ldap_inst);
 
-	return result;
+	*ldap_instp = NULL;
 }
 
-/* Delete zone by dns zone name */
-isc_result_t
-ldap_delete_zone2(ldap_instance_t *inst, dns_name_t *name, isc_boolean_t lock)
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+new_ldap_connection(ldap_pool_t *pool, ldap_connection_t **ldap_connp)
 {
 	isc_result_t result;
-	isc_result_t isforward = ISC_R_NOTFOUND;
-	isc_result_t lock_state = ISC_R_IGNORE;
-	isc_boolean_t freeze = ISC_FALSE;
-	dns_zone_t *raw = NULL;
-	dns_zone_t *secure = NULL;
-	dns_zone_t *foundzone = NULL;
-	char zone_name_char[DNS_NAME_FORMATSIZE];
+	ldap_connection_t *ldap_conn;
 
-	dns_name_format(name, zone_name_char, DNS_NAME_FORMATSIZE);
-	log_debug(1, "deleting zone '%s'", zone_name_char);
-	if (lock)
-		run_exclusive_enter(inst, &lock_state);
+	REQUIRE(pool != NULL);
+	REQUIRE(ldap_connp != NULL && *ldap_connp == NULL);
 
-	/* simulate no explicit forwarding configuration */
-	CHECK(fwd_configure_zone(&inst->empty_fwdz_settings, inst, name));
-	isforward = fwdr_zone_ispresent(inst->fwd_register, name);
-	if (isforward == ISC_R_SUCCESS)
-		CHECK(fwdr_del_zone(inst->fwd_register, name));
+	CHECKED_MEM_GET_PTR(pool->mctx, ldap_conn);
+	ZERO_PTR(ldap_conn);
 
-	result = zr_get_zone_ptr(inst->zone_register, name, &raw, &secure);
-	if (result == ISC_R_NOTFOUND || result == DNS_R_PARTIALMATCH) {
-		if (isforward == ISC_R_SUCCESS)
-			log_info("forward zone '%s': shutting down", zone_name_char);
-		log_debug(1, "zone '%s' not found in zone register", zone_name_char);
-		CLEANUP_WITH(ISC_R_SUCCESS);
-	} else if (result != ISC_R_SUCCESS)
-		goto cleanup;
+	result = isc_mutex_init(&ldap_conn->lock);
+	if (result != ISC_R_SUCCESS) {
+		SAFE_MEM_PUT_PTR(pool->mctx, ldap_conn);
+		return result;
+	}
 
-	result = dns_view_findzone(inst->view, name, &foundzone);
-	if (result == ISC_R_SUCCESS) {
-		/* foundzone != zone indicates a bug */
-		if (secure != NULL)
-			RUNTIME_CHECK(foundzone == secure);
-		else
-			RUNTIME_CHECK(foundzone == raw);
-		dns_zone_detach(&foundzone);
+	isc_mem_attach(pool->mctx, &ldap_conn->mctx);
 
-		if (lock) {
-			dns_view_thaw(inst->view);
-			freeze = ISC_TRUE;
-		}
-	} /* else: zone wasn't in a view */
+	*ldap_connp = ldap_conn;
 
-	if (secure != NULL)
-		CHECK(delete_bind_zone(inst->view->zonetable, &secure));
-	CHECK(delete_bind_zone(inst->view->zonetable, &raw));
-	CHECK(zr_del_zone(inst->zone_register, name));
+	return ISC_R_SUCCESS;
 
 cleanup:
-	if (freeze)
-		dns_view_freeze(inst->view);
-	run_exclusive_exit(inst, lock_state);
+	destroy_ldap_connection(&ldap_conn);
 
 	return result;
 }
 
-/**
- * Remove zone from view but let the zone object intact. The same zone object
- * can be re-published later using publish_zone().
- *
- * @warning
- * This function removes zone from view but the zone->view pointer will stay
- * unchanged and will reference the old view.
- * It works like that because dns_zone_setview() doesn't work with NULL view.
- * I hope it will not break something...
- */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-unpublish_zone(ldap_instance_t *inst, dns_name_t *name, const char *logname) {
-	isc_result_t result;
-	isc_result_t lock_state = ISC_R_IGNORE;
-	dns_zone_t *raw = NULL;
-	dns_zone_t *secure = NULL;
-	dns_zone_t *zone_in_view = NULL;
-	isc_boolean_t freeze = ISC_FALSE;
+static void
+destroy_ldap_connection(ldap_connection_t **ldap_connp)
+{
+	ldap_connection_t *ldap_conn;
 
-	CHECK(zr_get_zone_ptr(inst->zone_register, name, &raw, &secure));
+	REQUIRE(ldap_connp != NULL);
 
-	run_exclusive_enter(inst, &lock_state);
-	if (inst->view->frozen) {
-		freeze = ISC_TRUE;
-		dns_view_thaw(inst->view);
-	}
-	CHECK(dns_view_findzone(inst->view, name, &zone_in_view));
-	INSIST(zone_in_view == raw || zone_in_view == secure);
-	/* simulate no explicit forwarding configuration */
-	CHECK(fwd_configure_zone(&inst->empty_fwdz_settings, inst, name));
-	CHECK(dns_zt_unmount(inst->view->zonetable, zone_in_view));
+	ldap_conn = *ldap_connp;
+	if (ldap_conn == NULL)
+		return;
 
-cleanup:
-	if (freeze)
-		dns_view_freeze(inst->view);
-	run_exclusive_exit(inst, lock_state);
-	if (result != ISC_R_SUCCESS)
-		log_error_r("%s un-publication failed", logname);
-	if (raw != NULL)
-		dns_zone_detach(&raw);
-	if (secure != NULL)
-		dns_zone_detach(&secure);
-	if (zone_in_view != NULL)
-		dns_zone_detach(&zone_in_view);
+	DESTROYLOCK(&ldap_conn->lock);
+	if (ldap_conn->handle != NULL)
+		ldap_unbind_ext_s(ldap_conn->handle, NULL, NULL);
 
-	return result;
+	MEM_PUT_AND_DETACH(*ldap_connp);
 }
 
-/* Parse the config object entry */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_parse_configentry(ldap_entry_t *entry, ldap_instance_t *inst)
-{
+static isc_result_t ATTR_NONNULLS
+cleanup_zone_files(dns_zone_t *zone) {
 	isc_result_t result;
+	isc_boolean_t failure = ISC_FALSE;
+	const char *filename = NULL;
+	dns_zone_t *raw = NULL;
+	int namelen;
+	char bck_filename[PATH_MAX];
 
-	/* BIND functions are thread safe, ldap instance 'inst' is locked
-	 * inside setting* functions. */
-
-	log_debug(3, "Parsing configuration object");
+	dns_zone_getraw(zone, &raw);
+	if (raw != NULL) {
+		result = cleanup_zone_files(raw);
+		dns_zone_detach(&raw);
+		failure = (result != ISC_R_SUCCESS);
+	}
 
-	result = fwd_parse_ldap(entry, inst->global_settings);
-	if (result == ISC_R_SUCCESS) {
-		CHECK(fwd_reconfig_global(inst));
-	} else if (result != ISC_R_IGNORE)
-		goto cleanup;
+	filename = dns_zone_getfile(zone);
+	result = fs_file_remove(filename);
+	failure = failure || (result != ISC_R_SUCCESS);
 
-	result = setting_update_from_ldap_entry("dyn_update",
-						inst->global_settings,
-						"idnsAllowDynUpdate",
-						entry);
-	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
-		goto cleanup;
+	filename = dns_zone_getjournal(zone);
+	result = fs_file_remove(filename);
+	failure = failure || (result != ISC_R_SUCCESS);
 
-	result = setting_update_from_ldap_entry("sync_ptr",
-						inst->global_settings,
-						"idnsAllowSyncPTR",
-						entry);
-	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
-		goto cleanup;
+	/* Taken from dns_journal_open() from bind-9.9.4-P2:
+	 * Journal backup file name ends with ".jbk" instead of ".jnl". */
+	namelen = strlen(filename);
+	if (namelen > 4 && strcmp(filename + namelen - 4, ".jnl") == 0)
+		namelen -= 4;
+	CHECK(isc_string_printf(bck_filename, sizeof(bck_filename),
+				"%.*s.jbk", namelen, filename));
+	CHECK(fs_file_remove(bck_filename));
 
 cleanup:
-	/* Configuration errors are not fatal. */
-	/* TODO: log something? */
-	return ISC_R_SUCCESS;
-}
-
-/* Parse the idnsServerConfig object entry */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_parse_serverconfigentry(ldap_entry_t *entry, ldap_instance_t *inst)
-{
-	isc_result_t result;
-
-	/* BIND functions are thread safe, ldap instance 'inst' is locked
-	 * inside setting* functions. */
-
-	log_debug(3, "Parsing server configuration object");
-
-	result = fwd_parse_ldap(entry, inst->server_ldap_settings);
-	if (result == ISC_R_SUCCESS) {
-		CHECK(fwd_reconfig_global(inst));
-	} else if (result != ISC_R_IGNORE)
-		goto cleanup;
-
-	result = setting_update_from_ldap_entry("fake_mname",
-						inst->server_ldap_settings,
-						"idnsSOAmName",
-						entry);
-	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
-		goto cleanup;
+	failure = failure || (result != ISC_R_SUCCESS);
+	if (failure == ISC_TRUE)
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "unable to remove files, expect problems");
 
-	result = setting_update_from_ldap_entry("substitutionvariable_ipalocation",
-						inst->server_ldap_settings,
-						"idnsSubstitutionVariable;ipalocation",
-						entry);
-	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
-		goto cleanup;
+	if (failure == ISC_TRUE && result == ISC_R_SUCCESS)
+		result = ISC_R_FAILURE;
 
-cleanup:
-	/* Configuration errors are not fatal. */
-	/* TODO: log something? */
-	return ISC_R_SUCCESS;
+	return result;
 }
 
-/* Parse the forward zone entry */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_parse_fwd_zoneentry(ldap_entry_t *entry, ldap_instance_t *inst)
-{
-	ldap_valuelist_t values;
-	char name_txt[DNS_NAME_FORMATSIZE];
+/**
+ * Remove zone files and journal files associated with all zones in ZR.
+ */
+static isc_result_t ATTR_CHECKRESULT
+cleanup_files(ldap_instance_t *inst) {
 	isc_result_t result;
+	rbt_iterator_t *iter = NULL;
+	dns_zone_t *raw = NULL;
+	dns_zone_t *secure = NULL;
+	DECLARE_BUFFERED_NAME(name);
 
-	settings_set_t *fwdz_settings = NULL;
-
-	REQUIRE(entry != NULL);
-	REQUIRE(inst != NULL);
-
-	/* Zone is active */
-	CHECK(ldap_entry_getvalues(entry, "idnsZoneActive", &values));
-	if (HEAD(values) != NULL &&
-	    strcasecmp(HEAD(values)->value, "TRUE") != 0) {
-		/* Zone is not active */
-		result = ldap_delete_zone2(inst, &entry->fqdn, ISC_TRUE);
-		goto cleanup;
-	}
-
-	CHECK(settings_set_create(inst->mctx, settings_fwdz_defaults, sizeof(settings_fwdz_defaults),
-				  "fake fwdz settings", inst->server_ldap_settings,
-				  &fwdz_settings));
-	result = fwd_parse_ldap(entry, fwdz_settings);
-	if (result == ISC_R_IGNORE) {
-		log_error_r("%s: invalid object: either "
-			    "forwarding policy or forwarders must be set",
-			    ldap_entry_logname(entry));
-		goto cleanup;
-	}
-	CHECK(fwd_configure_zone(fwdz_settings, inst, &entry->fqdn));
+	INIT_BUFFERED_NAME(name);
+	CHECK(zr_rbt_iter_init(inst->zone_register, &iter, &name));
+	do {
+		CHECK(zr_get_zone_ptr(inst->zone_register, &name, &raw, &secure));
+		cleanup_zone_files(raw);
+		dns_zone_detach(&raw);
+		if (secure != NULL) {
+			cleanup_zone_files(secure);
+			dns_zone_detach(&secure);
+		}
 
-	result = fwdr_add_zone(inst->fwd_register, &entry->fqdn);
-	if (result != ISC_R_EXISTS && result != ISC_R_SUCCESS) {
-		dns_name_format(&entry->fqdn, name_txt, DNS_NAME_FORMATSIZE);
-		log_error_r("failed to add forward zone '%s' "
-			    "to the forwarding register", name_txt);
-		goto cleanup;
-	}
-	result = ISC_R_SUCCESS;
-	dns_name_format(&entry->fqdn, name_txt, DNS_NAME_FORMATSIZE);
-	log_info("forward zone '%s': loaded", name_txt);
+		INIT_BUFFERED_NAME(name);
+		CHECK(rbt_iter_next(&iter, &name));
+	} while (result == ISC_R_SUCCESS);
 
 cleanup:
-	settings_set_free(&fwdz_settings);
+	if (result == ISC_R_NOTFOUND || result == ISC_R_NOMORE)
+		result = ISC_R_SUCCESS;
 	return result;
 }
 
 /**
- * Compute minimal diff between rdatalist and rdataset iterator. This produces
- * minimal diff applicable to a database.
+ * Unload empty zone from given view.
+ *
+ * @retval ISC_R_EXISTS   if a zone with given name is not an empty zone
+ * @retval ISC_R_SUCCESS  if name was an empty zone
+ *                        and it was unloaded successfully
+ * @retval ISC_R_NOTFOUND if name does not match any zone in given view
+ * @retval other errors
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-diff_ldap_rbtdb(isc_mem_t *mctx, dns_name_t *name, ldapdb_rdatalist_t *ldap_rdatalist,
-		    dns_rdatasetiter_t *rbt_rds_iter, dns_diff_t *diff) {
+zone_unload_ifempty(dns_view_t *view, dns_name_t *name) {
 	isc_result_t result;
-	dns_rdataset_t rbt_rds;
-	dns_rdatalist_t *l;
-
-	dns_rdataset_init(&rbt_rds);
+	dns_zone_t *zone = NULL;
+	char zone_name[DNS_NAME_FORMATSIZE];
 
-	/* FIXME: rbt_rds_iter == NULL || ldap_rdatalist == NULL */
-	for (result = dns_rdatasetiter_first(rbt_rds_iter);
-	     result == ISC_R_SUCCESS;
-	     result = dns_rdatasetiter_next(rbt_rds_iter)) {
-		dns_rdatasetiter_current(rbt_rds_iter, &rbt_rds);
-		CHECK(rdataset_to_diff(mctx, DNS_DIFFOP_DEL, name, &rbt_rds,
-				       diff));
-		dns_rdataset_disassociate(&rbt_rds);
-	}
+	CHECK(dns_view_findzone(view, name, &zone));
 
-	for (l = HEAD(*ldap_rdatalist);
-	     l != NULL;
-	     l = NEXT(l, link)) {
-		result = rdatalist_to_diff(mctx, DNS_DIFFOP_ADD, name, l, diff);
-		if (result != ISC_R_SUCCESS && result != ISC_R_NOMORE)
-			goto cleanup;
+	if (zone_isempty(zone) == ISC_TRUE) {
+		dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+		result = delete_bind_zone(view->zonetable, &zone);
+		if (result != ISC_R_SUCCESS)
+			log_error_r("unable to unload automatic empty zone "
+				    "%s", zone_name);
+		else
+			log_info("automatic empty zone %s unloaded",
+				 zone_name);
+	} else {
+		result = ISC_R_EXISTS;
 	}
-	if (result == ISC_R_NOMORE)
-		result = ISC_R_SUCCESS;
 
 cleanup:
+	if (zone != NULL)
+		dns_zone_detach(&zone);
 	return result;
 }
 
-/**
- * Process strictly minimal diff and detect if data were changed
- * and return latest SOA RR.
- *
- * @pre Input diff has to be minimal, i.e. it can't contain DEL & ADD operation
- *      for the same data under the same name and TTL.
- *
- * @pre If the tuple list contains SOA RR, then exactly one SOA RR deletion
- *      has to precede exactly one SOA RR addition.
- *      (Each SOA RR deletion has to have matching addition.)
- *
- * @param[in]	diff		Input diff. List of tuples can be empty.
- * @param[out]	soa_latest	Pointer to last added SOA RR from tuple list.
- *				Result can be NULL if there is no added SOA RR
- *				in the tuple list.
- * @param[out]	data_changed	ISC_TRUE if any data other than SOA serial were
- * 				changed. ISC_FALSE if nothing (except SOA
- * 				serial) was changed.
- *
- */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-diff_analyze_serial(dns_diff_t *diff, dns_difftuple_t **soa_latest,
-		    isc_boolean_t *data_changed) {
-	dns_difftuple_t *t = NULL;
-	dns_rdata_t *del_soa = NULL; /* last seen SOA with op == DEL */
-	dns_difftuple_t *tmp_tuple = NULL; /* tuple used for SOA comparison */
-	isc_result_t result = ISC_R_SUCCESS;
-	int ret;
-
-	REQUIRE(DNS_DIFF_VALID(diff));
-	REQUIRE(soa_latest != NULL && *soa_latest == NULL);
-	REQUIRE(data_changed != NULL);
-
-	*data_changed = ISC_FALSE;
-	for (t = HEAD(diff->tuples);
-	     t != NULL;
-	     t = NEXT(t, link)) {
-		INSIST(tmp_tuple == NULL);
-		if (t->rdata.type != dns_rdatatype_soa)
-			*data_changed = ISC_TRUE;
-		else { /* SOA is always special case */
-			if (t->op == DNS_DIFFOP_DEL ||
-			    t->op == DNS_DIFFOP_DELRESIGN) {
-				/* delete operation has to precede add */
-				INSIST(del_soa == NULL);
-				del_soa = &t->rdata;
-			} else if (t->op == DNS_DIFFOP_ADD ||
-				   t->op == DNS_DIFFOP_ADDRESIGN) {
-				/* add operation has to follow a delete */
-				*soa_latest = t;
+configure_paths(isc_mem_t *mctx, ldap_instance_t *inst, dns_zone_t *zone,
+		isc_boolean_t issecure) {
+	isc_result_t result;
+	ld_string_t *file_name = NULL;
+	ld_string_t *key_dir = NULL;
 
-				/* we are adding SOA without preceding delete
-				 * -> we are initializing new empty zone */
-				if (del_soa == NULL) {
-					*data_changed = ISC_TRUE;
-				} else if (*data_changed == ISC_FALSE) {
-					/* detect if fields other than serial
-					 * were changed (compute only if necessary) */
-					CHECK(dns_difftuple_copy(t, &tmp_tuple));
-					dns_soa_setserial(dns_soa_getserial(del_soa),
-							  &tmp_tuple->rdata);
-					ret = dns_rdata_compare(del_soa,
-								&tmp_tuple->rdata);
-					*data_changed = ISC_TF(ret != 0);
-				}
-				if (tmp_tuple != NULL)
-					dns_difftuple_free(&tmp_tuple);
-				/* re-start the SOA delete-add search cycle */
-				del_soa = NULL;
-			} else {
-				INSIST("unexpected diff: op != ADD || DEL"
-				       == NULL);
-			}
-		}
+	CHECK(zr_get_zone_path(mctx, ldap_instance_getsettings_local(inst),
+			       dns_zone_getorigin(zone),
+			       (issecure ? "signed" : "raw"), &file_name));
+	CHECK(dns_zone_setfile(zone, str_buf(file_name)));
+	if (issecure == ISC_TRUE) {
+		CHECK(zr_get_zone_path(mctx,
+				       ldap_instance_getsettings_local(inst),
+				       dns_zone_getorigin(zone), "keys/",
+				       &key_dir));
+		dns_zone_setkeydirectory(zone, str_buf(key_dir));
 	}
-	/* SOA deletions & additions has to create self-contained couples */
-	INSIST(del_soa == NULL && tmp_tuple == NULL);
+	CHECK(fs_file_remove(dns_zone_getfile(zone)));
+	CHECK(fs_file_remove(dns_zone_getjournal(zone)));
 
 cleanup:
-	if (tmp_tuple != NULL)
-		dns_difftuple_free(&tmp_tuple);
+	str_destroy(&file_name);
+	str_destroy(&key_dir);
 	return result;
 }
 
-/**
- * Replace SOA serial in LDAP for given zone.
- *
- * @param[in]	inst
- * @param[in]	zone	Zone name.
- * @param[in]	serial	New serial.
- *
+/*
+ * Create a new zone with origin 'name'. The zone will be added to the
+ * ldap_inst->view.
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_replace_serial(ldap_instance_t *inst, dns_name_t *zone,
-		    isc_uint32_t serial) {
+create_zone(ldap_instance_t * const inst, const char * const dn,
+	    dns_name_t * const name, dns_db_t * const ldapdb,
+	    const isc_boolean_t want_secure, dns_zone_t ** const rawp,
+	    dns_zone_t ** const securep)
+{
 	isc_result_t result;
-#define MAX_SERIAL_LENGTH sizeof("4294967295") /* SOA serial is isc_uint32_t */
-	char serial_char[MAX_SERIAL_LENGTH];
-	char *values[2] = { serial_char, NULL };
-	LDAPMod change;
-	LDAPMod *changep[2] = { &change, NULL };
-	ld_string_t *dn = NULL;
+	dns_zone_t *raw = NULL;
+	dns_zone_t *secure = NULL;
+	const char *ldap_argv[1] = { inst->db_name };
+	const char *rbt_argv[1] = { "rbt" };
+	sync_state_t sync_state;
+	sync_ctx_t *sctx;
+	isc_task_t *task = NULL;
+	char zone_name[DNS_NAME_FORMATSIZE];
 
 	REQUIRE(inst != NULL);
+	REQUIRE(name != NULL);
+	REQUIRE(rawp != NULL && *rawp == NULL);
 
-	CHECK(str_new(inst->mctx, &dn));
-	CHECK(dnsname_to_dn(inst->zone_register, zone, zone, dn));
-
-	change.mod_op = LDAP_MOD_REPLACE;
-	change.mod_type = "idnsSOAserial";
-	change.mod_values = values;
-	CHECK(isc_string_printf(serial_char, MAX_SERIAL_LENGTH, "%u", serial));
+	result = zone_unload_ifempty(inst->view, name);
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
+		goto cleanup;
 
-	CHECK(ldap_modify_do(inst, str_buf(dn), changep, ISC_FALSE));
+	CHECK(dns_zone_create(&raw, inst->mctx));
+	CHECK(dns_zone_setorigin(raw, name));
+	dns_zone_setclass(raw, dns_rdataclass_in);
+	dns_zone_settype(raw, dns_zone_master);
+	/* dns_zone_setview(raw, view); */
+	CHECK(dns_zone_setdbtype(raw, sizeof(ldap_argv)/sizeof(ldap_argv[0]),
+				 ldap_argv));
+	CHECK(configure_paths(inst->mctx, inst, raw, ISC_FALSE));
 
-cleanup:
-	str_destroy(&dn);
-	return result;
-#undef MAX_SERIAL_LENGTH
-}
+	if (want_secure == ISC_FALSE) {
+		CHECK(dns_zonemgr_managezone(inst->zmgr, raw));
+		CHECK(cleanup_zone_files(raw));
+	} else {
+		CHECK(dns_zone_create(&secure, inst->mctx));
+		CHECK(dns_zone_setorigin(secure, name));
+		dns_zone_setclass(secure, dns_rdataclass_in);
+		dns_zone_settype(secure, dns_zone_master);
+		/* dns_zone_setview(secure, view); */
+		CHECK(dns_zone_setdbtype(secure, 1, rbt_argv));
+		CHECK(dns_zonemgr_managezone(inst->zmgr, secure));
+		CHECK(dns_zone_link(secure, raw));
+		dns_zone_rekey(secure, ISC_TRUE);
+		CHECK(configure_paths(inst->mctx, inst, secure, ISC_TRUE));
+		CHECK(cleanup_zone_files(secure));
+	}
 
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-zone_master_reconfigure_nsec3param(settings_set_t *zone_settings,
-				   dns_zone_t *secure) {
-	isc_mem_t *mctx = NULL;
-	isc_result_t result;
-	dns_rdata_t *nsec3p_rdata = NULL;
-	dns_rdata_nsec3param_t nsec3p_rr;
-	dns_name_t *origin = NULL;
-	const char *nsec3p_str = NULL;
-	ldap_entry_t *fake_entry = NULL;
+	/* zone tasks have to be covered by the data barrier of the session
+	 * which reads the zone */
+	sctx = sync_ctx_for_dn(inst, dn);
+	sync_state_get(sctx, &sync_state);
+	if (sync_state == sync_datainit) {
+		dns_zone_gettask(raw, &task);
+		CHECK(sync_task_add(sctx, task));
+		isc_task_detach(&task);
 
-	REQUIRE(secure != NULL);
+		if (secure != NULL) {
+			dns_zone_gettask(secure, &task);
+			CHECK(sync_task_add(sctx, task));
+			isc_task_detach(&task);
+		}
+	}
 
-	mctx = dns_zone_getmctx(secure);
-	origin = dns_zone_getorigin(secure);
-	CHECK(ldap_entry_init(mctx, &fake_entry));
+	CHECK(zr_add_zone(inst->zone_register, ldapdb, raw, secure, dn));
 
-	CHECK(setting_get_str("nsec3param", zone_settings, &nsec3p_str));
-	dns_zone_log(secure, ISC_LOG_INFO,
-		     "reconfiguring NSEC3PARAM to '%s'", nsec3p_str);
-	CHECK(parse_rdata(mctx, fake_entry, dns_rdataclass_in,
-			  dns_rdatatype_nsec3param, origin, nsec3p_str,
-			  &nsec3p_rdata));
-	CHECK(dns_rdata_tostruct(nsec3p_rdata, &nsec3p_rr, NULL));
-	CHECK(dns_zone_setnsec3param(secure, nsec3p_rr.hash, nsec3p_rr.flags,
-				     nsec3p_rr.iterations,
-				     nsec3p_rr.salt_length, nsec3p_rr.salt,
-				     ISC_TRUE));
+	*rawp = raw;
+	*securep = secure;
+	return ISC_R_SUCCESS;
 
 cleanup:
-	if (nsec3p_rdata != NULL) {
-		isc_mem_put(mctx, nsec3p_rdata->data, nsec3p_rdata->length);
-		SAFE_MEM_PUT_PTR(mctx, nsec3p_rdata);
+	dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+	log_error_r("failed to create new zone '%s'", zone_name);
+
+	if (raw != NULL) {
+		if (dns_zone_getmgr(raw) != NULL)
+			dns_zonemgr_releasezone(inst->zmgr, raw);
+		dns_zone_detach(&raw);
 	}
-	if (fake_entry != NULL)
-		ldap_entry_destroy(&fake_entry);
+	if (task != NULL)
+		isc_task_detach(&task);
+
 	return result;
 }
 
 /**
- * Reconfigure master zone according to configuration in LDAP object.
- *
- * @param[in]  raw Raw zone backed by LDAP database. In-line secure zone
- *                 will be reconfigured as necessary.
+ * @warning Never call this on raw part of in-line secure zone.
  */
-static isc_result_t ATTR_NONNULL(1,2,3,5) ATTR_CHECKRESULT
-zone_master_reconfigure(ldap_entry_t *entry, settings_set_t *zone_settings,
-			dns_zone_t *raw, dns_zone_t *secure, isc_task_t *task) {
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+load_zone(dns_zone_t *zone, isc_boolean_t log) {
 	isc_result_t result;
-	ldap_valuelist_t values;
-	isc_mem_t *mctx = NULL;
-	isc_boolean_t ssu_changed;
-	dns_zone_t *inview = NULL;
-
-	REQUIRE(entry != NULL);
-	REQUIRE(zone_settings != NULL);
-	REQUIRE(raw != NULL);
-	REQUIRE(task != NULL);
-
-	mctx = dns_zone_getmctx(raw);
-
-	if (secure != NULL)
-		dns_zone_attach(secure, &inview);
-	else
-		dns_zone_attach(raw, &inview);
+	isc_boolean_t zone_dynamic;
+	isc_uint32_t serial;
+	dns_zone_t *raw = NULL;
 
-	result = setting_update_from_ldap_entry("dyn_update", zone_settings,
-						"idnsAllowDynUpdate", entry);
-	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
+	result = dns_zone_load(zone);
+	if (result != ISC_R_SUCCESS && result != DNS_R_UPTODATE
+	    && result != DNS_R_DYNAMIC && result != DNS_R_CONTINUE)
 		goto cleanup;
-	ssu_changed = (result == ISC_R_SUCCESS);
+	zone_dynamic = (result == DNS_R_DYNAMIC);
 
-	result = setting_update_from_ldap_entry("sync_ptr", zone_settings,
-				       "idnsAllowSyncPTR", entry);
-	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
-		goto cleanup;
+	dns_zone_getraw(zone, &raw);
+	if (raw == NULL) {
+		dns_zone_attach(zone, &raw);
+		zone = NULL;
+	}
 
-	result = setting_update_from_ldap_entry("default_ttl", zone_settings,
-					        "DNSdefaultTTL", entry);
+	CHECK(dns_zone_getserial2(raw, &serial));
+	if (log == ISC_TRUE)
+		dns_zone_log(raw, ISC_LOG_INFO, "loaded serial %u", serial);
+	if (zone != NULL) {
+		result = dns_zone_getserial2(zone, &serial);
+		if (result == ISC_R_SUCCESS && log == ISC_TRUE)
+			dns_zone_log(zone, ISC_LOG_INFO, "loaded serial %u",
+				     serial);
+		/* in-line secure zone is loaded asynchonously in background */
+		else if (result == DNS_R_NOTLOADED) {
+			if (log == ISC_TRUE)
+				dns_zone_log(zone, ISC_LOG_INFO,
+					     "signing in progress");
+			result = ISC_R_SUCCESS;
+		} else
+			goto cleanup;
+	}
+
+	if (zone_dynamic)
+		dns_zone_notify((zone != NULL) ? zone : raw);
+
+cleanup:
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	return result;
+}
+
+/**
+ * Add zone to the view defined in inst->view.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+publish_zone(isc_task_t *task, ldap_instance_t *inst, dns_zone_t *zone)
+{
+	isc_result_t result;
+	isc_boolean_t freeze = ISC_FALSE;
+	dns_zone_t *zone_in_view = NULL;
+	dns_view_t *view_in_zone = NULL;
+	isc_result_t lock_state = ISC_R_IGNORE;
+
+	REQUIRE(ISCAPI_TASK_VALID(task));
+	REQUIRE(inst != NULL);
+	REQUIRE(zone != NULL);
+
+	/* Return success if the zone is already in the view as expected. */
+	result = dns_view_findzone(inst->view, dns_zone_getorigin(zone),
+				   &zone_in_view);
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
+		goto cleanup;
+
+	view_in_zone = dns_zone_getview(zone);
+	if (view_in_zone != NULL) {
+		/* Zone has a view set -> view should contain the same zone. */
+		if (zone_in_view == zone) {
+			/* Zone is already published in the right view. */
+			CLEANUP_WITH(ISC_R_SUCCESS);
+		} else if (view_in_zone != inst->view) {
+			/* Un-published inactive zone will have
+			 * inst->view in zone but will not be present
+			 * in the view itself. */
+			dns_zone_log(zone, ISC_LOG_ERROR, "zone->view doesn't "
+				     "match data in the view");
+			CLEANUP_WITH(ISC_R_UNEXPECTED);
+		}
+	}
+	if (zone_in_view != NULL) {
+		dns_zone_log(zone, ISC_LOG_ERROR, "cannot publish zone: view "
+			     "already contains another zone with this name");
+		CLEANUP_WITH(ISC_R_UNEXPECTED);
+	} /* else if (zone_in_view == NULL &&
+		      (view_in_zone == NULL || view_in_zone == inst->view))
+	     Publish the zone. */
+
+	run_exclusive_enter(inst, &lock_state);
+	if (inst->view->frozen) {
+		freeze = ISC_TRUE;
+		dns_view_thaw(inst->view);
+	}
+
+	dns_zone_setview(zone, inst->view);
+	CHECK(dns_view_addzone(inst->view, zone));
+
+cleanup:
+	if (zone_in_view != NULL)
+		dns_zone_detach(&zone_in_view);
+	if (freeze)
+		dns_view_freeze(inst->view);
+	run_exclusive_exit(inst, lock_state);
 	if (result == ISC_R_SUCCESS)
-		log_bug("default TTL cannot be changed at run-time");
-	else if (result != ISC_R_IGNORE)
+		mirror_zone_publish(inst, zone);
+
+	return result;
+}
+
+/**
+ * Get MNAME which follower uses in SOA records instead of the value
+ * from data source, see option fake_mname.
+ *
+ * @retval ISC_R_SUCCESS MNAME is in mname.
+ * @retval ISC_R_IGNORE  Option is not set, SOA from data source is used as-is.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+mirror_mname_get(ldap_instance_t *follower, dns_name_t *origin,
+		 dns_name_t *mname)
+{
+	isc_result_t result;
+	const char *fake_mname = NULL;
+
+	CHECK(setting_get_str(SETTING_FAKE_MNAME,
+			      follower->server_ldap_settings, &fake_mname));
+	if (strlen(fake_mname) == 0)
+		CLEANUP_WITH(ISC_R_IGNORE);
+	CHECK(dns_name_fromstring2(mname, fake_mname, origin, 0, NULL));
+
+cleanup:
+	return result;
+}
+
+/**
+ * Zone database can be shared with data source only if data in both views
+ * are identical. The only difference can be caused by option fake_mname
+ * of the follower which changes MNAME in SOA record.
+ *
+ * @param[out] copyp ISC_TRUE if follower needs its own copy of the database.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+mirror_needs_copy(ldap_instance_t *follower, dns_name_t *name,
+		  dns_db_t *srcdb, isc_boolean_t *copyp)
+{
+	isc_result_t result;
+	dns_dbversion_t *version = NULL;
+	dns_fixedname_t mname;
+	dns_diff_t diff;
+
+	dns_diff_init(follower->mctx, &diff);
+	*copyp = ISC_FALSE;
+
+	dns_fixedname_init(&mname);
+	result = mirror_mname_get(follower, name, dns_fixedname_name(&mname));
+	if (result == ISC_R_IGNORE)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	else if (result != ISC_R_SUCCESS)
 		goto cleanup;
 
-	result = setting_update_from_ldap_entry("update_policy", zone_settings,
-						"idnsUpdatePolicy", entry);
-	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
+	dns_db_currentversion(srcdb, &version);
+	result = zone_soamname_addtuple(follower->mctx, srcdb, version,
+					dns_fixedname_name(&mname), &diff);
+	if (result == ISC_R_SUCCESS)
+		*copyp = ISC_TRUE;
+	else if (result == ISC_R_IGNORE)
+		result = ISC_R_SUCCESS;
+
+cleanup:
+	dns_diff_clear(&diff);
+	if (version != NULL)
+		dns_db_closeversion(srcdb, &version, ISC_FALSE);
+	return result;
+}
+
+/**
+ * Bring copy of zone database owned by follower up-to-date with the zone
+ * database in data source. The copy differs only in MNAME field of SOA
+ * record, see mirror_needs_copy(). Shared database is left intact.
+ *
+ * The whole zone is compared so the copy is refreshed only if SOA serial
+ * in the data source differs from serial in the copy.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+mirror_copy_refresh(ldap_instance_t *follower, dns_name_t *name,
+		    dns_db_t *srcdb)
+{
+	isc_result_t result;
+	dns_db_t *ldapdb = NULL;
+	dns_db_t *rbtdb = NULL;
+	dns_dbversion_t *srcversion = NULL;
+	dns_dbversion_t *version = NULL;
+	dns_zone_t *raw = NULL;
+	dns_fixedname_t mname;
+	dns_diff_t diff;
+	isc_uint32_t src_serial;
+	isc_uint32_t serial;
+
+	dns_diff_init(follower->mctx, &diff);
+
+	CHECK(zr_get_zone_dbs(follower->zone_register, name, &ldapdb, &rbtdb));
+	if (ldapdb == srcdb)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+
+	dns_db_currentversion(srcdb, &srcversion);
+	CHECK(dns_db_getsoaserial(srcdb, srcversion, &src_serial));
+	if (dns_db_getsoaserial(rbtdb, NULL, &serial) == ISC_R_SUCCESS
+	    && serial == src_serial)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+
+	CHECK(dns_db_newversion(ldapdb, &version));
+	/* diff transforms the copy into data from data source */
+	CHECK(dns_db_diffx(&diff, ldapdb_get_rbtdb(srcdb), srcversion,
+			   rbtdb, version, NULL));
+	CHECK(dns_diff_apply(&diff, rbtdb, version));
+	dns_diff_clear(&diff);
+
+	dns_fixedname_init(&mname);
+	result = mirror_mname_get(follower, name, dns_fixedname_name(&mname));
+	if (result == ISC_R_SUCCESS) {
+		result = zone_soamname_addtuple(follower->mctx, rbtdb, version,
+						dns_fixedname_name(&mname),
+						&diff);
+		if (result == ISC_R_SUCCESS)
+			CHECK(dns_diff_apply(&diff, rbtdb, version));
+		else if (result != ISC_R_IGNORE)
+			goto cleanup;
+	} else if (result != ISC_R_IGNORE) {
 		goto cleanup;
+	}
+	dns_db_closeversion(ldapdb, &version, ISC_TRUE);
 
-	if (result == ISC_R_SUCCESS || ssu_changed) {
-		isc_boolean_t ssu_enabled;
-		const char *ssu_policy = NULL;
-
-		CHECK(setting_get_bool("dyn_update", zone_settings, &ssu_enabled));
-		if (ssu_enabled) {
-			/* Get the update policy and update the zone with it. */
-			CHECK(setting_get_str("update_policy", zone_settings,
-					      &ssu_policy));
-			dns_zone_log(raw, ISC_LOG_DEBUG(2),
-				     "setting update-policy to '%s'",
-				     ssu_policy);
-			CHECK(configure_zone_ssutable(raw, ssu_policy));
-		} else {
-			/* Empty policy will prevent the update from reaching
-			 * LDAP driver and error will be logged. */
-			dns_zone_log(raw, ISC_LOG_DEBUG(2),
-				     "update-policy is not set");
-			CHECK(configure_zone_ssutable(raw, ""));
+	if (zr_get_zone_ptr(follower->zone_register, name, &raw, NULL)
+	    == ISC_R_SUCCESS)
+		dns_zone_markdirty(raw);
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	dns_diff_clear(&diff);
+	/* rollback */
+	if (version != NULL)
+		dns_db_closeversion(ldapdb, &version, ISC_FALSE);
+	if (srcversion != NULL)
+		dns_db_closeversion(srcdb, &srcversion, ISC_FALSE);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	if (rbtdb != NULL)
+		dns_db_detach(&rbtdb);
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+	return result;
+}
+
+/**
+ * Publish zone from data source in view of a follower instance.
+ * The follower has its own zone object so ACLs and forwarding configured
+ * in its view apply. Zone database is shared with the data source as long
+ * as data in both views are identical, otherwise the follower gets its own
+ * copy which is refreshed after each change, see mirror_copy_refresh().
+ *
+ * Runs in task of the follower instance.
+ */
+static void ATTR_NONNULLS
+follower_zone_publish(isc_task_t *task, isc_event_t *event)
+{
+	ldap_mirrorev_t *mevent = (ldap_mirrorev_t *)event;
+	ldap_instance_t *follower = mevent->follower;
+	dns_name_t *name = dns_fixedname_name(&mevent->name);
+	isc_result_t result;
+	dns_zone_t *mirror = NULL;
+	isc_boolean_t copy;
+	const char *ldap_argv[1];
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	if (!follower_isattached(follower, mevent->source)
+	    || follower->exiting == ISC_TRUE)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+
+	result = zr_get_zone_ptr(follower->zone_register, name, &mirror, NULL);
+	if (result == ISC_R_NOTFOUND || result == DNS_R_PARTIALMATCH) {
+		result = zone_unload_ifempty(follower->view, name);
+		if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
+			goto cleanup;
+
+		CHECK(mirror_needs_copy(follower, name, mevent->ldapdb, &copy));
+		/* dns_db_create() will attach the database from zone register
+		 * of the data source or of the follower itself */
+		ldap_argv[0] = (copy == ISC_TRUE) ? follower->db_name
+						  : mevent->source->db_name;
+		CHECK(dns_zone_create(&mirror, follower->mctx));
+		CHECK(dns_zone_setorigin(mirror, name));
+		dns_zone_setclass(mirror, dns_rdataclass_in);
+		dns_zone_settype(mirror, dns_zone_master);
+		CHECK(dns_zone_setdbtype(mirror, 1, ldap_argv));
+		CHECK(dns_zonemgr_managezone(follower->zmgr, mirror));
+		/* NULL database means a new empty copy */
+		result = zr_add_zone(follower->zone_register,
+				     (copy == ISC_TRUE) ? NULL : mevent->ldapdb,
+				     mirror, NULL, mevent->dn);
+		if (result != ISC_R_SUCCESS) {
+			dns_zonemgr_releasezone(follower->zmgr, mirror);
+			goto cleanup;
 		}
+	} else if (result != ISC_R_SUCCESS) {
+		goto cleanup;
 	}
 
-	/* Fetch allow-query and allow-transfer ACLs */
-	result = ldap_entry_getvalues(entry, "idnsAllowQuery", &values);
-	if (result == ISC_R_SUCCESS) {
-		dns_zone_log(inview, ISC_LOG_DEBUG(2),
-			     "setting allow-query to '%s'",
-			     HEAD(values)->value);
-		CHECK(configure_zone_acl(mctx, inview, &dns_zone_setqueryacl,
-					 HEAD(values)->value, acl_type_query));
-	} else {
-		dns_zone_log(inview, ISC_LOG_DEBUG(2), "allow-query is not set");
-		dns_zone_clearqueryacl(raw);
+	CHECK(mirror_copy_refresh(follower, name, mevent->ldapdb));
+	CHECK(publish_zone(task, follower, mirror));
+	CHECK(load_zone(mirror, ISC_FALSE));
+
+cleanup:
+	if (result != ISC_R_SUCCESS) {
+		dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+		log_error_r("zone '%s': publication for instance '%s' failed",
+			    zone_name, follower->db_name);
 	}
+	if (mirror != NULL)
+		dns_zone_detach(&mirror);
+	mirror_event_free(&mevent);
+}
 
-	result = ldap_entry_getvalues(entry, "idnsAllowTransfer", &values);
-	if (result == ISC_R_SUCCESS) {
-		dns_zone_log(inview, ISC_LOG_DEBUG(2),
-			     "setting allow-transfer to '%s'",
-			     HEAD(values)->value);
-		CHECK(configure_zone_acl(mctx, inview, &dns_zone_setxfracl,
-					 HEAD(values)->value, acl_type_transfer));
-	} else {
-		dns_zone_log(inview, ISC_LOG_DEBUG(2),
-			     "allow-transfer is not set");
-		dns_zone_clearxfracl(raw);
-		result = ISC_R_SUCCESS;
+/**
+ * Remove zone from view of a follower instance. The data source might be
+ * gone already but the zone has to be removed anyway.
+ *
+ * Runs in task of the follower instance.
+ */
+static void ATTR_NONNULLS
+follower_zone_delete(isc_task_t *task, isc_event_t *event)
+{
+	ldap_mirrorev_t *mevent = (ldap_mirrorev_t *)event;
+	ldap_instance_t *follower = mevent->follower;
+	dns_name_t *name = dns_fixedname_name(&mevent->name);
+	isc_result_t result;
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	UNUSED(task);
+
+	if (!follower_isattached(follower, NULL)
+	    || follower->exiting == ISC_TRUE)
+		goto cleanup;
+
+	result = ldap_delete_zone2(follower, name, ISC_TRUE);
+	if (result != ISC_R_SUCCESS) {
+		dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+		log_error_r("zone '%s': removal from instance '%s' failed",
+			    zone_name, follower->db_name);
 	}
 
-	if (secure != NULL) {
-		/* notifications should be sent from secure zone only */
-		dns_zone_setnotifytype(raw, dns_notifytype_no);
+cleanup:
+	mirror_event_free(&mevent);
+}
 
-		/* Magic constants are taken from zoneconf.c */
-		/* sig-validity-interval */
-		dns_zone_setsigvalidityinterval(secure, 2592000);
+/**
+ * Apply change in data source to copy of the zone owned by follower.
+ *
+ * Runs in task of the follower instance.
+ */
+static void ATTR_NONNULLS
+follower_zone_refresh(isc_task_t *task, isc_event_t *event)
+{
+	ldap_mirrorev_t *mevent = (ldap_mirrorev_t *)event;
+	ldap_instance_t *follower = mevent->follower;
+	dns_name_t *name = dns_fixedname_name(&mevent->name);
+	isc_result_t result;
+	char zone_name[DNS_NAME_FORMATSIZE];
 
-		/* re-sign */
-		dns_zone_setsigresigninginterval(secure, 648000);
+	UNUSED(task);
 
-		/* sig-signing-signatures */
-		dns_zone_setsignatures(secure, 10);
+	if (!follower_isattached(follower, mevent->source)
+	    || follower->exiting == ISC_TRUE)
+		goto cleanup;
 
-		/* sig-signing-nodes */
-		dns_zone_setnodes(secure, 10);
+	result = mirror_copy_refresh(follower, name, mevent->ldapdb);
+	/* zone might have been removed in the meantime */
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND
+	    && result != DNS_R_PARTIALMATCH) {
+		dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+		log_error_r("zone '%s': copy in instance '%s' is outdated, "
+			    "run `rndc reload`", zone_name, follower->db_name);
+	}
 
-		/* sig-signing-type */
-		dns_zone_setprivatetype(secure, 65534);
+cleanup:
+	mirror_event_free(&mevent);
+}
 
-		/* update-check-ksk */
-		dns_zone_setoption(secure, DNS_ZONEOPT_UPDATECHECKKSK, ISC_TRUE);
+/**
+ * Publish zone in views of all instances which use this instance
+ * as data source. Only events are sent while instances_lock is held,
+ * the views are modified by tasks of the followers.
+ */
+static void
+mirror_zone_publish(ldap_instance_t *inst, dns_zone_t *zone)
+{
+	isc_result_t result;
+	ldap_instance_t *follower;
+
+	/* followers cannot have followers */
+	if (inst->data_source != NULL)
+		return;
+
+	LOCK(&instances_lock);
+	for (follower = HEAD(inst->followers);
+	     follower != NULL;
+	     follower = NEXT(follower, follower_link)) {
+		result = mirror_zone_send(inst, follower,
+					  dns_zone_getorigin(zone));
+		if (result != ISC_R_SUCCESS)
+			dns_zone_log(zone, ISC_LOG_ERROR, "publication for "
+				     "instance '%s' failed: %s",
+				     follower->db_name,
+				     isc_result_totext(result));
+	}
+	UNLOCK(&instances_lock);
+}
+
+/**
+ * Remove zone from views of all instances which use this instance
+ * as data source.
+ */
+static void ATTR_NONNULLS
+mirror_zone_delete(ldap_instance_t *inst, dns_name_t *name)
+{
+	isc_result_t result;
+	ldap_instance_t *follower;
+	dns_zone_t *mirror = NULL;
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	/* followers cannot have followers */
+	if (inst->data_source != NULL)
+		return;
+
+	LOCK(&instances_lock);
+	for (follower = HEAD(inst->followers);
+	     follower != NULL;
+	     follower = NEXT(follower, follower_link)) {
+		result = zr_get_zone_ptr(follower->zone_register, name,
+					 &mirror, NULL);
+		if (result != ISC_R_SUCCESS)
+			continue;
+		dns_zone_detach(&mirror);
+		result = mirror_event_send(inst, follower, name,
+					   follower_zone_delete, NULL, NULL);
+		if (result != ISC_R_SUCCESS) {
+			dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+			log_error_r("zone '%s': removal from instance '%s' "
+				    "failed", zone_name, follower->db_name);
+		}
+	}
+	UNLOCK(&instances_lock);
+}
+
+/**
+ * Refresh copies of zone database owned by followers after a change
+ * of the zone in this instance. Followers which share the database
+ * with this instance see the change immediately.
+ *
+ * Called by LDAP database driver for each committed version.
+ */
+void
+ldap_zone_mirror_update(ldap_instance_t *inst, dns_name_t *name)
+{
+	isc_result_t result;
+	ldap_instance_t *follower;
+	dns_db_t *ldapdb = NULL;
+	dns_db_t *copydb = NULL;
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	/* followers cannot have followers */
+	if (inst->data_source != NULL)
+		return;
+
+	LOCK(&instances_lock);
+	for (follower = HEAD(inst->followers);
+	     follower != NULL;
+	     follower = NEXT(follower, follower_link)) {
+		if (zr_get_zone_dbs(follower->zone_register, name, &copydb,
+				    NULL) != ISC_R_SUCCESS)
+			continue;
+		if (ldapdb == NULL
+		    && zr_get_zone_dbs(inst->zone_register, name, &ldapdb,
+				       NULL) != ISC_R_SUCCESS) {
+			dns_db_detach(&copydb);
+			break;
+		}
+		if (copydb != ldapdb) {
+			result = mirror_event_send(inst, follower, name,
+						   follower_zone_refresh,
+						   ldapdb, NULL);
+			if (result != ISC_R_SUCCESS) {
+				dns_name_format(name, zone_name,
+						DNS_NAME_FORMATSIZE);
+				log_error_r("zone '%s': copy in instance '%s' "
+					    "is outdated, run `rndc reload`",
+					    zone_name, follower->db_name);
+			}
+		}
+		dns_db_detach(&copydb);
+	}
+	UNLOCK(&instances_lock);
+
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+}
+
+#define LDAPDB_EVENT_INSTANCE_REBIND	(LDAPDB_EVENTCLASS + 10)
+#define LDAPDB_EVENT_INSTANCE_REAP	(LDAPDB_EVENTCLASS + 11)
+
+typedef struct ldap_rebindev ldap_rebindev_t;
+struct ldap_rebindev {
+	ISC_EVENT_COMMON(ldap_rebindev_t);
+	dns_view_t		*view;
+};
+
+/**
+ * Move zones and forwarding configuration of an instance adopted after
+ * reload from the old view to the new one. Zones are published in the new
+ * view only if they were published in the old view, inactive zones only
+ * get the new view assigned.
+ *
+ * The view is switched in exclusive mode so no other event can see
+ * a zone with view different from inst->view.
+ */
+static void ATTR_NONNULLS
+instance_rebind(isc_task_t *task, isc_event_t *event)
+{
+	ldap_rebindev_t *pevent = (ldap_rebindev_t *)event;
+	ldap_instance_t *inst = pevent->ev_arg;
+	ldap_instance_t *adopted;
+	isc_result_t result;
+	isc_result_t lock_state = ISC_R_IGNORE;
+	dns_view_t *oldview = NULL;
+	dns_forwarders_t *named_conf_forwarders = NULL;
+	rbt_iterator_t *iter = NULL;
+	DECLARE_BUFFERED_NAME(name);
+	dns_zone_t *raw = NULL;
+	dns_zone_t *secure = NULL;
+	dns_zone_t *toview = NULL;
+	dns_zone_t *zone_in_view = NULL;
+	settings_set_t *zone_settings;
+	isc_boolean_t published;
+	unsigned int zone_cnt = 0;
+	unsigned int fwd_cnt = 0;
+	unsigned int fail_cnt = 0;
+
+	/* instance might have been parked or destroyed again */
+	LOCK(&instances_lock);
+	for (adopted = HEAD(instances);
+	     adopted != NULL && adopted != inst;
+	     adopted = NEXT(adopted, link))
+		;
+	UNLOCK(&instances_lock);
+	if (adopted == NULL)
+		goto cleanup;
+
+	run_exclusive_enter(inst, &lock_state);
+	oldview = inst->view;
+	inst->view = pevent->view;
+	pevent->view = NULL;
+
+	INIT_BUFFERED_NAME(name);
+	for (result = zr_rbt_iter_init(inst->zone_register, &iter, &name);
+	     result == ISC_R_SUCCESS;
+	     dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
+		if (zr_get_zone_ptr(inst->zone_register, &name, &raw,
+				    &secure) != ISC_R_SUCCESS)
+			continue;
+		toview = (secure != NULL) ? secure : raw;
+		published = ISC_TF(dns_view_findzone(oldview, &name,
+						     &zone_in_view)
+				   == ISC_R_SUCCESS && zone_in_view == toview);
+
+		dns_zone_setview(raw, inst->view);
+		if (secure != NULL)
+			dns_zone_setview(secure, inst->view);
+		if (published == ISC_TRUE) {
+			result = zone_unload_ifempty(inst->view, &name);
+			if (result == ISC_R_SUCCESS || result == ISC_R_NOTFOUND)
+				result = publish_zone(task, inst, toview);
+			if (result == ISC_R_SUCCESS) {
+				zone_cnt++;
+			} else {
+				dns_zone_log(toview, ISC_LOG_ERROR,
+					     "cannot move zone to the new "
+					     "view: %s",
+					     dns_result_totext(result));
+				fail_cnt++;
+			}
+			zone_settings = NULL;
+			result = zr_get_zone_settings(inst->zone_register,
+						      &name, &zone_settings);
+			if (result == ISC_R_SUCCESS)
+				result = fwd_configure_zone(zone_settings,
+							    inst, &name);
+			if (result != ISC_R_SUCCESS)
+				dns_zone_log(toview, ISC_LOG_ERROR,
+					     "cannot configure forwarders "
+					     "in the new view: %s",
+					     dns_result_totext(result));
+		}
+		/* records dropped to zone directory since the last reload */
+		if (zone_import_spool(inst, &name) != ISC_R_SUCCESS)
+			dns_zone_log(raw, ISC_LOG_ERROR,
+				     "cannot schedule import of records");
+
+		if (zone_in_view != NULL)
+			dns_zone_detach(&zone_in_view);
+		dns_zone_detach(&raw);
+		if (secure != NULL)
+			dns_zone_detach(&secure);
+	}
+
+	/* LDAP forward zones */
+	INIT_BUFFERED_NAME(name);
+	for (result = fwdr_rbt_iter_init(inst->fwd_register, &iter, &name);
+	     result == ISC_R_SUCCESS;
+	     dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
+		/* fwd_copy_zone() logs the failure with zone name */
+		if (fwd_copy_zone(oldview, inst->view, &name)
+		    == ISC_R_SUCCESS)
+			fwd_cnt++;
+		else
+			fail_cnt++;
+	}
+
+	/* named.conf might have changed, LDAP config has higher priority */
+	result = named_conf_forwarders_load(inst, &named_conf_forwarders);
+	if (result == ISC_R_SUCCESS && named_conf_forwarders != NULL)
+		result = empty_zone_handle_conflicts(dns_rootname,
+						     inst->view->zonetable,
+						     (named_conf_forwarders->fwdpolicy
+						      == dns_fwdpolicy_first));
+	if (result == ISC_R_SUCCESS)
+		result = fwd_reconfig_global(inst);
+	if (result != ISC_R_SUCCESS)
+		log_error_r("global forwarders could not be configured "
+			    "in the new view");
+
+	if (fail_cnt > 0)
+		log_error("LDAP instance '%s': %u zones could not be moved "
+			  "to the new view, run `rndc reload`",
+			  inst->db_name, fail_cnt);
+	log_info("LDAP instance '%s': %u zones and %u forward zones moved "
+		 "to the new view", inst->db_name, zone_cnt, fwd_cnt);
+
+cleanup:
+	if (iter != NULL)
+		rbt_iter_stop(&iter);
+	run_exclusive_exit(inst, lock_state);
+	if (oldview != NULL)
+		dns_view_detach(&oldview);
+	if (pevent->view != NULL)
+		dns_view_detach(&pevent->view);
+	isc_event_free(&event);
+}
+
+/**
+ * Destroy parked instance which was not adopted during reload.
+ */
+static void ATTR_NONNULLS
+parked_instance_reap(isc_task_t *task, isc_event_t *event)
+{
+	ldap_instance_t *inst = event->ev_arg;
+	ldap_instance_t *parked_inst;
+
+	UNUSED(task);
+
+	isc_event_free(&event);
+
+	/* only pointers are compared, the instance might not exist anymore */
+	LOCK(&instances_lock);
+	for (parked_inst = HEAD(parked);
+	     parked_inst != NULL && parked_inst != inst;
+	     parked_inst = NEXT(parked_inst, link))
+		;
+	if (parked_inst != NULL)
+		UNLINK(parked, parked_inst, link);
+	UNLOCK(&instances_lock);
+
+	if (parked_inst != NULL) {
+		log_info("LDAP instance '%s' is not configured anymore",
+			 parked_inst->db_name);
+		destroy_ldap_instance(&parked_inst);
+	}
+}
+
+/**
+ * Reuse instance kept by park_ldap_instance() if it has the same name,
+ * the same parameters and its view has the same name. All zones,
+ * SyncRepl sessions and LDAP connections are kept, zones are moved
+ * to the new view by instance_rebind().
+ *
+ * Parked instance with the same name and different configuration
+ * is destroyed so the new instance can register database implementation
+ * with the same name.
+ *
+ * @retval ISC_R_SUCCESS	Parked instance was adopted.
+ * @retval ISC_R_NOTFOUND	New instance has to be created.
+ */
+static isc_result_t
+parked_instance_adopt(const char *db_name, const char *parameters,
+		      const dns_dyndbctx_t *dctx, ldap_instance_t **ldap_instp)
+{
+	isc_result_t result;
+	ldap_instance_t *inst;
+	ldap_rebindev_t *pevent = NULL;
+
+	LOCK(&instances_lock);
+	for (inst = HEAD(parked);
+	     inst != NULL && strcmp(inst->db_name, db_name) != 0;
+	     inst = NEXT(inst, link))
+		;
+	if (inst != NULL)
+		UNLINK(parked, inst, link);
+	UNLOCK(&instances_lock);
+	if (inst == NULL)
+		return ISC_R_NOTFOUND;
+
+	if (strcmp(inst->parameters, parameters) != 0
+	    || strcmp(inst->view->name, dctx->view->name) != 0
+	    || inst->zmgr != dctx->zmgr || inst->task != dctx->task) {
+		log_info("configuration of LDAP instance '%s' was changed, "
+			 "all data will be reloaded", db_name);
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+	}
+
+	pevent = (ldap_rebindev_t *)isc_event_allocate(inst->mctx, inst,
+				LDAPDB_EVENT_INSTANCE_REBIND,
+				instance_rebind, inst,
+				sizeof(ldap_rebindev_t));
+	if (pevent == NULL) {
+		log_error("LDAP instance '%s' cannot be reused: %s",
+			  db_name, isc_result_totext(ISC_R_NOMEMORY));
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+	}
+	pevent->view = NULL;
+	dns_view_attach(dctx->view, &pevent->view);
+
+	LOCK(&instances_lock);
+	APPEND(instances, inst, link);
+	UNLOCK(&instances_lock);
+	isc_task_send(inst->task, (isc_event_t **)&pevent);
+
+	log_info("LDAP instance '%s' was not changed, data loaded before "
+		 "reload will be used", db_name);
+	*ldap_instp = inst;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	destroy_ldap_instance(&inst);
+	return result;
+}
+
+/**
+ * Release instance when BIND is reloaded or shut down.
+ *
+ * During reload the instance is not destroyed immediately but it is kept
+ * running with all zones, SyncRepl sessions and LDAP connections so
+ * new_ldap_instance() can adopt it if the configuration was not changed.
+ * Instances which were not adopted are destroyed when BIND leaves
+ * the exclusive mode used for reload.
+ *
+ * Tainted instances and instances with option data_source are always
+ * destroyed.
+ */
+void
+park_ldap_instance(ldap_instance_t **ldap_instp)
+{
+	ldap_instance_t *ldap_inst;
+	isc_event_t *event = NULL;
+
+	REQUIRE(ldap_instp != NULL);
+
+	ldap_inst = *ldap_instp;
+	if (ldap_inst == NULL)
+		return;
+
+	/* isc_task_exiting() is true only during server shutdown */
+	if (isc_task_exiting(ldap_inst->task) == ISC_TRUE
+	    || ldap_inst->watcher == 0 || ldap_inst->data_source != NULL
+	    || isc_refcount_current(&ldap_inst->errors) != 0) {
+		destroy_ldap_instance(ldap_instp);
+		return;
+	}
+
+	event = isc_event_allocate(ldap_inst->mctx, ldap_inst,
+				   LDAPDB_EVENT_INSTANCE_REAP,
+				   parked_instance_reap, ldap_inst,
+				   sizeof(isc_event_t));
+	if (event == NULL) {
+		destroy_ldap_instance(ldap_instp);
+		return;
+	}
+
+	LOCK(&instances_lock);
+	if (ISC_LINK_LINKED(ldap_inst, link))
+		UNLINK(instances, ldap_inst, link);
+	APPEND(parked, ldap_inst, link);
+	UNLOCK(&instances_lock);
+	isc_task_send(ldap_inst->task, &event);
+
+	log_debug(1, "LDAP instance '%s' kept running during reload",
+		  ldap_inst->db_name);
+	*ldap_instp = NULL;
+}
+
+#define LDAPDB_EVENT_ZONE_ACTIVATE	(LDAPDB_EVENTCLASS + 7)
+
+/** Minimal interval between two progress reports from zone activation. */
+#define ZONE_ACTIVATION_REPORT_INTERVAL	10
+
+/**
+ * Progress of activate_zones(). Zones are published to the view
+ * sequentially but loaded in parallel on their own tasks.
+ * Structure is freed by the last zone loaded.
+ */
+typedef struct zone_activation {
+	isc_mem_t	*mctx;
+	ldap_instance_t	*inst;
+	isc_mutex_t	lock;		/**< guards rest of the structure */
+	unsigned int	refs;		/**< outstanding events + the sender */
+	unsigned int	total_cnt;	/**< all zones in zone register */
+	unsigned int	active_cnt;	/**< zones which should be loaded */
+	unsigned int	done_cnt;	/**< zones which finished loading */
+	unsigned int	published_cnt;	/**< zones loaded successfully */
+	isc_time_t	start;
+	isc_time_t	last_report;
+} zone_activation_t;
+
+typedef struct ldap_zoneactivateev ldap_zoneactivateev_t;
+struct ldap_zoneactivateev {
+	ISC_EVENT_COMMON(ldap_zoneactivateev_t);
+	zone_activation_t	*za;
+	dns_zone_t		*zone;	/**< zone published in the view */
+};
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_activation_create(ldap_instance_t *inst, zone_activation_t **zap) {
+	isc_result_t result;
+	zone_activation_t *za = NULL;
+
+	CHECKED_MEM_GET_PTR(inst->mctx, za);
+	ZERO_PTR(za);
+	isc_mem_attach(inst->mctx, &za->mctx);
+	za->inst = inst;
+	za->refs = 1;
+	CHECK(isc_time_now(&za->start));
+	za->last_report = za->start;
+	CHECK(isc_mutex_init(&za->lock));
+
+	*zap = za;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (za != NULL)
+		MEM_PUT_AND_DETACH(za);
+	return result;
+}
+
+/**
+ * Zones per second since start of activation.
+ *
+ * @pre za->lock is locked.
+ */
+static unsigned int ATTR_NONNULLS
+zone_activation_rate(zone_activation_t *za, isc_time_t *now) {
+	isc_uint64_t usec;
+
+	usec = isc_time_microdiff(now, &za->start);
+	if (usec == 0)
+		return za->done_cnt;
+	return (unsigned int)(za->done_cnt * (isc_uint64_t)1000000 / usec);
+}
+
+/**
+ * Release one reference to zone activation. Final summary is logged
+ * and the structure is freed when the last reference is gone.
+ *
+ * @param[in] loaded ISC_TRUE if the releasing event loaded a zone,
+ *                   ISC_FALSE if it failed or if the sender is releasing
+ *                   its reference.
+ * @param[in] zone   Zone processed by the releasing event or NULL.
+ */
+static void
+zone_activation_detach(zone_activation_t **zap, dns_zone_t *zone,
+		       isc_boolean_t loaded) {
+	zone_activation_t *za = *zap;
+	isc_time_t now;
+	isc_boolean_t last;
+
+	*zap = NULL;
+	if (isc_time_now(&now) != ISC_R_SUCCESS)
+		now = za->last_report;
+
+	LOCK(&za->lock);
+	if (zone != NULL) {
+		za->done_cnt++;
+		if (loaded == ISC_TRUE)
+			za->published_cnt++;
+		if (isc_time_microdiff(&now, &za->last_report)
+		    >= ZONE_ACTIVATION_REPORT_INTERVAL * 1000000ULL) {
+			za->last_report = now;
+			log_info("%u/%u master zones from LDAP instance '%s' "
+				 "loaded (%u zones/s)", za->done_cnt,
+				 za->active_cnt, za->inst->db_name,
+				 zone_activation_rate(za, &now));
+		}
+	}
+	INSIST(za->refs > 0);
+	last = ISC_TF(--za->refs == 0);
+	UNLOCK(&za->lock);
+
+	if (last == ISC_FALSE)
+		return;
+
+	log_info("%u master zones from LDAP instance '%s' loaded (%u zones "
+		 "defined, %u inactive, %u failed to load, %u zones/s)",
+		 za->published_cnt, za->inst->db_name, za->total_cnt,
+		 za->total_cnt - za->active_cnt,
+		 za->active_cnt - za->published_cnt,
+		 zone_activation_rate(za, &now));
+	if (za->total_cnt < 1)
+		log_info("0 master zones is suspicious number, please check "
+			 "access control instructions on LDAP server");
+	DESTROYLOCK(&za->lock);
+	MEM_PUT_AND_DETACH(za);
+}
+
+/**
+ * Load zone which was already published by activate_zones().
+ * It runs on the zone's own task so zones are loaded in parallel.
+ */
+static void ATTR_NONNULLS
+activate_zone_load(isc_task_t *task, isc_event_t *event) {
+	ldap_zoneactivateev_t *zevent = (ldap_zoneactivateev_t *)event;
+	zone_activation_t *za = zevent->za;
+	ldap_instance_t *inst = za->inst;
+	dns_zone_t *zone = zevent->zone;
+	dns_zone_t *raw = NULL;
+	settings_set_t *zone_settings = NULL;
+	isc_result_t result;
+
+	UNUSED(task);
+
+	if (inst->exiting)
+		CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
+
+	CHECK(load_zone(zone, ISC_TRUE));
+	/* records dropped to zone directory while the zone was not loaded */
+	if (zone_import_spool(inst, dns_zone_getorigin(zone)) != ISC_R_SUCCESS)
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "cannot schedule import of records");
+	dns_zone_getraw(zone, &raw);
+	if (raw != NULL) { /* in-line signing */
+		CHECK(zr_get_zone_settings(inst->zone_register,
+					   dns_zone_getorigin(zone),
+					   &zone_settings));
+		CHECK(zone_master_reconfigure_nsec3param(zone_settings, zone));
+	}
+
+cleanup:
+	if (result != ISC_R_SUCCESS && result != ISC_R_SHUTTINGDOWN)
+		dns_zone_log(zone, ISC_LOG_ERROR, "unable to load zone: %s",
+			     dns_result_totext(result));
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	zone_activation_detach(&za, zone, ISC_TF(result == ISC_R_SUCCESS));
+	dns_zone_detach(&zone);
+	isc_event_free(&event);
+}
+
+/**
+ * Add zone to view and send event which will call dns_zone_load()
+ * from the zone's task.
+ *
+ * @pre Caller is in exclusive mode and view is thawed.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+activate_zone(isc_task_t *task, ldap_instance_t *inst, dns_name_t *name,
+	      zone_activation_t *za) {
+	isc_result_t result;
+	dns_zone_t *raw = NULL;
+	dns_zone_t *secure = NULL;
+	dns_zone_t *toview = NULL;
+	isc_task_t *zone_task = NULL;
+	ldap_zoneactivateev_t *zevent = NULL;
+
+	CHECK(zr_get_zone_ptr(inst->zone_register, name, &raw, &secure));
+
+	/* Load only "secure" zone if inline-signing is active.
+	 * It will not work if raw zone is loaded explicitly
+	 * - dns_zone_load() will fail magically. */
+	toview = (secure != NULL) ? secure : raw;
+
+	/*
+	 * Zone has to be published *before* zone load
+	 * otherwise it will race with zone->view != NULL check
+	 * in zone_maintenance() in zone.c.
+	 */
+	result = publish_zone(task, inst, toview);
+	if (result != ISC_R_SUCCESS) {
+		dns_zone_log(toview, ISC_LOG_ERROR,
+			     "cannot add zone to view: %s",
+			     dns_result_totext(result));
+		goto cleanup;
+	}
+
+	zevent = (ldap_zoneactivateev_t *)isc_event_allocate(inst->mctx,
+				inst, LDAPDB_EVENT_ZONE_ACTIVATE,
+				activate_zone_load, NULL,
+				sizeof(ldap_zoneactivateev_t));
+	if (zevent == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+	zevent->za = za;
+	zevent->zone = NULL;
+	dns_zone_attach(toview, &zevent->zone);
+
+	LOCK(&za->lock);
+	za->refs++;
+	UNLOCK(&za->lock);
+	dns_zone_gettask(toview, &zone_task);
+	isc_task_send(zone_task, (isc_event_t **)&zevent);
+
+cleanup:
+	if (zone_task != NULL)
+		isc_task_detach(&zone_task);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	if (secure != NULL)
+		dns_zone_detach(&secure);
+	return result;
+}
+
+/**
+ * Exclusive section shared by LDAP_ZONE_BATCH_SIZE activated zones.
+ */
+typedef struct activation_batch {
+	unsigned int	cnt;
+	isc_result_t	lock_state;
+	isc_boolean_t	freeze;
+} activation_batch_t;
+
+#define ACTIVATION_BATCH_INIT	{ 0, ISC_R_IGNORE, ISC_FALSE }
+
+/**
+ * Close exclusive section of the current batch, if any.
+ */
+static void ATTR_NONNULLS
+activation_batch_end(ldap_instance_t *inst, activation_batch_t *batch) {
+	if (batch->freeze == ISC_TRUE)
+		dns_view_freeze(inst->view);
+	run_exclusive_exit(inst, batch->lock_state);
+	batch->freeze = ISC_FALSE;
+	batch->lock_state = ISC_R_IGNORE;
+	batch->cnt = 0;
+}
+
+/**
+ * Activate zone and configure its forwarding. The first zone of a batch
+ * enters exclusive mode and thaws the view, the last one leaves it.
+ */
+static void ATTR_NONNULLS
+activation_batch_add(isc_task_t *task, ldap_instance_t *inst,
+		     activation_batch_t *batch, dns_name_t *name,
+		     settings_set_t *settings, zone_activation_t *za) {
+	isc_result_t result;
+
+	if (batch->cnt++ == 0) {
+		run_exclusive_enter(inst, &batch->lock_state);
+		if (inst->view->frozen) {
+			batch->freeze = ISC_TRUE;
+			dns_view_thaw(inst->view);
+		}
+	}
+	result = activate_zone(task, inst, name, za);
+	if (result != ISC_R_SUCCESS)
+		log_error_r("could not activate zone");
+	result = fwd_configure_zone(settings, inst, name);
+	if (result != ISC_R_SUCCESS)
+		log_error_r("could not configure forwarding");
+	if (batch->cnt == LDAP_ZONE_BATCH_SIZE)
+		activation_batch_end(inst, batch);
+}
+
+/**
+ * Add all active zones in zone register to DNS view specified in inst->view
+ * and load zones.
+ *
+ * Only zones read by the SyncRepl session which owns sctx are activated,
+ * sessions for additional bases finish their refresh independently.
+ *
+ * Zones are published in batches, each batch runs in one exclusive
+ * section with the view thawed only once. Zone loading is then
+ * done in parallel by zone tasks and progress is logged periodically.
+ */
+isc_result_t
+activate_zones(isc_task_t *task, ldap_instance_t *inst, sync_ctx_t *sctx) {
+	isc_result_t result;
+	rbt_iterator_t *iter = NULL;
+	DECLARE_BUFFERED_NAME(name);
+	settings_set_t *settings;
+	isc_boolean_t active;
+	activation_batch_t batch = ACTIVATION_BATCH_INIT;
+	zone_activation_t *za = NULL;
+
+	/* zones were added to zone register during initial synchronization,
+	 * let lookups of all of them go to the lock-free snapshot */
+	result = zr_publish(inst->zone_register);
+	if (result != ISC_R_SUCCESS)
+		log_error_r("unable to rebuild zone register snapshot");
+
+	CHECK(zone_activation_create(inst, &za));
+
+	INIT_BUFFERED_NAME(name);
+	for(result = zr_rbt_iter_init(inst->zone_register, &iter, &name);
+	    result == ISC_R_SUCCESS;
+	    dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
+		if (sync_ctx_for_zone(inst, &name) != sctx)
+			continue;
+		settings = NULL;
+		result = zr_get_zone_settings(inst->zone_register, &name, &settings);
+		INSIST(result == ISC_R_SUCCESS);
+		result = setting_get_bool(SETTING_ACTIVE, settings, &active);
+		INSIST(result == ISC_R_SUCCESS);
+
+		/* zone events cannot finish before the counters are final */
+		LOCK(&za->lock);
+		++za->total_cnt;
+		if (active == ISC_TRUE)
+			++za->active_cnt;
+		UNLOCK(&za->lock);
+		if (active == ISC_TRUE)
+			activation_batch_add(task, inst, &batch, &name,
+					     settings, za);
+	};
+	activation_batch_end(inst, &batch);
+
+cleanup:
+	if (za != NULL)
+		zone_activation_detach(&za, NULL, ISC_FALSE);
+	return result;
+}
+
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+configure_zone_acl(acl_cache_t *cache, dns_zone_t *zone,
+		void (acl_setter)(dns_zone_t *zone, dns_acl_t *acl),
+		const char *aclstr, acl_type_t type) {
+	isc_result_t result;
+	isc_result_t result2;
+	dns_acl_t *acl = NULL;
+	const char *type_txt = NULL;
+
+	result = acl_cache_get(cache, aclstr, type, &acl);
+	if (result != ISC_R_SUCCESS) {
+		result2 = get_enum_description(acl_type_txts, type, &type_txt);
+		if (result2 != ISC_R_SUCCESS) {
+			log_bug("invalid acl type %u", type);
+			type_txt = "<unknown>";
+		}
+
+		dns_zone_logc(zone, DNS_LOGCATEGORY_SECURITY, ISC_LOG_ERROR,
+			      "%s policy is invalid: %s; configuring most "
+			      "restrictive %s policy as possible",
+			      type_txt, isc_result_totext(result), type_txt);
+		result2 = acl_cache_get(cache, "", type, &acl);
+		if (result2 != ISC_R_SUCCESS) {
+			dns_zone_logc(zone, DNS_LOGCATEGORY_SECURITY, ISC_LOG_CRITICAL,
+				      "cannot configure restrictive %s policy: %s",
+				      type_txt, isc_result_totext(result2));
+			FATAL_ERROR(__FILE__, __LINE__,
+				    "insecure state detected");
+		}
+	}
+	acl_setter(zone, acl);
+
+	if (acl != NULL)
+		dns_acl_detach(&acl);
+
+	return result;
+}
+
+/* In BIND9 terminology "ssu" means "Simple Secure Update" */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+configure_zone_ssutable(acl_cache_t *cache, dns_zone_t *zone,
+			const char *update_str)
+{
+	isc_result_t result;
+	isc_result_t result2;
+
+	REQUIRE(zone != NULL);
+
+	/*
+	 * This is meant only for debugging.
+	 * DANGEROUS: Do not leave uncommented!
+	 */
+#if 0 
+	{
+		dns_acl_t *any;
+		dns_acl_any(dns_zone_getmctx(zone), &any);
+		dns_zone_setupdateacl(zone, any);
+		dns_acl_detach(&any);
+	}
+
+	return ISC_R_SUCCESS;
+#endif
+
+	/* Set simple update table. */
+	result = acl_configure_zone_ssutable(cache, update_str, zone);
+	if (result != ISC_R_SUCCESS) {
+		dns_zone_logc(zone, DNS_LOGCATEGORY_SECURITY, ISC_LOG_ERROR,
+			      "disabling all updates because of error in "
+			      "update policy configuration: %s",
+			      isc_result_totext(result));
+		result2 = acl_configure_zone_ssutable(cache, "", zone);
+		if (result2 != ISC_R_SUCCESS) {
+			dns_zone_logc(zone, DNS_LOGCATEGORY_SECURITY, ISC_LOG_CRITICAL,
+				      "cannot disable all updates: %s",
+				      isc_result_totext(result2));
+			FATAL_ERROR(__FILE__, __LINE__,
+				    "insecure state detected");
+		}
+	}
+
+	return result;
+}
+
+/**
+ * Configure update policy of a zone according to effective values
+ * of settings dyn_update and update_policy.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_ssutable_reconfigure(ldap_instance_t *inst, dns_zone_t *raw,
+			  const settings_set_t *zone_settings)
+{
+	isc_result_t result;
+	isc_boolean_t ssu_enabled;
+	const char *ssu_policy = NULL;
+
+	CHECK(setting_get_bool(SETTING_DYN_UPDATE, zone_settings,
+			       &ssu_enabled));
+	if (ssu_enabled) {
+		/* Get the update policy and update the zone with it. */
+		CHECK(setting_get_str(SETTING_UPDATE_POLICY, zone_settings,
+				      &ssu_policy));
+		dns_zone_log(raw, ISC_LOG_DEBUG(2),
+			     "setting update-policy to '%s'",
+			     ssu_policy);
+		CHECK(configure_zone_ssutable(inst->acl_cache, raw,
+					      ssu_policy));
+	} else {
+		/* Empty policy will prevent the update from reaching
+		 * LDAP driver and error will be logged. */
+		dns_zone_log(raw, ISC_LOG_DEBUG(2),
+			     "update-policy is not set");
+		CHECK(configure_zone_ssutable(inst->acl_cache, raw, ""));
+	}
+
+cleanup:
+	return result;
+}
+
+/* Delete zone by dns zone name */
+isc_result_t
+ldap_delete_zone2(ldap_instance_t *inst, dns_name_t *name, isc_boolean_t lock)
+{
+	isc_result_t result;
+	isc_result_t isforward = ISC_R_NOTFOUND;
+	isc_result_t lock_state = ISC_R_IGNORE;
+	isc_boolean_t freeze = ISC_FALSE;
+	dns_zone_t *raw = NULL;
+	dns_zone_t *secure = NULL;
+	dns_zone_t *foundzone = NULL;
+	settings_set_t *zone_settings = NULL;
+	char zone_name_char[DNS_NAME_FORMATSIZE];
+
+	dns_name_format(name, zone_name_char, DNS_NAME_FORMATSIZE);
+	log_debug(1, "deleting zone '%s'", zone_name_char);
+	if (lock)
+		run_exclusive_enter(inst, &lock_state);
+
+	/* simulate no explicit forwarding configuration */
+	CHECK(fwd_configure_zone(&inst->empty_fwdz_settings, inst, name));
+	isforward = fwdr_zone_ispresent(inst->fwd_register, name);
+	if (isforward == ISC_R_SUCCESS)
+		CHECK(fwdr_del_zone(inst->fwd_register, name));
+
+	result = zr_get_zone_ptr(inst->zone_register, name, &raw, &secure);
+	if (result == ISC_R_NOTFOUND || result == DNS_R_PARTIALMATCH) {
+		if (isforward == ISC_R_SUCCESS)
+			log_info("forward zone '%s': shutting down", zone_name_char);
+		log_debug(1, "zone '%s' not found in zone register", zone_name_char);
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	} else if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	result = dns_view_findzone(inst->view, name, &foundzone);
+	if (result == ISC_R_SUCCESS) {
+		/* foundzone != zone indicates a bug */
+		if (secure != NULL)
+			RUNTIME_CHECK(foundzone == secure);
+		else
+			RUNTIME_CHECK(foundzone == raw);
+		dns_zone_detach(&foundzone);
+
+		if (lock) {
+			dns_view_thaw(inst->view);
+			freeze = ISC_TRUE;
+		}
+	} /* else: zone wasn't in a view */
+
+	if (secure != NULL)
+		CHECK(delete_bind_zone(inst->view->zonetable, &secure));
+	CHECK(delete_bind_zone(inst->view->zonetable, &raw));
+	/* templates rendered for the zone will not be used anymore */
+	if (zr_get_zone_settings(inst->zone_register, name, &zone_settings)
+	    == ISC_R_SUCCESS)
+		rr_template_cache_forget(inst->rr_templates, zone_settings);
+	CHECK(zr_del_zone(inst->zone_register, name));
+	mirror_zone_delete(inst, name);
+
+cleanup:
+	if (freeze)
+		dns_view_freeze(inst->view);
+	run_exclusive_exit(inst, lock_state);
+
+	return result;
+}
+
+/**
+ * Remove zone from view but let the zone object intact. The same zone object
+ * can be re-published later using publish_zone().
+ *
+ * @warning
+ * This function removes zone from view but the zone->view pointer will stay
+ * unchanged and will reference the old view.
+ * It works like that because dns_zone_setview() doesn't work with NULL view.
+ * I hope it will not break something...
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+unpublish_zone(ldap_instance_t *inst, dns_name_t *name, const char *logname) {
+	isc_result_t result;
+	isc_result_t lock_state = ISC_R_IGNORE;
+	dns_zone_t *raw = NULL;
+	dns_zone_t *secure = NULL;
+	dns_zone_t *zone_in_view = NULL;
+	isc_boolean_t freeze = ISC_FALSE;
+
+	CHECK(zr_get_zone_ptr(inst->zone_register, name, &raw, &secure));
+
+	run_exclusive_enter(inst, &lock_state);
+	if (inst->view->frozen) {
+		freeze = ISC_TRUE;
+		dns_view_thaw(inst->view);
+	}
+	CHECK(dns_view_findzone(inst->view, name, &zone_in_view));
+	INSIST(zone_in_view == raw || zone_in_view == secure);
+	/* simulate no explicit forwarding configuration */
+	CHECK(fwd_configure_zone(&inst->empty_fwdz_settings, inst, name));
+	CHECK(dns_zt_unmount(inst->view->zonetable, zone_in_view));
+	/* zone is re-created in follower views by publish_zone() */
+	mirror_zone_delete(inst, name);
+
+cleanup:
+	if (freeze)
+		dns_view_freeze(inst->view);
+	run_exclusive_exit(inst, lock_state);
+	if (result != ISC_R_SUCCESS)
+		log_error_r("%s un-publication failed", logname);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	if (secure != NULL)
+		dns_zone_detach(&secure);
+	if (zone_in_view != NULL)
+		dns_zone_detach(&zone_in_view);
+
+	return result;
+}
+
+/* Parse the config object entry */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_parse_configentry(ldap_entry_t *entry, ldap_instance_t *inst)
+{
+	isc_result_t result;
+	isc_boolean_t old_dyn_update;
+	isc_boolean_t new_dyn_update;
+
+	/* BIND functions are thread safe, ldap instance 'inst' is locked
+	 * inside setting* functions. */
+
+	log_debug(3, "Parsing configuration object");
+
+	result = fwd_parse_ldap(inst, entry, inst->global_settings);
+	if (result == ISC_R_SUCCESS) {
+		CHECK(fwd_reconfig_global(inst));
+	} else if (result != ISC_R_IGNORE)
+		goto cleanup;
+
+	/* value inherited by zones, i.e. including server config */
+	CHECK(setting_get_bool(SETTING_DYN_UPDATE, inst->server_ldap_settings,
+			       &old_dyn_update));
+	result = setting_update_from_ldap_entry("dyn_update",
+						inst->global_settings,
+						"idnsAllowDynUpdate",
+						entry);
+	if (result == ISC_R_SUCCESS) {
+		CHECK(setting_get_bool(SETTING_DYN_UPDATE,
+				       inst->server_ldap_settings,
+				       &new_dyn_update));
+		if (new_dyn_update != old_dyn_update)
+			CHECK(zone_conf_fanout(inst, ZONE_CONF_SSU));
+	} else if (result != ISC_R_IGNORE)
+		goto cleanup;
+
+	/* sync_ptr is evaluated for each update, no zone is affected */
+	result = setting_update_from_ldap_entry("sync_ptr",
+						inst->global_settings,
+						"idnsAllowSyncPTR",
+						entry);
+	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
+		goto cleanup;
+
+cleanup:
+	/* Configuration errors are not fatal. */
+	/* TODO: log something? */
+	return ISC_R_SUCCESS;
+}
+
+/* Parse the idnsServerConfig object entry */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_parse_serverconfigentry(ldap_entry_t *entry, ldap_instance_t *inst)
+{
+	isc_result_t result;
+	const char *fake_mname = NULL;
+	char *old_fake_mname = NULL;
+
+	/* BIND functions are thread safe, ldap instance 'inst' is locked
+	 * inside setting* functions. */
+
+	log_debug(3, "Parsing server configuration object");
+
+	result = fwd_parse_ldap(inst, entry, inst->server_ldap_settings);
+	if (result == ISC_R_SUCCESS) {
+		CHECK(fwd_reconfig_global(inst));
+	} else if (result != ISC_R_IGNORE)
+		goto cleanup;
+
+	/* original value is released by the update */
+	CHECK(setting_get_str(SETTING_FAKE_MNAME, inst->server_ldap_settings,
+			      &fake_mname));
+	CHECKED_MEM_STRDUP(inst->mctx, fake_mname, old_fake_mname);
+	result = setting_update_from_ldap_entry("fake_mname",
+						inst->server_ldap_settings,
+						"idnsSOAmName",
+						entry);
+	if (result == ISC_R_SUCCESS) {
+		CHECK(setting_get_str(SETTING_FAKE_MNAME,
+				      inst->server_ldap_settings,
+				      &fake_mname));
+		if (strcmp(fake_mname, old_fake_mname) != 0)
+			CHECK(zone_conf_fanout(inst, ZONE_CONF_SOA));
+	} else if (result != ISC_R_IGNORE)
+		goto cleanup;
+
+	/* ISC_R_IGNORE means that the value did not change */
+	result = setting_update_from_ldap_entry("substitutionvariable_ipalocation",
+						inst->server_ldap_settings,
+						"idnsSubstitutionVariable;ipalocation",
+						entry);
+	if (result == ISC_R_SUCCESS)
+		CHECK(refresh_templates(inst,
+					"substitutionvariable_ipalocation"));
+	else if (result != ISC_R_IGNORE)
+		goto cleanup;
+
+cleanup:
+	if (old_fake_mname != NULL)
+		isc_mem_free(inst->mctx, old_fake_mname);
+	/* Configuration errors are not fatal. */
+	/* TODO: log something? */
+	return ISC_R_SUCCESS;
+}
+
+/* Parse the forward zone entry */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_parse_fwd_zoneentry(ldap_entry_t *entry, ldap_instance_t *inst)
+{
+	ldap_valuelist_t values;
+	char name_txt[DNS_NAME_FORMATSIZE];
+	isc_result_t result;
+
+	settings_set_t *fwdz_settings = NULL;
+
+	REQUIRE(entry != NULL);
+	REQUIRE(inst != NULL);
+
+	/* Zone is active */
+	CHECK(ldap_entry_getvalues(entry, "idnsZoneActive", &values));
+	if (HEAD(values) != NULL &&
+	    strcasecmp(HEAD(values)->value, "TRUE") != 0) {
+		/* Zone is not active */
+		result = ldap_delete_zone2(inst, &entry->fqdn, ISC_TRUE);
+		goto cleanup;
+	}
+
+	CHECK(settings_set_create(inst->mctx, settings_fwdz_defaults, sizeof(settings_fwdz_defaults),
+				  "fake fwdz settings", inst->server_ldap_settings,
+				  &fwdz_settings));
+	result = fwd_parse_ldap(inst, entry, fwdz_settings);
+	if (result == ISC_R_IGNORE) {
+		log_error_r("%s: invalid object: either "
+			    "forwarding policy or forwarders must be set",
+			    ldap_entry_logname(entry));
+		goto cleanup;
+	}
+	CHECK(fwd_configure_zone(fwdz_settings, inst, &entry->fqdn));
+
+	result = fwdr_add_zone(inst->fwd_register, &entry->fqdn);
+	if (result != ISC_R_EXISTS && result != ISC_R_SUCCESS) {
+		dns_name_format(&entry->fqdn, name_txt, DNS_NAME_FORMATSIZE);
+		log_error_r("failed to add forward zone '%s' "
+			    "to the forwarding register", name_txt);
+		goto cleanup;
+	}
+	result = ISC_R_SUCCESS;
+	dns_name_format(&entry->fqdn, name_txt, DNS_NAME_FORMATSIZE);
+	log_info("forward zone '%s': loaded", name_txt);
+
+cleanup:
+	settings_set_free(&fwdz_settings);
+	return result;
+}
+
+/**
+ * Compute minimal diff between rdatalist and rdataset iterator. This produces
+ * minimal diff applicable to a database.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+diff_ldap_rbtdb(isc_mem_t *mctx, dns_name_t *name, ldapdb_rdatalist_t *ldap_rdatalist,
+		    dns_rdatasetiter_t *rbt_rds_iter, dns_diff_t *diff) {
+	isc_result_t result;
+	dns_rdataset_t rbt_rds;
+	dns_rdatalist_t *l;
+
+	dns_rdataset_init(&rbt_rds);
+
+	/* FIXME: rbt_rds_iter == NULL || ldap_rdatalist == NULL */
+	for (result = dns_rdatasetiter_first(rbt_rds_iter);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdatasetiter_next(rbt_rds_iter)) {
+		dns_rdatasetiter_current(rbt_rds_iter, &rbt_rds);
+		CHECK(rdataset_to_diff(mctx, DNS_DIFFOP_DEL, name, &rbt_rds,
+				       diff));
+		dns_rdataset_disassociate(&rbt_rds);
+	}
+
+	for (l = HEAD(*ldap_rdatalist);
+	     l != NULL;
+	     l = NEXT(l, link)) {
+		result = rdatalist_to_diff(mctx, DNS_DIFFOP_ADD, name, l, diff);
+		if (result != ISC_R_SUCCESS && result != ISC_R_NOMORE)
+			goto cleanup;
+	}
+	if (result == ISC_R_NOMORE)
+		result = ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+/**
+ * Process strictly minimal diff and detect if data were changed
+ * and return latest SOA RR.
+ *
+ * @pre Input diff has to be minimal, i.e. it can't contain DEL & ADD operation
+ *      for the same data under the same name and TTL.
+ *
+ * @pre If the tuple list contains SOA RR, then exactly one SOA RR deletion
+ *      has to precede exactly one SOA RR addition.
+ *      (Each SOA RR deletion has to have matching addition.)
+ *
+ * @param[in]	diff		Input diff. List of tuples can be empty.
+ * @param[out]	soa_latest	Pointer to last added SOA RR from tuple list.
+ *				Result can be NULL if there is no added SOA RR
+ *				in the tuple list.
+ * @param[out]	data_changed	ISC_TRUE if any data other than SOA serial were
+ * 				changed. ISC_FALSE if nothing (except SOA
+ * 				serial) was changed.
+ *
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+diff_analyze_serial(dns_diff_t *diff, dns_difftuple_t **soa_latest,
+		    isc_boolean_t *data_changed) {
+	dns_difftuple_t *t = NULL;
+	dns_rdata_t *del_soa = NULL; /* last seen SOA with op == DEL */
+	dns_difftuple_t *tmp_tuple = NULL; /* tuple used for SOA comparison */
+	isc_result_t result = ISC_R_SUCCESS;
+	int ret;
+
+	REQUIRE(DNS_DIFF_VALID(diff));
+	REQUIRE(soa_latest != NULL && *soa_latest == NULL);
+	REQUIRE(data_changed != NULL);
+
+	*data_changed = ISC_FALSE;
+	for (t = HEAD(diff->tuples);
+	     t != NULL;
+	     t = NEXT(t, link)) {
+		INSIST(tmp_tuple == NULL);
+		if (t->rdata.type != dns_rdatatype_soa)
+			*data_changed = ISC_TRUE;
+		else { /* SOA is always special case */
+			if (t->op == DNS_DIFFOP_DEL ||
+			    t->op == DNS_DIFFOP_DELRESIGN) {
+				/* delete operation has to precede add */
+				INSIST(del_soa == NULL);
+				del_soa = &t->rdata;
+			} else if (t->op == DNS_DIFFOP_ADD ||
+				   t->op == DNS_DIFFOP_ADDRESIGN) {
+				/* add operation has to follow a delete */
+				*soa_latest = t;
+
+				/* we are adding SOA without preceding delete
+				 * -> we are initializing new empty zone */
+				if (del_soa == NULL) {
+					*data_changed = ISC_TRUE;
+				} else if (*data_changed == ISC_FALSE) {
+					/* detect if fields other than serial
+					 * were changed (compute only if necessary) */
+					CHECK(dns_difftuple_copy(t, &tmp_tuple));
+					dns_soa_setserial(dns_soa_getserial(del_soa),
+							  &tmp_tuple->rdata);
+					ret = dns_rdata_compare(del_soa,
+								&tmp_tuple->rdata);
+					*data_changed = ISC_TF(ret != 0);
+				}
+				if (tmp_tuple != NULL)
+					dns_difftuple_free(&tmp_tuple);
+				/* re-start the SOA delete-add search cycle */
+				del_soa = NULL;
+			} else {
+				INSIST("unexpected diff: op != ADD || DEL"
+				       == NULL);
+			}
+		}
+	}
+	/* SOA deletions & additions has to create self-contained couples */
+	INSIST(del_soa == NULL && tmp_tuple == NULL);
+
+cleanup:
+	if (tmp_tuple != NULL)
+		dns_difftuple_free(&tmp_tuple);
+	return result;
+}
+
+/**
+ * Replace SOA serial in LDAP for given zone.
+ *
+ * @param[in]	inst
+ * @param[in]	zone	Zone name.
+ * @param[in]	serial	New serial.
+ *
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_replace_serial(ldap_instance_t *inst, dns_name_t *zone,
+		    isc_uint32_t serial) {
+	isc_result_t result;
+#define MAX_SERIAL_LENGTH sizeof("4294967295") /* SOA serial is isc_uint32_t */
+	char serial_char[MAX_SERIAL_LENGTH];
+	char *values[2] = { serial_char, NULL };
+	LDAPMod change;
+	LDAPMod *changep[2] = { &change, NULL };
+	ld_string_t *dn = NULL;
+
+	REQUIRE(inst != NULL);
+
+	CHECK(str_new(inst->mctx, &dn));
+	CHECK(dnsname_to_dn(inst->zone_register, zone, zone, dn));
+
+	change.mod_op = LDAP_MOD_REPLACE;
+	change.mod_type = "idnsSOAserial";
+	change.mod_values = values;
+	CHECK(isc_string_printf(serial_char, MAX_SERIAL_LENGTH, "%u", serial));
+
+	CHECK(ldap_modify_do(inst, str_buf(dn), changep, ISC_FALSE));
+
+cleanup:
+	str_destroy(&dn);
+	return result;
+#undef MAX_SERIAL_LENGTH
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_master_reconfigure_nsec3param(settings_set_t *zone_settings,
+				   dns_zone_t *secure) {
+	isc_mem_t *mctx = NULL;
+	isc_result_t result;
+	dns_rdata_t *nsec3p_rdata = NULL;
+	dns_rdata_nsec3param_t nsec3p_rr;
+	dns_name_t *origin = NULL;
+	const char *nsec3p_str = NULL;
+	ldap_entry_t *fake_entry = NULL;
+
+	REQUIRE(secure != NULL);
+
+	mctx = dns_zone_getmctx(secure);
+	origin = dns_zone_getorigin(secure);
+	CHECK(ldap_entry_init(mctx, &fake_entry));
+
+	CHECK(setting_get_str(SETTING_NSEC3PARAM, zone_settings, &nsec3p_str));
+	dns_zone_log(secure, ISC_LOG_INFO,
+		     "reconfiguring NSEC3PARAM to '%s'", nsec3p_str);
+	CHECK(parse_rdata(mctx, fake_entry, dns_rdataclass_in,
+			  dns_rdatatype_nsec3param, origin, nsec3p_str,
+			  &nsec3p_rdata));
+	CHECK(dns_rdata_tostruct(nsec3p_rdata, &nsec3p_rr, NULL));
+	CHECK(dns_zone_setnsec3param(secure, nsec3p_rr.hash, nsec3p_rr.flags,
+				     nsec3p_rr.iterations,
+				     nsec3p_rr.salt_length, nsec3p_rr.salt,
+				     ISC_TRUE));
+
+cleanup:
+	if (nsec3p_rdata != NULL) {
+		isc_mem_put(mctx, nsec3p_rdata->data, nsec3p_rdata->length);
+		SAFE_MEM_PUT_PTR(mctx, nsec3p_rdata);
+	}
+	if (fake_entry != NULL)
+		ldap_entry_destroy(&fake_entry);
+	return result;
+}
+
+/**
+ * Reconfigure master zone according to configuration in LDAP object.
+ *
+ * @param[in]  raw Raw zone backed by LDAP database. In-line secure zone
+ *                 will be reconfigured as necessary.
+ */
+static isc_result_t ATTR_NONNULL(1,2,3,4,6) ATTR_CHECKRESULT
+zone_master_reconfigure(ldap_instance_t *inst, ldap_entry_t *entry,
+			settings_set_t *zone_settings, dns_zone_t *raw,
+			dns_zone_t *secure, isc_task_t *task) {
+	isc_result_t result;
+	ldap_valuelist_t values;
+	isc_boolean_t ssu_changed;
+	dns_zone_t *inview = NULL;
+
+	REQUIRE(inst != NULL);
+	REQUIRE(entry != NULL);
+	REQUIRE(zone_settings != NULL);
+	REQUIRE(raw != NULL);
+	REQUIRE(task != NULL);
+
+	if (secure != NULL)
+		dns_zone_attach(secure, &inview);
+	else
+		dns_zone_attach(raw, &inview);
+
+	result = setting_update_from_ldap_entry("dyn_update", zone_settings,
+						"idnsAllowDynUpdate", entry);
+	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
+		goto cleanup;
+	ssu_changed = (result == ISC_R_SUCCESS);
+
+	result = setting_update_from_ldap_entry("sync_ptr", zone_settings,
+				       "idnsAllowSyncPTR", entry);
+	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
+		goto cleanup;
+
+	result = setting_update_from_ldap_entry("default_ttl", zone_settings,
+					        "DNSdefaultTTL", entry);
+	if (result == ISC_R_SUCCESS)
+		log_bug("default TTL cannot be changed at run-time");
+	else if (result != ISC_R_IGNORE)
+		goto cleanup;
+
+	/* remembered for change of fake_mname, see zone_conf_refresh_soa() */
+	result = setting_update_from_ldap_entry("soa_mname", zone_settings,
+						"idnsSOAmName", entry);
+	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
+		goto cleanup;
+
+	result = setting_update_from_ldap_entry("update_policy", zone_settings,
+						"idnsUpdatePolicy", entry);
+	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
+		goto cleanup;
+
+	if (result == ISC_R_SUCCESS || ssu_changed)
+		CHECK(zone_ssutable_reconfigure(inst, raw, zone_settings));
+
+	/* Fetch allow-query and allow-transfer ACLs */
+	result = ldap_entry_getvalues(entry, "idnsAllowQuery", &values);
+	if (result == ISC_R_SUCCESS) {
+		dns_zone_log(inview, ISC_LOG_DEBUG(2),
+			     "setting allow-query to '%s'",
+			     HEAD(values)->value);
+		CHECK(configure_zone_acl(inst->acl_cache, inview,
+					 &dns_zone_setqueryacl,
+					 HEAD(values)->value, acl_type_query));
+	} else {
+		dns_zone_log(inview, ISC_LOG_DEBUG(2), "allow-query is not set");
+		dns_zone_clearqueryacl(raw);
+	}
+
+	result = ldap_entry_getvalues(entry, "idnsAllowTransfer", &values);
+	if (result == ISC_R_SUCCESS) {
+		dns_zone_log(inview, ISC_LOG_DEBUG(2),
+			     "setting allow-transfer to '%s'",
+			     HEAD(values)->value);
+		CHECK(configure_zone_acl(inst->acl_cache, inview,
+					 &dns_zone_setxfracl,
+					 HEAD(values)->value, acl_type_transfer));
+	} else {
+		dns_zone_log(inview, ISC_LOG_DEBUG(2),
+			     "allow-transfer is not set");
+		dns_zone_clearxfracl(raw);
+		result = ISC_R_SUCCESS;
+	}
+
+	if (secure != NULL) {
+		/* notifications should be sent from secure zone only */
+		dns_zone_setnotifytype(raw, dns_notifytype_no);
+
+		/* Magic constants are taken from zoneconf.c */
+		/* sig-validity-interval */
+		dns_zone_setsigvalidityinterval(secure, 2592000);
+
+		/* re-sign */
+		dns_zone_setsigresigninginterval(secure, 648000);
+
+		/* sig-signing-signatures */
+		dns_zone_setsignatures(secure, 10);
+
+		/* sig-signing-nodes */
+		dns_zone_setnodes(secure, 10);
+
+		/* sig-signing-type */
+		dns_zone_setprivatetype(secure, 65534);
+
+		/* update-check-ksk */
+		dns_zone_setoption(secure, DNS_ZONEOPT_UPDATECHECKKSK, ISC_TRUE);
+
+		/* dnssec-loadkeys-interval */
+		CHECK(dns_zone_setrefreshkeyinterval(secure, 60));
+
+		result = setting_update_from_ldap_entry("nsec3param",
+							zone_settings,
+							"nsec3paramRecord",
+							entry);
+		if (result == ISC_R_SUCCESS)
+			CHECK(zone_master_reconfigure_nsec3param(zone_settings,
+								 secure));
+		else if (result == ISC_R_IGNORE)
+			result = ISC_R_SUCCESS;
+		else
+			goto cleanup;
+
+		/* auto-dnssec = maintain */
+		dns_zone_setkeyopt(secure, DNS_ZONEKEY_ALLOW, ISC_TRUE);
+		dns_zone_setkeyopt(secure, DNS_ZONEKEY_MAINTAIN, ISC_TRUE);
+	}
+
+cleanup:
+	if (inview != NULL)
+		dns_zone_detach(&inview);
+	return result;
+}
+
+/**
+ * Synchronize internal RBTDB with master zone object in LDAP and update serial
+ * as necessary.
+ *
+ * @param[in]  new_zone Is the RBTDB empty? (I.e. even without SOA record.)
+ * @param[in]  version  LDAP DB opened for reading and writing.
+ * @param[out] diff     Initialized diff. It will be filled with differences
+ *                      between RBTDB and LDAP object + SOA serial update.
+ * @param[out] new_serial     SOA serial after update;
+ *                            valid if ldap_writeback = ISC_TRUE.
+ * @param[out] ldap_writeback SOA serial was updated.
+ * @param[out] data_changed   Other data were updated.
+ *
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_sync_apex(const ldap_instance_t * const inst,
+	       ldap_entry_t * const entry, dns_name_t name,
+	       const sync_state_t sync_state, const isc_boolean_t new_zone,
+	       dns_db_t * const ldapdb, dns_db_t * const rbtdb,
+	       dns_dbversion_t * const version,
+	       const settings_set_t * const zone_settings,
+	       dns_diff_t * const diff,
+	       isc_uint32_t * const new_serial,
+	       isc_boolean_t * const ldap_writeback,
+	       isc_boolean_t * const data_changed) {
+	isc_result_t result;
+	ldapdb_rdatalist_t rdatalist;
+	dns_rdatasetiter_t *rbt_rds_iterator = NULL;
+	/* RBTDB's origin node cannot be detached until the node is non-empty.
+	 * This is workaround for ISC-Bug #35080. */
+	dns_dbnode_t *node = NULL;
+	dns_difftuple_t *soa_tuple = NULL;
+	isc_uint32_t curr_serial;
+
+	REQUIRE(ldap_writeback != NULL);
+
+	INIT_LIST(rdatalist);
+	*ldap_writeback = ISC_FALSE; /* GCC */
+
+	CHECK(ldap_parse_rrentry(inst->mctx, entry, &name,
+				 zone_settings, inst->rr_templates,
+				 &rdatalist));
+
+	CHECK(dns_db_getoriginnode(rbtdb, &node));
+	result = dns_db_allrdatasets(rbtdb, node, version, 0,
+				     &rbt_rds_iterator);
+	if (result == ISC_R_SUCCESS) {
+		CHECK(diff_ldap_rbtdb(inst->mctx, &name, &rdatalist,
+				      rbt_rds_iterator, diff));
+		dns_rdatasetiter_destroy(&rbt_rds_iterator);
+	} else if (result != ISC_R_NOTFOUND)
+		goto cleanup;
+
+	/* New zone doesn't have serial defined yet. */
+	if (new_zone != ISC_TRUE)
+		CHECK(dns_db_getsoaserial(rbtdb, version, &curr_serial));
+
+	/* Detect if SOA serial is affected by the update or not.
+	 * Always bump serial in case of re-synchronization. */
+	CHECK(diff_analyze_serial(diff, &soa_tuple, data_changed));
+	if (new_zone == ISC_TRUE || *data_changed == ISC_TRUE ||
+	    sync_state != sync_finished) {
+		if (soa_tuple == NULL) {
+			/* The diff doesn't contain new SOA serial
+			 * => generate new serial and write it back to LDAP. */
+			*ldap_writeback = ISC_TRUE;
+			CHECK(zone_soaserial_addtuple(inst->mctx, ldapdb,
+						      version, diff, new_serial));
+		} else if (new_zone == ISC_TRUE || sync_state != sync_finished ||
+			   isc_serial_le(dns_soa_getserial(&soa_tuple->rdata),
+					 curr_serial)) {
+			/* The diff tries to send SOA serial back!
+			 * => generate new serial and write it back to LDAP.
+			 * Force serial update if we are adding a new zone. */
+			*ldap_writeback = ISC_TRUE;
+			CHECK(zone_soaserial_updatetuple(dns_updatemethod_unixtime,
+							 soa_tuple, new_serial));
+		} else {
+			/* The diff contains new serial already
+			 * => do nothing. */
+			*ldap_writeback = ISC_FALSE;
+		}
+
+	} else {/* if (data_changed == ISC_FALSE) */
+		*ldap_writeback = ISC_FALSE;
+		if (soa_tuple == NULL) {
+			/* The diff is empty => do nothing. */
+			INSIST(EMPTY(diff->tuples));
+		} else if (isc_serial_le(dns_soa_getserial(&soa_tuple->rdata),
+					 curr_serial)) {
+			/* Attempt to move serial backwards without any data
+			 * => ignore it. */
+			dns_diff_clear(diff);
+		}/* else:
+		  * The diff contains new serial already
+		  * => do nothing. */
+	}
+
+cleanup:
+	if (node != NULL)
+		dns_db_detachnode(rbtdb, &node);
+	if (rbt_rds_iterator != NULL)
+		dns_rdatasetiter_destroy(&rbt_rds_iterator);
+	ldapdb_rdatalist_destroy(inst->mctx, &rdatalist);
+	return result;
+}
+
+/**
+ * Change security status of an existing zone.
+ *
+ * LDAP database is detached from the original zone, the zone is deleted
+ * and re-created with different parameters on top of the old LDAP database.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_security_change(ldap_entry_t * const entry, dns_name_t * const name,
+		     ldap_instance_t * const inst, ldap_syncsess_t * const sess,
+		     isc_task_t * const task) {
+	isc_result_t result;
+	dns_db_t *olddb = NULL;
+	isc_result_t lock_state = ISC_R_IGNORE;
+
+	CHECK(zr_get_zone_dbs(inst->zone_register, name, &olddb, NULL));
+
+	/* Lock is necessary to ensure that no events from LDAP are lost
+	 * in period where old zone was deleted but the new zone was not
+	 * created yet. */
+	run_exclusive_enter(inst, &lock_state);
+	CHECK(ldap_delete_zone2(inst, name, ISC_FALSE));
+	CHECK(ldap_parse_master_zoneentry(entry, olddb, inst, sess, task));
+
+cleanup:
+	run_exclusive_exit(inst, lock_state);
+	if (olddb != NULL)
+		dns_db_detach(&olddb);
+	return result;
+}
+
+/**
+ * Parse the master zone entry and configure DNS zone accordingly.
+ * New zone will be created if it doesn't exist. Existing zone will be
+ * updated with new settings from LDAP entry.
+ *
+ * This function also synchronizes data at zone apex and ensures
+ * that zone serial is incremented after each change.
+ *
+ * @param olddb[in]  LDAP database to be used when constructing a new zone.
+ *                   Empty database will be created if it is NULL.
+ *                   It should be non-NULL only if reconfiguration of
+ *                   an existing zone is not possible so the old zone
+ *                   was deleted but the new zone should re-use the old
+ *                   database.
+ */
+static isc_result_t
+ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
+			    ldap_instance_t * const inst,
+			    ldap_syncsess_t * const sess,
+			    isc_task_t * const task)
+{
+	ldap_valuelist_t values;
+	dns_zone_t *raw = NULL;
+	dns_zone_t *secure = NULL;
+	dns_zone_t *toview = NULL;
+	isc_result_t result;
+	isc_result_t lock_state = ISC_R_IGNORE;
+	isc_boolean_t new_zone = ISC_FALSE;
+	isc_boolean_t want_secure = ISC_FALSE;
+	isc_boolean_t configured = ISC_FALSE;
+	isc_boolean_t activity_changed;
+	isc_boolean_t reactivated;
+	isc_boolean_t isactive = ISC_FALSE;
+	settings_set_t *zone_settings = NULL;
+	isc_boolean_t ldap_writeback;
+	isc_boolean_t data_changed = ISC_FALSE; /* GCC */
+	isc_uint32_t new_serial;
+
+	dns_db_t *rbtdb = NULL;
+	dns_db_t *ldapdb = NULL;
+	dns_diff_t diff;
+	dns_dbversion_t *version = NULL;
+	sync_state_t sync_state;
+
+	REQUIRE(entry != NULL);
+	REQUIRE(inst != NULL);
+	REQUIRE(task == inst->task); /* For task-exclusive mode */
+
+	dns_diff_init(inst->mctx, &diff);
+
+	run_exclusive_enter(inst, &lock_state);
+
+	result = ldap_entry_getvalues(entry, "idnsSecInlineSigning", &values);
+	if (result == ISC_R_NOTFOUND || HEAD(values) == NULL)
+		want_secure = ISC_FALSE;
+	else
+		want_secure = ISC_TF(strcasecmp(HEAD(values)->value, "TRUE")
+				     == 0);
+
+	/* Check if we are already serving given zone */
+	result = zr_get_zone_ptr(inst->zone_register, &entry->fqdn,
+				 &raw, &secure);
+	if (result == ISC_R_NOTFOUND || result == DNS_R_PARTIALMATCH) {
+		CHECK(create_zone(inst, entry->dn, &entry->fqdn, olddb,
+				  want_secure, &raw, &secure));
+		new_zone = ISC_TRUE;
+		log_debug(2, "created %s: raw %p; secure %p",
+			  ldap_entry_logname(entry), raw, secure);
+	} else if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	else if (want_secure != ISC_TF(secure != NULL)) {
+		if (want_secure == ISC_TRUE)
+			dns_zone_log(raw, ISC_LOG_INFO,
+				     "upgrading zone to secure");
+		else
+			dns_zone_log(secure, ISC_LOG_INFO,
+				     "downgrading zone to insecure");
+		CHECK(zone_security_change(entry, &entry->fqdn, inst, sess,
+					   task));
+		goto cleanup;
+	} else { /* Zone exists and it's security status is unchanged. */
+		INSIST(olddb == NULL);
+	}
+
+	CHECK(zr_get_zone_settings(inst->zone_register, &entry->fqdn,
+				   &zone_settings));
+	CHECK(zone_master_reconfigure(inst, entry, zone_settings, raw, secure,
+				      task));
+	result = fwd_parse_ldap(inst, entry, zone_settings);
+	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
+		goto cleanup;
+	/* synchronize zone origin with LDAP */
+	CHECK(zr_get_zone_dbs(inst->zone_register, &entry->fqdn, &ldapdb, &rbtdb));
+	CHECK(dns_db_newversion(ldapdb, &version));
+	sync_state_get(sess != NULL ? sess->sctx
+				    : sync_ctx_for_dn(inst, entry->dn),
+		       &sync_state);
+	CHECK(zone_sync_apex(inst, entry, entry->fqdn, sync_state, new_zone,
+			     ldapdb, rbtdb, version, zone_settings,
+			     &diff, &new_serial, &ldap_writeback,
+			     &data_changed));
+
+#if RBTDB_DEBUG >= 2
+	dns_diff_print(&diff, stdout);
+#else
+	dns_diff_print(&diff, NULL);
+#endif
+	if (ldap_writeback == ISC_TRUE) {
+		dns_zone_log(raw, ISC_LOG_DEBUG(5), "writing new zone serial "
+			     "%u to LDAP", new_serial);
+		result = ldap_replace_serial(inst, &entry->fqdn, new_serial);
+		if (result != ISC_R_SUCCESS)
+			dns_zone_log(raw, ISC_LOG_ERROR,
+				     "serial (%u) write back to LDAP failed",
+				     new_serial);
+	}
+
+	if (!EMPTY(diff.tuples)) {
+		if (sync_state == sync_finished && new_zone == ISC_FALSE) {
+			/* write the transaction to journal */
+			CHECK(zone_journal_adddiff(inst->mctx, raw, &diff));
+		}
+
+		/* commit */
+		CHECK(dns_diff_apply(&diff, rbtdb, version));
+		dns_db_closeversion(ldapdb, &version, ISC_TRUE);
+		dns_zone_markdirty(raw);
+	} else {
+		/* It is necessary to release lock before calling load_zone()
+		 * otherwise it will deadlock on newversion() call
+		 * in journal roll-forward process! */
+		dns_db_closeversion(ldapdb, &version, ISC_FALSE);
+	}
+	configured = ISC_TRUE;
+
+	/* Detect active/inactive zone and activity changes */
+	result = setting_update_from_ldap_entry("active", zone_settings,
+						"idnsZoneActive", entry);
+	if (result == ISC_R_SUCCESS) {
+		activity_changed = ISC_TRUE;
+	} else if (result == ISC_R_IGNORE) {
+		activity_changed = ISC_FALSE;
+	} else
+		goto cleanup;
+	CHECK(setting_get_bool(SETTING_ACTIVE, zone_settings, &isactive));
+
+	/* Records of inactive zones are not loaded, see syncrepl_update().
+	 * zone_resync() reads them, records the difference in the journal
+	 * and then publishes the zone using zone_ready_activate().
+	 * This is the only path which re-activates a zone. */
+	reactivated = ISC_TF(isactive == ISC_TRUE
+			     && activity_changed == ISC_TRUE
+			     && (new_zone == ISC_FALSE || olddb != NULL));
+	if (reactivated == ISC_TRUE)
+		CHECK(ldap_zone_resync(inst, &entry->fqdn));
+
+	/* Do zone load only if the initial LDAP synchronization is done. */
+	if (sync_state != sync_finished)
+		goto cleanup;
+
+	toview = (want_secure == ISC_TRUE) ? secure : raw;
+	if (reactivated == ISC_TRUE) {
+		dns_zone_log(toview, ISC_LOG_INFO, "zone activated, "
+			     "reading records from LDAP");
+	} else if (isactive == ISC_TRUE) {
+		if (new_zone == ISC_TRUE || activity_changed == ISC_TRUE)
+			CHECK(publish_zone(task, inst, toview));
+		CHECK(load_zone(toview, ISC_FALSE));
+		if (zone_import_spool(inst, &entry->fqdn) != ISC_R_SUCCESS)
+			dns_zone_log(toview, ISC_LOG_ERROR,
+				     "cannot schedule import of records");
+		CHECK(fwd_configure_zone(zone_settings, inst, &entry->fqdn));
+	} else if (activity_changed == ISC_TRUE) { /* Zone was deactivated */
+		CHECK(unpublish_zone(inst, &entry->fqdn,
+				     ldap_entry_logname(entry)));
+		/* emulate "no explicit forwarding config" */
+		CHECK(fwd_configure_zone(&inst->empty_fwdz_settings, inst,
+					 &entry->fqdn));
+		dns_zone_log(toview, ISC_LOG_INFO, "zone deactivated "
+			     "and removed from view");
+	}
+
+cleanup:
+	dns_diff_clear(&diff);
+	if (rbtdb != NULL && version != NULL)
+		dns_db_closeversion(ldapdb, &version, ISC_FALSE); /* rollback */
+	if (rbtdb != NULL)
+		dns_db_detach(&rbtdb);
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+	if (new_zone == ISC_TRUE && configured == ISC_FALSE) {
+		/* Failure in ACL parsing or so. */
+		log_error_r("%s: publishing failed, rolling back due to",
+			    ldap_entry_logname(entry));
+		/* TODO: verify this */
+		result = ldap_delete_zone2(inst, &entry->fqdn, ISC_TRUE);
+		if (result != ISC_R_SUCCESS)
+			log_error_r("%s: rollback failed: ",
+				    ldap_entry_logname(entry));
+	}
+	run_exclusive_exit(inst, lock_state);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	if (secure != NULL)
+		dns_zone_detach(&secure);
+
+	return result;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+findrdatatype_or_create(isc_mem_t *mctx, ldapdb_rdatalist_t *rdatalist,
+			dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
+			dns_ttl_t ttl, dns_rdatalist_t **rdlistp)
+{
+	isc_result_t result;
+	dns_rdatalist_t *rdlist = NULL;
+
+	REQUIRE(rdatalist != NULL);
+	REQUIRE(rdlistp != NULL);
+
+	*rdlistp = NULL;
+
+	result = ldapdb_rdatalist_findrdatatype(rdatalist, rdtype, &rdlist);
+	if (result != ISC_R_SUCCESS) {
+		CHECKED_MEM_GET_PTR(mctx, rdlist);
+
+		dns_rdatalist_init(rdlist);
+		rdlist->rdclass = rdclass;
+		rdlist->type = rdtype;
+		rdlist->ttl = ttl;
+		APPEND(*rdatalist, rdlist, link);
+	} else {
+		/*
+		 * No support for different TTLs yet.
+		 */
+		if (rdlist->ttl != ttl) {
+			log_error("different TTLs in single rdata list "
+				  "are not supported");
+			CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
+		}
+	}
+
+	*rdlistp = rdlist;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	SAFE_MEM_PUT_PTR(mctx, rdlist);
+
+	return result;
+}
+
+/*
+ * ldapdb_rdatalist_t related functions.
+ */
+isc_result_t
+ldapdb_rdatalist_findrdatatype(ldapdb_rdatalist_t *rdatalist,
+			       dns_rdatatype_t rdtype,
+			       dns_rdatalist_t **rdlistp)
+{
+	dns_rdatalist_t *rdlist;
+
+	REQUIRE(rdatalist != NULL);
+	REQUIRE(rdlistp != NULL && *rdlistp == NULL);
+
+	rdlist = HEAD(*rdatalist);
+	while (rdlist != NULL && rdlist->type != rdtype) {
+		rdlist = NEXT(rdlist, link);
+	}
+
+	*rdlistp = rdlist;
+
+	return (rdlist == NULL) ? ISC_R_NOTFOUND : ISC_R_SUCCESS;
+}
+
+void
+ldapdb_rdatalist_destroy(isc_mem_t *mctx, ldapdb_rdatalist_t *rdatalist)
+{
+	dns_rdatalist_t *rdlist;
+
+	REQUIRE(rdatalist != NULL);
+
+	while (!EMPTY(*rdatalist)) {
+		rdlist = HEAD(*rdatalist);
+		free_rdatalist(mctx, rdlist);
+		UNLINK(*rdatalist, rdlist, link);
+		SAFE_MEM_PUT_PTR(mctx, rdlist);
+	}
+}
+
+void
+free_rdatalist(isc_mem_t *mctx, dns_rdatalist_t *rdlist)
+{
+	dns_rdata_t *rdata;
+	isc_region_t r;
+
+	REQUIRE(rdlist != NULL);
+
+	while (!EMPTY(rdlist->rdata)) {
+		rdata = HEAD(rdlist->rdata);
+		UNLINK(rdlist->rdata, rdata, link);
+		dns_rdata_toregion(rdata, &r);
+		isc_mem_put(mctx, r.base, r.length);
+		SAFE_MEM_PUT_PTR(mctx, rdata);
+	}
+}
+
+/**
+ * Substitute strings into idnsTemplateAttributes
+ * and parse results into list of rdatas.
+ *
+ * idnsTemplateAttribute must have exactly one sub-type like "TXTRecord"
+ * (e.g. "idnsTemplateAttribute;TXTRecord"). The sub-type specifies target type.
+ *
+ * @warning Substitution currently works only for *Record attributes
+ *          and cannot be used for anything else.
+ *
+ * Variables used by the entry are recorded in the template cache
+ * so the entry can be refreshed when some of them change,
+ * see refresh_templates().
+ *
+ * @retval  ISC_R_SUCCESS  A template exists in the entry and values
+ *                         were successfully substituted into it.
+ *                         Rdatalist contains new rdata.
+ * @retval  ISC_R_IGNORE   No template was found or variables
+ *                         do not have defined values. Ignore output.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_parse_rrentry_template(isc_mem_t *mctx, ldap_entry_t *entry,
+			    dns_name_t *origin,
+			    const settings_set_t * const settings,
+			    rr_template_cache_t * const templates,
+			    ldapdb_rdatalist_t *rdatalist)
+{
+	isc_result_t result;
+	ldap_attribute_t *attr;
+	ld_string_t *orig_val = NULL;
+	ld_string_t *new_val = NULL;
+	dns_rdata_t *rdata = NULL;
+	dns_rdataclass_t rdclass;
+	dns_ttl_t ttl;
+	dns_rdatatype_t rdtype;
+	dns_rdatalist_t *rdlist = NULL;
+	isc_boolean_t did_something = ISC_FALSE;
+	isc_boolean_t has_deps = ISC_FALSE;
+	static const char prefix[] = "idnsTemplateAttribute;";
+	static const char prefix_len = sizeof(prefix) - 1;
+
+	CHECK(str_new(mctx, &orig_val));
+	rdclass = ldap_entry_getrdclass(entry);
+	ttl = ldap_entry_getttl(entry, settings);
+
+	while ((attr = ldap_entry_nextattr(entry)) != NULL) {
+		if (strncasecmp(prefix, attr->name, prefix_len) != 0)
+			continue;
+
+		result = ldap_attribute_to_rdatatype(attr->name + prefix_len,
+						     &rdtype);
+		if (result != ISC_R_SUCCESS) {
+			log_bug("%s: substitution into '%s' is not supported",
+				ldap_entry_logname(entry),
+				attr->name + prefix_len);
+			continue;
+		}
+
+		CHECK(findrdatatype_or_create(mctx, rdatalist, rdclass,
+					      rdtype, ttl, &rdlist));
+		for (result = ldap_attr_firstvalue(attr, orig_val);
+		     result == ISC_R_SUCCESS;
+		     result = ldap_attr_nextvalue(attr, orig_val)) {
+			str_destroy(&new_val);
+			if (entry->uuid != NULL) {
+				CHECK(rr_template_deps_add(templates,
+							   str_buf(orig_val),
+							   entry->uuid,
+							   entry->dn));
+				has_deps = ISC_TRUE;
+			}
+			CHECK(rr_template_render(templates, settings,
+						 str_buf(orig_val), &new_val));
+			log_debug(10, "%s: substituted '%s' '%s' -> '%s'",
+				  ldap_entry_logname(entry), attr->name,
+				  str_buf(orig_val), str_buf(new_val));
+			CHECK(parse_rdata(mctx, entry, rdclass, rdtype, origin,
+					  str_buf(new_val), &rdata));
+			APPEND(rdlist->rdata, rdata, link);
+			rdata = NULL;
+			did_something = ISC_TRUE;
+		}
+	}
+	if (has_deps == ISC_TRUE)
+		CHECK(rr_template_entry_save(templates, entry));
+
+cleanup:
+	str_destroy(&orig_val);
+	str_destroy(&new_val);
+	if (result == ISC_R_NOMORE || result == ISC_R_SUCCESS)
+		result = did_something ? ISC_R_SUCCESS : ISC_R_IGNORE;
+
+	return result;
+}
+
+/**
+ * Parse object containing DNS records and substitute idnsAttributeTemplates
+ * into it if they are defined.
+ *
+ * idnsAttributeTemplates take precedence over all statically defined
+ * attributes with RRs.
+ * All static RRs are ignored if substitution was successful.
+ *
+ * @pre rdatalist is empty initialized list.
+ *
+ * @param rdatalist[in,out]
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_parse_rrentry(isc_mem_t *mctx, ldap_entry_t *entry, dns_name_t *origin,
+		   const settings_set_t * const settings,
+		   rr_template_cache_t * const templates,
+		   ldapdb_rdatalist_t *rdatalist)
+{
+	isc_result_t result;
+	dns_rdataclass_t rdclass;
+	dns_ttl_t ttl;
+	dns_rdatatype_t rdtype;
+	dns_rdata_t *rdata = NULL;
+	dns_rdatalist_t *rdlist = NULL;
+	ldap_attribute_t *attr;
+	const char *data_str = "<NULL data>";
+	ld_string_t *data_buf = NULL;
+	const char *fake_mname;
+
+	REQUIRE(EMPTY(*rdatalist));
+
+	ttl = ldap_entry_getttl(entry, settings);
+	rdclass = ldap_entry_getrdclass(entry);
+	if ((entry->class & LDAP_ENTRYCLASS_MASTER) != 0) {
+		CHECK(setting_get_str(SETTING_FAKE_MNAME, settings, &fake_mname));
+		CHECK(add_soa_record(mctx, origin, entry, ttl, rdatalist,
+				     fake_mname));
+	}
+
+	if ((entry->class & LDAP_ENTRYCLASS_TEMPLATE) != 0) {
+		result = ldap_parse_rrentry_template(mctx, entry, origin,
+						     settings, templates,
+						     rdatalist);
+		if (result == ISC_R_SUCCESS)
+			/* successful substitution overrides all constants */
+			return result;
+		else if (result != ISC_R_IGNORE)
+			goto cleanup;
+	}
+
+	CHECK(str_new(mctx, &data_buf));
+	for (result = ldap_entry_firstrdtype(entry, &attr, &rdtype);
+	     result == ISC_R_SUCCESS;
+	     result = ldap_entry_nextrdtype(entry, &attr, &rdtype)) {
+
+		CHECK(findrdatatype_or_create(mctx, rdatalist, rdclass,
+					      rdtype, ttl, &rdlist));
+		for (result = ldap_attr_firstvalue(attr, data_buf);
+		     result == ISC_R_SUCCESS;
+		     result = ldap_attr_nextvalue(attr, data_buf)) {
+			CHECK(parse_rdata(mctx, entry, rdclass,
+					  rdtype, origin,
+					  str_buf(data_buf), &rdata));
+			APPEND(rdlist->rdata, rdata, link);
+			rdata = NULL;
+		}
+		if (result != ISC_R_NOMORE)
+			goto cleanup;
+		rdlist = NULL;
+	}
+	if (result != ISC_R_NOMORE)
+		goto cleanup;
+
+	str_destroy(&data_buf);
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (data_buf != NULL && str_len(data_buf) != 0)
+		data_str = str_buf(data_buf);
+	log_error_r("failed to parse RR entry: %s: data '%s'",
+		    ldap_entry_logname(entry), data_str);
+	str_destroy(&data_buf);
+	return result;
+}
+
+/** Attribute with generators of records, see rr_range.c. */
+#define LDAP_RANGE_ATTR	"idnsRangeGenerator"
+
+/**
+ * Records generated by idnsRangeGenerator values of one or more entries
+ * grouped by owner name. Generated names are not backed by LDAP entries
+ * so they exist only in this set and in the zone database.
+ */
+typedef struct range_set {
+	isc_mem_t		*mctx;
+	dns_name_t		*origin;
+	isc_rwlock_t		rwlock;	/**< required by rbt_iter_first() */
+	dns_rbt_t		*names;	/**< name -> ldapdb_rdatalist_t */
+	dns_rbt_t		*skip;	/**< names defined by other entries */
+
+	/* Names with records in the database are defined by other entries
+	 * unless they were generated by the previous version of the entry. */
+	dns_db_t		*db;
+	dns_dbversion_t		*version;
+	struct range_set	*prev;
+
+	/* Entry which is being expanded. */
+	ldap_entry_t		*entry;
+	dns_rdataclass_t	rdclass;
+	dns_ttl_t		ttl;
+} range_set_t;
+
+static void
+range_set_freenode(void *data, void *arg) {
+	ldapdb_rdatalist_t *rdatalist = data;
+	isc_mem_t *mctx = arg;
+
+	ldapdb_rdatalist_destroy(mctx, rdatalist);
+	SAFE_MEM_PUT_PTR(mctx, rdatalist);
+}
+
+static isc_result_t ATTR_NONNULL(1,2,4) ATTR_CHECKRESULT
+range_set_init(isc_mem_t *mctx, dns_name_t *origin, dns_rbt_t *skip,
+	       range_set_t *set) {
+	isc_result_t result;
+
+	ZERO_PTR(set);
+	set->mctx = mctx;
+	set->origin = origin;
+	set->skip = skip;
+	CHECK(isc_rwlock_init(&set->rwlock, 0, 0));
+	result = dns_rbt_create(mctx, range_set_freenode, mctx, &set->names);
+	if (result != ISC_R_SUCCESS)
+		isc_rwlock_destroy(&set->rwlock);
+
+cleanup:
+	return result;
+}
+
+static void ATTR_NONNULLS
+range_set_destroy(range_set_t *set) {
+	if (set->names == NULL)
+		return;
+
+	dns_rbt_destroy(&set->names);
+	isc_rwlock_destroy(&set->rwlock);
+}
+
+/**
+ * @retval ISC_TRUE if the record is in the rdatalist.
+ */
+static isc_boolean_t ATTR_NONNULLS ATTR_CHECKRESULT
+range_rdata_find(ldapdb_rdatalist_t *rdatalist, dns_rdatatype_t type,
+		 dns_rdata_t *rdata) {
+	dns_rdatalist_t *rdlist;
+	dns_rdata_t *rd;
+
+	for (rdlist = HEAD(*rdatalist); rdlist != NULL;
+	     rdlist = NEXT(rdlist, link)) {
+		if (rdlist->type != type)
+			continue;
+		for (rd = HEAD(rdlist->rdata); rd != NULL; rd = NEXT(rd, link)) {
+			if (dns_rdata_compare(rd, rdata) == 0)
+				return ISC_TRUE;
+		}
+	}
+	return ISC_FALSE;
+}
+
+/**
+ * Name is defined by another entry if it is in the skip set or if it has
+ * some record in the database which was not generated by the previous
+ * version of the entry.
+ *
+ * @retval ISC_TRUE if generated records must not be added to the name.
+ */
+static isc_boolean_t ATTR_NONNULLS ATTR_CHECKRESULT
+range_set_isforeign(range_set_t *set, dns_name_t *owner) {
+	isc_result_t result;
+	dns_dbnode_t *node = NULL;
+	dns_rdatasetiter_t *rds_iter = NULL;
+	dns_rdataset_t rdataset;
+	dns_rdata_t rdata;
+	ldapdb_rdatalist_t empty;
+	ldapdb_rdatalist_t *generated = &empty;
+	isc_boolean_t foreign = ISC_FALSE;
+	void *data = NULL;
+
+	if (set->skip != NULL
+	    && dns_rbt_findname(set->skip, owner, 0, NULL, &data)
+	       == ISC_R_SUCCESS)
+		return ISC_TRUE;
+	if (set->db == NULL)
+		return ISC_FALSE;
+
+	INIT_LIST(empty);
+	data = NULL;
+	if (set->prev != NULL
+	    && dns_rbt_findname(set->prev->names, owner, 0, NULL, &data)
+	       == ISC_R_SUCCESS)
+		generated = data;
+	if (dns_db_findnode(set->db, owner, ISC_FALSE, &node)
+	    != ISC_R_SUCCESS)
+		return ISC_FALSE;
+
+	dns_rdataset_init(&rdataset);
+	if (dns_db_allrdatasets(set->db, node, set->version, 0, &rds_iter)
+	    != ISC_R_SUCCESS)
+		goto cleanup;
+	for (result = dns_rdatasetiter_first(rds_iter);
+	     result == ISC_R_SUCCESS && foreign == ISC_FALSE;
+	     result = dns_rdatasetiter_next(rds_iter)) {
+		dns_rdatasetiter_current(rds_iter, &rdataset);
+		for (result = dns_rdataset_first(&rdataset);
+		     result == ISC_R_SUCCESS && foreign == ISC_FALSE;
+		     result = dns_rdataset_next(&rdataset)) {
+			dns_rdata_init(&rdata);
+			dns_rdataset_current(&rdataset, &rdata);
+			foreign = !range_rdata_find(generated, rdataset.type,
+						    &rdata);
+		}
+		dns_rdataset_disassociate(&rdataset);
+	}
+
+cleanup:
+	if (rds_iter != NULL)
+		dns_rdatasetiter_destroy(&rds_iter);
+	dns_db_detachnode(set->db, &node);
+	return foreign;
+}
+
+/**
+ * Add one generated record to the set, see rr_range_action_t.
+ *
+ * Generated names must not collide with the zone apex, with the name
+ * of the generating entry or with names defined by other entries.
+ * Colliding records are ignored.
+ */
+static isc_result_t ATTR_CHECKRESULT
+range_set_add(void *arg, const char *owner_text, dns_rdatatype_t rdtype,
+	      const char *rdata_text) {
+	range_set_t *set = arg;
+	isc_result_t result;
+	isc_buffer_t buffer;
+	dns_fixedname_t fname;
+	dns_name_t *owner;
+	ldapdb_rdatalist_t *rdatalist = NULL;
+	dns_rdatalist_t *rdlist = NULL;
+	dns_rdata_t *rdata = NULL;
+	dns_rdata_t *rd;
+	isc_region_t r;
+	void *data = NULL;
+	char name_txt[DNS_NAME_FORMATSIZE];
+
+	dns_fixedname_init(&fname);
+	owner = dns_fixedname_name(&fname);
+	isc_buffer_constinit(&buffer, owner_text, strlen(owner_text));
+	isc_buffer_add(&buffer, strlen(owner_text));
+	result = dns_name_fromtext(owner, &buffer, set->origin, 0, NULL);
+	if (result != ISC_R_SUCCESS) {
+		log_error_r("%s: invalid generated name '%s'",
+			    ldap_entry_logname(set->entry), owner_text);
+		goto cleanup;
+	}
+	if (!dns_name_issubdomain(owner, set->origin)) {
+		log_error("%s: generated name '%s' is outside of the zone",
+			  ldap_entry_logname(set->entry), owner_text);
+		CLEANUP_WITH(DNS_R_BADOWNERNAME);
+	}
+	if (dns_name_equal(owner, set->origin)
+	    || dns_name_equal(owner, &set->entry->fqdn)
+	    || range_set_isforeign(set, owner) == ISC_TRUE) {
+		dns_name_format(owner, name_txt, DNS_NAME_FORMATSIZE);
+		log_error("%s: name '%s' is defined by another entry, "
+			  "ignoring generated record",
+			  ldap_entry_logname(set->entry), name_txt);
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	}
+
+	data = NULL;
+	result = dns_rbt_findname(set->names, owner, 0, NULL, &data);
+	if (result == ISC_R_SUCCESS) {
+		rdatalist = data;
+	} else if (result == ISC_R_NOTFOUND || result == DNS_R_PARTIALMATCH) {
+		CHECKED_MEM_GET_PTR(set->mctx, rdatalist);
+		INIT_LIST(*rdatalist);
+		result = dns_rbt_addname(set->names, owner, rdatalist);
+		if (result != ISC_R_SUCCESS) {
+			SAFE_MEM_PUT_PTR(set->mctx, rdatalist);
+			goto cleanup;
+		}
+	} else {
+		goto cleanup;
+	}
+
+	result = parse_rdata(set->mctx, set->entry, set->rdclass, rdtype,
+			     set->origin, rdata_text, &rdata);
+	if (result != ISC_R_SUCCESS) {
+		log_error_r("%s: invalid generated record '%s' '%s'",
+			    ldap_entry_logname(set->entry), owner_text,
+			    rdata_text);
+		goto cleanup;
+	}
+	CHECK(findrdatatype_or_create(set->mctx, rdatalist, set->rdclass,
+				      rdtype, set->ttl, &rdlist));
+	/* diff cannot contain the same record twice */
+	for (rd = HEAD(rdlist->rdata); rd != NULL; rd = NEXT(rd, link)) {
+		if (dns_rdata_compare(rd, rdata) == 0)
+			break;
+	}
+	if (rd == NULL) {
+		APPEND(rdlist->rdata, rdata, link);
+		rdata = NULL;
+	}
+
+cleanup:
+	if (rdata != NULL) {
+		dns_rdata_toregion(rdata, &r);
+		isc_mem_put(set->mctx, r.base, r.length);
+		SAFE_MEM_PUT_PTR(set->mctx, rdata);
+	}
+	return result;
+}
+
+/**
+ * Add records generated by newline-separated generator values of the entry
+ * to the set. All values of one entry together can generate at most
+ * RR_RANGE_MAX records, the limit is checked before anything is expanded.
+ *
+ * @retval ISC_R_RANGE Values generate too many records.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+range_set_expand(range_set_t *set, ldap_entry_t *entry,
+		 const settings_set_t *settings, const char *specs) {
+	isc_result_t result;
+	char *buf = NULL;
+	char *end;
+	char *spec;
+	unsigned long count;
+	unsigned long total = 0;
+
+	set->entry = entry;
+	set->rdclass = ldap_entry_getrdclass(entry);
+	set->ttl = ldap_entry_getttl(entry, settings);
+
+	CHECKED_MEM_STRDUP(set->mctx, specs, buf);
+	end = buf + strlen(buf);
+	for (spec = buf; spec < end; spec++) {
+		if (*spec == '\n')
+			*spec = '\0';
+	}
+
+	for (spec = buf; spec <= end; spec += strlen(spec) + 1) {
+		CHECK(rr_range_count(spec, &count));
+		total += count;
+		if (total > RR_RANGE_MAX) {
+			log_error("%s: range generators produce more than "
+				  "%u records", ldap_entry_logname(entry),
+				  RR_RANGE_MAX);
+			CLEANUP_WITH(ISC_R_RANGE);
+		}
+	}
+	for (spec = buf; spec <= end; spec += strlen(spec) + 1)
+		CHECK(rr_range_expand(set->mctx, spec, range_set_add, set));
+
+cleanup:
+	if (buf != NULL)
+		isc_mem_free(set->mctx, buf);
+	set->entry = NULL;
+	return result;
+}
+
+/**
+ * Add records from the rdatalist which are present in the zone database
+ * to the diff as deletions. Other records of the node are left intact.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+range_diff_removed(isc_mem_t *mctx, dns_name_t *name,
+		   ldapdb_rdatalist_t *rdatalist, dns_db_t *rbtdb,
+		   dns_dbnode_t *node, dns_dbversion_t *version,
+		   dns_diff_t *diff) {
+	isc_result_t result = ISC_R_SUCCESS;
+	dns_rdatalist_t *rdlist;
+	dns_rdataset_t rdataset;
+	dns_rdata_t rdata;
+	dns_difftuple_t *tp = NULL;
+
+	dns_rdataset_init(&rdataset);
+	for (rdlist = HEAD(*rdatalist); rdlist != NULL;
+	     rdlist = NEXT(rdlist, link)) {
+		result = dns_db_findrdataset(rbtdb, node, version, rdlist->type,
+					     0, 0, &rdataset, NULL);
+		if (result == ISC_R_NOTFOUND)
+			continue;
+		else if (result != ISC_R_SUCCESS)
+			goto cleanup;
+		for (result = dns_rdataset_first(&rdataset);
+		     result == ISC_R_SUCCESS;
+		     result = dns_rdataset_next(&rdataset)) {
+			dns_rdata_init(&rdata);
+			dns_rdataset_current(&rdataset, &rdata);
+			if (range_rdata_find(rdatalist, rdlist->type, &rdata)
+			    == ISC_FALSE)
+				continue;
+			CHECK(dns_difftuple_create(mctx, DNS_DIFFOP_DEL, name,
+						   rdataset.ttl, &rdata, &tp));
+			dns_diff_appendminimal(diff, &tp);
+		}
+		if (result != ISC_R_NOMORE)
+			goto cleanup;
+		dns_rdataset_disassociate(&rdataset);
+	}
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	if (dns_rdataset_isassociated(&rdataset))
+		dns_rdataset_disassociate(&rdataset);
+	return result;
+}
+
+/**
+ * Compute difference between zone database and the set. Generated records
+ * replace whole content of respective nodes. Names which were generated
+ * by the previous version of the entry and are not generated anymore lose
+ * only the records generated previously, other records of such names
+ * might have been added by other entries in the meantime.
+ *
+ * @param[in] prev Records generated by the previous version or NULL.
+ */
+static isc_result_t ATTR_NONNULL(1,3,4,5) ATTR_CHECKRESULT
+range_set_diff(range_set_t *set, range_set_t *prev, dns_db_t *rbtdb,
+	       dns_dbversion_t *version, dns_diff_t *diff) {
+	isc_result_t result;
+	rbt_iterator_t *iter = NULL;
+	dns_dbnode_t *node = NULL;
+	dns_rdatasetiter_t *rbt_rds_iterator = NULL;
+	dns_diff_t name_diff;
+	void *data;
+	DECLARE_BUFFERED_NAME(name);
+
+	dns_diff_init(set->mctx, &name_diff);
+	INIT_BUFFERED_NAME(name);
+	for (result = rbt_iter_first(set->mctx, set->names, &set->rwlock,
+				     &iter, &name);
+	     result == ISC_R_SUCCESS;
+	     dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
+		data = NULL;
+		CHECK(dns_rbt_findname(set->names, &name, 0, NULL, &data));
+		CHECK(dns_db_findnode(rbtdb, &name, ISC_TRUE, &node));
+		result = dns_db_allrdatasets(rbtdb, node, version, 0,
+					     &rbt_rds_iterator);
+		if (result == ISC_R_SUCCESS) {
+			CHECK(diff_ldap_rbtdb(set->mctx, &name, data,
+					      rbt_rds_iterator, &name_diff));
+			dns_rdatasetiter_destroy(&rbt_rds_iterator);
+		} else if (result != ISC_R_NOTFOUND) {
+			goto cleanup;
+		}
+		dns_db_detachnode(rbtdb, &node);
+		/* Tuples for different names never cancel out so minimal
+		 * diff of each name can be appended in constant time. */
+		ISC_LIST_APPENDLIST(diff->tuples, name_diff.tuples, link);
+	}
+	if (result != ISC_R_NOTFOUND && result != ISC_R_NOMORE)
+		goto cleanup;
+	result = ISC_R_SUCCESS;
+	if (prev == NULL)
+		goto cleanup;
+
+	/* names which are not generated anymore */
+	dns_name_reset(&name);
+	for (result = rbt_iter_first(prev->mctx, prev->names, &prev->rwlock,
+				     &iter, &name);
+	     result == ISC_R_SUCCESS;
+	     dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
+		data = NULL;
+		if (dns_rbt_findname(set->names, &name, 0, NULL, &data)
+		    == ISC_R_SUCCESS)
+			continue;
+		CHECK(dns_rbt_findname(prev->names, &name, 0, NULL, &data));
+		result = dns_db_findnode(rbtdb, &name, ISC_FALSE, &node);
+		if (result == ISC_R_NOTFOUND)
+			continue;
+		else if (result != ISC_R_SUCCESS)
+			goto cleanup;
+		CHECK(range_diff_removed(set->mctx, &name, data, rbtdb, node,
+					 version, &name_diff));
+		dns_db_detachnode(rbtdb, &node);
+		ISC_LIST_APPENDLIST(diff->tuples, name_diff.tuples, link);
+	}
+	if (result == ISC_R_NOTFOUND || result == ISC_R_NOMORE)
+		result = ISC_R_SUCCESS;
+
+cleanup:
+	rbt_iter_stop(&iter);
+	if (rbt_rds_iterator != NULL)
+		dns_rdatasetiter_destroy(&rbt_rds_iterator);
+	if (node != NULL)
+		dns_db_detachnode(rbtdb, &node);
+	dns_diff_clear(&name_diff);
+	return result;
+}
+
+/**
+ * Render idnsRangeGenerator values of the entry. Variables used in the
+ * values are recorded in the template cache so the entry is refreshed
+ * when some of them change, see refresh_templates(). Values with
+ * undefined variables are ignored.
+ *
+ * @param[out] specs Values separated by newline, empty string if the entry
+ *                   does not generate any records.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+range_specs_get(ldap_instance_t *inst, ldap_entry_t *entry,
+		const settings_set_t *settings, ld_string_t *specs) {
+	isc_result_t result;
+	ldap_valuelist_t values;
+	ldap_value_t *val;
+	ld_string_t *rendered = NULL;
+
+	CHECK(str_init_char(specs, ""));
+	if ((entry->class & LDAP_ENTRYCLASS_RANGE) == 0
+	    || ldap_entry_getvalues(entry, LDAP_RANGE_ATTR, &values)
+	       != ISC_R_SUCCESS)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	if (entry->uuid != NULL)
+		CHECK(rr_template_entry_save(inst->rr_templates, entry));
+
+	for (val = HEAD(values); val != NULL; val = NEXT(val, link)) {
+		str_destroy(&rendered);
+		if (entry->uuid != NULL)
+			CHECK(rr_template_deps_add(inst->rr_templates,
+						   val->value, entry->uuid,
+						   entry->dn));
+		result = rr_template_render(inst->rr_templates, settings,
+					    val->value, &rendered);
+		if (result == ISC_R_IGNORE) {
+			log_debug(3, "%s: ignoring range generator '%s'",
+				  ldap_entry_logname(entry), val->value);
+			continue;
+		} else if (result != ISC_R_SUCCESS) {
+			goto cleanup;
+		}
+		if (str_len(specs) > 0)
+			CHECK(str_cat_char(specs, "\n"));
+		CHECK(str_cat_char(specs, str_buf(rendered)));
+	}
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	str_destroy(&rendered);
+	return result;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+add_soa_record(isc_mem_t *mctx, dns_name_t *origin,
+	       ldap_entry_t *entry, dns_ttl_t ttl, ldapdb_rdatalist_t *rdatalist,
+	       const char *fake_mname)
+{
+	isc_result_t result;
+	ld_string_t *string = NULL;
+	dns_rdataclass_t rdclass;
+	dns_rdata_t *rdata = NULL;
+	dns_rdatalist_t *rdlist = NULL;
+
+	CHECK(str_new(mctx, &string));
+
+	CHECK(ldap_entry_getfakesoa(entry, fake_mname, string));
+	rdclass = ldap_entry_getrdclass(entry);
+	CHECK(parse_rdata(mctx, entry, rdclass, dns_rdatatype_soa, origin,
+			  str_buf(string), &rdata));
+
+	CHECK(findrdatatype_or_create(mctx, rdatalist, rdclass, dns_rdatatype_soa,
+				      ttl, &rdlist));
+
+	APPEND(rdlist->rdata, rdata, link);
+
+cleanup:
+	str_destroy(&string);
+	if (result != ISC_R_SUCCESS)
+		SAFE_MEM_PUT_PTR(mctx, rdata);
+
+	return result;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+parse_rdata(isc_mem_t *mctx, ldap_entry_t *entry,
+	    dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
+	    dns_name_t *origin, const char *rdata_text, dns_rdata_t **rdatap)
+{
+	isc_result_t result;
+	isc_consttextregion_t text;
+	isc_buffer_t lex_buffer;
+	isc_region_t rdatamem;
+	dns_rdata_t *rdata;
+
+	REQUIRE(entry != NULL);
+	REQUIRE(rdata_text != NULL);
+	REQUIRE(rdatap != NULL);
+
+	rdata = NULL;
+	rdatamem.base = NULL;
+
+	text.base = rdata_text;
+	text.length = strlen(text.base);
+
+	isc_buffer_init(&lex_buffer, (char *)text.base, text.length);
+	isc_buffer_add(&lex_buffer, text.length);
+	isc_buffer_setactive(&lex_buffer, text.length);
+
+	CHECK(isc_lex_openbuffer(entry->lex, &lex_buffer));
+
+	isc_buffer_init(&entry->rdata_target, entry->rdata_target_mem,
+			DNS_RDATA_MAXLENGTH);
+	CHECK(dns_rdata_fromtext(NULL, rdclass, rdtype, entry->lex, origin,
+				 0, mctx, &entry->rdata_target, NULL));
+
+	CHECKED_MEM_GET_PTR(mctx, rdata);
+	dns_rdata_init(rdata);
+
+	rdatamem.length = isc_buffer_usedlength(&entry->rdata_target);
+	CHECKED_MEM_GET(mctx, rdatamem.base, rdatamem.length);
+
+	memcpy(rdatamem.base, isc_buffer_base(&entry->rdata_target),
+	       rdatamem.length);
+	dns_rdata_fromregion(rdata, rdclass, rdtype, &rdatamem);
+
+	isc_lex_close(entry->lex);
+
+	*rdatap = rdata;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	isc_lex_close(entry->lex);
+	SAFE_MEM_PUT_PTR(mctx, rdata);
+	if (rdatamem.base != NULL)
+		isc_mem_put(mctx, rdatamem.base, rdatamem.length);
+
+	return result;
+}
+
+/* FIXME: Tested with SASL/GSSAPI/KRB5 only */
+static int ATTR_NONNULL(3) ATTR_CHECKRESULT
+ldap_sasl_interact(LDAP *ld, unsigned flags, void *defaults, void *sin)
+{
+	sasl_interact_t *in;
+	ldap_instance_t *ldap_inst = defaults;
+	int ret = LDAP_OTHER;
+	isc_result_t result;
+
+	REQUIRE(ldap_inst != NULL);
+	UNUSED(flags);
+
+	if (ld == NULL || sin == NULL)
+		return LDAP_PARAM_ERROR;
+
+	log_debug(4, "doing interactive bind");
+	for (in = sin; in != NULL && in->id != SASL_CB_LIST_END; in++) {
+		switch (in->id) {
+		case SASL_CB_USER:
+			log_debug(4, "got request for SASL_CB_USER");
+			CHECK(setting_get_str(SETTING_SASL_USER,
+					      ldap_inst->server_ldap_settings,
+					      (const char **)&in->result));
+			in->len = strlen(in->result);
+			ret = LDAP_SUCCESS;
+			break;
+		case SASL_CB_GETREALM:
+			log_debug(4, "got request for SASL_CB_GETREALM");
+			CHECK(setting_get_str(SETTING_SASL_REALM,
+					      ldap_inst->server_ldap_settings,
+					      (const char **)&in->result));
+			in->len = strlen(in->result);
+			ret = LDAP_SUCCESS;
+			break;
+		case SASL_CB_AUTHNAME:
+			log_debug(4, "got request for SASL_CB_AUTHNAME");
+			CHECK(setting_get_str(SETTING_SASL_AUTH_NAME,
+					      ldap_inst->server_ldap_settings,
+					      (const char **)&in->result));
+			in->len = strlen(in->result);
+			ret = LDAP_SUCCESS;
+			break;
+		case SASL_CB_PASS:
+			log_debug(4, "got request for SASL_CB_PASS");
+			CHECK(setting_get_str(SETTING_SASL_PASSWORD,
+					      ldap_inst->server_ldap_settings,
+					      (const char **)&in->result));
+			in->len = strlen(in->result);
+			ret = LDAP_SUCCESS;
+			break;
+		default:
+			goto cleanup;
+		}
+	}
+
+	return ret;
+
+cleanup:
+	in->result = NULL;
+	in->len = 0;
+	return LDAP_OTHER;
+}
+
+/*
+ * Initialize the LDAP handle and bind to the server. Needed authentication
+ * credentials and settings are available from the ldap_inst.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_connect(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn,
+	     isc_boolean_t force)
+{
+	LDAP *ld = NULL;
+	int ret;
+	int version;
+	struct timeval timeout;
+	isc_result_t result = ISC_R_FAILURE;
+	const char *uri = NULL;
+	const char *ldap_hostname = NULL;
+	isc_uint32_t timeout_sec;
+
+	REQUIRE(ldap_inst != NULL);
+	REQUIRE(ldap_conn != NULL);
+
+	CHECK(setting_get_str(SETTING_URI, ldap_inst->local_settings, &uri));
+	ret = ldap_initialize(&ld, uri);
+	if (ret != LDAP_SUCCESS) {
+		log_error("LDAP initialization failed: %s",
+			  ldap_err2string(ret));
+		CLEANUP_WITH(ISC_R_FAILURE);
+	}
+
+	version = LDAP_VERSION3;
+	ret = ldap_set_option(ld, LDAP_OPT_PROTOCOL_VERSION, &version);
+	LDAP_OPT_CHECK(ret, "failed to set LDAP version");
+
+	CHECK(setting_get_uint(SETTING_TIMEOUT, ldap_inst->server_ldap_settings,
+			       &timeout_sec));
+	timeout.tv_sec = timeout_sec;
+	timeout.tv_usec = 0;
+
+	ret = ldap_set_option(ld, LDAP_OPT_TIMEOUT, &timeout);
+	LDAP_OPT_CHECK(ret, "failed to set timeout");
+
+	CHECK(setting_get_str(SETTING_LDAP_HOSTNAME, ldap_inst->local_settings,
+			      &ldap_hostname));
+	if (strlen(ldap_hostname) > 0) {
+		ret = ldap_set_option(ld, LDAP_OPT_HOST_NAME, ldap_hostname);
+		LDAP_OPT_CHECK(ret, "failed to set LDAP_OPT_HOST_NAME");
+	}
+
+	if (ldap_conn->handle != NULL)
+		ldap_unbind_ext_s(ldap_conn->handle, NULL, NULL);
+	ldap_conn->handle = ld;
+	ld = NULL; /* prevent double-unbind from ldap_reconnect() and cleanup: */
+
+	CHECK(ldap_reconnect(ldap_inst, ldap_conn, force));
+	return result;
+
+cleanup:
+	if (ld != NULL)
+		ldap_unbind_ext_s(ld, NULL, NULL);
+
+	/* Make sure handle is NULL. */
+	if (ldap_conn->handle != NULL) {
+		ldap_unbind_ext_s(ldap_conn->handle, NULL, NULL);
+		ldap_conn->handle = NULL;
+	}
+
+	return result;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_reconnect(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn,
+	       isc_boolean_t force)
+{
+	isc_result_t result;
+	int ret = 0;
+	const char *bind_dn = NULL;
+	const char *password = NULL;
+	const char *uri = NULL;
+	const char *sasl_mech = NULL;
+	const char *krb5_principal = NULL;
+	const char *krb5_keytab = NULL;
+	ldap_auth_t auth_method_enum = AUTH_INVALID;
+	isc_uint32_t reconnect_interval;
+
+	if (force)
+		goto force_reconnect;
+
+	if (ldap_conn->tries > 0) {
+		isc_time_t now;
+		int time_cmp;
+
+		result = isc_time_now(&now);
+		time_cmp = isc_time_compare(&now, &ldap_conn->next_reconnect);
+		if (result == ISC_R_SUCCESS && time_cmp < 0)
+			return ISC_R_SOFTQUOTA;
+	}
+
+	/* Set the next possible reconnect time. */
+	{
+		isc_interval_t delay;
+		unsigned int i;
+		unsigned int seconds;
+		const unsigned int intervals[] = { 2, 5, 20, UINT_MAX };
+		const size_t ntimes = sizeof(intervals) / sizeof(intervals[0]);
+
+		i = ISC_MIN(ntimes - 1, ldap_conn->tries);
+		CHECK(setting_get_uint(SETTING_RECONNECT_INTERVAL,
+				       ldap_inst->server_ldap_settings,
+				       &reconnect_interval));
+		seconds = ISC_MIN(intervals[i], reconnect_interval);
+		isc_interval_set(&delay, seconds, 0);
+		isc_time_nowplusinterval(&ldap_conn->next_reconnect, &delay);
+	}
+
+	ldap_conn->tries++;
+force_reconnect:
+	CHECK(setting_get_str(SETTING_URI, ldap_inst->local_settings, &uri));
+	log_debug(2, "trying to establish LDAP connection to %s", uri);
+
+	CHECK(setting_get_uint(SETTING_AUTH_METHOD_ENUM, ldap_inst->local_settings,
+			       &auth_method_enum));
+	switch (auth_method_enum) {
+	case AUTH_NONE:
+		ret = ldap_simple_bind_s(ldap_conn->handle, NULL, NULL);
+		break;
+	case AUTH_SIMPLE:
+		CHECK(setting_get_str(SETTING_BIND_DN, ldap_inst->server_ldap_settings,
+				      &bind_dn));
+		CHECK(setting_get_str(SETTING_PASSWORD, ldap_inst->server_ldap_settings,
+				      &password));
+		ret = ldap_simple_bind_s(ldap_conn->handle, bind_dn, password);
+		break;
+	case AUTH_SASL:
+		CHECK(setting_get_str(SETTING_SASL_MECH, ldap_inst->local_settings,
+				      &sasl_mech));
+		if (strcmp(sasl_mech, "GSSAPI") == 0) {
+			CHECK(setting_get_str(SETTING_KRB5_PRINCIPAL,
+					      ldap_inst->local_settings,
+					      &krb5_principal));
+			CHECK(setting_get_str(SETTING_KRB5_KEYTAB,
+					      ldap_inst->local_settings,
+					      &krb5_keytab));
+			LOCK(&ldap_inst->kinit_lock);
+			result = get_krb5_tgt(ldap_inst->mctx,
+					      krb5_principal,
+					      krb5_keytab);
+			UNLOCK(&ldap_inst->kinit_lock);
+			if (result != ISC_R_SUCCESS)
+				return ISC_R_NOTCONNECTED;
+		}
+
+		log_debug(4, "trying interactive bind using '%s' mechanism",
+			  sasl_mech);
+		ret = ldap_sasl_interactive_bind_s(ldap_conn->handle, NULL,
+						   sasl_mech,
+						   NULL, NULL, LDAP_SASL_QUIET,
+						   ldap_sasl_interact,
+						   ldap_inst);
+		break;
+	case AUTH_INVALID:
+		UNEXPECTED_ERROR(__FILE__, __LINE__,
+				"invalid auth_method_enum value %u",
+				 auth_method_enum);
+		break;
+
+	default:
+		log_bug("unsupported authentication mechanism");
+		ret = LDAP_OTHER;
+		break;
+	}
+
+	if (ret != LDAP_SUCCESS) {
+		log_ldap_error(ldap_conn->handle, "bind to LDAP server failed");
+
+		/*
+		 * Clean the connection handle.
+		 */
+		if (ldap_conn->handle != NULL) {
+			ldap_unbind_ext_s(ldap_conn->handle, NULL, NULL);
+			ldap_conn->handle = NULL;
+		}
+
+		switch (ret) {
+		case LDAP_INVALID_CREDENTIALS:
+			return ISC_R_NOPERM;
+		case LDAP_SERVER_DOWN:
+			return ISC_R_NOTCONNECTED;
+		case LDAP_TIMEOUT:
+			return ISC_R_TIMEDOUT;
+		default:
+			return ISC_R_FAILURE;
+		}
+	} else
+		log_debug(2, "bind to LDAP server successful");
+
+	ldap_conn->tries = 0;
+
+	/* Failure is not fatal, type-specific attributes are tried first. */
+	result = rr_schema_refresh(ldap_inst->rr_schema, ldap_conn->handle);
+
+	return ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+static isc_result_t ATTR_NONNULLS
+handle_connection_error(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn,
+			isc_boolean_t force)
+{
+	int ret;
+	int err_code;
+	isc_result_t result = ISC_R_FAILURE;
+
+	REQUIRE(ldap_conn != NULL);
+
+	if (ldap_conn->handle == NULL)
+		goto reconnect;
+
+	ret = ldap_get_option(ldap_conn->handle, LDAP_OPT_RESULT_CODE,
+				(void *)&err_code);
+	if (ret != LDAP_OPT_SUCCESS) {
+		log_error("handle_connection_error failed to obtain ldap error code");
+		goto reconnect;
+	}
+
+	switch (err_code) {
+	case LDAP_NO_SUCH_OBJECT:
+		ldap_conn->tries = 0;
+		result = ISC_R_SUCCESS;
+		break;
+	case LDAP_TIMEOUT:
+		log_error("LDAP query timed out. Try to adjust \"timeout\" parameter");
+		result = ISC_R_TIMEDOUT;
+		break;
+	case LDAP_INVALID_DN_SYNTAX:
+	case LDAP_INVALID_SYNTAX:
+	case LDAP_FILTER_ERROR:
+		log_ldap_error(ldap_conn->handle, "invalid syntax in "
+			       "handle_connection_error indicates a bug");
+		result = ISC_R_UNEXPECTEDTOKEN;
+		break;
+	default:
+		/* Try to reconnect on other errors. */
+		log_ldap_error(ldap_conn->handle, "connection error");
+reconnect:
+		if (ldap_conn->handle == NULL && force == ISC_FALSE)
+			log_error("connection to the LDAP server was lost");
+		result = ldap_connect(ldap_inst, ldap_conn, force);
+		if (result == ISC_R_SUCCESS)
+			log_info("successfully reconnected to LDAP server");
+		break;
+	}
+
+	return result;
+}
+
+/**
+ * Apply LDAP modifications.
+ *
+ * @retval ISC_R_SUCCESS
+ * @retval DNS_R_UNKNOWN = LDAP_OBJECT_CLASS_VIOLATION
+ *                       or LDAP_INSUFFICIENT_ACCESS. Most likely an attribute
+ *                       for a DNS RR type cannot be added because it is not
+ *                       present in the LDAP schema.
+ */
+isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_modify_do(ldap_instance_t *ldap_inst, const char *dn, LDAPMod **mods,
+		isc_boolean_t delete_node)
+{
+	int ret;
+	int err_code;
+	const char *operation_str;
+	isc_boolean_t once = ISC_FALSE;
+	isc_result_t result;
+	ldap_connection_t *ldap_conn = NULL;
+
+	REQUIRE(dn != NULL);
+	REQUIRE(mods != NULL);
+	REQUIRE(ldap_inst != NULL);
+
+	/* Any mod_op can be ORed with LDAP_MOD_BVALUES. */
+	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_ADD)
+		operation_str = "modifying(add)";
+	else if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_DELETE)
+		operation_str = "modifying(del)";
+	else if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_REPLACE)
+		operation_str = "modifying(replace)";
+	else {
+		operation_str = "modifying(unknown operation)";
+		log_bug("%s: 0x%x", operation_str, mods[0]->mod_op);
+		CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
+	}
+
+	CHECK(ldap_pool_getconnection(ldap_inst->pool, &ldap_conn));
+	if (ldap_conn->handle == NULL) {
+		/*
+		 * handle can be NULL when the first connection to LDAP wasn't
+		 * successful
+		 * TODO: handle this case inside ldap_pool_getconnection()?
+		 */
+retry:
+		once = ISC_TRUE;
+		CHECK(handle_connection_error(ldap_inst, ldap_conn, ISC_FALSE));
+	}
+
+	if (delete_node) {
+		log_debug(2, "deleting whole node: '%s'", dn);
+		ret = ldap_delete_ext_s(ldap_conn->handle, dn, NULL, NULL);
+	} else {
+		log_debug(2, "writing to '%s': %s", dn, operation_str);
+		ret = ldap_modify_ext_s(ldap_conn->handle, dn, mods, NULL, NULL);
+	}
+
+	result = (ret == LDAP_SUCCESS) ? ISC_R_SUCCESS : ISC_R_FAILURE;
+	if (ret == LDAP_SUCCESS)
+		goto cleanup;
+
+	LDAP_OPT_CHECK(ldap_get_option(ldap_conn->handle, LDAP_OPT_RESULT_CODE,
+			&err_code), "ldap_modify_do(%s) failed to obtain ldap error code",
+			operation_str);
+
+	/* If there is no object yet, create it with an ldap add operation. */
+	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_ADD &&
+	     err_code == LDAP_NO_SUCH_OBJECT) {
+		int i;
+		LDAPMod **new_mods;
+		char *obj_str[] = { "idnsRecord", NULL };
+		LDAPMod obj_class = {
+			0, "objectClass", { .modv_strvals = obj_str },
+		};
 
-		/* dnssec-loadkeys-interval */
-		CHECK(dns_zone_setrefreshkeyinterval(secure, 60));
+		/*
+		 * Create a new array of LDAPMod structures. We will change
+		 * the mod_op member of each one to 0 (but preserve
+		 * LDAP_MOD_BVALUES. Additionally, we also need to specify
+		 * the objectClass attribute.
+		 */
+		for (i = 0; mods[i]; i++)
+			mods[i]->mod_op &= LDAP_MOD_BVALUES;
+		new_mods = alloca((i + 2) * sizeof(LDAPMod *));
+		memcpy(new_mods, mods, i * sizeof(LDAPMod *));
+		new_mods[i] = &obj_class;
+		new_mods[i + 1] = NULL;
 
-		result = setting_update_from_ldap_entry("nsec3param",
-							zone_settings,
-							"nsec3paramRecord",
-							entry);
-		if (result == ISC_R_SUCCESS)
-			CHECK(zone_master_reconfigure_nsec3param(zone_settings,
-								 secure));
-		else if (result == ISC_R_IGNORE)
-			result = ISC_R_SUCCESS;
-		else
+		ret = ldap_add_ext_s(ldap_conn->handle, dn, new_mods, NULL, NULL);
+		result = (ret == LDAP_SUCCESS) ? ISC_R_SUCCESS : ISC_R_FAILURE;
+		if (ret == LDAP_SUCCESS)
 			goto cleanup;
+		LDAP_OPT_CHECK(ldap_get_option(ldap_conn->handle, LDAP_OPT_RESULT_CODE,
+				&err_code),
+				"ldap_modify_do(add) failed to obtain ldap error code");
+		operation_str = "adding";
+	}
 
-		/* auto-dnssec = maintain */
-		dns_zone_setkeyopt(secure, DNS_ZONEKEY_ALLOW, ISC_TRUE);
-		dns_zone_setkeyopt(secure, DNS_ZONEKEY_MAINTAIN, ISC_TRUE);
+	log_ldap_error(ldap_conn->handle, "while %s entry '%s'", operation_str, dn);
+	/* attempt to manipulate attribute failed - likely a unknown RR type */
+	if (err_code == LDAP_OBJECT_CLASS_VIOLATION
+	    || err_code == LDAP_INSUFFICIENT_ACCESS) /* this is for 389 DS */
+		CLEANUP_WITH(DNS_R_UNKNOWN);
+
+	/* do not error out if we are trying to delete an
+	 * unexisting attribute */
+	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) != LDAP_MOD_DELETE ||
+	    err_code != LDAP_NO_SUCH_ATTRIBUTE) {
+		result = ISC_R_FAILURE;
+		if (once == ISC_FALSE) {
+			log_error("retrying LDAP operation (%s) on entry '%s'",
+				  operation_str, dn);
+			goto retry;
+		}
 	}
 
 cleanup:
-	if (inview != NULL)
-		dns_zone_detach(&inview);
+	ldap_pool_putconnection(ldap_inst->pool, &ldap_conn);
+
 	return result;
 }
 
-/**
- * Synchronize internal RBTDB with master zone object in LDAP and update serial
- * as necessary.
- *
- * @param[in]  new_zone Is the RBTDB empty? (I.e. even without SOA record.)
- * @param[in]  version  LDAP DB opened for reading and writing.
- * @param[out] diff     Initialized diff. It will be filled with differences
- *                      between RBTDB and LDAP object + SOA serial update.
- * @param[out] new_serial     SOA serial after update;
- *                            valid if ldap_writeback = ISC_TRUE.
- * @param[out] ldap_writeback SOA serial was updated.
- * @param[out] data_changed   Other data were updated.
- *
- */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-zone_sync_apex(const ldap_instance_t * const inst,
-	       ldap_entry_t * const entry, dns_name_t name,
-	       const sync_state_t sync_state, const isc_boolean_t new_zone,
-	       dns_db_t * const ldapdb, dns_db_t * const rbtdb,
-	       dns_dbversion_t * const version,
-	       const settings_set_t * const zone_settings,
-	       dns_diff_t * const diff,
-	       isc_uint32_t * const new_serial,
-	       isc_boolean_t * const ldap_writeback,
-	       isc_boolean_t * const data_changed) {
-	isc_result_t result;
-	ldapdb_rdatalist_t rdatalist;
-	dns_rdatasetiter_t *rbt_rds_iterator = NULL;
-	/* RBTDB's origin node cannot be detached until the node is non-empty.
-	 * This is workaround for ISC-Bug #35080. */
-	dns_dbnode_t *node = NULL;
-	dns_difftuple_t *soa_tuple = NULL;
-	isc_uint32_t curr_serial;
+void ATTR_NONNULLS
+ldap_mod_free(isc_mem_t *mctx, LDAPMod **changep)
+{
+	LDAPMod *change;
 
-	REQUIRE(ldap_writeback != NULL);
+	REQUIRE(changep != NULL);
 
-	INIT_LIST(rdatalist);
-	*ldap_writeback = ISC_FALSE; /* GCC */
+	change = *changep;
+	if (change == NULL)
+		return;
 
-	CHECK(ldap_parse_rrentry(inst->mctx, entry, &name,
-				 zone_settings, &rdatalist));
+	free_char_array(mctx, &change->mod_values);
+	if (change->mod_type != NULL)
+		SAFE_MEM_PUT(mctx, change->mod_type, LDAP_ATTR_FORMATSIZE);
+	SAFE_MEM_PUT_PTR(mctx, change);
 
-	CHECK(dns_db_getoriginnode(rbtdb, &node));
-	result = dns_db_allrdatasets(rbtdb, node, version, 0,
-				     &rbt_rds_iterator);
-	if (result == ISC_R_SUCCESS) {
-		CHECK(diff_ldap_rbtdb(inst->mctx, &name, &rdatalist,
-				      rbt_rds_iterator, diff));
-		dns_rdatasetiter_destroy(&rbt_rds_iterator);
-	} else if (result != ISC_R_NOTFOUND)
-		goto cleanup;
+	*changep = NULL;
+}
 
-	/* New zone doesn't have serial defined yet. */
-	if (new_zone != ISC_TRUE)
-		CHECK(dns_db_getsoaserial(rbtdb, version, &curr_serial));
+isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_mod_create(isc_mem_t *mctx, LDAPMod **changep)
+{
+	LDAPMod *change = NULL;
+	isc_result_t result;
 
-	/* Detect if SOA serial is affected by the update or not.
-	 * Always bump serial in case of re-synchronization. */
-	CHECK(diff_analyze_serial(diff, &soa_tuple, data_changed));
-	if (new_zone == ISC_TRUE || *data_changed == ISC_TRUE ||
-	    sync_state != sync_finished) {
-		if (soa_tuple == NULL) {
-			/* The diff doesn't contain new SOA serial
-			 * => generate new serial and write it back to LDAP. */
-			*ldap_writeback = ISC_TRUE;
-			CHECK(zone_soaserial_addtuple(inst->mctx, ldapdb,
-						      version, diff, new_serial));
-		} else if (new_zone == ISC_TRUE || sync_state != sync_finished ||
-			   isc_serial_le(dns_soa_getserial(&soa_tuple->rdata),
-					 curr_serial)) {
-			/* The diff tries to send SOA serial back!
-			 * => generate new serial and write it back to LDAP.
-			 * Force serial update if we are adding a new zone. */
-			*ldap_writeback = ISC_TRUE;
-			CHECK(zone_soaserial_updatetuple(dns_updatemethod_unixtime,
-							 soa_tuple, new_serial));
-		} else {
-			/* The diff contains new serial already
-			 * => do nothing. */
-			*ldap_writeback = ISC_FALSE;
-		}
+	REQUIRE(changep != NULL && *changep == NULL);
 
-	} else {/* if (data_changed == ISC_FALSE) */
-		*ldap_writeback = ISC_FALSE;
-		if (soa_tuple == NULL) {
-			/* The diff is empty => do nothing. */
-			INSIST(EMPTY(diff->tuples));
-		} else if (isc_serial_le(dns_soa_getserial(&soa_tuple->rdata),
-					 curr_serial)) {
-			/* Attempt to move serial backwards without any data
-			 * => ignore it. */
-			dns_diff_clear(diff);
-		}/* else:
-		  * The diff contains new serial already
-		  * => do nothing. */
-	}
+	CHECKED_MEM_GET_PTR(mctx, change);
+	ZERO_PTR(change);
+	CHECKED_MEM_GET(mctx, change->mod_type, LDAP_ATTR_FORMATSIZE);
+
+	*changep = change;
+	return ISC_R_SUCCESS;
 
 cleanup:
-	if (node != NULL)
-		dns_db_detachnode(rbtdb, &node);
-	if (rbt_rds_iterator != NULL)
-		dns_rdatasetiter_destroy(&rbt_rds_iterator);
-	ldapdb_rdatalist_destroy(inst->mctx, &rdatalist);
+	if (change != NULL)
+		SAFE_MEM_PUT_PTR(mctx, change);
+
 	return result;
 }
 
 /**
- * Change security status of an existing zone.
- *
- * LDAP database is detached from the original zone, the zone is deleted
- * and re-created with different parameters on top of the old LDAP database.
+ * @param[in]  rdlist
+ * @param[out] changep
+ * @param[in]  mod_op  LDAP operation as integer used in LDAPMod.
+ * @param[in]  generic Use generic (RFC 3597) syntax.
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-zone_security_change(ldap_entry_t * const entry, dns_name_t * const name,
-		     ldap_instance_t * const inst, isc_task_t * const task) {
+ldap_rdatalist_to_ldapmod(isc_mem_t *mctx, dns_rdatalist_t *rdlist,
+			  LDAPMod **changep, int mod_op, isc_boolean_t unknown)
+{
 	isc_result_t result;
-	dns_db_t *olddb = NULL;
-	isc_result_t lock_state = ISC_R_IGNORE;
+	LDAPMod *change = NULL;
+	char **vals = NULL;
 
-	CHECK(zr_get_zone_dbs(inst->zone_register, name, &olddb, NULL));
+	CHECK(ldap_mod_create(mctx, &change));
+	CHECK(rdatatype_to_ldap_attribute(rdlist->type, change->mod_type,
+					  LDAP_ATTR_FORMATSIZE, unknown));
+	CHECK(ldap_rdata_to_char_array(mctx, HEAD(rdlist->rdata), unknown,
+				       &vals));
 
-	/* Lock is necessary to ensure that no events from LDAP are lost
-	 * in period where old zone was deleted but the new zone was not
-	 * created yet. */
-	run_exclusive_enter(inst, &lock_state);
-	CHECK(ldap_delete_zone2(inst, name, ISC_FALSE));
-	CHECK(ldap_parse_master_zoneentry(entry, olddb, inst, task));
+	change->mod_op = mod_op;
+	change->mod_values = vals;
+
+	*changep = change;
+	return ISC_R_SUCCESS;
 
 cleanup:
-	run_exclusive_exit(inst, lock_state);
-	if (olddb != NULL)
-		dns_db_detach(&olddb);
+	ldap_mod_free(mctx, &change);
+
 	return result;
 }
 
 /**
- * Parse the master zone entry and configure DNS zone accordingly.
- * New zone will be created if it doesn't exist. Existing zone will be
- * updated with new settings from LDAP entry.
- *
- * This function also synchronizes data at zone apex and ensures
- * that zone serial is incremented after each change.
+ * Convert list of DNS Rdata to array of LDAP values.
  *
- * @param olddb[in]  LDAP database to be used when constructing a new zone.
- *                   Empty database will be created if it is NULL.
- *                   It should be non-NULL only if reconfiguration of
- *                   an existing zone is not possible so the old zone
- *                   was deleted but the new zone should re-use the old
- *                   database.
+ * @param[in]  unknown  ISC_TRUE  = use generic (RFC 3597) format,
+ *                      ISC_FALSE = use record-specific syntax (if available).
  */
-static isc_result_t
-ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
-			    ldap_instance_t * const inst,
-			    isc_task_t * const task)
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_rdata_to_char_array(isc_mem_t *mctx, dns_rdata_t *rdata_head,
+			 isc_boolean_t unknown, char ***valsp)
 {
-	ldap_valuelist_t values;
-	dns_zone_t *raw = NULL;
-	dns_zone_t *secure = NULL;
-	dns_zone_t *toview = NULL;
 	isc_result_t result;
-	isc_result_t lock_state = ISC_R_IGNORE;
-	isc_boolean_t new_zone = ISC_FALSE;
-	isc_boolean_t want_secure = ISC_FALSE;
-	isc_boolean_t configured = ISC_FALSE;
-	isc_boolean_t activity_changed;
-	isc_boolean_t isactive = ISC_FALSE;
-	settings_set_t *zone_settings = NULL;
-	isc_boolean_t ldap_writeback;
-	isc_boolean_t data_changed = ISC_FALSE; /* GCC */
-	isc_uint32_t new_serial;
+	char **vals;
+	unsigned int i;
+	unsigned int rdata_count = 0;
+	size_t vals_size;
+	dns_rdata_t *rdata;
 
-	dns_db_t *rbtdb = NULL;
-	dns_db_t *ldapdb = NULL;
-	dns_diff_t diff;
-	dns_dbversion_t *version = NULL;
-	sync_state_t sync_state;
+	REQUIRE(rdata_head != NULL);
+	REQUIRE(valsp != NULL && *valsp == NULL);
 
-	REQUIRE(entry != NULL);
-	REQUIRE(inst != NULL);
-	REQUIRE(task == inst->task); /* For task-exclusive mode */
+	for (rdata = rdata_head; rdata != NULL; rdata = NEXT(rdata, link))
+		rdata_count++;
 
-	dns_diff_init(inst->mctx, &diff);
+	vals_size = (rdata_count + 1) * sizeof(char *);
 
-	run_exclusive_enter(inst, &lock_state);
+	CHECKED_MEM_ALLOCATE(mctx, vals, vals_size);
+	memset(vals, 0, vals_size);
 
-	result = ldap_entry_getvalues(entry, "idnsSecInlineSigning", &values);
-	if (result == ISC_R_NOTFOUND || HEAD(values) == NULL)
-		want_secure = ISC_FALSE;
-	else
-		want_secure = ISC_TF(strcasecmp(HEAD(values)->value, "TRUE")
-				     == 0);
+	rdata = rdata_head;
+	for (i = 0; i < rdata_count && rdata != NULL; i++) {
+		DECLARE_BUFFER(buffer, /* RFC 3597 format is hex string */
+			       DNS_RDATA_MAXLENGTH * 2 + sizeof("\\# 65535 "));
+		isc_region_t region;
 
-	/* Check if we are already serving given zone */
-	result = zr_get_zone_ptr(inst->zone_register, &entry->fqdn,
-				 &raw, &secure);
-	if (result == ISC_R_NOTFOUND || result == DNS_R_PARTIALMATCH) {
-		CHECK(create_zone(inst, entry->dn, &entry->fqdn, olddb,
-				  want_secure, &raw, &secure));
-		new_zone = ISC_TRUE;
-		log_debug(2, "created %s: raw %p; secure %p",
-			  ldap_entry_logname(entry), raw, secure);
-	} else if (result != ISC_R_SUCCESS)
-		goto cleanup;
-	else if (want_secure != ISC_TF(secure != NULL)) {
-		if (want_secure == ISC_TRUE)
-			dns_zone_log(raw, ISC_LOG_INFO,
-				     "upgrading zone to secure");
+		/* Convert rdata to text. */
+		INIT_BUFFER(buffer);
+		if (unknown == ISC_FALSE)
+			CHECK(dns_rdata_totext(rdata, NULL, &buffer));
 		else
-			dns_zone_log(secure, ISC_LOG_INFO,
-				     "downgrading zone to insecure");
-		CHECK(zone_security_change(entry, &entry->fqdn, inst, task));
-		goto cleanup;
-	} else { /* Zone exists and it's security status is unchanged. */
-		INSIST(olddb == NULL);
-	}
-
-	CHECK(zr_get_zone_settings(inst->zone_register, &entry->fqdn,
-				   &zone_settings));
-	CHECK(zone_master_reconfigure(entry, zone_settings, raw, secure, task));
-	result = fwd_parse_ldap(entry, zone_settings);
-	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
-		goto cleanup;
-	/* synchronize zone origin with LDAP */
-	CHECK(zr_get_zone_dbs(inst->zone_register, &entry->fqdn, &ldapdb, &rbtdb));
-	CHECK(dns_db_newversion(ldapdb, &version));
-	sync_state_get(inst->sctx, &sync_state);
-	CHECK(zone_sync_apex(inst, entry, entry->fqdn, sync_state, new_zone,
-			     ldapdb, rbtdb, version, zone_settings,
-			     &diff, &new_serial, &ldap_writeback,
-			     &data_changed));
+			CHECK(rdata_to_generic(rdata, &buffer));
+		isc_buffer_usedregion(&buffer, &region);
 
-#if RBTDB_DEBUG >= 2
-	dns_diff_print(&diff, stdout);
-#else
-	dns_diff_print(&diff, NULL);
-#endif
-	if (ldap_writeback == ISC_TRUE) {
-		dns_zone_log(raw, ISC_LOG_DEBUG(5), "writing new zone serial "
-			     "%u to LDAP", new_serial);
-		result = ldap_replace_serial(inst, &entry->fqdn, new_serial);
-		if (result != ISC_R_SUCCESS)
-			dns_zone_log(raw, ISC_LOG_ERROR,
-				     "serial (%u) write back to LDAP failed",
-				     new_serial);
+		/* Now allocate the string with the right size. */
+		CHECKED_MEM_ALLOCATE(mctx, vals[i], region.length + 1);
+		memcpy(vals[i], region.base, region.length);
+		vals[i][region.length] = '\0';
+		
+		rdata = NEXT(rdata, link);
 	}
 
-	if (!EMPTY(diff.tuples)) {
-		if (sync_state == sync_finished && new_zone == ISC_FALSE) {
-			/* write the transaction to journal */
-			CHECK(zone_journal_adddiff(inst->mctx, raw, &diff));
-		}
+	*valsp = vals;
+	return ISC_R_SUCCESS;
 
-		/* commit */
-		CHECK(dns_diff_apply(&diff, rbtdb, version));
-		dns_db_closeversion(ldapdb, &version, ISC_TRUE);
-		dns_zone_markdirty(raw);
-	} else {
-		/* It is necessary to release lock before calling load_zone()
-		 * otherwise it will deadlock on newversion() call
-		 * in journal roll-forward process! */
-		dns_db_closeversion(ldapdb, &version, ISC_FALSE);
-	}
-	configured = ISC_TRUE;
+cleanup:
+	free_char_array(mctx, &vals);
+	return result;
+}
 
-	/* Detect active/inactive zone and activity changes */
-	result = setting_update_from_ldap_entry("active", zone_settings,
-						"idnsZoneActive", entry);
-	if (result == ISC_R_SUCCESS) {
-		activity_changed = ISC_TRUE;
-	} else if (result == ISC_R_IGNORE) {
-		activity_changed = ISC_FALSE;
-	} else
-		goto cleanup;
-	CHECK(setting_get_bool("active", zone_settings, &isactive));
+static void ATTR_NONNULLS
+free_char_array(isc_mem_t *mctx, char ***valsp)
+{
+	char **vals;
+	unsigned int i;
 
-	/* Do zone load only if the initial LDAP synchronization is done. */
-	if (sync_state != sync_finished)
-		goto cleanup;
+	REQUIRE(valsp != NULL);
 
-	toview = (want_secure == ISC_TRUE) ? secure : raw;
-	if (isactive == ISC_TRUE) {
-		if (new_zone == ISC_TRUE || activity_changed == ISC_TRUE)
-			CHECK(publish_zone(task, inst, toview));
-		CHECK(load_zone(toview, ISC_FALSE));
-		CHECK(fwd_configure_zone(zone_settings, inst, &entry->fqdn));
-	} else if (activity_changed == ISC_TRUE) { /* Zone was deactivated */
-		CHECK(unpublish_zone(inst, &entry->fqdn,
-				     ldap_entry_logname(entry)));
-		/* emulate "no explicit forwarding config" */
-		CHECK(fwd_configure_zone(&inst->empty_fwdz_settings, inst,
-					 &entry->fqdn));
-		dns_zone_log(toview, ISC_LOG_INFO, "zone deactivated "
-			     "and removed from view");
-	}
+	vals = *valsp;
+	if (vals == NULL)
+		return;
 
-cleanup:
-	dns_diff_clear(&diff);
-	if (rbtdb != NULL && version != NULL)
-		dns_db_closeversion(ldapdb, &version, ISC_FALSE); /* rollback */
-	if (rbtdb != NULL)
-		dns_db_detach(&rbtdb);
-	if (ldapdb != NULL)
-		dns_db_detach(&ldapdb);
-	if (new_zone == ISC_TRUE && configured == ISC_FALSE) {
-		/* Failure in ACL parsing or so. */
-		log_error_r("%s: publishing failed, rolling back due to",
-			    ldap_entry_logname(entry));
-		/* TODO: verify this */
-		result = ldap_delete_zone2(inst, &entry->fqdn, ISC_TRUE);
-		if (result != ISC_R_SUCCESS)
-			log_error_r("%s: rollback failed: ",
-				    ldap_entry_logname(entry));
-	}
-	run_exclusive_exit(inst, lock_state);
-	if (raw != NULL)
-		dns_zone_detach(&raw);
-	if (secure != NULL)
-		dns_zone_detach(&secure);
+	for (i = 0; vals[i] != NULL; i++)
+		isc_mem_free(mctx, vals[i]);
 
-	return result;
+	isc_mem_free(mctx, vals);
+	*valsp = NULL;
 }
 
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-findrdatatype_or_create(isc_mem_t *mctx, ldapdb_rdatalist_t *rdatalist,
-			dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
-			dns_ttl_t ttl, dns_rdatalist_t **rdlistp)
+ldap_rdttl_to_ldapmod(isc_mem_t *mctx, dns_rdatalist_t *rdlist,
+		      LDAPMod **changep)
 {
+	LDAPMod *change = NULL;
+	ld_string_t *ttlval = NULL;
+	char **vals = NULL;
 	isc_result_t result;
-	dns_rdatalist_t *rdlist = NULL;
 
-	REQUIRE(rdatalist != NULL);
-	REQUIRE(rdlistp != NULL);
+	REQUIRE(changep != NULL && *changep == NULL);
 
-	*rdlistp = NULL;
+	CHECK(str_new(mctx, &ttlval));
+	CHECK(str_sprintf(ttlval, "%d", rdlist->ttl));
 
-	result = ldapdb_rdatalist_findrdatatype(rdatalist, rdtype, &rdlist);
-	if (result != ISC_R_SUCCESS) {
-		CHECKED_MEM_GET_PTR(mctx, rdlist);
+	CHECK(ldap_mod_create(mctx, &change));
+	change->mod_op = LDAP_MOD_REPLACE;
+	CHECK(isc_string_copy(change->mod_type, LDAP_ATTR_FORMATSIZE, "dnsTTL"));
 
-		dns_rdatalist_init(rdlist);
-		rdlist->rdclass = rdclass;
-		rdlist->type = rdtype;
-		rdlist->ttl = ttl;
-		APPEND(*rdatalist, rdlist, link);
-	} else {
-		/*
-		 * No support for different TTLs yet.
-		 */
-		if (rdlist->ttl != ttl) {
-			log_error("different TTLs in single rdata list "
-				  "are not supported");
-			CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
-		}
-	}
+	CHECKED_MEM_ALLOCATE(mctx, vals, 2 * sizeof(char *));
+	memset(vals, 0, 2 * sizeof(char *));
+	change->mod_values = vals;
 
-	*rdlistp = rdlist;
-	return ISC_R_SUCCESS;
+	CHECKED_MEM_ALLOCATE(mctx, vals[0], str_len(ttlval) + 1);
+	memcpy(vals[0], str_buf(ttlval), str_len(ttlval) + 1);
+
+	*changep = change;
 
 cleanup:
-	SAFE_MEM_PUT_PTR(mctx, rdlist);
+	if (ttlval) str_destroy(&ttlval);
+	if (change && result != ISC_R_SUCCESS) ldap_mod_free(mctx, &change);
 
 	return result;
 }
 
 /*
- * ldapdb_rdatalist_t related functions.
+ * Modify the SOA record of a zone, where DN of the zone is 'zone_dn'.
+ * The SOA record is a special case because we need to update serial,
+ * refresh, retry, expire and minimum attributes for each SOA record.
  */
-isc_result_t
-ldapdb_rdatalist_findrdatatype(ldapdb_rdatalist_t *rdatalist,
-			       dns_rdatatype_t rdtype,
-			       dns_rdatalist_t **rdlistp)
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+modify_soa_record(ldap_instance_t *ldap_inst, const char *zone_dn,
+		  dns_rdata_t *rdata)
 {
-	dns_rdatalist_t *rdlist;
+	isc_result_t result;
+	dns_rdata_soa_t soa;
+	LDAPMod change[5];
+	LDAPMod *changep[6] = {
+		&change[0], &change[1], &change[2], &change[3], &change[4],
+		NULL
+	};
 
-	REQUIRE(rdatalist != NULL);
-	REQUIRE(rdlistp != NULL && *rdlistp == NULL);
+	REQUIRE(ldap_inst != NULL);
+
+/* all values in SOA record are isc_uint32_t, i.e. max. 2^32-1 */
+#define MAX_SOANUM_LENGTH (10 + 1)
+#define SET_LDAP_MOD(index, name) \
+	change[index].mod_op = LDAP_MOD_REPLACE; \
+	change[index].mod_type = "idnsSOA" #name; \
+	change[index].mod_values = alloca(2 * sizeof(char *)); \
+	change[index].mod_values[0] = alloca(MAX_SOANUM_LENGTH); \
+	change[index].mod_values[1] = NULL; \
+	CHECK(isc_string_printf(change[index].mod_values[0], \
+		MAX_SOANUM_LENGTH, "%u", soa.name));
 
-	rdlist = HEAD(*rdatalist);
-	while (rdlist != NULL && rdlist->type != rdtype) {
-		rdlist = NEXT(rdlist, link);
-	}
+	dns_rdata_tostruct(rdata, (void *)&soa, ldap_inst->mctx);
 
-	*rdlistp = rdlist;
+	SET_LDAP_MOD(0, serial);
+	SET_LDAP_MOD(1, refresh);
+	SET_LDAP_MOD(2, retry);
+	SET_LDAP_MOD(3, expire);
+	SET_LDAP_MOD(4, minimum);
 
-	return (rdlist == NULL) ? ISC_R_NOTFOUND : ISC_R_SUCCESS;
-}
+	dns_rdata_freestruct((void *)&soa);
 
-void
-ldapdb_rdatalist_destroy(isc_mem_t *mctx, ldapdb_rdatalist_t *rdatalist)
-{
-	dns_rdatalist_t *rdlist;
+	result = ldap_modify_do(ldap_inst, zone_dn, changep, ISC_FALSE);
 
-	REQUIRE(rdatalist != NULL);
+cleanup:
+	return result;
 
-	while (!EMPTY(*rdatalist)) {
-		rdlist = HEAD(*rdatalist);
-		free_rdatalist(mctx, rdlist);
-		UNLINK(*rdatalist, rdlist, link);
-		SAFE_MEM_PUT_PTR(mctx, rdlist);
-	}
+#undef MAX_SOANUM_LENGTH
+#undef SET_LDAP_MOD
 }
 
-void
-free_rdatalist(isc_mem_t *mctx, dns_rdatalist_t *rdlist)
+/**
+ * LDAP server accepted other record attribute than the one chosen
+ * according to schema. Re-read the schema if it was not checked recently
+ * and remember which attribute works for the type.
+ */
+static void ATTR_NONNULLS
+rr_schema_mismatch(ldap_instance_t *inst, dns_rdatatype_t rdtype,
+		   isc_boolean_t unknown)
 {
-	dns_rdata_t *rdata;
-	isc_region_t r;
-
-	REQUIRE(rdlist != NULL);
+	isc_result_t result;
+	ldap_connection_t *conn = NULL;
 
-	while (!EMPTY(rdlist->rdata)) {
-		rdata = HEAD(rdlist->rdata);
-		UNLINK(rdlist->rdata, rdata, link);
-		dns_rdata_toregion(rdata, &r);
-		isc_mem_put(mctx, r.base, r.length);
-		SAFE_MEM_PUT_PTR(mctx, rdata);
+	if (rr_schema_recheck(inst->rr_schema) == ISC_TRUE) {
+		result = ldap_pool_getconnection(inst->pool, &conn);
+		if (result == ISC_R_SUCCESS && conn->handle != NULL)
+			result = rr_schema_refresh(inst->rr_schema,
+						   conn->handle);
+		ldap_pool_putconnection(inst->pool, &conn);
 	}
+	rr_schema_learn(inst->rr_schema, rdtype, unknown);
 }
 
-/**
- * Replace occurrences of \{variable_name\} with respective strings from
- * settings tree. Remaining parts of the original string are just copied
- * into the output.
- *
- * Double-escaped strings \\{ \\} do not trigger substitution.
- * Nested references will expand only innermost variable: \{\{var1\}\}
- * Non-matching parentheses and other garbage will be copied verbatim
- * without trigerring an error.
- *
- * @retval  ISC_R_SUCCESS  Output string is valid. Caller must deallocate output.
- * @retval  ISC_R_IGNORE   Some variables used in the template are not defined
- *                         in settings tree. Substitution was terminated
- *                         prematurely and output is not available.
- * @retval  others         Unexpected errors.
- */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_substitute_rr_template(isc_mem_t *mctx, const settings_set_t * set,
-			    ld_string_t *orig_val, ld_string_t **output) {
+modify_ldap_common(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst,
+		   dns_rdatalist_t *rdlist, int mod_op, isc_boolean_t delete_node)
+{
 	isc_result_t result;
-	regex_t regex;
-	regmatch_t matches[3];
-	size_t processed = 0;
-	char *tmp = NULL;
-	const char *setting_name;
-	setting_t *setting;
-	ld_string_t *replaced = NULL;
-
-	/* match \{variable_name\} in the text
-	 * \{ and \} must not be double-escaped like \\{ or \\} */
-	if (regcomp(&regex,
-		    "\\(^\\|[^\\]\\)" /* character preceding \{ = matches[1] */
-		    "\\\\{"
-		    "\\([a-zA-Z0-9_-]\\+\\)" /* variable name = matches[2] */
-		    "\\\\}",
-		    0) != 0)
-		CLEANUP_WITH(ISC_R_UNEXPECTED);
-
-	CHECK(str_new(mctx, &replaced));
-	CHECKED_MEM_STRDUP(mctx, str_buf(orig_val), tmp);
+	isc_mem_t *mctx = ldap_inst->mctx;
+	ld_string_t *owner_dn = NULL;
+	LDAPMod *change[3] = { NULL };
+	isc_boolean_t zone_sync_ptr;
+	char **vals = NULL;
+	char *zone_dn = NULL;
+	settings_set_t *zone_settings = NULL;
+	int af; /* address family */
+	isc_boolean_t unknown_type = ISC_FALSE;
+	isc_boolean_t first_unknown;
 
-	while (regexec(&regex, tmp + processed,
-		       sizeof(matches)/sizeof(regmatch_t),
-		       matches, 0) == 0)
-	{
-		/* derelativize offsets to make sure they
-		 * always start from tmp instead of tmp + processed */
-		for (size_t i = 0; i < sizeof(matches)/sizeof(regmatch_t); i++) {
-			matches[i].rm_so += processed;
-			matches[i].rm_eo += processed;
-		}
-		/* copy verbatim part of the string which precedes the \{ */
-		CHECK(str_cat_char_len(replaced,
-				       tmp + processed,
-				       matches[1].rm_eo - processed));
-
-		/* find value for given variable name in settings tree */
-		setting_name = tmp + matches[2].rm_so;
-		tmp[matches[2].rm_eo] = '\0';
-		setting = NULL;
-		result = setting_find(setting_name, set, isc_boolean_true,
-				      isc_boolean_true, &setting);
-		if (result != ISC_R_SUCCESS) {
-			log_debug(3, "setting '%s' is not defined so it "
-				  "cannot be substituted into template '%s'",
-				  setting_name, str_buf(orig_val));
-			CLEANUP_WITH(ISC_R_IGNORE);
-		}
-		if (setting->type != ST_STRING) {
-			log_bug("setting '%s' it not string so it cannot be "
-				"substituted", setting_name);
-			CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
-		}
-		CHECK(str_cat_char(replaced, setting->value.value_char));
+	/*
+	 * Find parent zone entry and check if Dynamic Update is allowed.
+	 * Zone DN is used only for logging, caller already knows zone name.
+	 */
+	CHECK(str_new(mctx, &owner_dn));
 
-		/* end offset of previous match = matches[0].rm_eo */
-		processed = matches[0].rm_eo;
-	};
+	CHECK(dnsname_to_dn(ldap_inst->zone_register, owner, zone, owner_dn));
+	zone_dn = strstr(str_buf(owner_dn),", ");
 
-	/* copy remaining part of the string */
-	CHECK(str_cat_char(replaced, tmp + processed));
+	if (zone_dn == NULL) { /* SOA record; owner = zone => owner_dn = zone_dn */
+		zone_dn = (char *)str_buf(owner_dn);
+	} else {
+		zone_dn += 1; /* skip whitespace */
+	}
 
-	*output = replaced;
-	replaced = NULL;
-	result = ISC_R_SUCCESS;
+	result = zr_get_zone_settings(ldap_inst->zone_register, zone,
+				      &zone_settings);
+	if (result != ISC_R_SUCCESS) {
+		if (result == ISC_R_NOTFOUND)
+			log_debug(3, "update refused: "
+				  "active zone '%s' not found", zone_dn);
+		CLEANUP_WITH(DNS_R_NOTAUTH);
+	}
 
-cleanup:
-	if (tmp != NULL)
-		isc_mem_free(mctx, tmp);
+	if (rdlist->type == dns_rdatatype_soa && mod_op == LDAP_MOD_DELETE)
+		CLEANUP_WITH(ISC_R_SUCCESS);
 
-	str_destroy(&replaced);
-	return result;
-}
+	if (rdlist->type == dns_rdatatype_soa) {
+		result = modify_soa_record(ldap_inst, str_buf(owner_dn),
+					   HEAD(rdlist->rdata));
+		goto cleanup;
+	}
 
-/**
- * Substitute strings into idnsTemplateAttributes
- * and parse results into list of rdatas.
- *
- * idnsTemplateAttribute must have exactly one sub-type like "TXTRecord"
- * (e.g. "idnsTemplateAttribute;TXTRecord"). The sub-type specifies target type.
- *
- * @warning Substitution currently works only for *Record attributes
- *          and cannot be used for anything else.
- *
- * @retval  ISC_R_SUCCESS  A template exists in the entry and values
- *                         were successfully substituted into it.
- *                         Rdatalist contains new rdata.
- * @retval  ISC_R_IGNORE   No template was found or variables
- *                         do not have defined values. Ignore output.
- */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_parse_rrentry_template(isc_mem_t *mctx, ldap_entry_t *entry,
-			    dns_name_t *origin,
-			    const settings_set_t * const settings,
-			    ldapdb_rdatalist_t *rdatalist)
-{
-	isc_result_t result;
-	ldap_attribute_t *attr;
-	ld_string_t *orig_val = NULL;
-	ld_string_t *new_val = NULL;
-	dns_rdata_t *rdata = NULL;
-	dns_rdataclass_t rdclass;
-	dns_ttl_t ttl;
-	dns_rdatatype_t rdtype;
-	dns_rdatalist_t *rdlist = NULL;
-	isc_boolean_t did_something = ISC_FALSE;
-	static const char prefix[] = "idnsTemplateAttribute;";
-	static const char prefix_len = sizeof(prefix) - 1;
+	if (mod_op == LDAP_MOD_ADD) {
+		/* for now always replace the ttl on add */
+		CHECK(ldap_rdttl_to_ldapmod(mctx, rdlist, &change[1]));
+	}
 
-	CHECK(str_new(mctx, &orig_val));
-	rdclass = ldap_entry_getrdclass(entry);
-	ttl = ldap_entry_getttl(entry, settings);
+	/* Store data into named attribute like "URIRecord" if LDAP schema
+	 * has it, into "UnknownRecord;TYPE256" otherwise. If that fails,
+	 * the schema might have changed so try the other attribute. */
+	first_unknown = rr_schema_use_unknown(ldap_inst->rr_schema,
+					      rdlist->type);
+	unknown_type = first_unknown;
+	do {
+		ldap_mod_free(mctx, &change[0]);
+		CHECK(ldap_rdatalist_to_ldapmod(mctx, rdlist, &change[0],
+						mod_op, unknown_type));
+		result = ldap_modify_do(ldap_inst, str_buf(owner_dn), change,
+					delete_node);
+		if (result != DNS_R_UNKNOWN)
+			break;
+		unknown_type = !unknown_type; /* try again with other type */
+	} while (unknown_type != first_unknown);
+	if (result == ISC_R_SUCCESS && unknown_type != first_unknown)
+		rr_schema_mismatch(ldap_inst, rdlist->type, unknown_type);
 
-	while ((attr = ldap_entry_nextattr(entry)) != NULL) {
-		if (strncasecmp(prefix, attr->name, prefix_len) != 0)
-			continue;
+	/* Keep the PTR of corresponding A/AAAA record synchronized. */
+	if (rdlist->type == dns_rdatatype_a || rdlist->type == dns_rdatatype_aaaa) {
+		/*
+		 * Look for zone "idnsAllowSyncPTR" attribute. If attribute do not exist,
+		 * use global plugin configuration: option "sync_ptr"
+		 */
 
-		result = ldap_attribute_to_rdatatype(attr->name + prefix_len,
-						     &rdtype);
-		if (result != ISC_R_SUCCESS) {
-			log_bug("%s: substitution into '%s' is not supported",
-				ldap_entry_logname(entry),
-				attr->name + prefix_len);
-			continue;
+		CHECK(setting_get_bool(SETTING_SYNC_PTR, zone_settings,
+				       &zone_sync_ptr));
+		if (!zone_sync_ptr) {
+			log_debug(3, "sync PTR is disabled for zone '%s'", zone_dn);
+			CLEANUP_WITH(ISC_R_SUCCESS);
 		}
+		log_debug(3, "sync PTR is enabled for zone '%s'", zone_dn);
 
-		CHECK(findrdatatype_or_create(mctx, rdatalist, rdclass,
-					      rdtype, ttl, &rdlist));
-		for (result = ldap_attr_firstvalue(attr, orig_val);
-		     result == ISC_R_SUCCESS;
-		     result = ldap_attr_nextvalue(attr, orig_val)) {
-			str_destroy(&new_val);
-			CHECK(ldap_substitute_rr_template(mctx, settings,
-							  orig_val, &new_val));
-			log_debug(10, "%s: substituted '%s' '%s' -> '%s'",
-				  ldap_entry_logname(entry), attr->name,
-				  str_buf(orig_val), str_buf(new_val));
-			CHECK(parse_rdata(mctx, entry, rdclass, rdtype, origin,
-					  str_buf(new_val), &rdata));
-			APPEND(rdlist->rdata, rdata, link);
-			rdata = NULL;
-			did_something = ISC_TRUE;
-		}
+		af = (rdlist->type == dns_rdatatype_a) ? AF_INET : AF_INET6;
+		/* Following call will not work if A/AAAA records are unknown. */
+		result = sync_ptr_init(ldap_inst->sync_ptr_queue,
+				       ldap_inst->view->zonetable,
+				       ldap_inst->zone_register, owner, af,
+				       change[0]->mod_values[0], rdlist->ttl,
+				       mod_op);
+		/* Silently ignore cases where the reverse zone does not exist,
+		 * does not accept dynamic updates, or is not managed by this
+		 * driver instance. */
+		if (result == ISC_R_NOTFOUND ||
+		    result == ISC_R_NOPERM ||
+		    result == DNS_R_NOTAUTHORITATIVE)
+			result = ISC_R_SUCCESS;
 	}
 
 cleanup:
-	str_destroy(&orig_val);
-	str_destroy(&new_val);
-	if (result == ISC_R_NOMORE || result == ISC_R_SUCCESS)
-		result = did_something ? ISC_R_SUCCESS : ISC_R_IGNORE;
+	str_destroy(&owner_dn);
+	ldap_mod_free(mctx, &change[0]);
+	ldap_mod_free(mctx, &change[1]);
+	free_char_array(mctx, &vals);
 
 	return result;
 }
 
+isc_result_t
+write_to_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst, dns_rdatalist_t *rdlist)
+{
+	return modify_ldap_common(owner, zone, ldap_inst, rdlist, LDAP_MOD_ADD, ISC_FALSE);
+}
+
+isc_result_t
+remove_values_from_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst,
+		 dns_rdatalist_t *rdlist, isc_boolean_t delete_node)
+{
+	return modify_ldap_common(owner, zone, ldap_inst, rdlist, LDAP_MOD_DELETE,
+				  delete_node);
+}
+
 /**
- * Parse object containing DNS records and substitute idnsAttributeTemplates
- * into it if they are defined.
- *
- * idnsAttributeTemplates take precedence over all statically defined
- * attributes with RRs.
- * All static RRs are ignored if substitution was successful.
- *
- * @pre rdatalist is empty initialized list.
- *
- * @param rdatalist[in,out]
+ * Delete named attribute 'URIRecord'
+ * and equivalent attribute 'UnknownRecord;TYPE256' too.
  */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_parse_rrentry(isc_mem_t *mctx, ldap_entry_t *entry, dns_name_t *origin,
-		   const settings_set_t * const settings,
-		   ldapdb_rdatalist_t *rdatalist)
-{
+isc_result_t
+remove_rdtype_from_ldap(dns_name_t *owner, dns_name_t *zone,
+		      ldap_instance_t *ldap_inst, dns_rdatatype_t type) {
+	char attr[LDAP_ATTR_FORMATSIZE];
+	LDAPMod *change[2] = { NULL };
+	ld_string_t *dn = NULL;
 	isc_result_t result;
-	dns_rdataclass_t rdclass;
-	dns_ttl_t ttl;
-	dns_rdatatype_t rdtype;
-	dns_rdata_t *rdata = NULL;
-	dns_rdatalist_t *rdlist = NULL;
-	ldap_attribute_t *attr;
-	const char *data_str = "<NULL data>";
-	ld_string_t *data_buf = NULL;
-	const char *fake_mname;
+	isc_boolean_t unknown_type = ISC_FALSE;
+
+	CHECK(str_new(ldap_inst->mctx, &dn));
+	CHECK(dnsname_to_dn(ldap_inst->zone_register, owner, zone, dn));
+
+	do {
+		CHECK(ldap_mod_create(ldap_inst->mctx, &change[0]));
+		change[0]->mod_op = LDAP_MOD_DELETE;
+		/* delete all values from given attribute */
+		change[0]->mod_vals.modv_strvals = NULL;
+		CHECK(rdatatype_to_ldap_attribute(type, attr, sizeof(attr),
+						  unknown_type));
+		CHECK(isc_string_copy(change[0]->mod_type, LDAP_ATTR_FORMATSIZE,
+				      attr));
+		CHECK(ldap_modify_do(ldap_inst, str_buf(dn), change, ISC_FALSE));
+		ldap_mod_free(ldap_inst->mctx, &change[0]);
+		unknown_type = !unknown_type;
+	} while (unknown_type == ISC_TRUE);
 
-	REQUIRE(EMPTY(*rdatalist));
+cleanup:
+	ldap_mod_free(ldap_inst->mctx, &change[0]);
+	str_destroy(&dn);
+	return result;
+}
 
-	ttl = ldap_entry_getttl(entry, settings);
-	rdclass = ldap_entry_getrdclass(entry);
-	if ((entry->class & LDAP_ENTRYCLASS_MASTER) != 0) {
-		CHECK(setting_get_str("fake_mname", settings, &fake_mname));
-		CHECK(add_soa_record(mctx, origin, entry, ttl, rdatalist,
-				     fake_mname));
-	}
 
-	if ((entry->class & LDAP_ENTRYCLASS_TEMPLATE) != 0) {
-		result = ldap_parse_rrentry_template(mctx, entry, origin,
-						     settings, rdatalist);
-		if (result == ISC_R_SUCCESS)
-			/* successful substitution overrides all constants */
-			return result;
-		else if (result != ISC_R_IGNORE)
-			goto cleanup;
-	}
+isc_result_t
+remove_entry_from_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst) {
+	ldap_connection_t *ldap_conn = NULL;
+	ld_string_t *dn = NULL;
+	int ret;
+	isc_result_t result;
 
-	CHECK(str_new(mctx, &data_buf));
-	for (result = ldap_entry_firstrdtype(entry, &attr, &rdtype);
-	     result == ISC_R_SUCCESS;
-	     result = ldap_entry_nextrdtype(entry, &attr, &rdtype)) {
+	CHECK(str_new(ldap_inst->mctx, &dn));
+	CHECK(dnsname_to_dn(ldap_inst->zone_register, owner, zone, dn));
+	log_debug(2, "deleting whole node: '%s'", str_buf(dn));
 
-		CHECK(findrdatatype_or_create(mctx, rdatalist, rdclass,
-					      rdtype, ttl, &rdlist));
-		for (result = ldap_attr_firstvalue(attr, data_buf);
-		     result == ISC_R_SUCCESS;
-		     result = ldap_attr_nextvalue(attr, data_buf)) {
-			CHECK(parse_rdata(mctx, entry, rdclass,
-					  rdtype, origin,
-					  str_buf(data_buf), &rdata));
-			APPEND(rdlist->rdata, rdata, link);
-			rdata = NULL;
-		}
-		if (result != ISC_R_NOMORE)
-			goto cleanup;
-		rdlist = NULL;
+	CHECK(ldap_pool_getconnection(ldap_inst->pool, &ldap_conn));
+	if (ldap_conn->handle == NULL) {
+		/*
+		 * handle can be NULL when the first connection to LDAP wasn't
+		 * successful
+		 * TODO: handle this case inside ldap_pool_getconnection()?
+		 */
+		CHECK(ldap_connect(ldap_inst, ldap_conn, ISC_FALSE));
 	}
-	if (result != ISC_R_NOMORE)
+	ret = ldap_delete_ext_s(ldap_conn->handle, str_buf(dn), NULL, NULL);
+	result = (ret == LDAP_SUCCESS) ? ISC_R_SUCCESS : ISC_R_FAILURE;
+	if (ret == LDAP_SUCCESS)
 		goto cleanup;
 
-	str_destroy(&data_buf);
-	return ISC_R_SUCCESS;
+	LDAP_OPT_CHECK(ldap_get_option(ldap_conn->handle, LDAP_OPT_RESULT_CODE,
+		       &ret), "remove_entry_from_ldap failed to obtain "
+		       "ldap error code");
 
+	if (result != ISC_R_SUCCESS)
+		log_ldap_error(ldap_conn->handle, "while deleting entry '%s'",
+			       str_buf(dn));
 cleanup:
-	if (data_buf != NULL && str_len(data_buf) != 0)
-		data_str = str_buf(data_buf);
-	log_error_r("failed to parse RR entry: %s: data '%s'",
-		    ldap_entry_logname(entry), data_str);
-	str_destroy(&data_buf);
+	ldap_pool_putconnection(ldap_inst->pool, &ldap_conn);
+	str_destroy(&dn);
 	return result;
 }
 
+
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-add_soa_record(isc_mem_t *mctx, dns_name_t *origin,
-	       ldap_entry_t *entry, dns_ttl_t ttl, ldapdb_rdatalist_t *rdatalist,
-	       const char *fake_mname)
+ldap_pool_create(isc_mem_t *mctx, unsigned int connections, ldap_pool_t **poolp)
 {
+	ldap_pool_t *pool;
 	isc_result_t result;
-	ld_string_t *string = NULL;
-	dns_rdataclass_t rdclass;
-	dns_rdata_t *rdata = NULL;
-	dns_rdatalist_t *rdlist = NULL;
 
-	CHECK(str_new(mctx, &string));
+	REQUIRE(poolp != NULL && *poolp == NULL);
 
-	CHECK(ldap_entry_getfakesoa(entry, fake_mname, string));
-	rdclass = ldap_entry_getrdclass(entry);
-	CHECK(parse_rdata(mctx, entry, rdclass, dns_rdatatype_soa, origin,
-			  str_buf(string), &rdata));
+	CHECKED_MEM_GET(mctx, pool, sizeof(*pool));
+	ZERO_PTR(pool);
+	isc_mem_attach(mctx, &pool->mctx);
+	
+	CHECK(semaphore_init(&pool->conn_semaphore, connections));
+	CHECKED_MEM_GET(mctx, pool->conns,
+			connections * sizeof(ldap_connection_t *));
+	memset(pool->conns, 0, connections * sizeof(ldap_connection_t *));
+	pool->connections = connections;
 
-	CHECK(findrdatatype_or_create(mctx, rdatalist, rdclass, dns_rdatatype_soa,
-				      ttl, &rdlist));
+	*poolp = pool;
 
-	APPEND(rdlist->rdata, rdata, link);
+	return ISC_R_SUCCESS;
 
 cleanup:
-	str_destroy(&string);
-	if (result != ISC_R_SUCCESS)
-		SAFE_MEM_PUT_PTR(mctx, rdata);
-
+	ldap_pool_destroy(&pool);
 	return result;
 }
 
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-parse_rdata(isc_mem_t *mctx, ldap_entry_t *entry,
-	    dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
-	    dns_name_t *origin, const char *rdata_text, dns_rdata_t **rdatap)
+static void ATTR_NONNULLS
+ldap_pool_destroy(ldap_pool_t **poolp)
 {
-	isc_result_t result;
-	isc_consttextregion_t text;
-	isc_buffer_t lex_buffer;
-	isc_region_t rdatamem;
-	dns_rdata_t *rdata;
+	ldap_pool_t *pool;
+	ldap_connection_t *ldap_conn;
+	unsigned int i;
 
-	REQUIRE(entry != NULL);
-	REQUIRE(rdata_text != NULL);
-	REQUIRE(rdatap != NULL);
+	REQUIRE(poolp != NULL);
 
-	rdata = NULL;
-	rdatamem.base = NULL;
+	pool = *poolp;
+	if (pool == NULL)
+		return;
 
-	text.base = rdata_text;
-	text.length = strlen(text.base);
+	if (pool->conns != NULL) {
+		for (i = 0; i < pool->connections; i++) {
+			ldap_conn = pool->conns[i];
+			if (ldap_conn != NULL)
+				destroy_ldap_connection(&ldap_conn);
+		}
 
-	isc_buffer_init(&lex_buffer, (char *)text.base, text.length);
-	isc_buffer_add(&lex_buffer, text.length);
-	isc_buffer_setactive(&lex_buffer, text.length);
+		SAFE_MEM_PUT(pool->mctx, pool->conns,
+			     pool->connections * sizeof(ldap_connection_t *));
+	}
 
-	CHECK(isc_lex_openbuffer(entry->lex, &lex_buffer));
+	semaphore_destroy(&pool->conn_semaphore);
 
-	isc_buffer_init(&entry->rdata_target, entry->rdata_target_mem,
-			DNS_RDATA_MAXLENGTH);
-	CHECK(dns_rdata_fromtext(NULL, rdclass, rdtype, entry->lex, origin,
-				 0, mctx, &entry->rdata_target, NULL));
+	MEM_PUT_AND_DETACH(pool);
+	*poolp = NULL;
+}
 
-	CHECKED_MEM_GET_PTR(mctx, rdata);
-	dns_rdata_init(rdata);
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_pool_getconnection(ldap_pool_t *pool, ldap_connection_t ** conn)
+{
+	ldap_connection_t *ldap_conn = NULL;
+	unsigned int i;
+	isc_result_t result;
 
-	rdatamem.length = isc_buffer_usedlength(&entry->rdata_target);
-	CHECKED_MEM_GET(mctx, rdatamem.base, rdatamem.length);
+	REQUIRE(pool != NULL);
+	REQUIRE(conn != NULL && *conn == NULL);
+	ldap_conn = *conn;
 
-	memcpy(rdatamem.base, isc_buffer_base(&entry->rdata_target),
-	       rdatamem.length);
-	dns_rdata_fromregion(rdata, rdclass, rdtype, &rdatamem);
+	CHECK(semaphore_wait_timed(&pool->conn_semaphore, &conn_wait_timeout));
+	/* Following assertion is necessary to convince clang static analyzer
+	 * that the loop is always entered. */
+	REQUIRE(pool->connections > 0);
+	for (i = 0; i < pool->connections; i++) {
+		ldap_conn = pool->conns[i];
+		if (isc_mutex_trylock(&ldap_conn->lock) == ISC_R_SUCCESS)
+			break;
+	}
 
-	isc_lex_close(entry->lex);
+	RUNTIME_CHECK(ldap_conn != NULL);
 
-	*rdatap = rdata;
-	return ISC_R_SUCCESS;
+	*conn = ldap_conn;
 
 cleanup:
-	isc_lex_close(entry->lex);
-	SAFE_MEM_PUT_PTR(mctx, rdata);
-	if (rdatamem.base != NULL)
-		isc_mem_put(mctx, rdatamem.base, rdatamem.length);
-
+	if (result != ISC_R_SUCCESS) {
+		log_error("timeout in ldap_pool_getconnection(): try to raise "
+				"'connections' parameter; potential deadlock?");
+	}
 	return result;
 }
 
-/* FIXME: Tested with SASL/GSSAPI/KRB5 only */
-static int ATTR_NONNULL(3) ATTR_CHECKRESULT
-ldap_sasl_interact(LDAP *ld, unsigned flags, void *defaults, void *sin)
+static void ATTR_NONNULLS
+ldap_pool_putconnection(ldap_pool_t *pool, ldap_connection_t **conn)
 {
-	sasl_interact_t *in;
-	ldap_instance_t *ldap_inst = defaults;
-	int ret = LDAP_OTHER;
-	isc_result_t result;
-
-	REQUIRE(ldap_inst != NULL);
-	UNUSED(flags);
-
-	if (ld == NULL || sin == NULL)
-		return LDAP_PARAM_ERROR;
+	REQUIRE(conn != NULL);
+	ldap_connection_t *ldap_conn = *conn;
 
-	log_debug(4, "doing interactive bind");
-	for (in = sin; in != NULL && in->id != SASL_CB_LIST_END; in++) {
-		switch (in->id) {
-		case SASL_CB_USER:
-			log_debug(4, "got request for SASL_CB_USER");
-			CHECK(setting_get_str("sasl_user",
-					      ldap_inst->server_ldap_settings,
-					      (const char **)&in->result));
-			in->len = strlen(in->result);
-			ret = LDAP_SUCCESS;
-			break;
-		case SASL_CB_GETREALM:
-			log_debug(4, "got request for SASL_CB_GETREALM");
-			CHECK(setting_get_str("sasl_realm",
-					      ldap_inst->server_ldap_settings,
-					      (const char **)&in->result));
-			in->len = strlen(in->result);
-			ret = LDAP_SUCCESS;
-			break;
-		case SASL_CB_AUTHNAME:
-			log_debug(4, "got request for SASL_CB_AUTHNAME");
-			CHECK(setting_get_str("sasl_auth_name",
-					      ldap_inst->server_ldap_settings,
-					      (const char **)&in->result));
-			in->len = strlen(in->result);
-			ret = LDAP_SUCCESS;
-			break;
-		case SASL_CB_PASS:
-			log_debug(4, "got request for SASL_CB_PASS");
-			CHECK(setting_get_str("sasl_password",
-					      ldap_inst->server_ldap_settings,
-					      (const char **)&in->result));
-			in->len = strlen(in->result);
-			ret = LDAP_SUCCESS;
-			break;
-		default:
+	if (ldap_conn == NULL)
+		return;
+
+	UNLOCK(&ldap_conn->lock);
+	semaphore_signal(&pool->conn_semaphore);
+
+	*conn = NULL;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_pool_connect(ldap_pool_t *pool, ldap_instance_t *ldap_inst)
+{
+	isc_result_t result;
+	ldap_connection_t *ldap_conn;
+	unsigned int i;
+
+	for (i = 0; i < pool->connections; i++) {
+		ldap_conn = NULL;
+		CHECK(new_ldap_connection(pool, &ldap_conn));
+		result = ldap_connect(ldap_inst, ldap_conn, ISC_FALSE);
+		/* Continue even if LDAP server is down */
+		if (result != ISC_R_NOTCONNECTED && result != ISC_R_TIMEDOUT &&
+		    result != ISC_R_SUCCESS) {
 			goto cleanup;
 		}
+		pool->conns[i] = ldap_conn;
 	}
 
-	return ret;
+	return ISC_R_SUCCESS;
 
 cleanup:
-	in->result = NULL;
-	in->len = 0;
-	return LDAP_OTHER;
+	log_error_r("couldn't establish connection in LDAP connection pool");
+	for (i = 0; i < pool->connections; i++) {
+		destroy_ldap_connection(&pool->conns[i]);
+	}
+	return result;
 }
 
+#define LDAP_ENTRYCHANGE_ALL	(LDAP_SYNC_CAPI_ADD | LDAP_SYNC_CAPI_DELETE | LDAP_SYNC_CAPI_MODIFY)
+
+#define LDAPDB_EVENT_TEMPLATE_REFRESH	(LDAPDB_EVENTCLASS + 6)
+
 /*
- * Initialize the LDAP handle and bind to the server. Needed authentication
- * credentials and settings are available from the ldap_inst.
+ * Event for asynchronous re-rendering of an entry with templates.
+ */
+typedef struct ldap_tmplrefreshev ldap_tmplrefreshev_t;
+struct ldap_tmplrefreshev {
+	ISC_EVENT_COMMON(ldap_tmplrefreshev_t);
+	isc_mem_t *mctx;
+	ldap_instance_t *inst;
+	rr_template_dep_t *dep;
+};
+
+#define SYNCREPL_ADD(chgtype) (chgtype == LDAP_SYNC_CAPI_ADD)
+#define SYNCREPL_DEL(chgtype) (chgtype == LDAP_SYNC_CAPI_DELETE)
+#define SYNCREPL_MOD(chgtype) (chgtype == LDAP_SYNC_CAPI_MODIFY)
+/* SYNCREPL_MODDN: Change in DN can be detected only via UUID->DN mapping:
+ * Map UUID to (remembered) DN and compare remembered DN with new one. */
+/* SYNCREPL_ANY: Initial database dump should be detected via sync_ctx state:
+ * All changes received before first 'intermediate' message contain initial
+ * state of the database.
+#define SYNCREPL_ANY(chgtype) ((chgtype & LDAP_ENTRYCHANGE_ALL) != 0)
+ */
+
+/*
+ * update_zone routine is processed asynchronously so it cannot assume
+ * anything about state of ldap_inst from where it was sent. The ldap_inst
+ * could have been already destroyed due server reload. The safest
+ * way how to handle zone update is to refetch ldap_inst,
+ * perform query to LDAP and delete&add the zone. This is expensive
+ * operation but zones don't change often.
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_connect(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn,
-	     isc_boolean_t force)
+update_zone_entry(isc_task_t *task, ldap_instance_t *inst, ldap_syncsess_t *sess,
+		  ldap_entry_t *entry, int chgtype)
 {
-	LDAP *ld = NULL;
-	int ret;
-	int version;
-	struct timeval timeout;
-	isc_result_t result = ISC_R_FAILURE;
-	const char *uri = NULL;
-	const char *ldap_hostname = NULL;
-	isc_uint32_t timeout_sec;
-
-	REQUIRE(ldap_inst != NULL);
-	REQUIRE(ldap_conn != NULL);
+	isc_result_t result;
 
-	CHECK(setting_get_str("uri", ldap_inst->local_settings, &uri));
-	ret = ldap_initialize(&ld, uri);
-	if (ret != LDAP_SUCCESS) {
-		log_error("LDAP initialization failed: %s",
-			  ldap_err2string(ret));
-		CLEANUP_WITH(ISC_R_FAILURE);
+	if (SYNCREPL_DEL(chgtype)) {
+		CHECK(ldap_delete_zone2(inst, &entry->fqdn, ISC_TRUE));
+	} else {
+		if (entry->class & LDAP_ENTRYCLASS_MASTER)
+			CHECK(ldap_parse_master_zoneentry(entry, NULL, inst,
+							  sess, task));
+		else if (entry->class & LDAP_ENTRYCLASS_FORWARD)
+			CHECK(ldap_parse_fwd_zoneentry(entry, inst));
+		else
+			FATAL_ERROR(__FILE__, __LINE__,
+				    "update_zone: unexpected entry class");
 	}
 
-	version = LDAP_VERSION3;
-	ret = ldap_set_option(ld, LDAP_OPT_PROTOCOL_VERSION, &version);
-	LDAP_OPT_CHECK(ret, "failed to set LDAP version");
+cleanup:
+	if (result != ISC_R_SUCCESS)
+		log_error_r("update_zone (syncrepl) failed for %s. "
+			    "Zones can be outdated, run `rndc reload`",
+			    ldap_entry_logname(entry));
+	return result;
+}
 
-	CHECK(setting_get_uint("timeout", ldap_inst->server_ldap_settings,
-			       &timeout_sec));
-	timeout.tv_sec = timeout_sec;
-	timeout.tv_usec = 0;
+static void ATTR_NONNULLS
+update_zone(isc_task_t *task, isc_event_t *event)
+{
+	ldap_syncreplevent_t *pevent = (ldap_syncreplevent_t *)event;
+	ldap_instance_t *inst = pevent->inst;
+	isc_mem_t *mctx;
+	ldap_entry_t *entry = pevent->entry;
 
-	ret = ldap_set_option(ld, LDAP_OPT_TIMEOUT, &timeout);
-	LDAP_OPT_CHECK(ret, "failed to set timeout");
+	mctx = pevent->mctx;
 
-	CHECK(setting_get_str("ldap_hostname", ldap_inst->local_settings,
-			      &ldap_hostname));
-	if (strlen(ldap_hostname) > 0) {
-		ret = ldap_set_option(ld, LDAP_OPT_HOST_NAME, ldap_hostname);
-		LDAP_OPT_CHECK(ret, "failed to set LDAP_OPT_HOST_NAME");
-	}
+	INSIST(task == inst->task); /* For task-exclusive mode */
 
-	if (ldap_conn->handle != NULL)
-		ldap_unbind_ext_s(ldap_conn->handle, NULL, NULL);
-	ldap_conn->handle = ld;
-	ld = NULL; /* prevent double-unbind from ldap_reconnect() and cleanup: */
+	(void)update_zone_entry(task, inst, pevent->sess, entry,
+				pevent->chgtype);
 
-	CHECK(ldap_reconnect(ldap_inst, ldap_conn, force));
-	return result;
+	sync_concurr_limit_signal(pevent->sess->sctx);
+	sync_event_signal(pevent->sess->sctx, pevent);
 
-cleanup:
-	if (ld != NULL)
-		ldap_unbind_ext_s(ld, NULL, NULL);
+	if (pevent->prevdn != NULL)
+		isc_mem_free(mctx, pevent->prevdn);
+	ldap_entry_destroy(&entry);
+	isc_mem_detach(&mctx);
+	isc_event_free(&event);
+	isc_task_detach(&task);
+}
 
-	/* Make sure handle is NULL. */
-	if (ldap_conn->handle != NULL) {
-		ldap_unbind_ext_s(ldap_conn->handle, NULL, NULL);
-		ldap_conn->handle = NULL;
-	}
+/**
+ * Free zone events from a batch which were not processed
+ * and the batch event itself.
+ */
+static void ATTR_NONNULLS
+zone_batch_destroy(ldap_syncsess_t *sess, ldap_syncreplevent_t **batchp)
+{
+	ldap_syncreplevent_t *batch = *batchp;
+	ldap_syncreplevent_t *pevent;
 
-	return result;
+	if (batch == NULL)
+		return;
+
+	while ((pevent = HEAD(batch->batch)) != NULL) {
+		UNLINK(batch->batch, pevent, batch_link);
+		sync_concurr_limit_signal(sess->sctx);
+		if (pevent->prevdn != NULL)
+			isc_mem_free(pevent->mctx, pevent->prevdn);
+		ldap_entry_destroy(&pevent->entry);
+		isc_mem_detach(&pevent->mctx);
+		isc_event_free((isc_event_t **)&pevent);
+	}
+	isc_mem_detach(&batch->mctx);
+	isc_event_free((isc_event_t **)batchp);
 }
 
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_reconnect(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn,
-	       isc_boolean_t force)
+/**
+ * Process batch of zone events collected by syncrepl_update().
+ *
+ * All zones in the batch are created and published in a single
+ * exclusive section and the view is thawed only once.
+ */
+static void ATTR_NONNULLS
+update_zone_batch(isc_task_t *task, isc_event_t *event)
 {
-	isc_result_t result;
-	int ret = 0;
-	const char *bind_dn = NULL;
-	const char *password = NULL;
-	const char *uri = NULL;
-	const char *sasl_mech = NULL;
-	const char *krb5_principal = NULL;
-	const char *krb5_keytab = NULL;
-	ldap_auth_t auth_method_enum = AUTH_INVALID;
-	isc_uint32_t reconnect_interval;
+	ldap_syncreplevent_t *batch = (ldap_syncreplevent_t *)event;
+	ldap_syncreplevent_t *pevent;
+	ldap_instance_t *inst = batch->inst;
+	isc_result_t lock_state = ISC_R_IGNORE;
+	isc_boolean_t freeze = ISC_FALSE;
 
-	if (force)
-		goto force_reconnect;
+	INSIST(task == inst->task); /* For task-exclusive mode */
 
-	if (ldap_conn->tries > 0) {
-		isc_time_t now;
-		int time_cmp;
+	run_exclusive_enter(inst, &lock_state);
+	if (inst->view->frozen) {
+		freeze = ISC_TRUE;
+		dns_view_thaw(inst->view);
+	}
 
-		result = isc_time_now(&now);
-		time_cmp = isc_time_compare(&now, &ldap_conn->next_reconnect);
-		if (result == ISC_R_SUCCESS && time_cmp < 0)
-			return ISC_R_SOFTQUOTA;
+	for (pevent = HEAD(batch->batch);
+	     pevent != NULL;
+	     pevent = NEXT(pevent, batch_link)) {
+		(void)update_zone_entry(task, inst, batch->sess,
+					pevent->entry, pevent->chgtype);
 	}
 
-	/* Set the next possible reconnect time. */
-	{
-		isc_interval_t delay;
-		unsigned int i;
-		unsigned int seconds;
-		const unsigned int intervals[] = { 2, 5, 20, UINT_MAX };
-		const size_t ntimes = sizeof(intervals) / sizeof(intervals[0]);
+	if (freeze)
+		dns_view_freeze(inst->view);
+	run_exclusive_exit(inst, lock_state);
 
-		i = ISC_MIN(ntimes - 1, ldap_conn->tries);
-		CHECK(setting_get_uint("reconnect_interval",
-				       ldap_inst->server_ldap_settings,
-				       &reconnect_interval));
-		seconds = ISC_MIN(intervals[i], reconnect_interval);
-		isc_interval_set(&delay, seconds, 0);
-		isc_time_nowplusinterval(&ldap_conn->next_reconnect, &delay);
-	}
+	sync_event_signal(batch->sess->sctx, batch);
+	zone_batch_destroy(batch->sess, &batch);
+	isc_task_detach(&task);
+}
 
-	ldap_conn->tries++;
-force_reconnect:
-	CHECK(setting_get_str("uri", ldap_inst->local_settings, &uri));
-	log_debug(2, "trying to establish LDAP connection to %s", uri);
+static void ATTR_NONNULLS
+update_config(isc_task_t * task, isc_event_t *event)
+{
+	ldap_syncreplevent_t *pevent = (ldap_syncreplevent_t *)event;
+	isc_result_t result;
+	ldap_instance_t *inst = pevent->inst;
+	ldap_entry_t *entry = pevent->entry;
+	isc_mem_t *mctx;
 
-	CHECK(setting_get_uint("auth_method_enum", ldap_inst->local_settings,
-			       &auth_method_enum));
-	switch (auth_method_enum) {
-	case AUTH_NONE:
-		ret = ldap_simple_bind_s(ldap_conn->handle, NULL, NULL);
-		break;
-	case AUTH_SIMPLE:
-		CHECK(setting_get_str("bind_dn", ldap_inst->server_ldap_settings,
-				      &bind_dn));
-		CHECK(setting_get_str("password", ldap_inst->server_ldap_settings,
-				      &password));
-		ret = ldap_simple_bind_s(ldap_conn->handle, bind_dn, password);
-		break;
-	case AUTH_SASL:
-		CHECK(setting_get_str("sasl_mech", ldap_inst->local_settings,
-				      &sasl_mech));
-		if (strcmp(sasl_mech, "GSSAPI") == 0) {
-			CHECK(setting_get_str("krb5_principal",
-					      ldap_inst->local_settings,
-					      &krb5_principal));
-			CHECK(setting_get_str("krb5_keytab",
-					      ldap_inst->local_settings,
-					      &krb5_keytab));
-			LOCK(&ldap_inst->kinit_lock);
-			result = get_krb5_tgt(ldap_inst->mctx,
-					      krb5_principal,
-					      krb5_keytab);
-			UNLOCK(&ldap_inst->kinit_lock);
-			if (result != ISC_R_SUCCESS)
-				return ISC_R_NOTCONNECTED;
-		}
+	mctx = pevent->mctx;
 
-		log_debug(4, "trying interactive bind using '%s' mechanism",
-			  sasl_mech);
-		ret = ldap_sasl_interactive_bind_s(ldap_conn->handle, NULL,
-						   sasl_mech,
-						   NULL, NULL, LDAP_SASL_QUIET,
-						   ldap_sasl_interact,
-						   ldap_inst);
-		break;
-	case AUTH_INVALID:
-		UNEXPECTED_ERROR(__FILE__, __LINE__,
-				"invalid auth_method_enum value %u",
-				 auth_method_enum);
-		break;
+	INSIST(task == inst->task); /* For task-exclusive mode */
+	CHECK(ldap_parse_configentry(entry, inst));
 
-	default:
-		log_bug("unsupported authentication mechanism");
-		ret = LDAP_OTHER;
-		break;
+cleanup:
+	if (inst != NULL) {
+		sync_concurr_limit_signal(pevent->sess->sctx);
+		sync_event_signal(pevent->sess->sctx, pevent);
 	}
+	if (result != ISC_R_SUCCESS)
+		log_error_r("update_config (syncrepl) failed for %s. "
+			    "Configuration can be outdated, run `rndc reload`",
+			    ldap_entry_logname(entry));
 
-	if (ret != LDAP_SUCCESS) {
-		log_ldap_error(ldap_conn->handle, "bind to LDAP server failed");
+	ldap_entry_destroy(&entry);
+	isc_mem_detach(&mctx);
+	isc_event_free(&event);
+	isc_task_detach(&task);
+}
 
-		/*
-		 * Clean the connection handle.
-		 */
-		if (ldap_conn->handle != NULL) {
-			ldap_unbind_ext_s(ldap_conn->handle, NULL, NULL);
-			ldap_conn->handle = NULL;
-		}
+static void ATTR_NONNULLS
+update_serverconfig(isc_task_t * task, isc_event_t *event)
+{
+	ldap_syncreplevent_t *pevent = (ldap_syncreplevent_t *)event;
+	isc_result_t result;
+	ldap_instance_t *inst = pevent->inst;
+	ldap_entry_t *entry = pevent->entry;
+	isc_mem_t *mctx;
 
-		switch (ret) {
-		case LDAP_INVALID_CREDENTIALS:
-			return ISC_R_NOPERM;
-		case LDAP_SERVER_DOWN:
-			return ISC_R_NOTCONNECTED;
-		case LDAP_TIMEOUT:
-			return ISC_R_TIMEDOUT;
-		default:
-			return ISC_R_FAILURE;
-		}
-	} else
-		log_debug(2, "bind to LDAP server successful");
+	mctx = pevent->mctx;
 
-	ldap_conn->tries = 0;
+	INSIST(task == inst->task); /* For task-exclusive mode */
+	CHECK(ldap_parse_serverconfigentry(entry, inst));
 
-	return ISC_R_SUCCESS;
+cleanup:
+	if (inst != NULL) {
+		sync_concurr_limit_signal(pevent->sess->sctx);
+		sync_event_signal(pevent->sess->sctx, pevent);
+	}
+	if (result != ISC_R_SUCCESS)
+		log_error_r("update_serverconfig (syncrepl) failed for %s. "
+			    "Configuration can be outdated, run `rndc reload`",
+			    ldap_entry_logname(entry));
+
+	ldap_entry_destroy(&entry);
+	isc_mem_detach(&mctx);
+	isc_event_free(&event);
+	isc_task_detach(&task);
+}
+
+/**
+ * Read entryUUID attribute of an entry returned by plain LDAP search.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_entry_uuid_read(LDAP *ld, LDAPMessage *entry, const char *base,
+		     uuid_t uuid) {
+	isc_result_t result;
+	struct berval **values = NULL;
+	char uuid_str[sizeof("01234567-89ab-cdef-0123-456789abcdef")];
+
+	values = ldap_get_values_len(ld, entry, "entryUUID");
+	if (values == NULL || values[0] == NULL
+	    || values[0]->bv_len >= sizeof(uuid_str)) {
+		log_bug("entry without valid entryUUID in '%s'", base);
+		CLEANUP_WITH(ISC_R_UNEXPECTED);
+	}
+	memcpy(uuid_str, values[0]->bv_val, values[0]->bv_len);
+	uuid_str[values[0]->bv_len] = '\0';
+	if (uuid_parse(uuid_str, uuid) != 0) {
+		log_bug("entryUUID '%s' cannot be parsed", uuid_str);
+		CLEANUP_WITH(ISC_R_UNEXPECTED);
+	}
+	result = ISC_R_SUCCESS;
 
 cleanup:
+	if (values != NULL)
+		ldap_value_free_len(values);
 	return result;
 }
 
-static isc_result_t ATTR_NONNULLS
-handle_connection_error(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn,
-			isc_boolean_t force)
-{
-	int ret;
-	int err_code;
-	isc_result_t result = ISC_R_FAILURE;
+#define LDAPDB_EVENT_ZONE_RESYNC	(LDAPDB_EVENTCLASS + 12)
 
-	REQUIRE(ldap_conn != NULL);
+/** Number of entries in one page of paged search, i.e. entries read
+ *  by one run of zone_resync(). */
+#define LDAP_RESYNC_PAGE_SIZE	256
 
-	if (ldap_conn->handle == NULL)
-		goto reconnect;
+/* Node data for names generated by range entries. */
+#define RESYNC_NAME_MARK ((void *)1)
 
-	ret = ldap_get_option(ldap_conn->handle, LDAP_OPT_RESULT_CODE,
-				(void *)&err_code);
-	if (ret != LDAP_OPT_SUCCESS) {
-		log_error("handle_connection_error failed to obtain ldap error code");
-		goto reconnect;
-	}
+/**
+ * Re-synchronization of one zone. The event is sent again to the zone task
+ * after each page of entries so state of the search is kept here.
+ */
+typedef struct ldap_zoneresyncev ldap_zoneresyncev_t;
+struct ldap_zoneresyncev {
+	ISC_EVENT_COMMON(ldap_zoneresyncev_t);
+	ldap_instance_t		*inst;
+	dns_fixedname_t		name;
+
+	/** Own connection, paged results cookie is bound to it. */
+	ldap_connection_t	*conn;
+	struct berval		cookie;
+	/** Page which was not processed yet. */
+	LDAPMessage		*page;
+	/** Names of entries read so far, node data is entryUUID. */
+	dns_rbt_t		*names;
+	/** Generated names are known only when all entries are seen. */
+	LIST(ldap_entry_t)	range_entries;
+	/** Zone content before the first page. Names added by other events
+	 *  in the meantime are not removed from the zone. */
+	dns_db_t		*rbtdb;
+	dns_dbversion_t		*snapshot;
+	unsigned int		entry_cnt;
+	unsigned int		page_cnt;
+};
 
-	switch (err_code) {
-	case LDAP_NO_SUCH_OBJECT:
-		ldap_conn->tries = 0;
-		result = ISC_R_SUCCESS;
-		break;
-	case LDAP_TIMEOUT:
-		log_error("LDAP query timed out. Try to adjust \"timeout\" parameter");
-		result = ISC_R_TIMEDOUT;
-		break;
-	case LDAP_INVALID_DN_SYNTAX:
-	case LDAP_INVALID_SYNTAX:
-	case LDAP_FILTER_ERROR:
-		log_ldap_error(ldap_conn->handle, "invalid syntax in "
-			       "handle_connection_error indicates a bug");
-		result = ISC_R_UNEXPECTEDTOKEN;
-		break;
-	default:
-		/* Try to reconnect on other errors. */
-		log_ldap_error(ldap_conn->handle, "connection error");
-reconnect:
-		if (ldap_conn->handle == NULL && force == ISC_FALSE)
-			log_error("connection to the LDAP server was lost");
-		result = ldap_connect(ldap_inst, ldap_conn, force);
-		if (result == ISC_R_SUCCESS)
-			log_info("successfully reconnected to LDAP server");
-		break;
+static void
+resync_name_free(void *data, void *arg) {
+	isc_mem_t *mctx = arg;
+
+	if (data != RESYNC_NAME_MARK)
+		isc_mem_put(mctx, data, sizeof(uuid_t));
+}
+
+/**
+ * Release state of re-synchronization and the event itself.
+ */
+static void ATTR_NONNULLS
+zone_resync_event_free(ldap_zoneresyncev_t **zeventp)
+{
+	ldap_zoneresyncev_t *zevent = *zeventp;
+	ldap_entry_t *entry;
+
+	destroy_ldap_connection(&zevent->conn);
+	if (zevent->cookie.bv_val != NULL)
+		ber_memfree(zevent->cookie.bv_val);
+	if (zevent->page != NULL)
+		ldap_msgfree(zevent->page);
+	if (zevent->names != NULL)
+		dns_rbt_destroy(&zevent->names);
+	while ((entry = HEAD(zevent->range_entries)) != NULL) {
+		UNLINK(zevent->range_entries, entry, link);
+		ldap_entry_destroy(&entry);
 	}
+	if (zevent->snapshot != NULL)
+		dns_db_closeversion(zevent->rbtdb, &zevent->snapshot,
+				    ISC_FALSE);
+	if (zevent->rbtdb != NULL)
+		dns_db_detach(&zevent->rbtdb);
+	isc_event_free((isc_event_t **)zeventp);
+}
+
+/**
+ * Prepare state for the first page: requests received from now on
+ * need another run.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_resync_start(ldap_zoneresyncev_t *zevent)
+{
+	isc_result_t result;
+	ldap_instance_t *inst = zevent->inst;
+	dns_name_t *zname = dns_fixedname_name(&zevent->name);
+
+	CHECK(zr_set_zone_tainted(inst->zone_register, zname, ISC_FALSE,
+				  NULL));
+	CHECK(dns_rbt_create(inst->mctx, resync_name_free, inst->mctx,
+			     &zevent->names));
+	CHECK(zr_get_zone_dbs(inst->zone_register, zname, NULL,
+			      &zevent->rbtdb));
+	dns_db_currentversion(zevent->rbtdb, &zevent->snapshot);
+	CHECK(new_ldap_connection(inst->pool, &zevent->conn));
+	CHECK(ldap_connect(inst, zevent->conn, ISC_FALSE));
 
+cleanup:
 	return result;
 }
 
 /**
- * Apply LDAP modifications.
- *
- * @retval ISC_R_SUCCESS
- * @retval DNS_R_UNKNOWN = LDAP_OBJECT_CLASS_VIOLATION
- *                       or LDAP_INSUFFICIENT_ACCESS. Most likely an attribute
- *                       for a DNS RR type cannot be added because it is not
- *                       present in the LDAP schema.
+ * Read next page of entries matching filter from subtree. Paged results
+ * control keeps the result within server size limit and limits time spent
+ * by processing of one page. Cookie has to be empty for the first page,
+ * it is empty again after the last page. The cookie is bound to connection
+ * ld so all pages have to be read using the same connection.
  */
-isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_modify_do(ldap_instance_t *ldap_inst, const char *dn, LDAPMod **mods,
-		isc_boolean_t delete_node)
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_search_page(LDAP *ld, const char *base, const char *filter,
+		 struct berval *cookiep, LDAPMessage **msgp)
 {
-	int ret;
-	int err_code;
-	const char *operation_str;
-	isc_boolean_t once = ISC_FALSE;
 	isc_result_t result;
-	ldap_connection_t *ldap_conn = NULL;
+	char *attrs[] = { "*", "entryUUID", NULL };
+	LDAPControl *ctrls[2] = { NULL, NULL };
+	LDAPControl **res_ctrls = NULL;
+	LDAPControl *page_ctrl;
+	struct berval cookie = { 0, NULL };
+	ber_int_t estimate;
+	int ret;
+	int err;
 
-	REQUIRE(dn != NULL);
-	REQUIRE(mods != NULL);
-	REQUIRE(ldap_inst != NULL);
+	REQUIRE(*msgp == NULL);
 
-	/* Any mod_op can be ORed with LDAP_MOD_BVALUES. */
-	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_ADD)
-		operation_str = "modifying(add)";
-	else if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_DELETE)
-		operation_str = "modifying(del)";
-	else if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_REPLACE)
-		operation_str = "modifying(replace)";
-	else {
-		operation_str = "modifying(unknown operation)";
-		log_bug("%s: 0x%x", operation_str, mods[0]->mod_op);
-		CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
+	ret = ldap_create_page_control(ld, LDAP_RESYNC_PAGE_SIZE,
+				       cookiep, 0, &ctrls[0]);
+	if (ret != LDAP_SUCCESS) {
+		log_ldap_error(ld, "unable to create paged results control");
+		CLEANUP_WITH(ISC_R_FAILURE);
 	}
 
-	CHECK(ldap_pool_getconnection(ldap_inst->pool, &ldap_conn));
-	if (ldap_conn->handle == NULL) {
-		/*
-		 * handle can be NULL when the first connection to LDAP wasn't
-		 * successful
-		 * TODO: handle this case inside ldap_pool_getconnection()?
-		 */
-retry:
-		once = ISC_TRUE;
-		CHECK(handle_connection_error(ldap_inst, ldap_conn, ISC_FALSE));
+	ret = ldap_search_ext_s(ld, base, LDAP_SCOPE_SUBTREE, filter,
+				attrs, 0, ctrls, NULL, NULL, LDAP_NO_LIMIT,
+				msgp);
+	if (ret == LDAP_SUCCESS)
+		ret = ldap_parse_result(ld, *msgp, &err, NULL, NULL, NULL,
+					&res_ctrls, 0);
+	if (ret == LDAP_SUCCESS)
+		ret = err;
+	if (ret != LDAP_SUCCESS) {
+		log_ldap_error(ld, "search in '%s' failed", base);
+		CLEANUP_WITH(ISC_R_FAILURE);
 	}
 
-	if (delete_node) {
-		log_debug(2, "deleting whole node: '%s'", dn);
-		ret = ldap_delete_ext_s(ldap_conn->handle, dn, NULL, NULL);
-	} else {
-		log_debug(2, "writing to '%s': %s", dn, operation_str);
-		ret = ldap_modify_ext_s(ldap_conn->handle, dn, mods, NULL, NULL);
+	/* server which does not support paging returns everything at once */
+	page_ctrl = ldap_control_find(LDAP_CONTROL_PAGEDRESULTS, res_ctrls,
+				      NULL);
+	if (page_ctrl != NULL
+	    && ldap_parse_pageresponse_control(ld, page_ctrl, &estimate,
+					       &cookie) != LDAP_SUCCESS) {
+		log_ldap_error(ld, "unable to parse paged results control "
+			       "from '%s'", base);
+		CLEANUP_WITH(ISC_R_FAILURE);
 	}
+	if (cookiep->bv_val != NULL)
+		ber_memfree(cookiep->bv_val);
+	*cookiep = cookie;
+	result = ISC_R_SUCCESS;
 
-	result = (ret == LDAP_SUCCESS) ? ISC_R_SUCCESS : ISC_R_FAILURE;
-	if (ret == LDAP_SUCCESS)
-		goto cleanup;
-
-	LDAP_OPT_CHECK(ldap_get_option(ldap_conn->handle, LDAP_OPT_RESULT_CODE,
-			&err_code), "ldap_modify_do(%s) failed to obtain ldap error code",
-			operation_str);
+cleanup:
+	if (result != ISC_R_SUCCESS && *msgp != NULL) {
+		ldap_msgfree(*msgp);
+		*msgp = NULL;
+	}
+	if (ctrls[0] != NULL)
+		ldap_control_free(ctrls[0]);
+	if (res_ctrls != NULL)
+		ldap_controls_free(res_ctrls);
+	return result;
+}
 
-	/* If there is no object yet, create it with an ldap add operation. */
-	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_ADD &&
-	     err_code == LDAP_NO_SUCH_OBJECT) {
-		int i;
-		LDAPMod **new_mods;
-		char *obj_str[] = { "idnsRecord", NULL };
-		LDAPMod obj_class = {
-			0, "objectClass", { .modv_strvals = obj_str },
-		};
+/**
+ * Read next page of entries from the zone. Cookie in the event is empty
+ * after the last page.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_resync_search(ldap_zoneresyncev_t *zevent, const char *dn,
+		   LDAPMessage **msgp)
+{
+	/* zone object itself is processed by update_zone() */
+	return ldap_search_page(zevent->conn->handle, dn,
+				"(&(objectClass=idnsRecord)"
+				"  (!(objectClass=idnsZone)))",
+				&zevent->cookie, msgp);
+}
 
-		/*
-		 * Create a new array of LDAPMod structures. We will change
-		 * the mod_op member of each one to 0 (but preserve
-		 * LDAP_MOD_BVALUES. Additionally, we also need to specify
-		 * the objectClass attribute.
-		 */
-		for (i = 0; mods[i]; i++)
-			mods[i]->mod_op &= LDAP_MOD_BVALUES;
-		new_mods = alloca((i + 2) * sizeof(LDAPMod *));
-		memcpy(new_mods, mods, i * sizeof(LDAPMod *));
-		new_mods[i] = &obj_class;
-		new_mods[i + 1] = NULL;
+/**
+ * Compute difference between zone database and page of entries
+ * from LDAP which is stored in the event. Entries are stored into metaDB of the session which reads
+ * the zone so later changes from SyncRepl can be processed.
+ * Zone apex is maintained by update_zone() and is not touched.
+ *
+ * @param[in]  mldap	metaDB with open version or NULL
+ * @param[out] diff	Initialized diff
+ */
+static isc_result_t ATTR_NONNULL(1,2,4,5) ATTR_CHECKRESULT
+zone_resync_page(ldap_zoneresyncev_t *zevent, const char *dn,
+		 mldapdb_t *mldap, dns_dbversion_t *version, dns_diff_t *diff)
+{
+	isc_result_t result;
+	ldap_instance_t *inst = zevent->inst;
+	dns_name_t *zname = dns_fixedname_name(&zevent->name);
+	LDAP *ld = zevent->conn->handle;
+	dns_db_t *rbtdb = zevent->rbtdb;
+	settings_set_t *zone_settings = NULL;
+	LDAPMessage *ldap_entry;
+	ldap_entry_t *entry = NULL;
+	uuid_t uuid;
+	struct berval entryUUID = { .bv_len = sizeof(uuid),
+				    .bv_val = (char *)uuid };
+	unsigned char *name_uuid = NULL;
+	ldapdb_rdatalist_t rdatalist;
+	dns_dbnode_t *node = NULL;
+	dns_rdatasetiter_t *rbt_rds_iterator = NULL;
 
-		ret = ldap_add_ext_s(ldap_conn->handle, dn, new_mods, NULL, NULL);
-		result = (ret == LDAP_SUCCESS) ? ISC_R_SUCCESS : ISC_R_FAILURE;
-		if (ret == LDAP_SUCCESS)
-			goto cleanup;
-		LDAP_OPT_CHECK(ldap_get_option(ldap_conn->handle, LDAP_OPT_RESULT_CODE,
-				&err_code),
-				"ldap_modify_do(add) failed to obtain ldap error code");
-		operation_str = "adding";
-	}
+	INIT_LIST(rdatalist);
 
-	log_ldap_error(ldap_conn->handle, "while %s entry '%s'", operation_str, dn);
-	/* attempt to manipulate attribute failed - likely a unknown RR type */
-	if (err_code == LDAP_OBJECT_CLASS_VIOLATION
-	    || err_code == LDAP_INSUFFICIENT_ACCESS) /* this is for 389 DS */
-		CLEANUP_WITH(DNS_R_UNKNOWN);
+	CHECK(zr_get_zone_settings(inst->zone_register, zname,
+				   &zone_settings));
 
-	/* do not error out if we are trying to delete an
-	 * unexisting attribute */
-	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) != LDAP_MOD_DELETE ||
-	    err_code != LDAP_NO_SUCH_ATTRIBUTE) {
-		result = ISC_R_FAILURE;
-		if (once == ISC_FALSE) {
-			log_error("retrying LDAP operation (%s) on entry '%s'",
-				  operation_str, dn);
-			goto retry;
+	/* records from LDAP replace whole content of respective nodes */
+	for (ldap_entry = ldap_first_entry(ld, zevent->page);
+	     ldap_entry != NULL;
+	     ldap_entry = ldap_next_entry(ld, ldap_entry)) {
+		CHECK(ldap_entry_uuid_read(ld, ldap_entry, dn, uuid));
+		CHECK(ldap_entry_parse(inst->mctx, ld, ldap_entry, &entryUUID,
+				       &entry));
+		if ((entry->class & LDAP_ENTRYCLASS_RR) == 0
+		    || !dns_name_equal(&entry->zone_name, zname)
+		    || dns_name_equal(&entry->fqdn, zname)) {
+			ldap_entry_destroy(&entry);
+			continue;
+		}
+		CHECKED_MEM_GET(inst->mctx, name_uuid, sizeof(uuid));
+		memcpy(name_uuid, uuid, sizeof(uuid));
+		result = dns_rbt_addname(zevent->names, &entry->fqdn,
+					 name_uuid);
+		if (result == ISC_R_EXISTS) {
+			log_error("%s: name is defined by multiple entries, "
+				  "ignoring", ldap_entry_logname(entry));
+			SAFE_MEM_PUT(inst->mctx, name_uuid, sizeof(uuid));
+			ldap_entry_destroy(&entry);
+			continue;
+		} else if (result != ISC_R_SUCCESS) {
+			goto cleanup;
+		}
+		name_uuid = NULL;
+		if (mldap != NULL)
+			CHECK(mldap_entry_create(entry, mldap, &entry->fqdn,
+						 &entry->zone_name));
+
+		/* template dependencies are recorded again by parser */
+		rr_template_deps_remove(inst->rr_templates, entry->uuid);
+		CHECK(ldap_parse_rrentry(inst->mctx, entry, zname,
+					 zone_settings, inst->rr_templates,
+					 &rdatalist));
+		CHECK(dns_db_findnode(rbtdb, &entry->fqdn, ISC_TRUE, &node));
+		result = dns_db_allrdatasets(rbtdb, node, version, 0,
+					     &rbt_rds_iterator);
+		if (result == ISC_R_SUCCESS) {
+			CHECK(diff_ldap_rbtdb(inst->mctx, &entry->fqdn,
+					      &rdatalist, rbt_rds_iterator,
+					      diff));
+			dns_rdatasetiter_destroy(&rbt_rds_iterator);
+		} else if (result != ISC_R_NOTFOUND) {
+			goto cleanup;
+		}
+		dns_db_detachnode(rbtdb, &node);
+		ldapdb_rdatalist_destroy(inst->mctx, &rdatalist);
+		zevent->entry_cnt++;
+		if ((entry->class & LDAP_ENTRYCLASS_RANGE) != 0) {
+			APPEND(zevent->range_entries, entry, link);
+			entry = NULL;
+		} else {
+			ldap_entry_destroy(&entry);
 		}
 	}
+	result = ISC_R_SUCCESS;
 
 cleanup:
-	ldap_pool_putconnection(ldap_inst->pool, &ldap_conn);
-
+	if (name_uuid != NULL)
+		SAFE_MEM_PUT(inst->mctx, name_uuid, sizeof(uuid));
+	if (rbt_rds_iterator != NULL)
+		dns_rdatasetiter_destroy(&rbt_rds_iterator);
+	if (node != NULL)
+		dns_db_detachnode(rbtdb, &node);
+	ldapdb_rdatalist_destroy(inst->mctx, &rdatalist);
+	ldap_entry_destroy(&entry);
 	return result;
 }
 
-void ATTR_NONNULLS
-ldap_mod_free(isc_mem_t *mctx, LDAPMod **changep)
+/**
+ * Compute difference for names generated by range entries and for names
+ * which are not in LDAP anymore. Only names which were in the zone
+ * when the re-synchronization started are removed, names added
+ * by SyncRepl in the meantime are not in the pages read before.
+ * Stale entries of the zone are removed from metaDB.
+ *
+ * @param[in]  mldap	metaDB with open version or NULL
+ * @param[out] diff	Initialized diff
+ */
+static isc_result_t ATTR_NONNULL(1,3,4) ATTR_CHECKRESULT
+zone_resync_last(ldap_zoneresyncev_t *zevent, mldapdb_t *mldap,
+		 dns_dbversion_t *version, dns_diff_t *diff)
 {
-	LDAPMod *change;
+	isc_result_t result;
+	ldap_instance_t *inst = zevent->inst;
+	dns_name_t *zname = dns_fixedname_name(&zevent->name);
+	dns_db_t *rbtdb = zevent->rbtdb;
+	settings_set_t *zone_settings = NULL;
+	ldapdb_rdatalist_t rdatalist;
+	void *data;
+	dns_dbnode_t *node = NULL;
+	dns_dbiterator_t *dbiter = NULL;
+	dns_rdatasetiter_t *rbt_rds_iterator = NULL;
+	dns_fixedname_t fname;
+	dns_name_t *name;
+	ldap_entry_t *range_entry;
+	range_set_t set;
+	ld_string_t *specs = NULL;
+	rbt_iterator_t *iter = NULL;
+	unsigned int pruned = 0;
+	DECLARE_BUFFERED_NAME(gen_name);
 
-	REQUIRE(changep != NULL);
+	INIT_LIST(rdatalist);
+	set.names = NULL;
+	dns_fixedname_init(&fname);
+	name = dns_fixedname_name(&fname);
 
-	change = *changep;
-	if (change == NULL)
-		return;
+	CHECK(zr_get_zone_settings(inst->zone_register, zname,
+				   &zone_settings));
+	CHECK(str_new(inst->mctx, &specs));
+
+	/* names generated by range entries, names of entries take precedence */
+	CHECK(range_set_init(inst->mctx, zname, zevent->names, &set));
+	for (range_entry = HEAD(zevent->range_entries); range_entry != NULL;
+	     range_entry = NEXT(range_entry, link)) {
+		CHECK(range_specs_get(inst, range_entry, zone_settings, specs));
+		if (str_len(specs) > 0) {
+			CHECK(range_set_expand(&set, range_entry, zone_settings,
+					       str_buf(specs)));
+			CHECK(rr_range_set(inst->rr_ranges, range_entry->uuid,
+					   str_buf(specs)));
+		} else {
+			rr_range_remove(inst->rr_ranges, range_entry->uuid);
+		}
+	}
+	CHECK(range_set_diff(&set, NULL, rbtdb, version, diff));
+	INIT_BUFFERED_NAME(gen_name);
+	for (result = rbt_iter_first(inst->mctx, set.names, &set.rwlock,
+				     &iter, &gen_name);
+	     result == ISC_R_SUCCESS;
+	     dns_name_reset(&gen_name),
+	     result = rbt_iter_next(&iter, &gen_name)) {
+		result = dns_rbt_addname(zevent->names, &gen_name,
+					 RESYNC_NAME_MARK);
+		if (result != ISC_R_SUCCESS && result != ISC_R_EXISTS)
+			goto cleanup;
+	}
+	if (result != ISC_R_NOTFOUND && result != ISC_R_NOMORE)
+		goto cleanup;
 
-	free_char_array(mctx, &change->mod_values);
-	if (change->mod_type != NULL)
-		SAFE_MEM_PUT(mctx, change->mod_type, LDAP_ATTR_FORMATSIZE);
-	SAFE_MEM_PUT_PTR(mctx, change);
+	/* names which are not in LDAP anymore */
+	CHECK(dns_db_createiterator(rbtdb, 0, &dbiter));
+	for (result = dns_dbiterator_first(dbiter);
+	     result == ISC_R_SUCCESS;
+	     result = dns_dbiterator_next(dbiter)) {
+		result = dns_dbiterator_current(dbiter, &node, name);
+		if (result != ISC_R_SUCCESS && result != DNS_R_NEWORIGIN)
+			goto cleanup;
+		data = NULL;
+		if (dns_name_equal(name, zname)
+		    || dns_rbt_findname(zevent->names, name, 0, NULL, &data)
+		       == ISC_R_SUCCESS) {
+			dns_db_detachnode(rbtdb, &node);
+			continue;
+		}
+		CHECK(dns_dbiterator_pause(dbiter));
+		result = dns_db_allrdatasets(rbtdb, node, zevent->snapshot, 0,
+					     &rbt_rds_iterator);
+		if (result == ISC_R_SUCCESS) {
+			result = dns_rdatasetiter_first(rbt_rds_iterator);
+			dns_rdatasetiter_destroy(&rbt_rds_iterator);
+		}
+		if (result == ISC_R_NOMORE || result == ISC_R_NOTFOUND) {
+			/* name was added after the first page */
+			dns_db_detachnode(rbtdb, &node);
+			continue;
+		} else if (result != ISC_R_SUCCESS) {
+			goto cleanup;
+		}
+		result = dns_db_allrdatasets(rbtdb, node, version, 0,
+					     &rbt_rds_iterator);
+		if (result == ISC_R_SUCCESS) {
+			CHECK(diff_ldap_rbtdb(inst->mctx, name, &rdatalist,
+					      rbt_rds_iterator, diff));
+			dns_rdatasetiter_destroy(&rbt_rds_iterator);
+		} else if (result != ISC_R_NOTFOUND) {
+			goto cleanup;
+		}
+		dns_db_detachnode(rbtdb, &node);
+	}
+	if (result != ISC_R_NOMORE)
+		goto cleanup;
 
-	*changep = NULL;
+	if (mldap != NULL) {
+		CHECK(mldap_zone_prune(mldap, zname, zevent->names,
+				       RESYNC_NAME_MARK, &pruned));
+		if (pruned > 0)
+			log_debug(1, "%u stale entries removed from metaDB",
+				  pruned);
+	}
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	if (rbt_rds_iterator != NULL)
+		dns_rdatasetiter_destroy(&rbt_rds_iterator);
+	if (node != NULL)
+		dns_db_detachnode(rbtdb, &node);
+	if (dbiter != NULL)
+		dns_dbiterator_destroy(&dbiter);
+	rbt_iter_stop(&iter);
+	range_set_destroy(&set);
+	str_destroy(&specs);
+	ldapdb_rdatalist_destroy(inst->mctx, &rdatalist);
+	return result;
 }
 
-isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_mod_create(isc_mem_t *mctx, LDAPMod **changep)
+/**
+ * Re-synchronize one zone with LDAP. Records of the zone are read by paged
+ * subtree search, one page per run of the event, and the event is sent
+ * to the zone task again until the last page is processed. Difference
+ * found in each page is applied as one transaction with a new SOA serial.
+ * Active zones which are not in the view yet are published afterwards.
+ *
+ * The event is processed by task of the zone so it is serialized with
+ * update_record() events for the same zone, which can run between pages.
+ * Re-synchronization is the only way to re-activate a zone, see
+ * ldap_parse_master_zoneentry().
+ */
+static void ATTR_NONNULLS
+zone_resync(isc_task_t *task, isc_event_t *event)
 {
-	LDAPMod *change = NULL;
+	ldap_zoneresyncev_t *zevent = (ldap_zoneresyncev_t *)event;
+	ldap_instance_t *inst = zevent->inst;
+	dns_name_t *zname = dns_fixedname_name(&zevent->name);
 	isc_result_t result;
+	const char *dn = NULL;
+	ldap_syncsess_t *sess;
+	mldapdb_t *mldap = NULL;
+	isc_boolean_t last;
+	dns_zone_t *raw = NULL;
+	dns_db_t *ldapdb = NULL;
+	dns_dbversion_t *version = NULL;
+	dns_diff_t diff;
+	isc_uint32_t serial;
+	sync_state_t sync_state;
+	settings_set_t *zone_settings = NULL;
+	isc_boolean_t active;
+	char zone_name[DNS_NAME_FORMATSIZE];
 
-	REQUIRE(changep != NULL && *changep == NULL);
+	dns_diff_init(inst->mctx, &diff);
+	dns_name_format(zname, zone_name, DNS_NAME_FORMATSIZE);
 
-	CHECKED_MEM_GET_PTR(mctx, change);
-	ZERO_PTR(change);
-	CHECKED_MEM_GET(mctx, change->mod_type, LDAP_ATTR_FORMATSIZE);
+	if (ldap_instance_isexiting(inst))
+		CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
 
-	*changep = change;
-	return ISC_R_SUCCESS;
+	CHECK(zr_get_zone_dn(inst->zone_register, zname, &dn));
+	if (zevent->conn == NULL)
+		CHECK(zone_resync_start(zevent));
+	if (zevent->page == NULL) {
+		CHECK(zone_resync_search(zevent, dn, &zevent->page));
+		zevent->page_cnt++;
+	}
+	last = ISC_TF(zevent->cookie.bv_len == 0);
+
+	/* SyncRepl thread holds its metaDB version only for a short time
+	 * but it can wait for events in the zone task, do not block it;
+	 * the version is also refused while dead nodes are swept */
+	sess = syncsess_for_dn(inst, dn);
+	if (sess != NULL) {
+		result = mldap_trynewversion(sess->mldapdb);
+		if (result == ISC_R_LOCKBUSY) {
+			isc_task_send(task, &event);
+			CLEANUP_WITH(ISC_R_SUCCESS);
+		}
+		CHECK(result);
+		mldap = sess->mldapdb;
+	}
 
-cleanup:
-	if (change != NULL)
-		SAFE_MEM_PUT_PTR(mctx, change);
+	CHECK(zr_get_zone_ptr(inst->zone_register, zname, &raw, NULL));
+	CHECK(zr_get_zone_dbs(inst->zone_register, zname, &ldapdb, NULL));
+	CHECK(dns_db_newversion(ldapdb, &version));
+	CHECK(zone_resync_page(zevent, dn, mldap, version, &diff));
+	ldap_msgfree(zevent->page);
+	zevent->page = NULL;
+	if (last == ISC_TRUE)
+		CHECK(zone_resync_last(zevent, mldap, version, &diff));
 
-	return result;
+	sync_state_get(sync_ctx_for_dn(inst, dn), &sync_state);
+	if (HEAD(diff.tuples) != NULL) {
+		if (sync_state == sync_finished) {
+			CHECK(zone_soaserial_addtuple(inst->mctx, ldapdb,
+						      version, &diff, &serial));
+			result = ldap_replace_serial(inst, zname, serial);
+			if (result != ISC_R_SUCCESS)
+				dns_zone_log(raw, ISC_LOG_ERROR,
+					     "serial (%u) write back to LDAP "
+					     "failed", serial);
+			CHECK(zone_journal_adddiff(inst->mctx, raw, &diff));
+		}
+		dns_diff_print(&diff, NULL);
+		CHECK(dns_diff_apply(&diff, zevent->rbtdb, version));
+		dns_db_closeversion(ldapdb, &version, ISC_TRUE);
+		dns_zone_markdirty(raw);
+		log_debug(1, "zone '%s': differences from page %u "
+			  "were applied", zone_name, zevent->page_cnt);
+	} else {
+		dns_db_closeversion(ldapdb, &version, ISC_FALSE);
+	}
+
+	if (last == ISC_FALSE) {
+		/* let other events of the zone run between pages */
+		isc_task_send(task, &event);
+		goto cleanup;
+	}
+	log_info("zone '%s': re-synchronized with LDAP, %u entries read",
+		 zone_name, zevent->entry_cnt);
+
+	/* Zone activated after initial synchronization has its records
+	 * complete now. Zones activated earlier are published by
+	 * activate_zones(). */
+	CHECK(zr_get_zone_settings(inst->zone_register, zname,
+				   &zone_settings));
+	CHECK(setting_get_bool(SETTING_ACTIVE, zone_settings, &active));
+	if (sync_state == sync_finished && active == ISC_TRUE)
+		CHECK(zone_ready_send(inst, zname));
+
+cleanup:
+	if (result != ISC_R_SUCCESS && result != ISC_R_SHUTTINGDOWN)
+		log_error_r("zone '%s': re-synchronization with LDAP failed, "
+			    "records can be outdated, run `rndc reload`",
+			    zone_name);
+	if (mldap != NULL)
+		mldap_closeversion(mldap, ISC_TF(result == ISC_R_SUCCESS));
+	dns_diff_clear(&diff);
+	/* rollback */
+	if (version != NULL)
+		dns_db_closeversion(ldapdb, &version, ISC_FALSE);
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	if (event != NULL)
+		zone_resync_event_free(&zevent);
 }
 
 /**
- * @param[in]  rdlist
- * @param[out] changep
- * @param[in]  mod_op  LDAP operation as integer used in LDAPMod.
- * @param[in]  generic Use generic (RFC 3597) syntax.
+ * Schedule re-synchronization of a zone which data might differ from LDAP,
+ * see zone_resync(). Repeated requests are merged until
+ * the re-synchronization starts.
  */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_rdatalist_to_ldapmod(isc_mem_t *mctx, dns_rdatalist_t *rdlist,
-			  LDAPMod **changep, int mod_op, isc_boolean_t unknown)
+isc_result_t
+ldap_zone_resync(ldap_instance_t *inst, dns_name_t *name)
 {
 	isc_result_t result;
-	LDAPMod *change = NULL;
-	char **vals = NULL;
+	isc_boolean_t pending = ISC_TRUE;
+	dns_zone_t *raw = NULL;
+	isc_task_t *task = NULL;
+	ldap_zoneresyncev_t *zevent = NULL;
+	char zone_name[DNS_NAME_FORMATSIZE];
 
-	CHECK(ldap_mod_create(mctx, &change));
-	CHECK(rdatatype_to_ldap_attribute(rdlist->type, change->mod_type,
-					  LDAP_ATTR_FORMATSIZE, unknown));
-	CHECK(ldap_rdata_to_char_array(mctx, HEAD(rdlist->rdata), unknown,
-				       &vals));
+	/* instance with data source does not talk to LDAP */
+	if (inst->data_source != NULL)
+		return ISC_R_NOTIMPLEMENTED;
 
-	change->mod_op = mod_op;
-	change->mod_values = vals;
+	CHECK(zr_set_zone_tainted(inst->zone_register, name, ISC_TRUE,
+				  &pending));
+	if (pending == ISC_TRUE)
+		return ISC_R_SUCCESS;
 
-	*changep = change;
-	return ISC_R_SUCCESS;
+	CHECK(zr_get_zone_ptr(inst->zone_register, name, &raw, NULL));
+	zevent = (ldap_zoneresyncev_t *)isc_event_allocate(inst->mctx,
+				inst, LDAPDB_EVENT_ZONE_RESYNC,
+				zone_resync, NULL,
+				sizeof(ldap_zoneresyncev_t));
+	if (zevent == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+	zevent->inst = inst;
+	dns_fixedname_init(&zevent->name);
+	zevent->conn = NULL;
+	zevent->cookie.bv_len = 0;
+	zevent->cookie.bv_val = NULL;
+	zevent->page = NULL;
+	zevent->names = NULL;
+	INIT_LIST(zevent->range_entries);
+	zevent->rbtdb = NULL;
+	zevent->snapshot = NULL;
+	zevent->entry_cnt = 0;
+	zevent->page_cnt = 0;
+	CHECK(dns_name_copy(name, dns_fixedname_name(&zevent->name), NULL));
+	dns_zone_gettask(raw, &task);
+	isc_task_send(task, (isc_event_t **)&zevent);
+	isc_task_detach(&task);
 
-cleanup:
-	ldap_mod_free(mctx, &change);
+	dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+	log_info("zone '%s': re-synchronization with LDAP scheduled",
+		 zone_name);
 
+cleanup:
+	if (zevent != NULL)
+		isc_event_free((isc_event_t **)&zevent);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	/* allow another attempt, zone might be deleted in the meantime */
+	if (result != ISC_R_SUCCESS && pending == ISC_FALSE
+	    && zr_set_zone_tainted(inst->zone_register, name, ISC_FALSE,
+				   NULL) != ISC_R_SUCCESS)
+		log_debug(1, "unable to clear re-synchronization mark");
 	return result;
 }
 
-/**
- * Convert list of DNS Rdata to array of LDAP values.
- *
- * @param[in]  unknown  ISC_TRUE  = use generic (RFC 3597) format,
- *                      ISC_FALSE = use record-specific syntax (if available).
- */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_rdata_to_char_array(isc_mem_t *mctx, dns_rdata_t *rdata_head,
-			 isc_boolean_t unknown, char ***valsp)
-{
-	isc_result_t result;
-	char **vals;
-	unsigned int i;
-	unsigned int rdata_count = 0;
-	size_t vals_size;
-	dns_rdata_t *rdata;
-
-	REQUIRE(rdata_head != NULL);
-	REQUIRE(valsp != NULL && *valsp == NULL);
+#define LDAPDB_EVENT_ZONE_IMPORT	(LDAPDB_EVENTCLASS + 14)
 
-	for (rdata = rdata_head; rdata != NULL; rdata = NEXT(rdata, link))
-		rdata_count++;
+/** Maximal number of LDAP operations sent during import without reply. */
+#define IMPORT_LDAP_WINDOW	64
+/** Maximal number of names sent to LDAP by one run of zone_import(). */
+#define IMPORT_NAMES_PER_RUN	IMPORT_LDAP_WINDOW
+/** Maximal time one run of zone_import() waits for replies (milliseconds). */
+#define IMPORT_WAIT_MSEC	100
+/** Name of file picked up from zone directory by zone_import_spool(). */
+#define IMPORT_SPOOL_FILE	"import.zone"
 
-	vals_size = (rdata_count + 1) * sizeof(char *);
+/* Node data for names which could not be written to LDAP. */
+#define IMPORT_NAME_FAILED ((void *)1)
 
-	CHECKED_MEM_ALLOCATE(mctx, vals, vals_size);
-	memset(vals, 0, vals_size);
+/**
+ * Asynchronous LDAP operation which writes all imported records
+ * with one owner name.
+ */
+typedef struct import_op {
+	int			msgid;	/**< -1 for unused slot */
+	isc_boolean_t		adding;	/**< entry did not exist */
+	isc_boolean_t		swap_unknown; /**< schema violation seen */
+	dns_fixedname_t		name;
+	ld_string_t		*dn;
+	LDAPMod			**mods;
+	unsigned int		nmods;
+	unsigned int		mods_size;
+	LDAPMod			obj_class;
+	char			*obj_class_vals[2];
+} import_op_t;
 
-	rdata = rdata_head;
-	for (i = 0; i < rdata_count && rdata != NULL; i++) {
-		DECLARE_BUFFER(buffer, /* RFC 3597 format is hex string */
-			       DNS_RDATA_MAXLENGTH * 2 + sizeof("\\# 65535 "));
-		isc_region_t region;
+/**
+ * Import is done in multiple runs of zone_import(), all state is kept
+ * in the event which is sent again to the zone task after each run.
+ */
+typedef struct ldap_zoneimportev ldap_zoneimportev_t;
+struct ldap_zoneimportev {
+	ISC_EVENT_COMMON(ldap_zoneimportev_t);
+	ldap_instance_t		*inst;
+	dns_fixedname_t		name;
+	char			*filename;
+	isc_boolean_t		remove;
+	ldap_connection_t	*conn;
+	dns_db_t		*impdb;	/**< records loaded from the file */
+	dns_dbiterator_t	*dbiter; /**< NULL after the last name */
+	dns_rbt_t		*failed;
+	import_op_t		*ops;	/**< IMPORT_LDAP_WINDOW slots */
+	unsigned int		in_flight;
+	isc_time_t		last_reply;
+	unsigned int		name_cnt;
+	unsigned int		fail_cnt;
+};
 
-		/* Convert rdata to text. */
-		INIT_BUFFER(buffer);
-		if (unknown == ISC_FALSE)
-			CHECK(dns_rdata_totext(rdata, NULL, &buffer));
-		else
-			CHECK(rdata_to_generic(rdata, &buffer));
-		isc_buffer_usedregion(&buffer, &region);
+/**
+ * Records which are maintained by update_zone() or by BIND itself
+ * are not imported.
+ */
+static isc_boolean_t
+import_skiptype(dns_rdatatype_t type) {
+	return ISC_TF(type == dns_rdatatype_soa || dns_rdatatype_isdnssec(type));
+}
 
-		/* Now allocate the string with the right size. */
-		CHECKED_MEM_ALLOCATE(mctx, vals[i], region.length + 1);
-		memcpy(vals[i], region.base, region.length);
-		vals[i][region.length] = '\0';
-		
-		rdata = NEXT(rdata, link);
-	}
+/**
+ * Load records from master file into a temporary database.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+import_load(isc_mem_t *mctx, dns_name_t *zname, const char *filename,
+	    dns_db_t **dbp) {
+	isc_result_t result;
+	isc_result_t endresult;
+	dns_rdatacallbacks_t callbacks;
+	dns_db_t *db = NULL;
+
+	REQUIRE(*dbp == NULL);
+
+	CHECK(dns_db_create(mctx, "rbt", zname, dns_dbtype_zone,
+			    LDAP_DB_RDATACLASS, 0, NULL, &db));
+	dns_rdatacallbacks_init(&callbacks);
+	CHECK(dns_db_beginload(db, &callbacks));
+	result = dns_master_loadfile(filename, zname, zname,
+				     LDAP_DB_RDATACLASS, 0, &callbacks, mctx);
+	if (result == DNS_R_SEENINCLUDE)
+		result = ISC_R_SUCCESS;
+	endresult = dns_db_endload(db, &callbacks);
+	if (result == ISC_R_SUCCESS)
+		result = endresult;
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
 
-	*valsp = vals;
-	return ISC_R_SUCCESS;
+	*dbp = db;
+	db = NULL;
 
 cleanup:
-	free_char_array(mctx, &vals);
+	if (db != NULL)
+		dns_db_detach(&db);
 	return result;
 }
 
 static void ATTR_NONNULLS
-free_char_array(isc_mem_t *mctx, char ***valsp)
-{
-	char **vals;
-	unsigned int i;
-
-	REQUIRE(valsp != NULL);
+import_op_free(isc_mem_t *mctx, import_op_t *op) {
+	if (op->mods != NULL) {
+		for (unsigned int i = 0; i < op->nmods; i++)
+			ldap_mod_free(mctx, &op->mods[i]);
+		isc_mem_put(mctx, op->mods,
+			    op->mods_size * sizeof(*op->mods));
+		op->mods = NULL;
+	}
+	op->nmods = 0;
+	str_destroy(&op->dn);
+	op->msgid = -1;
+}
 
-	vals = *valsp;
-	if (vals == NULL)
-		return;
+/**
+ * Convert rdataset to LDAP modification which replaces all values
+ * of respective attribute.
+ *
+ * @param[in] swap_unknown Use the attribute which rr_schema_use_unknown()
+ *                         does not recommend.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+import_rdataset_to_ldapmod(ldap_instance_t *inst, dns_rdataset_t *rdataset,
+			   isc_boolean_t swap_unknown, LDAPMod **changep) {
+	isc_result_t result;
+	dns_rdatalist_t rdlist;
+	dns_rdata_t *rdatas = NULL;
+	unsigned int count = dns_rdataset_count(rdataset);
+	isc_boolean_t unknown;
+	unsigned int i;
 
-	for (i = 0; vals[i] != NULL; i++)
-		isc_mem_free(mctx, vals[i]);
+	dns_rdatalist_init(&rdlist);
+	rdlist.rdclass = rdataset->rdclass;
+	rdlist.type = rdataset->type;
+	rdlist.ttl = rdataset->ttl;
+
+	CHECKED_MEM_GET(inst->mctx, rdatas, count * sizeof(*rdatas));
+	for (i = 0, result = dns_rdataset_first(rdataset);
+	     result == ISC_R_SUCCESS && i < count;
+	     i++, result = dns_rdataset_next(rdataset)) {
+		dns_rdata_init(&rdatas[i]);
+		dns_rdataset_current(rdataset, &rdatas[i]);
+		APPEND(rdlist.rdata, &rdatas[i], link);
+	}
+	unknown = rr_schema_use_unknown(inst->rr_schema, rdlist.type);
+	if (swap_unknown == ISC_TRUE)
+		unknown = !unknown;
+	CHECK(ldap_rdatalist_to_ldapmod(inst->mctx, &rdlist, changep,
+					LDAP_MOD_REPLACE, unknown));
 
-	isc_mem_free(mctx, vals);
-	*valsp = NULL;
+cleanup:
+	if (rdatas != NULL)
+		isc_mem_put(inst->mctx, rdatas, count * sizeof(*rdatas));
+	return result;
 }
 
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_rdttl_to_ldapmod(isc_mem_t *mctx, dns_rdatalist_t *rdlist,
-		      LDAPMod **changep)
-{
-	LDAPMod *change = NULL;
-	ld_string_t *ttlval = NULL;
-	char **vals = NULL;
+/**
+ * Prepare LDAP modifications for all importable records at one node.
+ *
+ * @retval ISC_R_IGNORE Node does not contain any importable records.
+ * @retval DNS_R_BADTTL Records at the node have different TTLs
+ *                      which cannot be stored in a single LDAP entry.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+import_op_prepare(ldap_instance_t *inst, dns_name_t *zname, dns_db_t *db,
+		  dns_dbnode_t *node, dns_name_t *name,
+		  isc_boolean_t swap_unknown, import_op_t *op) {
 	isc_result_t result;
+	dns_rdatasetiter_t *rdsiter = NULL;
+	dns_rdataset_t rdataset;
+	dns_rdatalist_t ttl_rdlist;
+	unsigned int count = 0;
+	char name_str[DNS_NAME_FORMATSIZE];
 
-	REQUIRE(changep != NULL && *changep == NULL);
+	REQUIRE(op->msgid == -1 && op->mods == NULL);
 
-	CHECK(str_new(mctx, &ttlval));
-	CHECK(str_sprintf(ttlval, "%d", rdlist->ttl));
+	dns_rdataset_init(&rdataset);
+	dns_rdatalist_init(&ttl_rdlist);
 
-	CHECK(ldap_mod_create(mctx, &change));
-	change->mod_op = LDAP_MOD_REPLACE;
-	CHECK(isc_string_copy(change->mod_type, LDAP_ATTR_FORMATSIZE, "dnsTTL"));
+	CHECK(dns_db_allrdatasets(db, node, NULL, 0, &rdsiter));
+	for (result = dns_rdatasetiter_first(rdsiter);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdatasetiter_next(rdsiter))
+		count++;
+	if (result != ISC_R_NOMORE)
+		goto cleanup;
 
-	CHECKED_MEM_ALLOCATE(mctx, vals, 2 * sizeof(char *));
-	memset(vals, 0, 2 * sizeof(char *));
-	change->mod_values = vals;
+	/* record types + TTL + objectClass + NULL */
+	op->mods_size = count + 3;
+	CHECKED_MEM_GET(inst->mctx, op->mods,
+			op->mods_size * sizeof(*op->mods));
+	memset(op->mods, 0, op->mods_size * sizeof(*op->mods));
 
-	CHECKED_MEM_ALLOCATE(mctx, vals[0], str_len(ttlval) + 1);
-	memcpy(vals[0], str_buf(ttlval), str_len(ttlval) + 1);
+	for (result = dns_rdatasetiter_first(rdsiter);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdatasetiter_next(rdsiter)) {
+		dns_rdatasetiter_current(rdsiter, &rdataset);
+		if (import_skiptype(rdataset.type) == ISC_FALSE) {
+			/* LDAP entry has a single TTL */
+			if (op->nmods > 0 && ttl_rdlist.ttl != rdataset.ttl) {
+				dns_name_format(name, name_str,
+						DNS_NAME_FORMATSIZE);
+				log_error("zone import: records with owner "
+					  "'%s' have different TTLs (%u, %u), "
+					  "only one TTL per name is supported",
+					  name_str, ttl_rdlist.ttl,
+					  rdataset.ttl);
+				CLEANUP_WITH(DNS_R_BADTTL);
+			}
+			ttl_rdlist.ttl = rdataset.ttl;
+			CHECK(import_rdataset_to_ldapmod(inst, &rdataset,
+							 swap_unknown,
+							 &op->mods[op->nmods]));
+			op->nmods++;
+		}
+		dns_rdataset_disassociate(&rdataset);
+	}
+	if (result != ISC_R_NOMORE)
+		goto cleanup;
+	if (op->nmods == 0)
+		CLEANUP_WITH(ISC_R_IGNORE);
 
-	*changep = change;
+	CHECK(ldap_rdttl_to_ldapmod(inst->mctx, &ttl_rdlist,
+				    &op->mods[op->nmods]));
+	op->nmods++;
 
-cleanup:
-	if (ttlval) str_destroy(&ttlval);
-	if (change && result != ISC_R_SUCCESS) ldap_mod_free(mctx, &change);
+	dns_fixedname_init(&op->name);
+	CHECK(dns_name_copy(name, dns_fixedname_name(&op->name), NULL));
+	CHECK(str_new(inst->mctx, &op->dn));
+	CHECK(dnsname_to_dn(inst->zone_register, name, zname, op->dn));
+	op->adding = ISC_FALSE;
+	op->swap_unknown = swap_unknown;
 
+cleanup:
+	if (dns_rdataset_isassociated(&rdataset))
+		dns_rdataset_disassociate(&rdataset);
+	if (rdsiter != NULL)
+		dns_rdatasetiter_destroy(&rdsiter);
+	if (result != ISC_R_SUCCESS)
+		import_op_free(inst->mctx, op);
 	return result;
 }
 
-/*
- * Modify the SOA record of a zone, where DN of the zone is 'zone_dn'.
- * The SOA record is a special case because we need to update serial,
- * refresh, retry, expire and minimum attributes for each SOA record.
+/**
+ * Send modify operation for the node. Add operation with objectClass
+ * is sent instead if the entry does not exist yet.
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-modify_soa_record(ldap_instance_t *ldap_inst, const char *zone_dn,
-		  dns_rdata_t *rdata)
-{
-	isc_result_t result;
-	dns_rdata_soa_t soa;
-	LDAPMod change[5];
-	LDAPMod *changep[6] = {
-		&change[0], &change[1], &change[2], &change[3], &change[4],
-		NULL
-	};
+import_op_send(LDAP *ld, import_op_t *op) {
+	int ret;
 
-	REQUIRE(ldap_inst != NULL);
+	if (op->adding == ISC_TRUE) {
+		/* mod_op is ignored by add operation except BVALUES flag */
+		for (unsigned int i = 0; i < op->nmods; i++)
+			op->mods[i]->mod_op &= LDAP_MOD_BVALUES;
+		op->obj_class_vals[0] = "idnsRecord";
+		op->obj_class_vals[1] = NULL;
+		op->obj_class.mod_op = 0;
+		op->obj_class.mod_type = "objectClass";
+		op->obj_class.mod_values = op->obj_class_vals;
+		op->mods[op->nmods] = &op->obj_class;
+		op->mods[op->nmods + 1] = NULL;
+		ret = ldap_add_ext(ld, str_buf(op->dn), op->mods, NULL, NULL,
+				   &op->msgid);
+	} else {
+		op->mods[op->nmods] = NULL;
+		ret = ldap_modify_ext(ld, str_buf(op->dn), op->mods, NULL,
+				      NULL, &op->msgid);
+	}
+	if (ret != LDAP_SUCCESS) {
+		op->msgid = -1;
+		log_ldap_error(ld, "while writing entry '%s'", str_buf(op->dn));
+		return ISC_R_FAILURE;
+	}
+	return ISC_R_SUCCESS;
+}
 
-/* all values in SOA record are isc_uint32_t, i.e. max. 2^32-1 */
-#define MAX_SOANUM_LENGTH (10 + 1)
-#define SET_LDAP_MOD(index, name) \
-	change[index].mod_op = LDAP_MOD_REPLACE; \
-	change[index].mod_type = "idnsSOA" #name; \
-	change[index].mod_values = alloca(2 * sizeof(char *)); \
-	change[index].mod_values[0] = alloca(MAX_SOANUM_LENGTH); \
-	change[index].mod_values[1] = NULL; \
-	CHECK(isc_string_printf(change[index].mod_values[0], \
-		MAX_SOANUM_LENGTH, "%u", soa.name));
+/**
+ * Remember name which could not be written to LDAP, its records
+ * are not added to the zone database.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+import_name_failed(ldap_zoneimportev_t *zevent, dns_name_t *name) {
+	isc_result_t result;
 
-	dns_rdata_tostruct(rdata, (void *)&soa, ldap_inst->mctx);
+	result = dns_rbt_addname(zevent->failed, name, IMPORT_NAME_FAILED);
+	if (result == ISC_R_EXISTS)
+		return ISC_R_SUCCESS;
+	if (result == ISC_R_SUCCESS)
+		zevent->fail_cnt++;
+	return result;
+}
 
-	SET_LDAP_MOD(0, serial);
-	SET_LDAP_MOD(1, refresh);
-	SET_LDAP_MOD(2, retry);
-	SET_LDAP_MOD(3, expire);
-	SET_LDAP_MOD(4, minimum);
+/**
+ * Send the operation again with records stored in the other attribute,
+ * i.e. "UnknownRecord;TYPE256" instead of "URIRecord" and vice versa.
+ * Schema on the server might have changed since it was read last time.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+import_op_swap_unknown(ldap_zoneimportev_t *zevent, import_op_t *op) {
+	isc_result_t result;
+	ldap_instance_t *inst = zevent->inst;
+	dns_dbnode_t *node = NULL;
+	dns_fixedname_t fname;
+	dns_name_t *name;
+	isc_boolean_t adding = op->adding;
 
-	dns_rdata_freestruct((void *)&soa);
+	dns_fixedname_init(&fname);
+	name = dns_fixedname_name(&fname);
+	CHECK(dns_name_copy(dns_fixedname_name(&op->name), name, NULL));
+	CHECK(dns_db_findnode(zevent->impdb, name, ISC_FALSE, &node));
 
-	result = ldap_modify_do(ldap_inst, zone_dn, changep, ISC_FALSE);
+	import_op_free(inst->mctx, op);
+	CHECK(import_op_prepare(inst, dns_fixedname_name(&zevent->name),
+				zevent->impdb, node, name, ISC_TRUE, op));
+	op->adding = adding;
+	CHECK(import_op_send(zevent->conn->handle, op));
 
 cleanup:
+	if (node != NULL)
+		dns_db_detachnode(zevent->impdb, &node);
 	return result;
-
-#undef MAX_SOANUM_LENGTH
-#undef SET_LDAP_MOD
 }
 
+/**
+ * Process reply to one of operations in flight. Operation is sent again
+ * as add if the entry does not exist and once more with the other
+ * attribute for records if the server refused the attribute.
+ */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-modify_ldap_common(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst,
-		   dns_rdatalist_t *rdlist, int mod_op, isc_boolean_t delete_node)
-{
+import_op_reply(ldap_zoneimportev_t *zevent, LDAPMessage *res) {
 	isc_result_t result;
-	isc_mem_t *mctx = ldap_inst->mctx;
-	ld_string_t *owner_dn = NULL;
-	LDAPMod *change[3] = { NULL };
-	isc_boolean_t zone_sync_ptr;
-	char **vals = NULL;
-	dns_name_t zone_name;
-	char *zone_dn = NULL;
-	settings_set_t *zone_settings = NULL;
-	int af; /* address family */
-	isc_boolean_t unknown_type = ISC_FALSE;
-
-	/*
-	 * Find parent zone entry and check if Dynamic Update is allowed.
-	 * @todo Try the cache first and improve split: SOA records are problematic.
-	 */
-	dns_name_init(&zone_name, NULL);
-	CHECK(str_new(mctx, &owner_dn));
-
-	CHECK(dnsname_to_dn(ldap_inst->zone_register, owner, zone, owner_dn));
-	zone_dn = strstr(str_buf(owner_dn),", ");
+	LDAP *ld = zevent->conn->handle;
+	import_op_t *op = NULL;
+	int msgid;
+	int err;
+	int ret;
 
-	if (zone_dn == NULL) { /* SOA record; owner = zone => owner_dn = zone_dn */
-		zone_dn = (char *)str_buf(owner_dn);
-	} else {
-		zone_dn += 1; /* skip whitespace */
+	msgid = ldap_msgid(res);
+	for (unsigned int i = 0; i < IMPORT_LDAP_WINDOW; i++) {
+		if (zevent->ops[i].msgid == msgid) {
+			op = &zevent->ops[i];
+			break;
+		}
 	}
-
-	CHECK(dn_to_dnsname(mctx, zone_dn, &zone_name, NULL, NULL));
-	INSIST(dns_name_equal(zone, &zone_name) == ISC_TRUE);
-
-	result = zr_get_zone_settings(ldap_inst->zone_register, &zone_name,
-				      &zone_settings);
-	if (result != ISC_R_SUCCESS) {
-		if (result == ISC_R_NOTFOUND)
-			log_debug(3, "update refused: "
-				  "active zone '%s' not found", zone_dn);
-		CLEANUP_WITH(DNS_R_NOTAUTH);
+	if (op == NULL) { /* not our reply */
+		ldap_msgfree(res);
+		return ISC_R_SUCCESS;
 	}
 
-	if (rdlist->type == dns_rdatatype_soa && mod_op == LDAP_MOD_DELETE)
-		CLEANUP_WITH(ISC_R_SUCCESS);
-
-	if (rdlist->type == dns_rdatatype_soa) {
-		result = modify_soa_record(ldap_inst, str_buf(owner_dn),
-					   HEAD(rdlist->rdata));
-		goto cleanup;
+	ret = ldap_parse_result(ld, res, &err, NULL, NULL, NULL, NULL, 1);
+	if (ret != LDAP_SUCCESS) {
+		log_ldap_error(ld, "zone import: invalid reply");
+		return ISC_R_FAILURE;
 	}
 
-	if (mod_op == LDAP_MOD_ADD) {
-		/* for now always replace the ttl on add */
-		CHECK(ldap_rdttl_to_ldapmod(mctx, rdlist, &change[1]));
+	if (err == LDAP_NO_SUCH_OBJECT && op->adding == ISC_FALSE) {
+		op->adding = ISC_TRUE;
+		return import_op_send(ld, op);
+	} else if ((err == LDAP_OBJECT_CLASS_VIOLATION
+		    || err == LDAP_UNDEFINED_TYPE
+		    || err == LDAP_INSUFFICIENT_ACCESS) /* this is for 389 DS */
+		   && op->swap_unknown == ISC_FALSE) {
+		log_debug(1, "zone import: entry '%s' refused (%s), retrying "
+			  "with other attributes", str_buf(op->dn),
+			  ldap_err2string(err));
+		return import_op_swap_unknown(zevent, op);
+	} else if (err != LDAP_SUCCESS) {
+		log_error("zone import: writing entry '%s' failed: %s",
+			  str_buf(op->dn), ldap_err2string(err));
+		CHECK(import_name_failed(zevent, dns_fixedname_name(&op->name)));
 	}
+	import_op_free(zevent->inst->mctx, op);
+	zevent->in_flight--;
+	result = ISC_R_SUCCESS;
 
-	/* First, try to store data into named attribute like "URIRecord".
-	 * If that fails, try to store the data into "UnknownRecord;TYPE256". */
-	unknown_type = ISC_FALSE;
-	do {
-		ldap_mod_free(mctx, &change[0]);
-		CHECK(ldap_rdatalist_to_ldapmod(mctx, rdlist, &change[0],
-						mod_op, unknown_type));
-		result = ldap_modify_do(ldap_inst, str_buf(owner_dn), change,
-					delete_node);
-		unknown_type = !unknown_type; /* try again with unknown type */
-	} while (result == DNS_R_UNKNOWN && unknown_type == ISC_TRUE);
+cleanup:
+	return result;
+}
 
-	/* Keep the PTR of corresponding A/AAAA record synchronized. */
-	if (rdlist->type == dns_rdatatype_a || rdlist->type == dns_rdatatype_aaaa) {
-		/*
-		 * Look for zone "idnsAllowSyncPTR" attribute. If attribute do not exist,
-		 * use global plugin configuration: option "sync_ptr"
-		 */
+/**
+ * Process all replies which arrived so far.
+ *
+ * @param[in]  wait     Wait up to IMPORT_WAIT_MSEC for the first reply.
+ * @param[out] replyp   Number of processed replies.
+ *
+ * @retval ISC_R_TIMEDOUT No reply arrived for the LDAP timeout.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+import_poll(ldap_zoneimportev_t *zevent, isc_boolean_t wait,
+	    unsigned int *replyp) {
+	isc_result_t result;
+	LDAP *ld = zevent->conn->handle;
+	LDAPMessage *res = NULL;
+	struct timeval timeout;
+	isc_uint32_t timeout_sec;
+	isc_time_t now;
+	int ret;
 
-		CHECK(setting_get_bool("sync_ptr", zone_settings, &zone_sync_ptr));
-		if (!zone_sync_ptr) {
-			log_debug(3, "sync PTR is disabled for zone '%s'", zone_dn);
-			CLEANUP_WITH(ISC_R_SUCCESS);
+	*replyp = 0;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = (wait == ISC_TRUE) ? IMPORT_WAIT_MSEC * 1000 : 0;
+	while (zevent->in_flight > 0) {
+		ret = ldap_result(ld, LDAP_RES_ANY, LDAP_MSG_ALL, &timeout,
+				  &res);
+		if (ret == 0) {
+			break;
+		} else if (ret < 0) {
+			log_ldap_error(ld, "zone import: waiting for reply "
+				       "failed");
+			CLEANUP_WITH(ISC_R_FAILURE);
 		}
-		log_debug(3, "sync PTR is enabled for zone '%s'", zone_dn);
+		result = import_op_reply(zevent, res);
+		res = NULL;
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+		(*replyp)++;
+		timeout.tv_usec = 0;
+	}
 
-		af = (rdlist->type == dns_rdatatype_a) ? AF_INET : AF_INET6;
-		/* Following call will not work if A/AAAA records are unknown. */
-		result = sync_ptr_init(mctx, ldap_inst->view->zonetable,
-				       ldap_inst->zone_register, owner, af,
-				       change[0]->mod_values[0], rdlist->ttl,
-				       mod_op);
-		/* Silently ignore cases where the reverse zone does not exist,
-		 * does not accept dynamic updates, or is not managed by this
-		 * driver instance. */
-		if (result == ISC_R_NOTFOUND ||
-		    result == ISC_R_NOPERM ||
-		    result == DNS_R_NOTAUTHORITATIVE)
-			result = ISC_R_SUCCESS;
+	CHECK(isc_time_now(&now));
+	if (*replyp > 0 || zevent->in_flight == 0) {
+		zevent->last_reply = now;
+	} else {
+		CHECK(setting_get_uint(SETTING_TIMEOUT,
+				       zevent->inst->server_ldap_settings,
+				       &timeout_sec));
+		if (isc_time_microdiff(&now, &zevent->last_reply)
+		    >= (isc_uint64_t)timeout_sec * 1000000) {
+			log_error("zone import: LDAP server did not reply "
+				  "in time");
+			CLEANUP_WITH(ISC_R_TIMEDOUT);
+		}
 	}
+	result = ISC_R_SUCCESS;
 
 cleanup:
-	str_destroy(&owner_dn);
-	ldap_mod_free(mctx, &change[0]);
-	ldap_mod_free(mctx, &change[1]);
-	free_char_array(mctx, &vals);
-	dns_name_free(&zone_name, mctx);
-
 	return result;
 }
 
-isc_result_t
-write_to_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst, dns_rdatalist_t *rdlist)
-{
-	return modify_ldap_common(owner, zone, ldap_inst, rdlist, LDAP_MOD_ADD, ISC_FALSE);
-}
+/**
+ * Send operations for next names from the file to free slots,
+ * at most IMPORT_NAMES_PER_RUN names. Iterator is destroyed after
+ * the last name.
+ *
+ * @param[out] sentp Number of sent operations.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+import_fill(ldap_zoneimportev_t *zevent, unsigned int *sentp) {
+	isc_result_t result = ISC_R_SUCCESS;
+	ldap_instance_t *inst = zevent->inst;
+	dns_dbnode_t *node = NULL;
+	dns_fixedname_t fname;
+	dns_name_t *name;
+	import_op_t *op = NULL;
+	unsigned int slot = 0;
+
+	dns_fixedname_init(&fname);
+	name = dns_fixedname_name(&fname);
+	*sentp = 0;
+
+	while (zevent->dbiter != NULL && *sentp < IMPORT_NAMES_PER_RUN) {
+		for (op = NULL; slot < IMPORT_LDAP_WINDOW; slot++) {
+			if (zevent->ops[slot].msgid == -1) {
+				op = &zevent->ops[slot];
+				break;
+			}
+		}
+		if (op == NULL) /* window is full */
+			break;
 
-isc_result_t
-remove_values_from_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst,
-		 dns_rdatalist_t *rdlist, isc_boolean_t delete_node)
-{
-	return modify_ldap_common(owner, zone, ldap_inst, rdlist, LDAP_MOD_DELETE,
-				  delete_node);
+		result = dns_dbiterator_current(zevent->dbiter, &node, name);
+		if (result != ISC_R_SUCCESS && result != DNS_R_NEWORIGIN)
+			goto cleanup;
+		CHECK(dns_dbiterator_pause(zevent->dbiter));
+		result = import_op_prepare(inst,
+					   dns_fixedname_name(&zevent->name),
+					   zevent->impdb, node, name,
+					   ISC_FALSE, op);
+		dns_db_detachnode(zevent->impdb, &node);
+		if (result == DNS_R_BADTTL) {
+			zevent->name_cnt++;
+			CHECK(import_name_failed(zevent, name));
+		} else if (result == ISC_R_SUCCESS) {
+			CHECK(import_op_send(zevent->conn->handle, op));
+			zevent->in_flight++;
+			zevent->name_cnt++;
+			(*sentp)++;
+		} else if (result != ISC_R_IGNORE) {
+			goto cleanup;
+		}
+
+		result = dns_dbiterator_next(zevent->dbiter);
+		if (result == ISC_R_NOMORE)
+			dns_dbiterator_destroy(&zevent->dbiter);
+		else if (result != ISC_R_SUCCESS)
+			goto cleanup;
+	}
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	if (node != NULL)
+		dns_db_detachnode(zevent->impdb, &node);
+	return result;
 }
 
 /**
- * Delete named attribute 'URIRecord'
- * and equivalent attribute 'UnknownRecord;TYPE256' too.
+ * Compute difference between zone database and imported records.
+ * Imported RR sets replace RR sets of the same type, names which
+ * could not be written to LDAP are skipped.
  */
-isc_result_t
-remove_rdtype_from_ldap(dns_name_t *owner, dns_name_t *zone,
-		      ldap_instance_t *ldap_inst, dns_rdatatype_t type) {
-	char attr[LDAP_ATTR_FORMATSIZE];
-	LDAPMod *change[2] = { NULL };
-	ld_string_t *dn = NULL;
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+import_diff(isc_mem_t *mctx, dns_db_t *db, dns_rbt_t *failed,
+	    dns_db_t *rbtdb, dns_dbversion_t *version, dns_diff_t *diff) {
 	isc_result_t result;
-	isc_boolean_t unknown_type = ISC_FALSE;
-
-	CHECK(str_new(ldap_inst->mctx, &dn));
-	CHECK(dnsname_to_dn(ldap_inst->zone_register, owner, zone, dn));
+	dns_dbiterator_t *dbiter = NULL;
+	dns_dbnode_t *node = NULL;
+	dns_dbnode_t *rbtnode = NULL;
+	dns_rdatasetiter_t *rdsiter = NULL;
+	dns_rdataset_t rdataset;
+	dns_rdataset_t old_rdataset;
+	dns_fixedname_t fname;
+	dns_name_t *name;
+	void *data;
+
+	dns_fixedname_init(&fname);
+	name = dns_fixedname_name(&fname);
+	dns_rdataset_init(&rdataset);
+	dns_rdataset_init(&old_rdataset);
+
+	CHECK(dns_db_createiterator(db, 0, &dbiter));
+	for (result = dns_dbiterator_first(dbiter);
+	     result == ISC_R_SUCCESS;
+	     result = dns_dbiterator_next(dbiter)) {
+		result = dns_dbiterator_current(dbiter, &node, name);
+		if (result != ISC_R_SUCCESS && result != DNS_R_NEWORIGIN)
+			goto cleanup;
+		CHECK(dns_dbiterator_pause(dbiter));
+		data = NULL;
+		if (dns_rbt_findname(failed, name, 0, NULL, &data)
+		    == ISC_R_SUCCESS) {
+			dns_db_detachnode(db, &node);
+			continue;
+		}
 
-	do {
-		CHECK(ldap_mod_create(ldap_inst->mctx, &change[0]));
-		change[0]->mod_op = LDAP_MOD_DELETE;
-		/* delete all values from given attribute */
-		change[0]->mod_vals.modv_strvals = NULL;
-		CHECK(rdatatype_to_ldap_attribute(type, attr, sizeof(attr),
-						  unknown_type));
-		CHECK(isc_string_copy(change[0]->mod_type, LDAP_ATTR_FORMATSIZE,
-				      attr));
-		CHECK(ldap_modify_do(ldap_inst, str_buf(dn), change, ISC_FALSE));
-		ldap_mod_free(ldap_inst->mctx, &change[0]);
-		unknown_type = !unknown_type;
-	} while (unknown_type == ISC_TRUE);
+		CHECK(dns_db_findnode(rbtdb, name, ISC_TRUE, &rbtnode));
+		CHECK(dns_db_allrdatasets(db, node, NULL, 0, &rdsiter));
+		for (result = dns_rdatasetiter_first(rdsiter);
+		     result == ISC_R_SUCCESS;
+		     result = dns_rdatasetiter_next(rdsiter)) {
+			dns_rdatasetiter_current(rdsiter, &rdataset);
+			if (import_skiptype(rdataset.type) == ISC_TRUE) {
+				dns_rdataset_disassociate(&rdataset);
+				continue;
+			}
+			result = dns_db_findrdataset(rbtdb, rbtnode, version,
+						     rdataset.type, 0, 0,
+						     &old_rdataset, NULL);
+			if (result == ISC_R_SUCCESS) {
+				CHECK(rdataset_to_diff(mctx, DNS_DIFFOP_DEL,
+						       name, &old_rdataset,
+						       diff));
+				dns_rdataset_disassociate(&old_rdataset);
+			} else if (result != ISC_R_NOTFOUND) {
+				goto cleanup;
+			}
+			/* unchanged records cancel out in minimal diff */
+			CHECK(rdataset_to_diff(mctx, DNS_DIFFOP_ADD, name,
+					       &rdataset, diff));
+			dns_rdataset_disassociate(&rdataset);
+		}
+		if (result != ISC_R_NOMORE)
+			goto cleanup;
+		dns_rdatasetiter_destroy(&rdsiter);
+		dns_db_detachnode(rbtdb, &rbtnode);
+		dns_db_detachnode(db, &node);
+	}
+	if (result == ISC_R_NOMORE)
+		result = ISC_R_SUCCESS;
 
 cleanup:
-	ldap_mod_free(ldap_inst->mctx, &change[0]);
-	str_destroy(&dn);
+	if (dns_rdataset_isassociated(&rdataset))
+		dns_rdataset_disassociate(&rdataset);
+	if (dns_rdataset_isassociated(&old_rdataset))
+		dns_rdataset_disassociate(&old_rdataset);
+	if (rdsiter != NULL)
+		dns_rdatasetiter_destroy(&rdsiter);
+	if (rbtnode != NULL)
+		dns_db_detachnode(rbtdb, &rbtnode);
+	if (node != NULL)
+		dns_db_detachnode(db, &node);
+	if (dbiter != NULL)
+		dns_dbiterator_destroy(&dbiter);
 	return result;
 }
 
+static void ATTR_NONNULLS
+import_event_free(ldap_zoneimportev_t **zeventp)
+{
+	ldap_zoneimportev_t *zevent = *zeventp;
+	isc_mem_t *mctx = zevent->inst->mctx;
+
+	if (zevent->ops != NULL) {
+		for (unsigned int i = 0; i < IMPORT_LDAP_WINDOW; i++) {
+			if (zevent->ops[i].msgid != -1)
+				ldap_abandon_ext(zevent->conn->handle,
+						 zevent->ops[i].msgid,
+						 NULL, NULL);
+			import_op_free(mctx, &zevent->ops[i]);
+		}
+		isc_mem_put(mctx, zevent->ops,
+			    IMPORT_LDAP_WINDOW * sizeof(*zevent->ops));
+	}
+	destroy_ldap_connection(&zevent->conn);
+	if (zevent->dbiter != NULL)
+		dns_dbiterator_destroy(&zevent->dbiter);
+	if (zevent->failed != NULL)
+		dns_rbt_destroy(&zevent->failed);
+	if (zevent->impdb != NULL)
+		dns_db_detach(&zevent->impdb);
+	if (zevent->filename != NULL)
+		isc_mem_free(mctx, zevent->filename);
+	isc_event_free((isc_event_t **)zeventp);
+}
 
-isc_result_t
-remove_entry_from_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst) {
-	ldap_connection_t *ldap_conn = NULL;
-	ld_string_t *dn = NULL;
-	int ret;
+/**
+ * Load the file and prepare state for the first run. Import uses its own
+ * connection because replies are read by multiple runs of zone_import().
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+import_start(ldap_zoneimportev_t *zevent)
+{
 	isc_result_t result;
+	ldap_instance_t *inst = zevent->inst;
+	dns_name_t *zname = dns_fixedname_name(&zevent->name);
+	char zone_name[DNS_NAME_FORMATSIZE];
 
-	CHECK(str_new(ldap_inst->mctx, &dn));
-	CHECK(dnsname_to_dn(ldap_inst->zone_register, owner, zone, dn));
-	log_debug(2, "deleting whole node: '%s'", str_buf(dn));
-
-	CHECK(ldap_pool_getconnection(ldap_inst->pool, &ldap_conn));
-	if (ldap_conn->handle == NULL) {
-		/*
-		 * handle can be NULL when the first connection to LDAP wasn't
-		 * successful
-		 * TODO: handle this case inside ldap_pool_getconnection()?
-		 */
-		CHECK(ldap_connect(ldap_inst, ldap_conn, ISC_FALSE));
-	}
-	ret = ldap_delete_ext_s(ldap_conn->handle, str_buf(dn), NULL, NULL);
-	result = (ret == LDAP_SUCCESS) ? ISC_R_SUCCESS : ISC_R_FAILURE;
-	if (ret == LDAP_SUCCESS)
+	result = import_load(inst->mctx, zname, zevent->filename,
+			     &zevent->impdb);
+	if (result != ISC_R_SUCCESS) {
+		dns_name_format(zname, zone_name, DNS_NAME_FORMATSIZE);
+		log_error_r("zone '%s': unable to load records from '%s'",
+			    zone_name, zevent->filename);
 		goto cleanup;
+	}
+	CHECK(dns_rbt_create(inst->mctx, NULL, NULL, &zevent->failed));
+	CHECKED_MEM_GET(inst->mctx, zevent->ops,
+			IMPORT_LDAP_WINDOW * sizeof(*zevent->ops));
+	memset(zevent->ops, 0, IMPORT_LDAP_WINDOW * sizeof(*zevent->ops));
+	for (unsigned int i = 0; i < IMPORT_LDAP_WINDOW; i++)
+		zevent->ops[i].msgid = -1;
+
+	CHECK(new_ldap_connection(inst->pool, &zevent->conn));
+	CHECK(ldap_connect(inst, zevent->conn, ISC_FALSE));
+	CHECK(isc_time_now(&zevent->last_reply));
+
+	CHECK(dns_db_createiterator(zevent->impdb, 0, &zevent->dbiter));
+	result = dns_dbiterator_first(zevent->dbiter);
+	if (result == ISC_R_NOMORE) {
+		dns_dbiterator_destroy(&zevent->dbiter);
+		result = ISC_R_SUCCESS;
+	}
 
-	LDAP_OPT_CHECK(ldap_get_option(ldap_conn->handle, LDAP_OPT_RESULT_CODE,
-		       &ret), "remove_entry_from_ldap failed to obtain "
-		       "ldap error code");
-
-	if (result != ISC_R_SUCCESS)
-		log_ldap_error(ldap_conn->handle, "while deleting entry '%s'",
-			       str_buf(dn));
 cleanup:
-	ldap_pool_putconnection(ldap_inst->pool, &ldap_conn);
-	str_destroy(&dn);
 	return result;
 }
 
-
+/**
+ * Apply records which were written to LDAP to the zone database
+ * as one transaction with a new SOA serial.
+ */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_pool_create(isc_mem_t *mctx, unsigned int connections, ldap_pool_t **poolp)
+import_finish(ldap_zoneimportev_t *zevent)
 {
-	ldap_pool_t *pool;
 	isc_result_t result;
+	ldap_instance_t *inst = zevent->inst;
+	dns_name_t *zname = dns_fixedname_name(&zevent->name);
+	dns_zone_t *raw = NULL;
+	dns_db_t *ldapdb = NULL;
+	dns_db_t *rbtdb = NULL;
+	dns_dbversion_t *version = NULL;
+	dns_diff_t diff;
+	isc_uint32_t serial;
+	char zone_name[DNS_NAME_FORMATSIZE];
 
-	REQUIRE(poolp != NULL && *poolp == NULL);
-
-	CHECKED_MEM_GET(mctx, pool, sizeof(*pool));
-	ZERO_PTR(pool);
-	isc_mem_attach(mctx, &pool->mctx);
-	
-	CHECK(semaphore_init(&pool->conn_semaphore, connections));
-	CHECKED_MEM_GET(mctx, pool->conns,
-			connections * sizeof(ldap_connection_t *));
-	memset(pool->conns, 0, connections * sizeof(ldap_connection_t *));
-	pool->connections = connections;
+	dns_diff_init(inst->mctx, &diff);
+	dns_name_format(zname, zone_name, DNS_NAME_FORMATSIZE);
 
-	*poolp = pool;
+	CHECK(zr_get_zone_ptr(inst->zone_register, zname, &raw, NULL));
+	CHECK(zr_get_zone_dbs(inst->zone_register, zname, &ldapdb, &rbtdb));
+	CHECK(dns_db_newversion(ldapdb, &version));
+	CHECK(import_diff(inst->mctx, zevent->impdb, zevent->failed, rbtdb,
+			  version, &diff));
+	if (HEAD(diff.tuples) != NULL) {
+		CHECK(zone_soaserial_addtuple(inst->mctx, ldapdb, version,
+					      &diff, &serial));
+		result = ldap_replace_serial(inst, zname, serial);
+		if (result != ISC_R_SUCCESS)
+			dns_zone_log(raw, ISC_LOG_ERROR,
+				     "serial (%u) write back to LDAP failed",
+				     serial);
+		CHECK(zone_journal_adddiff(inst->mctx, raw, &diff));
+		CHECK(dns_diff_apply(&diff, rbtdb, version));
+		dns_db_closeversion(ldapdb, &version, ISC_TRUE);
+		dns_zone_markdirty(raw);
+	}
 
-	return ISC_R_SUCCESS;
+	if (zevent->fail_cnt == 0) {
+		log_info("zone '%s': %u names imported from '%s'",
+			 zone_name, zevent->name_cnt, zevent->filename);
+		if (zevent->remove == ISC_TRUE
+		    && isc_file_remove(zevent->filename) != ISC_R_SUCCESS)
+			log_error("zone '%s': unable to remove imported "
+				  "file '%s'", zone_name, zevent->filename);
+	} else {
+		log_error("zone '%s': %u of %u names from '%s' could not "
+			  "be imported", zone_name, zevent->fail_cnt,
+			  zevent->name_cnt, zevent->filename);
+	}
+	result = ISC_R_SUCCESS;
 
 cleanup:
-	ldap_pool_destroy(&pool);
+	dns_diff_clear(&diff);
+	/* rollback */
+	if (version != NULL)
+		dns_db_closeversion(ldapdb, &version, ISC_FALSE);
+	if (rbtdb != NULL)
+		dns_db_detach(&rbtdb);
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
 	return result;
 }
 
+/**
+ * Import records from master file to LDAP and to the zone database.
+ *
+ * Records are written to LDAP by asynchronous operations, one per owner
+ * name. Records from the file replace existing records with the same name
+ * and type. Zone database is updated as one transaction with a new SOA
+ * serial, changes sent later by SyncRepl for the same entries do not
+ * modify the database again.
+ *
+ * The event is processed by task of the zone so it is serialized with
+ * update_record() events for the same zone. Each run sends operations
+ * for at most IMPORT_NAMES_PER_RUN names and waits for replies at most
+ * IMPORT_WAIT_MSEC, then the event is sent to the zone task again so
+ * other events for the zone are not blocked by the import.
+ */
 static void ATTR_NONNULLS
-ldap_pool_destroy(ldap_pool_t **poolp)
+zone_import(isc_task_t *task, isc_event_t *event)
 {
-	ldap_pool_t *pool;
-	ldap_connection_t *ldap_conn;
-	unsigned int i;
+	ldap_zoneimportev_t *zevent = (ldap_zoneimportev_t *)event;
+	ldap_instance_t *inst = zevent->inst;
+	dns_name_t *zname = dns_fixedname_name(&zevent->name);
+	isc_result_t result;
+	sync_state_t sync_state;
+	unsigned int sent_cnt = 0;
+	unsigned int reply_cnt = 0;
+	char zone_name[DNS_NAME_FORMATSIZE];
 
-	REQUIRE(poolp != NULL);
+	dns_name_format(zname, zone_name, DNS_NAME_FORMATSIZE);
 
-	pool = *poolp;
-	if (pool == NULL)
-		return;
+	if (ldap_instance_isexiting(inst))
+		CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
 
-	if (pool->conns != NULL) {
-		for (i = 0; i < pool->connections; i++) {
-			ldap_conn = pool->conns[i];
-			if (ldap_conn != NULL)
-				destroy_ldap_connection(&ldap_conn);
+	if (zevent->impdb == NULL) { /* first run */
+		sync_state_get(sync_ctx_for_zone(inst, zname), &sync_state);
+		if (sync_state != sync_finished) {
+			log_error("zone '%s': import from '%s' refused: "
+				  "initial synchronization with LDAP is not "
+				  "finished", zone_name, zevent->filename);
+			CLEANUP_WITH(ISC_R_NOTREADY);
 		}
+		/* file from zone directory was imported by earlier event */
+		if (zevent->remove == ISC_TRUE
+		    && isc_file_exists(zevent->filename) == ISC_FALSE)
+			CLEANUP_WITH(ISC_R_SUCCESS);
+		CHECK(import_start(zevent));
+	}
 
-		SAFE_MEM_PUT(pool->mctx, pool->conns,
-			     pool->connections * sizeof(ldap_connection_t *));
+	CHECK(import_poll(zevent, ISC_FALSE, &reply_cnt));
+	CHECK(import_fill(zevent, &sent_cnt));
+	if (zevent->dbiter != NULL || zevent->in_flight > 0) {
+		/* nothing to send until some reply arrives */
+		if (sent_cnt == 0 && reply_cnt == 0)
+			CHECK(import_poll(zevent, ISC_TRUE, &reply_cnt));
+		isc_task_send(task, &event);
+		return;
 	}
 
-	semaphore_destroy(&pool->conn_semaphore);
+	CHECK(import_finish(zevent));
 
-	MEM_PUT_AND_DETACH(pool);
-	*poolp = NULL;
+cleanup:
+	if (result != ISC_R_SUCCESS && result != ISC_R_SHUTTINGDOWN
+	    && result != ISC_R_NOTREADY)
+		log_error_r("zone '%s': import from '%s' failed, "
+			    "records written to LDAP will arrive by SyncRepl",
+			    zone_name, zevent->filename);
+	import_event_free(&zevent);
 }
 
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_pool_getconnection(ldap_pool_t *pool, ldap_connection_t ** conn)
+/**
+ * Schedule import of records from master file 'filename' to zone 'name',
+ * see zone_import().
+ *
+ * @param[in] remove Delete the file after successful import.
+ */
+isc_result_t
+ldap_zone_import(ldap_instance_t *inst, dns_name_t *name,
+		 const char *filename, isc_boolean_t remove)
 {
-	ldap_connection_t *ldap_conn = NULL;
-	unsigned int i;
 	isc_result_t result;
+	dns_zone_t *raw = NULL;
+	isc_task_t *task = NULL;
+	ldap_zoneimportev_t *zevent = NULL;
+	char zone_name[DNS_NAME_FORMATSIZE];
 
-	REQUIRE(pool != NULL);
-	REQUIRE(conn != NULL && *conn == NULL);
-	ldap_conn = *conn;
-
-	CHECK(semaphore_wait_timed(&pool->conn_semaphore, &conn_wait_timeout));
-	/* Following assertion is necessary to convince clang static analyzer
-	 * that the loop is always entered. */
-	REQUIRE(pool->connections > 0);
-	for (i = 0; i < pool->connections; i++) {
-		ldap_conn = pool->conns[i];
-		if (isc_mutex_trylock(&ldap_conn->lock) == ISC_R_SUCCESS)
-			break;
-	}
+	/* instance with data source does not talk to LDAP */
+	if (inst->data_source != NULL)
+		return ISC_R_NOTIMPLEMENTED;
 
-	RUNTIME_CHECK(ldap_conn != NULL);
+	CHECK(zr_get_zone_ptr(inst->zone_register, name, &raw, NULL));
+	zevent = (ldap_zoneimportev_t *)isc_event_allocate(inst->mctx,
+				inst, LDAPDB_EVENT_ZONE_IMPORT,
+				zone_import, NULL,
+				sizeof(ldap_zoneimportev_t));
+	if (zevent == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+	zevent->inst = inst;
+	zevent->filename = NULL;
+	zevent->remove = remove;
+	zevent->conn = NULL;
+	zevent->impdb = NULL;
+	zevent->dbiter = NULL;
+	zevent->failed = NULL;
+	zevent->ops = NULL;
+	zevent->in_flight = 0;
+	zevent->name_cnt = 0;
+	zevent->fail_cnt = 0;
+	dns_fixedname_init(&zevent->name);
+	CHECK(dns_name_copy(name, dns_fixedname_name(&zevent->name), NULL));
+	CHECKED_MEM_STRDUP(inst->mctx, filename, zevent->filename);
+	dns_zone_gettask(raw, &task);
+	isc_task_send(task, (isc_event_t **)&zevent);
+	isc_task_detach(&task);
 
-	*conn = ldap_conn;
+	dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+	log_info("zone '%s': import from '%s' scheduled", zone_name, filename);
 
 cleanup:
-	if (result != ISC_R_SUCCESS) {
-		log_error("timeout in ldap_pool_getconnection(): try to raise "
-				"'connections' parameter; potential deadlock?");
-	}
+	if (zevent != NULL)
+		import_event_free(&zevent);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
 	return result;
 }
 
-static void ATTR_NONNULLS
-ldap_pool_putconnection(ldap_pool_t *pool, ldap_connection_t **conn)
-{
-	REQUIRE(conn != NULL);
-	ldap_connection_t *ldap_conn = *conn;
-
-	if (ldap_conn == NULL)
-		return;
-
-	UNLOCK(&ldap_conn->lock);
-	semaphore_signal(&pool->conn_semaphore);
-
-	*conn = NULL;
-}
-
+/**
+ * Schedule import of file IMPORT_SPOOL_FILE from zone directory
+ * if the file exists. The file is removed after successful import.
+ * It is called whenever the zone is loaded, files found before the end
+ * of initial synchronization are picked up by activate_zones().
+ */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_pool_connect(ldap_pool_t *pool, ldap_instance_t *ldap_inst)
+zone_import_spool(ldap_instance_t *inst, dns_name_t *name)
 {
 	isc_result_t result;
-	ldap_connection_t *ldap_conn;
-	unsigned int i;
+	ld_string_t *path = NULL;
+	sync_state_t sync_state;
 
-	for (i = 0; i < pool->connections; i++) {
-		ldap_conn = NULL;
-		CHECK(new_ldap_connection(pool, &ldap_conn));
-		result = ldap_connect(ldap_inst, ldap_conn, ISC_FALSE);
-		/* Continue even if LDAP server is down */
-		if (result != ISC_R_NOTCONNECTED && result != ISC_R_TIMEDOUT &&
-		    result != ISC_R_SUCCESS) {
-			goto cleanup;
-		}
-		pool->conns[i] = ldap_conn;
-	}
+	if (inst->data_source != NULL)
+		return ISC_R_SUCCESS;
+	sync_state_get(sync_ctx_for_zone(inst, name), &sync_state);
+	if (sync_state != sync_finished)
+		return ISC_R_SUCCESS;
 
-	return ISC_R_SUCCESS;
+	CHECK(zr_get_zone_path(inst->mctx, inst->local_settings, name,
+			       IMPORT_SPOOL_FILE, &path));
+	if (isc_file_exists(str_buf(path)) == ISC_TRUE)
+		CHECK(ldap_zone_import(inst, name, str_buf(path), ISC_TRUE));
 
 cleanup:
-	log_error_r("couldn't establish connection in LDAP connection pool");
-	for (i = 0; i < pool->connections; i++) {
-		destroy_ldap_connection(&pool->conns[i]);
-	}
+	str_destroy(&path);
 	return result;
 }
 
-#define LDAP_ENTRYCHANGE_ALL	(LDAP_SYNC_CAPI_ADD | LDAP_SYNC_CAPI_DELETE | LDAP_SYNC_CAPI_MODIFY)
+#define LDAPDB_EVENT_ZONE_CONFREFRESH	(LDAPDB_EVENTCLASS + 13)
 
-#define SYNCREPL_ADD(chgtype) (chgtype == LDAP_SYNC_CAPI_ADD)
-#define SYNCREPL_DEL(chgtype) (chgtype == LDAP_SYNC_CAPI_DELETE)
-#define SYNCREPL_MOD(chgtype) (chgtype == LDAP_SYNC_CAPI_MODIFY)
-/* SYNCREPL_MODDN: Change in DN can be detected only via UUID->DN mapping:
- * Map UUID to (remembered) DN and compare remembered DN with new one. */
-/* SYNCREPL_ANY: Initial database dump should be detected via sync_ctx state:
- * All changes received before first 'intermediate' message contain initial
- * state of the database.
-#define SYNCREPL_ANY(chgtype) ((chgtype & LDAP_ENTRYCHANGE_ALL) != 0)
+typedef struct ldap_zoneconfev ldap_zoneconfev_t;
+struct ldap_zoneconfev {
+	ISC_EVENT_COMMON(ldap_zoneconfev_t);
+	ldap_instance_t		*inst;
+	dns_fixedname_t		name;
+	unsigned int		what;	/**< ZONE_CONF_* flags */
+};
+
+/**
+ * Rewrite MNAME in SOA record of the zone so it reflects current value
+ * of setting fake_mname. Zone object is not read from LDAP again,
+ * MNAME from the object is remembered in setting soa_mname.
  */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_conf_refresh_soa(ldap_instance_t *inst, dns_name_t *zname,
+		      dns_zone_t *raw, settings_set_t *zone_settings) {
+	isc_result_t result;
+	const char *mname_str = NULL;
+	dns_fixedname_t fmname;
+	dns_name_t *mname;
+	dns_db_t *ldapdb = NULL;
+	dns_db_t *rbtdb = NULL;
+	dns_dbversion_t *version = NULL;
+	dns_diff_t diff;
+	sync_state_t sync_state;
+	isc_uint32_t new_serial;
 
-/*
- * update_zone routine is processed asynchronously so it cannot assume
- * anything about state of ldap_inst from where it was sent. The ldap_inst
- * could have been already destroyed due server reload. The safest
- * way how to handle zone update is to refetch ldap_inst,
- * perform query to LDAP and delete&add the zone. This is expensive
- * operation but zones don't change often.
+	dns_diff_init(inst->mctx, &diff);
+	dns_fixedname_init(&fmname);
+	mname = dns_fixedname_name(&fmname);
+
+	CHECK(setting_get_str(SETTING_FAKE_MNAME, zone_settings, &mname_str));
+	if (strlen(mname_str) == 0)
+		CHECK(setting_get_str(SETTING_SOA_MNAME, zone_settings,
+				      &mname_str));
+	CHECK(dns_name_fromstring2(mname, mname_str, zname, 0, NULL));
+
+	CHECK(zr_get_zone_dbs(inst->zone_register, zname, &ldapdb, &rbtdb));
+	CHECK(dns_db_newversion(ldapdb, &version));
+	result = zone_soamname_addtuple(inst->mctx, rbtdb, version, mname,
+					&diff);
+	if (result == ISC_R_IGNORE)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	else if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	sync_state_get(sync_ctx_for_zone(inst, zname), &sync_state);
+	if (sync_state == sync_finished) {
+		/* the last tuple adds the new SOA record */
+		CHECK(zone_soaserial_updatetuple(dns_updatemethod_unixtime,
+						 TAIL(diff.tuples),
+						 &new_serial));
+		result = ldap_replace_serial(inst, zname, new_serial);
+		if (result != ISC_R_SUCCESS)
+			dns_zone_log(raw, ISC_LOG_ERROR,
+				     "serial (%u) write back to LDAP failed",
+				     new_serial);
+		CHECK(zone_journal_adddiff(inst->mctx, raw, &diff));
+	}
+	dns_diff_print(&diff, NULL);
+	CHECK(dns_diff_apply(&diff, rbtdb, version));
+	dns_db_closeversion(ldapdb, &version, ISC_TRUE);
+	dns_zone_markdirty(raw);
+
+cleanup:
+	dns_diff_clear(&diff);
+	/* rollback */
+	if (version != NULL)
+		dns_db_closeversion(ldapdb, &version, ISC_FALSE);
+	if (rbtdb != NULL)
+		dns_db_detach(&rbtdb);
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+	return result;
+}
+
+/**
+ * Apply change of inherited settings to one zone.
+ *
+ * The event is processed by task of the zone so it is serialized with
+ * update_record() events for the same zone and the instance task is not
+ * blocked by the fan-out.
  */
 static void ATTR_NONNULLS
-update_zone(isc_task_t *task, isc_event_t *event)
+zone_conf_refresh(isc_task_t *task, isc_event_t *event)
 {
-	ldap_syncreplevent_t *pevent = (ldap_syncreplevent_t *)event;
-	isc_result_t result ;
-	ldap_instance_t *inst = pevent->inst;
-	isc_mem_t *mctx;
-	dns_name_t prevname;
-	ldap_entry_t *entry = pevent->entry;
+	ldap_zoneconfev_t *zevent = (ldap_zoneconfev_t *)event;
+	ldap_instance_t *inst = zevent->inst;
+	dns_name_t *zname = dns_fixedname_name(&zevent->name);
+	isc_result_t result;
+	dns_zone_t *raw = NULL;
+	settings_set_t *zone_settings = NULL;
+	char zone_name[DNS_NAME_FORMATSIZE];
 
-	mctx = pevent->mctx;
-	dns_name_init(&prevname, NULL);
+	UNUSED(task);
 
-	INSIST(task == inst->task); /* For task-exclusive mode */
+	if (ldap_instance_isexiting(inst))
+		CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
 
-	if (SYNCREPL_DEL(pevent->chgtype)) {
-		CHECK(ldap_delete_zone2(inst, &entry->fqdn, ISC_TRUE));
-	} else {
-		if (entry->class & LDAP_ENTRYCLASS_MASTER)
-			CHECK(ldap_parse_master_zoneentry(entry, NULL, inst,
-							  task));
-		else if (entry->class & LDAP_ENTRYCLASS_FORWARD)
-			CHECK(ldap_parse_fwd_zoneentry(entry, inst));
-		else
-			FATAL_ERROR(__FILE__, __LINE__,
-				    "update_zone: unexpected entry class");
-	}
+	result = zr_get_zone_ptr(inst->zone_register, zname, &raw, NULL);
+	if (result == ISC_R_NOTFOUND)
+		/* zone was deleted in meantime */
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	else if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	CHECK(zr_get_zone_settings(inst->zone_register, zname,
+				   &zone_settings));
+
+	if ((zevent->what & ZONE_CONF_SSU) != 0)
+		CHECK(zone_ssutable_reconfigure(inst, raw, zone_settings));
+	if ((zevent->what & ZONE_CONF_SOA) != 0)
+		CHECK(zone_conf_refresh_soa(inst, zname, raw, zone_settings));
 
 cleanup:
-	if (inst != NULL) {
-		sync_concurr_limit_signal(inst->sctx);
-		sync_event_signal(inst->sctx, pevent);
-		if (dns_name_dynamic(&prevname))
-			dns_name_free(&prevname, inst->mctx);
+	if (result != ISC_R_SUCCESS && result != ISC_R_SHUTTINGDOWN) {
+		dns_name_format(zname, zone_name, DNS_NAME_FORMATSIZE);
+		log_error_r("zone '%s': change in global configuration "
+			    "could not be applied, run `rndc reload`",
+			    zone_name);
 	}
-	if (result != ISC_R_SUCCESS)
-		log_error_r("update_zone (syncrepl) failed for %s. "
-			    "Zones can be outdated, run `rndc reload`",
-			    ldap_entry_logname(entry));
-
-	if (pevent->prevdn != NULL)
-		isc_mem_free(mctx, pevent->prevdn);
-	ldap_entry_destroy(&entry);
-	isc_mem_detach(&mctx);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
 	isc_event_free(&event);
-	isc_task_detach(&task);
 }
 
-static void ATTR_NONNULLS
-update_config(isc_task_t * task, isc_event_t *event)
-{
-	ldap_syncreplevent_t *pevent = (ldap_syncreplevent_t *)event;
-	isc_result_t result;
-	ldap_instance_t *inst = pevent->inst;
-	ldap_entry_t *entry = pevent->entry;
-	isc_mem_t *mctx;
+#define LDAPDB_EVENT_ZONE_CONFFANOUT	(LDAPDB_EVENTCLASS + 15)
 
-	mctx = pevent->mctx;
+/** Zones waiting for zone_conf_fanout_batch(). */
+typedef struct ldap_zonefanoutev ldap_zonefanoutev_t;
+struct ldap_zonefanoutev {
+	ISC_EVENT_COMMON(ldap_zonefanoutev_t);
+	ldap_instance_t		*inst;
+	unsigned int		what;	/**< ZONE_CONF_* flags */
+	zone_sync_list_t	zones;
+};
 
-	INSIST(task == inst->task); /* For task-exclusive mode */
-	CHECK(ldap_parse_configentry(entry, inst));
+/**
+ * Send zone_conf_refresh() events for the next LDAP_ZONE_BATCH_SIZE zones
+ * and send itself again to the instance task if there are more zones,
+ * so other events of the instance task are not delayed by the fan-out.
+ */
+static void ATTR_NONNULLS
+zone_conf_fanout_batch(isc_task_t *task, isc_event_t *event) {
+	ldap_zonefanoutev_t *fevent = (ldap_zonefanoutev_t *)event;
+	ldap_instance_t *inst = fevent->inst;
+	isc_result_t result = ISC_R_SUCCESS;
+	zone_sync_item_t *item;
+	dns_name_t *name;
+	dns_zone_t *raw = NULL;
+	settings_set_t *zone_settings;
+	isc_task_t *zone_task = NULL;
+	ldap_zoneconfev_t *zevent = NULL;
+	unsigned int zone_what;
+	unsigned int cnt;
+
+	if (ldap_instance_isexiting(inst))
+		CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
+
+	for (cnt = 0;
+	     cnt < LDAP_ZONE_BATCH_SIZE && (item = HEAD(fevent->zones)) != NULL;
+	     cnt++) {
+		UNLINK(fevent->zones, item, link);
+		name = dns_fixedname_name(&item->name);
+		zone_what = fevent->what;
+		zone_settings = NULL;
+		if (zr_get_zone_settings(inst->zone_register, name,
+					 &zone_settings) != ISC_R_SUCCESS)
+			zone_what = 0;
+		else if (setting_find("dyn_update", zone_settings, ISC_FALSE,
+				      ISC_TRUE, NULL) == ISC_R_SUCCESS)
+			zone_what &= ~ZONE_CONF_SSU;
+		/* zone was deleted in meantime or overrides the setting */
+		if (zone_what == 0 ||
+		    zr_get_zone_ptr(inst->zone_register, name, &raw, NULL)
+		    != ISC_R_SUCCESS) {
+			SAFE_MEM_PUT_PTR(inst->mctx, item);
+			continue;
+		}
 
-cleanup:
-	if (inst != NULL) {
-		sync_concurr_limit_signal(inst->sctx);
-		sync_event_signal(inst->sctx, pevent);
+		zevent = (ldap_zoneconfev_t *)isc_event_allocate(inst->mctx,
+					inst, LDAPDB_EVENT_ZONE_CONFREFRESH,
+					zone_conf_refresh, NULL,
+					sizeof(ldap_zoneconfev_t));
+		if (zevent == NULL) {
+			SAFE_MEM_PUT_PTR(inst->mctx, item);
+			CLEANUP_WITH(ISC_R_NOMEMORY);
+		}
+		zevent->inst = inst;
+		zevent->what = zone_what;
+		dns_fixedname_init(&zevent->name);
+		result = dns_name_copy(name, dns_fixedname_name(&zevent->name),
+				       NULL);
+		SAFE_MEM_PUT_PTR(inst->mctx, item);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+		dns_zone_gettask(raw, &zone_task);
+		isc_task_send(zone_task, (isc_event_t **)&zevent);
+		isc_task_detach(&zone_task);
+		dns_zone_detach(&raw);
 	}
-	if (result != ISC_R_SUCCESS)
-		log_error_r("update_config (syncrepl) failed for %s. "
-			    "Configuration can be outdated, run `rndc reload`",
-			    ldap_entry_logname(entry));
 
-	ldap_entry_destroy(&entry);
-	isc_mem_detach(&mctx);
+	if (!EMPTY(fevent->zones)) {
+		isc_task_send(task, &event);
+		return;
+	}
+
+cleanup:
+	if (result != ISC_R_SUCCESS && result != ISC_R_SHUTTINGDOWN)
+		log_error_r("change in global configuration could not be "
+			    "applied to all zones, run `rndc reload`");
+	if (zevent != NULL)
+		isc_event_free((isc_event_t **)&zevent);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	zone_sync_list_free(inst->mctx, &fevent->zones);
 	isc_event_free(&event);
-	isc_task_detach(&task);
 }
 
-static void ATTR_NONNULLS
-update_serverconfig(isc_task_t * task, isc_event_t *event)
-{
-	ldap_syncreplevent_t *pevent = (ldap_syncreplevent_t *)event;
+/**
+ * Schedule reconfiguration of zones affected by a change in global
+ * or server configuration object.
+ *
+ * Only zones which inherit the changed setting are affected, zones which
+ * override the setting in their own object are skipped. Names of zones
+ * are collected at once and events are sent in batches by instance task,
+ * see zone_conf_fanout_batch(). The work itself is done by tasks
+ * of the respective zones, see zone_conf_refresh().
+ *
+ * @param[in] what ZONE_CONF_* flags describing changed effective settings
+ */
+static isc_result_t
+zone_conf_fanout(ldap_instance_t *inst, unsigned int what) {
 	isc_result_t result;
-	ldap_instance_t *inst = pevent->inst;
-	ldap_entry_t *entry = pevent->entry;
-	isc_mem_t *mctx;
+	rbt_iterator_t *iter = NULL;
+	DECLARE_BUFFERED_NAME(name);
+	ldap_zonefanoutev_t *fevent = NULL;
+	zone_sync_item_t *item = NULL;
+	unsigned int count = 0;
 
-	mctx = pevent->mctx;
+	/* instance with data source does not talk to LDAP */
+	if (inst->data_source != NULL)
+		return ISC_R_SUCCESS;
 
-	INSIST(task == inst->task); /* For task-exclusive mode */
-	CHECK(ldap_parse_serverconfigentry(entry, inst));
+	fevent = (ldap_zonefanoutev_t *)isc_event_allocate(inst->mctx,
+				inst, LDAPDB_EVENT_ZONE_CONFFANOUT,
+				zone_conf_fanout_batch, NULL,
+				sizeof(ldap_zonefanoutev_t));
+	if (fevent == NULL)
+		return ISC_R_NOMEMORY;
+	fevent->inst = inst;
+	fevent->what = what;
+	INIT_LIST(fevent->zones);
+
+	INIT_BUFFERED_NAME(name);
+	for (result = zr_rbt_iter_init(inst->zone_register, &iter, &name);
+	     result == ISC_R_SUCCESS;
+	     dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
+		CHECKED_MEM_GET_PTR(inst->mctx, item);
+		ZERO_PTR(item);
+		INIT_LINK(item, link);
+		dns_fixedname_init(&item->name);
+		CHECK(dns_name_copy(&name, dns_fixedname_name(&item->name),
+				    NULL));
+		APPEND(fevent->zones, item, link);
+		item = NULL;
+		count++;
+	}
+	if (result != ISC_R_NOTFOUND && result != ISC_R_NOMORE)
+		goto cleanup;
+	log_debug(1, "%u zones will be checked for reconfiguration after "
+		  "change in global configuration", count);
+	result = ISC_R_SUCCESS;
+	if (count > 0)
+		isc_task_send(inst->task, (isc_event_t **)&fevent);
 
 cleanup:
-	if (inst != NULL) {
-		sync_concurr_limit_signal(inst->sctx);
-		sync_event_signal(inst->sctx, pevent);
+	if (iter != NULL)
+		rbt_iter_stop(&iter);
+	if (item != NULL)
+		SAFE_MEM_PUT_PTR(inst->mctx, item);
+	if (fevent != NULL) {
+		zone_sync_list_free(inst->mctx, &fevent->zones);
+		isc_event_free((isc_event_t **)&fevent);
 	}
-	if (result != ISC_R_SUCCESS)
-		log_error_r("update_serverconfig (syncrepl) failed for %s. "
-			    "Configuration can be outdated, run `rndc reload`",
-			    ldap_entry_logname(entry));
+	return result;
+}
 
-	ldap_entry_destroy(&entry);
-	isc_mem_detach(&mctx);
-	isc_event_free(&event);
-	isc_task_detach(&task);
+/**
+ * Compute difference for names generated by idnsRangeGenerator values
+ * of the entry. Records generated by the previous version of the entry
+ * and not generated anymore are removed from the zone. Names with records
+ * from other entries are skipped, see range_set_isforeign().
+ *
+ * @param[out] specsp Generator values to be remembered when the diff is
+ *                    applied, see rr_range_set(). Stays NULL if the entry
+ *                    never generated any records.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+range_update_diff(ldap_instance_t *inst, ldap_entry_t *entry, int chgtype,
+		  dns_db_t *rbtdb, dns_dbversion_t *version, dns_diff_t *diff,
+		  ld_string_t **specsp) {
+	isc_result_t result;
+	char *old_specs = NULL;
+	ld_string_t *new_specs = NULL;
+	settings_set_t *zone_settings = NULL;
+	range_set_t set;
+	range_set_t old_set;
+
+	REQUIRE(specsp != NULL && *specsp == NULL);
+
+	set.names = NULL;
+	old_set.names = NULL;
+	if (entry->uuid == NULL)
+		return ISC_R_SUCCESS;
+	result = rr_range_get(inst->rr_ranges, inst->mctx, entry->uuid,
+			      &old_specs);
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
+		goto cleanup;
+	/* ordinary records */
+	if (old_specs == NULL && (entry->class & LDAP_ENTRYCLASS_RANGE) == 0)
+		return ISC_R_SUCCESS;
+
+	CHECK(zr_get_zone_settings(inst->zone_register, &entry->zone_name,
+				   &zone_settings));
+	CHECK(str_new(inst->mctx, &new_specs));
+	CHECK(str_init_char(new_specs, ""));
+	if (SYNCREPL_ADD(chgtype) || SYNCREPL_MOD(chgtype))
+		CHECK(range_specs_get(inst, entry, zone_settings, new_specs));
+
+	CHECK(range_set_init(inst->mctx, &entry->zone_name, NULL, &old_set));
+	if (old_specs != NULL)
+		CHECK(range_set_expand(&old_set, entry, zone_settings,
+				       old_specs));
+	CHECK(range_set_init(inst->mctx, &entry->zone_name, NULL, &set));
+	set.db = rbtdb;
+	set.version = version;
+	set.prev = &old_set;
+	if (str_len(new_specs) > 0)
+		CHECK(range_set_expand(&set, entry, zone_settings,
+				       str_buf(new_specs)));
+	CHECK(range_set_diff(&set, &old_set, rbtdb, version, diff));
+
+	*specsp = new_specs;
+	new_specs = NULL;
+
+cleanup:
+	range_set_destroy(&set);
+	range_set_destroy(&old_set);
+	str_destroy(&new_specs);
+	if (old_specs != NULL)
+		isc_mem_free(inst->mctx, old_specs);
+	return result;
 }
 
 /**
@@ -3842,6 +8054,8 @@ update_record(isc_task_t *task, isc_event_t *event)
 	dns_rdatasetiter_t *rbt_rds_iterator = NULL;
 
 	sync_state_t sync_state;
+	isc_boolean_t zone_live;
+	ld_string_t *range_specs = NULL;
 
 	mctx = pevent->mctx;
 	dns_diff_init(mctx, &diff);
@@ -3868,6 +8082,7 @@ update_restart:
 	ldapdb = NULL;
 	zone_settings = NULL;
 	ldapdb_rdatalist_destroy(mctx, &rdatalist);
+	str_destroy(&range_specs);
 	CHECK(zr_get_zone_dbs(inst->zone_register, &entry->zone_name, &ldapdb, &rbtdb));
 	CHECK(dns_db_newversion(ldapdb, &version));
 
@@ -3915,6 +8130,11 @@ update_restart:
 	}
 	*/
 
+	/* Forget variables used by previous version of the entry,
+	 * ldap_parse_rrentry() will record variables used by the new one. */
+	if (entry->uuid != NULL)
+		rr_template_deps_remove(inst->rr_templates, entry->uuid);
+
 	if (SYNCREPL_ADD(pevent->chgtype) || SYNCREPL_MOD(pevent->chgtype)) {
 		/* Parse new data from LDAP. */
 		log_debug(5, "syncrepl_update: updating name in rbtdb, "
@@ -3922,7 +8142,8 @@ update_restart:
 		CHECK(zr_get_zone_settings(inst->zone_register,
 					   &entry->zone_name, &zone_settings));
 		CHECK(ldap_parse_rrentry(mctx, entry, &entry->zone_name,
-					 zone_settings, &rdatalist));
+					 zone_settings, inst->rr_templates,
+					 &rdatalist));
 	}
 
 	if (rbt_rds_iterator != NULL) {
@@ -3930,11 +8151,22 @@ update_restart:
 				      rbt_rds_iterator, &diff));
 		dns_rdatasetiter_destroy(&rbt_rds_iterator);
 	}
-
-	sync_state_get(inst->sctx, &sync_state);
+	CHECK(range_update_diff(inst, entry, pevent->chgtype, rbtdb, version,
+				&diff, &range_specs));
+
+	/* template refresh events do not come from any SyncRepl session */
+	sync_state_get(pevent->sess != NULL
+		       ? pevent->sess->sctx
+		       : sync_ctx_for_zone(inst, &entry->zone_name),
+		       &sync_state);
+	/* Zones published by per-zone synchronization serve data before
+	 * the initial synchronization is finished, changes delivered by
+	 * the refresh are ordinary updates for them. */
+	zone_live = ISC_TF(sync_state == sync_finished ||
+			   dns_zone_getserial2(raw, &serial) == ISC_R_SUCCESS);
 	/* No real change in RR data -> do not increment SOA serial. */
 	if (HEAD(diff.tuples) != NULL) {
-		if (sync_state == sync_finished) {
+		if (zone_live == ISC_TRUE) {
 			CHECK(zone_soaserial_addtuple(mctx, ldapdb, version,
 						      &diff, &serial));
 			dns_zone_log(raw, ISC_LOG_DEBUG(5),
@@ -3952,7 +8184,7 @@ update_restart:
 #else
 		dns_diff_print(&diff, NULL);
 #endif
-		if (sync_state == sync_finished) {
+		if (zone_live == ISC_TRUE) {
 			/* write the transaction to journal */
 			CHECK(zone_journal_adddiff(inst->mctx, raw, &diff));
 		}
@@ -3961,10 +8193,17 @@ update_restart:
 		dns_db_closeversion(ldapdb, &version, ISC_TRUE);
 		dns_zone_markdirty(raw);
 	}
+	if (range_specs != NULL) {
+		if (str_len(range_specs) > 0)
+			CHECK(rr_range_set(inst->rr_ranges, entry->uuid,
+					   str_buf(range_specs)));
+		else
+			rr_range_remove(inst->rr_ranges, entry->uuid);
+	}
 
 	/* Check if the zone is loaded or not.
 	 * No other function above returns DNS_R_NOTLOADED. */
-	if (sync_state == sync_finished)
+	if (zone_live == ISC_TRUE)
 		result = dns_zone_getserial2(raw, &serial);
 
 cleanup:
@@ -4016,12 +8255,21 @@ cleanup:
 	} else if (result != ISC_R_SUCCESS) {
 		/* error other than invalid zone */
 		log_error_r("update_record (syncrepl) failed, %s change type "
-			    "0x%x. Records can be outdated, run `rndc reload`",
+			    "0x%x. Zone will be re-synchronized",
 			    ldap_entry_logname(entry), pevent->chgtype);
+		if (inst != NULL && zone_found
+		    && !ldap_instance_isexiting(inst)
+		    && ldap_zone_resync(inst, &entry->zone_name)
+		       != ISC_R_SUCCESS)
+			log_error("%s: records can be outdated, "
+				  "run `rndc reload`",
+				  ldap_entry_logname(entry));
 	}
 
 	if (inst != NULL) {
-		sync_concurr_limit_signal(inst->sctx);
+		/* template refresh does not occupy syncrepl concurrency slot */
+		if (event->ev_type == LDAPDB_EVENT_SYNCREPL_UPDATE)
+			sync_concurr_limit_signal(pevent->sess->sctx);
 		if (dns_name_dynamic(&prevname))
 			dns_name_free(&prevname, inst->mctx);
 		if (dns_name_dynamic(&prevorigin))
@@ -4032,6 +8280,7 @@ cleanup:
 	if (secure != NULL)
 		dns_zone_detach(&secure);
 	ldapdb_rdatalist_destroy(mctx, &rdatalist);
+	str_destroy(&range_specs);
 	if (pevent->prevdn != NULL)
 		isc_mem_free(mctx, pevent->prevdn);
 	ldap_entry_destroy(&entry);
@@ -4040,6 +8289,159 @@ cleanup:
 	isc_task_detach(&task);
 }
 
+/**
+ * Pass copy of entry with templates to update_record() as if the entry
+ * was modified. update_record() then re-renders templates and applies
+ * the difference to the zone.
+ *
+ * The event is processed by task of the zone which contains the entry.
+ * The copy is taken when the event is processed so it reflects all
+ * SyncRepl updates processed by the task before, and update_record()
+ * is called directly so no other update can come in between.
+ */
+static void ATTR_NONNULLS
+refresh_template_record(isc_task_t *task, isc_event_t *event)
+{
+	ldap_tmplrefreshev_t *tevent = (ldap_tmplrefreshev_t *)event;
+	isc_result_t result;
+	ldap_instance_t *inst = tevent->inst;
+	isc_mem_t *mctx = tevent->mctx;
+	rr_template_dep_t *dep = tevent->dep;
+	ldap_entry_t *entry = NULL;
+	ldap_syncreplevent_t *pevent = NULL;
+
+	if (ldap_instance_isexiting(inst))
+		CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
+
+	result = rr_template_entry_get(inst->rr_templates, inst->mctx,
+				       dep->uuid, &entry);
+	if (result == ISC_R_NOTFOUND)
+		/* entry was deleted or does not use templates anymore */
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	else if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	pevent = (ldap_syncreplevent_t *)isc_event_allocate(inst->mctx,
+				inst, LDAPDB_EVENT_TEMPLATE_REFRESH,
+				update_record, NULL,
+				sizeof(ldap_syncreplevent_t));
+	if (pevent == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+
+	pevent->mctx = NULL;
+	isc_mem_attach(inst->mctx, &pevent->mctx);
+	pevent->inst = inst;
+	pevent->sess = NULL; /* not a SyncRepl event */
+	pevent->prevdn = NULL;
+	pevent->chgtype = LDAP_SYNC_CAPI_MODIFY;
+	pevent->entry = entry;
+	pevent->seqid = 0;
+	entry = NULL;
+	/* update_record() will detach the task and free the event */
+	update_record(task, (isc_event_t *)pevent);
+	task = NULL;
+
+cleanup:
+	if (result != ISC_R_SUCCESS && result != ISC_R_SHUTTINGDOWN)
+		log_error_r("unable to refresh templates in '%s'. "
+			    "Records can be outdated, run `rndc reload`",
+			    dep->dn);
+	ldap_entry_destroy(&entry);
+	rr_template_dep_free(mctx, &dep);
+	isc_mem_detach(&mctx);
+	isc_event_free(&event);
+	if (task != NULL)
+		isc_task_detach(&task);
+}
+
+/**
+ * Re-render all entries which use given variable in some template.
+ *
+ * Only entries recorded in the template dependency index are affected.
+ * Each of them is re-rendered from the copy kept in the template cache
+ * by task of the respective zone so LDAP is not queried again
+ * and other records are not touched.
+ */
+static isc_result_t
+refresh_templates(ldap_instance_t *inst, const char *variable)
+{
+	isc_result_t result;
+	rr_template_deplist_t deps;
+	rr_template_dep_t *dep;
+	ldap_tmplrefreshev_t *tevent = NULL;
+	ldap_entry_t *old_entry = NULL;
+	dns_zone_t *zone = NULL;
+	isc_task_t *task = NULL;
+	ldap_syncsess_t *sess;
+	ldap_entryclass_t class;
+	unsigned int count = 0;
+
+	INIT_LIST(deps);
+	CHECK(rr_template_deps_get(inst->rr_templates, inst->mctx, variable,
+				   &deps));
+
+	while ((dep = HEAD(deps)) != NULL) {
+		UNLINK(deps, dep, link);
+
+		/* find zone with the entry using metaLDAP of the session
+		 * which delivered the entry */
+		ldap_entry_destroy(&old_entry);
+		if (zone != NULL)
+			dns_zone_detach(&zone);
+		for (sess = HEAD(inst->sessions);
+		     sess != NULL;
+		     sess = NEXT(sess, link)) {
+			if (mldap_entry_read(sess->mldapdb, dep->uuid, &class,
+					     NULL, NULL) == ISC_R_SUCCESS)
+				break;
+		}
+		if (sess != NULL)
+			result = ldap_entry_reconstruct(inst->mctx,
+							sess->mldapdb,
+							dep->uuid, &old_entry);
+		else
+			result = ISC_R_NOTFOUND;
+		if (result == ISC_R_SUCCESS)
+			result = zr_get_zone_ptr(inst->zone_register,
+						 &old_entry->zone_name, &zone,
+						 NULL);
+		if (result != ISC_R_SUCCESS) {
+			log_debug(1, "template refresh: skipping '%s': %s",
+				  dep->dn, isc_result_totext(result));
+			rr_template_dep_free(inst->mctx, &dep);
+			continue;
+		}
+
+		tevent = (ldap_tmplrefreshev_t *)isc_event_allocate(inst->mctx,
+					inst, LDAPDB_EVENT_TEMPLATE_REFRESH,
+					refresh_template_record, NULL,
+					sizeof(ldap_tmplrefreshev_t));
+		if (tevent == NULL) {
+			rr_template_dep_free(inst->mctx, &dep);
+			CLEANUP_WITH(ISC_R_NOMEMORY);
+		}
+		tevent->mctx = NULL;
+		isc_mem_attach(inst->mctx, &tevent->mctx);
+		tevent->inst = inst;
+		tevent->dep = dep;
+
+		dns_zone_gettask(zone, &task);
+		isc_task_send(task, (isc_event_t **)&tevent);
+		task = NULL; /* refresh_template_record() will detach the task */
+		count++;
+	}
+	log_debug(1, "%u records using template variable '%s' "
+		  "scheduled for refresh", count, variable);
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	rr_template_deplist_free(inst->mctx, &deps);
+	ldap_entry_destroy(&old_entry);
+	if (zone != NULL)
+		dns_zone_detach(&zone);
+	return result;
+}
+
 isc_result_t
 ldap_dn_compare(const char *dn1_instr, const char *dn2_instr,
 		isc_boolean_t *isequal) {
@@ -4050,6 +8452,12 @@ ldap_dn_compare(const char *dn1_instr, const char *dn2_instr,
 	char *dn1_outstr = NULL;
 	char *dn2_outstr = NULL;
 
+	/* identical strings do not need normalization */
+	if (strcasecmp(dn1_instr, dn2_instr) == 0) {
+		*isequal = ISC_TRUE;
+		return ISC_R_SUCCESS;
+	}
+
 	ret = ldap_str2dn(dn1_instr, &dn1_ldap, LDAP_DN_FORMAT_LDAPV3);
 	if (ret != LDAP_SUCCESS)
 		CLEANUP_WITH(ISC_R_FAILURE);
@@ -4079,7 +8487,139 @@ cleanup:
 	if (dn1_outstr != NULL)
 		ldap_memfree(dn2_outstr);
 
-	return result;
+	return result;
+}
+
+/**
+ * Check if DN is equal to base or lies in subtree under the base.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_dn_insubtree(const char *dn_instr, const char *base_instr,
+		  isc_boolean_t *insubtreep) {
+	int ret;
+	isc_result_t result;
+	LDAPDN dn_ldap = NULL;
+	LDAPDN base_ldap = NULL;
+	char *suffix_outstr = NULL;
+	unsigned int dn_len = 0;
+	unsigned int base_len = 0;
+	size_t dn_strlen = strlen(dn_instr);
+	size_t base_strlen = strlen(base_instr);
+
+	/* textual suffix preceded by unescaped comma is always in subtree,
+	 * everything else is decided by normalized comparison */
+	if (dn_strlen == base_strlen
+	    || (dn_strlen > base_strlen + 1
+		&& dn_instr[dn_strlen - base_strlen - 1] == ','
+		&& dn_instr[dn_strlen - base_strlen - 2] != '\\')) {
+		if (strcasecmp(dn_instr + dn_strlen - base_strlen,
+			       base_instr) == 0) {
+			*insubtreep = ISC_TRUE;
+			return ISC_R_SUCCESS;
+		}
+	}
+
+	ret = ldap_str2dn(dn_instr, &dn_ldap, LDAP_DN_FORMAT_LDAPV3);
+	if (ret != LDAP_SUCCESS)
+		CLEANUP_WITH(ISC_R_FAILURE);
+
+	ret = ldap_str2dn(base_instr, &base_ldap, LDAP_DN_FORMAT_LDAPV3);
+	if (ret != LDAP_SUCCESS)
+		CLEANUP_WITH(ISC_R_FAILURE);
+
+	while (dn_ldap != NULL && dn_ldap[dn_len] != NULL)
+		dn_len++;
+	while (base_ldap != NULL && base_ldap[base_len] != NULL)
+		base_len++;
+	if (dn_len < base_len) {
+		*insubtreep = ISC_FALSE;
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	}
+
+	/* compare last base_len RDNs of the DN with the base */
+	ret = ldap_dn2str(dn_ldap + (dn_len - base_len), &suffix_outstr,
+			  LDAP_DN_FORMAT_LDAPV3);
+	if (ret != LDAP_SUCCESS)
+		CLEANUP_WITH(ISC_R_FAILURE);
+	CHECK(ldap_dn_compare(suffix_outstr, base_instr, insubtreep));
+
+cleanup:
+	if (dn_ldap != NULL)
+		ldap_dnfree(dn_ldap);
+	if (base_ldap != NULL)
+		ldap_dnfree(base_ldap);
+	if (suffix_outstr != NULL)
+		ldap_memfree(suffix_outstr);
+
+	return result;
+}
+
+/**
+ * Send zone events collected during SyncRepl refresh to the instance task
+ * and wait until they are processed.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_batch_flush(ldap_syncsess_t *sess)
+{
+	isc_result_t result;
+	ldap_syncreplevent_t *batch = NULL;
+	isc_task_t *task = NULL;
+
+	if (sess->zone_batch == NULL)
+		return ISC_R_SUCCESS;
+
+	batch = sess->zone_batch;
+	sess->zone_batch = NULL;
+	log_debug(5, "flushing batch of %u zone events", sess->zone_batch_len);
+	sess->zone_batch_len = 0;
+
+	isc_task_attach(sess->inst->task, &task);
+	CHECK(sync_event_send(sess->sctx, task, &batch, ISC_TRUE));
+
+cleanup:
+	if (batch != NULL) {
+		/* Event was not sent */
+		log_error_r("unable to process batch of zone events");
+		zone_batch_destroy(sess, &batch);
+		isc_task_detach(&task);
+	}
+	return result;
+}
+
+/**
+ * Append zone event to the batch. The batch has to be sent by
+ * zone_batch_flush() when it is full or before any other event.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_batch_add(ldap_syncsess_t *sess, ldap_syncreplevent_t **peventp)
+{
+	ldap_instance_t *inst = sess->inst;
+	ldap_syncreplevent_t *batch = sess->zone_batch;
+
+	if (batch == NULL) {
+		batch = (ldap_syncreplevent_t *)isc_event_allocate(inst->mctx,
+					inst, LDAPDB_EVENT_SYNCREPL_UPDATE,
+					update_zone_batch, NULL,
+					sizeof(ldap_syncreplevent_t));
+		if (batch == NULL)
+			return ISC_R_NOMEMORY;
+		batch->mctx = NULL;
+		isc_mem_attach(inst->mctx, &batch->mctx);
+		batch->inst = inst;
+		batch->sess = sess;
+		batch->prevdn = NULL;
+		batch->chgtype = 0;
+		batch->entry = NULL;
+		INIT_LIST(batch->batch);
+		INIT_LINK(batch, batch_link);
+		sess->zone_batch = batch;
+	}
+
+	APPEND(batch->batch, *peventp, batch_link);
+	*peventp = NULL;
+	sess->zone_batch_len++;
+
+	return ISC_R_SUCCESS;
 }
 
 /**
@@ -4094,9 +8634,10 @@ cleanup:
  * @post entryp is NULL.
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-syncrepl_update(ldap_instance_t *inst, ldap_entry_t **entryp, int chgtype)
+syncrepl_update(ldap_syncsess_t *sess, ldap_entry_t **entryp, int chgtype)
 {
 	isc_result_t result = ISC_R_SUCCESS;
+	ldap_instance_t *inst = sess->inst;
 	ldap_syncreplevent_t *pevent = NULL;
 	ldap_entry_t *entry = NULL;
 	dns_name_t *zone_name = NULL;
@@ -4105,6 +8646,8 @@ syncrepl_update(ldap_instance_t *inst, ldap_entry_t **entryp, int chgtype)
 	isc_taskaction_t action = NULL;
 	isc_task_t *task = NULL;
 	isc_boolean_t synchronous;
+	settings_set_t *zone_settings = NULL;
+	isc_boolean_t active;
 
 	REQUIRE(entryp != NULL);
 	entry = *entryp;
@@ -4119,6 +8662,33 @@ syncrepl_update(ldap_instance_t *inst, ldap_entry_t **entryp, int chgtype)
 	else
 		zone_name = &entry->zone_name;
 
+	/* Zones from pending batch have to exist before anything else
+	 * is processed. */
+	if ((entry->class
+	    & (LDAP_ENTRYCLASS_MASTER | LDAP_ENTRYCLASS_FORWARD)) == 0)
+		CHECK(zone_batch_flush(sess));
+
+	/* Records of inactive zones are tracked only in metaLDAP,
+	 * zone_resync() reads them when the zone is activated.
+	 * Deletions have to go through because the zone could have been
+	 * active before. */
+	if ((entry->class & LDAP_ENTRYCLASS_RR) != 0 &&
+	    (entry->class & LDAP_ENTRYCLASS_MASTER) == 0 &&
+	    !SYNCREPL_DEL(chgtype)) {
+		CHECK(zr_get_zone_settings(inst->zone_register, zone_name,
+					   &zone_settings));
+		CHECK(setting_get_bool(SETTING_ACTIVE, zone_settings, &active));
+		if (active == ISC_FALSE) {
+			log_debug(5, "syncrepl_update: zone is inactive, "
+				  "skipping %s", ldap_entry_logname(entry));
+			/* no event will be sent */
+			sync_concurr_limit_signal(sess->sctx);
+			ldap_entry_destroy(entryp);
+			entry = NULL;
+			goto cleanup;
+		}
+	}
+
 	/* Process ordinary records in parallel but serialize operations on
 	 * master zone objects.
 	 * See discussion about run_exclusive_begin() function in lock.c. */
@@ -4172,24 +8742,38 @@ syncrepl_update(ldap_instance_t *inst, ldap_entry_t **entryp, int chgtype)
 	pevent->mctx = NULL;
 	isc_mem_attach(inst->mctx, &pevent->mctx);
 	pevent->inst = inst;
+	pevent->sess = sess;
 	pevent->prevdn = NULL;
 	pevent->chgtype = chgtype;
 	pevent->entry = entry;
+	INIT_LIST(pevent->batch);
+	INIT_LINK(pevent, batch_link);
+
+	if (action == update_zone && sess->zone_batch_enabled == ISC_TRUE) {
+		isc_task_detach(&task);
+		CHECK(zone_batch_add(sess, &pevent));
+		/* batch handler will deallocate the LDAP entry */
+		*entryp = NULL;
+		entry = NULL;
+		if (sess->zone_batch_len >= LDAP_ZONE_BATCH_SIZE)
+			CHECK(zone_batch_flush(sess));
+		goto cleanup;
+	}
 
 	/* Lock syncrepl queue to prevent zone, config and resource records
 	 * from racing with each other. */
-	CHECK(sync_event_send(inst->sctx, task, &pevent, synchronous));
+	CHECK(sync_event_send(sess->sctx, task, &pevent, synchronous));
 	*entryp = NULL; /* event handler will deallocate the LDAP entry */
 
 cleanup:
 	if (zone_ptr != NULL)
 		dns_zone_detach(&zone_ptr);
-	if (result != ISC_R_SUCCESS)
+	if (result != ISC_R_SUCCESS && entry != NULL)
 		log_error_r("syncrepl_update failed for %s",
 			    ldap_entry_logname(entry));
 	if (pevent != NULL) {
 		/* Event was not sent */
-		sync_concurr_limit_signal(inst->sctx);
+		sync_concurr_limit_signal(sess->sctx);
 		if (pevent->mctx != NULL)
 			isc_mem_detach(&pevent->mctx);
 		ldap_entry_destroy(entryp);
@@ -4199,6 +8783,33 @@ cleanup:
 	return result;
 }
 
+/**
+ * Decide if an entry belongs to a zone assigned to this instance.
+ *
+ * Zones are split by hash of the zone name so all servers configured with
+ * the same zone_shards value agree on the assignment without any
+ * coordination, see zone_shard_hash().
+ */
+static isc_boolean_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_shard_match(ldap_instance_t *inst, ldap_entryclass_t class,
+		 dns_name_t *fqdn, dns_name_t *zone_name) {
+	dns_name_t *name;
+
+	if (inst->zone_shards <= 1)
+		return ISC_TRUE;
+	if ((class & (LDAP_ENTRYCLASS_CONFIG | LDAP_ENTRYCLASS_SERVERCONFIG))
+	    != 0)
+		return ISC_TRUE;
+
+	if ((class & (LDAP_ENTRYCLASS_MASTER | LDAP_ENTRYCLASS_FORWARD)) != 0)
+		name = fqdn;
+	else
+		name = zone_name;
+
+	return ISC_TF(zone_shard_hash(name) % inst->zone_shards
+		      == inst->zone_shard_index);
+}
+
 #define CHECK_EXIT \
 	do { \
 		if (inst->exiting) \
@@ -4269,49 +8880,67 @@ ldap_sync_search_reference (
 	return LDAP_SUCCESS;
 }
 
-/*
- * Called when an entry is returned by ldap_sync_init()/ldap_sync_poll().
- * If phase is LDAP_SYNC_CAPI_ADD or LDAP_SYNC_CAPI_MODIFY,
- * the entry has been either added or modified, and thus
- * the complete view of the entry should be in the LDAPMessage.
- * If phase is LDAP_SYNC_CAPI_PRESENT or LDAP_SYNC_CAPI_DELETE,
- * only the DN should be in the LDAPMessage.
+/**
+ * Update metaDB and send event for one entry from SyncRepl session
+ * or from plain search done by ldap_sync_search_plain().
+ *
+ * @param[in] ld    LDAP handle msg was received from.
+ * @param[in] phase LDAP_SYNC_CAPI_ADD, LDAP_SYNC_CAPI_MODIFY or
+ *                  LDAP_SYNC_CAPI_DELETE.
  */
-int ldap_sync_search_entry (
-	ldap_sync_t			*ls,
-	LDAPMessage			*msg,
-	struct berval			*entryUUID,
-	ldap_sync_refresh_t		phase ) {
-
-	ldap_instance_t *inst = ls->ls_private;
+static void ATTR_NONNULLS
+sync_entry_process(ldap_syncsess_t *sess, LDAP *ld, LDAPMessage *msg,
+		   struct berval *entryUUID, ldap_sync_refresh_t phase) {
+	ldap_instance_t *inst = sess->inst;
 	ldap_entry_t *old_entry = NULL;
 	ldap_entry_t *new_entry = NULL;
+	ldap_entry_t *failed_entry;
 	isc_result_t result;
-	metadb_node_t *node = NULL;
 	isc_boolean_t mldap_open = ISC_FALSE;
 	isc_boolean_t modrdn = ISC_FALSE;
+	ldap_entryclass_t class;
 
 #ifdef RBTDB_DEBUG
 	static unsigned int count = 0;
 #endif
 
 	if (inst->exiting)
-		return LDAP_SUCCESS;
+		return;
 
-	CHECK(mldap_newversion(inst->mldapdb));
+	CHECK(mldap_newversion(sess->mldapdb));
 	mldap_open = ISC_TRUE;
 
-	CHECK(sync_concurr_limit_wait(inst->sctx));
+	CHECK(sync_concurr_limit_wait(sess->sctx));
 	log_debug(20, "ldap_sync_search_entry phase: %x", phase);
 
+	/* Entries from zones assigned to other servers are not in metaDB */
+	if (inst->zone_shards > 1 &&
+	    (phase == LDAP_SYNC_CAPI_DELETE || phase == LDAP_SYNC_CAPI_MODIFY)
+	    && mldap_entry_read(sess->mldapdb, entryUUID, &class, NULL, NULL)
+	       == ISC_R_NOTFOUND) {
+		if (phase == LDAP_SYNC_CAPI_DELETE)
+			goto skip;
+		phase = LDAP_SYNC_CAPI_ADD;
+	}
+
 	/* MODIFY can be rename: get old name from metaDB */
 	if (phase == LDAP_SYNC_CAPI_DELETE || phase == LDAP_SYNC_CAPI_MODIFY) {
-		CHECK(ldap_entry_reconstruct(inst->mctx, inst->mldapdb,
+		CHECK(ldap_entry_reconstruct(inst->mctx, sess->mldapdb,
 					     entryUUID, &old_entry));
 	}
 	if (phase == LDAP_SYNC_CAPI_ADD || phase == LDAP_SYNC_CAPI_MODIFY) {
-		CHECK(ldap_entry_parse(inst->mctx, ls->ls_ld, msg, entryUUID,
+		CHECK(ldap_entry_parse(inst->mctx, ld, msg, entryUUID,
 				       &new_entry));
+		if (zone_shard_match(inst, new_entry->class, &new_entry->fqdn,
+				     &new_entry->zone_name) == ISC_FALSE) {
+			log_debug(20, "%s: zone is assigned to another server",
+				  ldap_entry_logname(new_entry));
+			ldap_entry_destroy(&new_entry);
+			if (phase == LDAP_SYNC_CAPI_ADD)
+				goto skip;
+			/* entry was moved out of zones served by us */
+			phase = LDAP_SYNC_CAPI_DELETE;
+		}
 	}
 	/* detect type of modification */
 	if (phase == LDAP_SYNC_CAPI_MODIFY) {
@@ -4340,23 +8969,25 @@ int ldap_sync_search_entry (
 	}
 	if (phase == LDAP_SYNC_CAPI_DELETE || modrdn == ISC_TRUE) {
 		/* delete old entry from zone and metaDB */
-		CHECK(syncrepl_update(inst, &old_entry, LDAP_SYNC_CAPI_DELETE));
-		CHECK(mldap_entry_delete(inst->mldapdb, entryUUID));
+		CHECK(syncrepl_update(sess, &old_entry, LDAP_SYNC_CAPI_DELETE));
+		CHECK(mldap_entry_delete(sess->mldapdb, entryUUID));
 	}
 	if (phase == LDAP_SYNC_CAPI_ADD || phase == LDAP_SYNC_CAPI_MODIFY) {
 		/* store new state into metaDB */
-		CHECK(mldap_entry_create(new_entry, inst->mldapdb, &node));
 		if ((new_entry->class
 		    & (LDAP_ENTRYCLASS_CONFIG | LDAP_ENTRYCLASS_SERVERCONFIG))
 		    == 0)
-			CHECK(mldap_dnsname_store(&new_entry->fqdn,
-						  &new_entry->zone_name, node));
+			CHECK(mldap_entry_create(new_entry, sess->mldapdb,
+						 &new_entry->fqdn,
+						 &new_entry->zone_name));
+		else
+			CHECK(mldap_entry_create(new_entry, sess->mldapdb,
+						 NULL, NULL));
 		/* commit new entry into metaLDAP DB before something breaks */
-		metadb_node_close(&node);
-		mldap_closeversion(inst->mldapdb, ISC_TRUE);
+		mldap_closeversion(sess->mldapdb, ISC_TRUE);
 		mldap_open = ISC_FALSE;
 		/* re-add entry under new DN, if necessary */
-		CHECK(syncrepl_update(inst, &new_entry,
+		CHECK(syncrepl_update(sess, &new_entry,
 		                      (modrdn == ISC_TRUE)
 					      ? LDAP_SYNC_CAPI_ADD : phase));
 	}
@@ -4371,19 +9002,52 @@ int ldap_sync_search_entry (
 		log_info("ldap_sync_search_entry: %u entries read; inuse: %zd",
 			 count, isc_mem_inuse(inst->mctx));
 #endif
+	goto cleanup;
+
+skip:
+	/* no event will be sent */
+	sync_concurr_limit_signal(sess->sctx);
 
 cleanup:
-	metadb_node_close(&node);
 	if (mldap_open == ISC_TRUE)
 		/* commit metaDB changes if the syncrepl event was sent */
-		mldap_closeversion(inst->mldapdb, ISC_TF(result == ISC_R_SUCCESS));
+		mldap_closeversion(sess->mldapdb, ISC_TF(result == ISC_R_SUCCESS));
 	if (result != ISC_R_SUCCESS) {
 		log_error_r("ldap_sync_search_entry failed");
-		sync_concurr_limit_signal(inst->sctx);
-		/* TODO: Add 'tainted' flag to the LDAP instance. */
+		sync_concurr_limit_signal(sess->sctx);
+		/* change might be lost, read the whole zone again */
+		failed_entry = (new_entry != NULL) ? new_entry : old_entry;
+		if (failed_entry != NULL
+		    && (failed_entry->class & LDAP_ENTRYCLASS_RR) != 0
+		    && !ldap_instance_isexiting(inst)) {
+			result = ldap_zone_resync(inst,
+						  &failed_entry->zone_name);
+			if (result != ISC_R_SUCCESS
+			    && result != ISC_R_NOTFOUND)
+				log_error_r("%s: rndc reload might be "
+					    "necessary",
+					    ldap_entry_logname(failed_entry));
+		}
 	}
 	ldap_entry_destroy(&old_entry);
 	ldap_entry_destroy(&new_entry);
+}
+
+/*
+ * Called when an entry is returned by ldap_sync_init()/ldap_sync_poll().
+ * If phase is LDAP_SYNC_CAPI_ADD or LDAP_SYNC_CAPI_MODIFY,
+ * the entry has been either added or modified, and thus
+ * the complete view of the entry should be in the LDAPMessage.
+ * If phase is LDAP_SYNC_CAPI_PRESENT or LDAP_SYNC_CAPI_DELETE,
+ * only the DN should be in the LDAPMessage.
+ */
+int ldap_sync_search_entry (
+	ldap_sync_t			*ls,
+	LDAPMessage			*msg,
+	struct berval			*entryUUID,
+	ldap_sync_refresh_t		phase ) {
+
+	sync_entry_process(ls->ls_private, ls->ls_ld, msg, entryUUID, phase);
 
 	/* Following return code will never reach upper layers.
 	 * It is limitation in ldap_sync_init() and ldap_sync_poll()
@@ -4414,8 +9078,9 @@ int ldap_sync_intermediate (
 	ldap_sync_refresh_t		phase ) {
 
 	isc_result_t	result;
-	ldap_instance_t *inst = ls->ls_private;
-	metadb_iter_t *mldap_iter = NULL;
+	ldap_syncsess_t *sess = ls->ls_private;
+	ldap_instance_t *inst = sess->inst;
+	mldap_iter_t *mldap_iter = NULL;
 	char entryUUID_buf[16];
 	struct berval entryUUID = { .bv_len = sizeof(entryUUID_buf),
 				    .bv_val = entryUUID_buf };
@@ -4431,20 +9096,31 @@ int ldap_sync_intermediate (
 	if (phase != LDAP_SYNC_CAPI_DONE)
 		goto cleanup;
 
-	sync_state_get(inst->sctx, &state);
+	/* refresh is done, process zone changes one by one from now on */
+	sess->zone_batch_enabled = ISC_FALSE;
+	result = zone_batch_flush(sess);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	/* each session activates zones from its own subtree */
+	sync_state_get(sess->sctx, &state);
 	if (state == sync_datainit) {
-		result = sync_barrier_wait(inst->sctx, inst);
+		result = sync_barrier_wait(sess->sctx, inst);
 		if (result != ISC_R_SUCCESS) {
-			log_error_r("%s: sync_barrier_wait() failed for "
-				    "instance '%s'", __func__, inst->db_name);
+			log_error_r("%s: sync_barrier_wait() failed "
+				    "for instance '%s'", __func__,
+				    inst->db_name);
 			goto cleanup;
 		}
+		if (sess->primary == ISC_FALSE)
+			log_info("LDAP data from '%s' for instance '%s' "
+				 "synchronized", sess->base, inst->db_name);
 	}
 
-	for (result = mldap_iter_deadnodes_start(inst->mldapdb, &mldap_iter,
+	for (result = mldap_iter_deadnodes_start(sess->mldapdb, &mldap_iter,
 						 &entryUUID);
 	     result == ISC_R_SUCCESS;
-	     result = mldap_iter_deadnodes_next(inst->mldapdb, &mldap_iter,
+	     result = mldap_iter_deadnodes_next(sess->mldapdb, &mldap_iter,
 					        &entryUUID)) {
 		ldap_sync_search_entry(ls, NULL, &entryUUID,
 				       LDAP_SYNC_CAPI_DELETE);
@@ -4468,7 +9144,8 @@ int ATTR_NONNULLS ATTR_CHECKRESULT ldap_sync_search_result (
 	LDAPMessage			*msg,
 	int				refreshDeletes ) {
 	isc_result_t	result;
-	ldap_instance_t *inst = ls->ls_private;
+	ldap_syncsess_t *sess = ls->ls_private;
+	ldap_instance_t *inst = sess->inst;
 	sync_state_t state;
 
 	UNUSED(msg);
@@ -4476,7 +9153,8 @@ int ATTR_NONNULLS ATTR_CHECKRESULT ldap_sync_search_result (
 
 	log_debug(1, "ldap_sync_search_result");
 
-	if (inst->exiting)
+	/* additional sessions do not synchronize configuration */
+	if (inst->exiting || sess->primary == ISC_FALSE)
 		goto cleanup;
 
 	/* This place can be reached only if:
@@ -4523,18 +9201,18 @@ ldap_sync_cleanup(ldap_sync_t **ldap_syncp) {
  * @param[in]  filter  LDAP filter to be used in SyncRepl session
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_sync_prepare(ldap_instance_t *inst, settings_set_t *settings,
-		  const char *filter, ldap_connection_t *conn,
-		  ldap_sync_t **ldap_syncp) {
+ldap_sync_prepare(ldap_syncsess_t *sess, const char *filter,
+		  ldap_connection_t *conn, ldap_sync_t **ldap_syncp) {
 	isc_result_t result;
-	const char *base = NULL;
 	ldap_sync_t *ldap_sync = NULL;
 
-	REQUIRE(inst != NULL);
+	REQUIRE(sess != NULL);
 	REQUIRE(ldap_syncp != NULL && *ldap_syncp == NULL);
 
-	/* Remove stale zone & journal files. */
-	CHECK(cleanup_files(inst));
+	/* Remove stale zone & journal files. Files of zones from other
+	 * sessions are in use. */
+	if (sess->primary == ISC_TRUE)
+		CHECK(cleanup_files(sess->inst));
 
 	if(conn->handle == NULL)
 		CLEANUP_WITH(ISC_R_NOTCONNECTED);
@@ -4546,8 +9224,7 @@ ldap_sync_prepare(ldap_instance_t *inst, settings_set_t *settings,
 	}
 	ZERO_PTR(ldap_sync);
 
-	CHECK(setting_get_str("base", settings, &base));
-	ldap_sync->ls_base = ldap_strdup(base);
+	ldap_sync->ls_base = ldap_strdup(sess->base);
 	if (ldap_sync->ls_base == NULL)
 		CLEANUP_WITH(ISC_R_NOMEMORY);
 	ldap_sync->ls_scope = LDAP_SCOPE_SUBTREE;
@@ -4564,7 +9241,7 @@ ldap_sync_prepare(ldap_instance_t *inst, settings_set_t *settings,
 	ldap_sync->ls_search_reference = ldap_sync_search_reference;
 	ldap_sync->ls_intermediate = ldap_sync_intermediate;
 	ldap_sync->ls_search_result = ldap_sync_search_result;
-	ldap_sync->ls_private = inst;
+	ldap_sync->ls_private = sess;
 
 	result = ISC_R_SUCCESS;
 	*ldap_syncp = ldap_sync;
@@ -4586,7 +9263,8 @@ cleanup:
  * @param[in]  filter_objcs  LDAP filter specifying objects which should
  *                           be retrieved during this session. The supplied
  *                           filter will be ORed filter specifying configuration
- *                           objects which always need to be retrieved.
+ *                           objects which always need to be retrieved
+ *                           by the primary session.
  * @param[in]  mode          LDAP_SYNC_REFRESH_AND_PERSIST
  *                           or LDAP_SYNC_REFRESH_ONLY
  *
@@ -4596,9 +9274,10 @@ cleanup:
  * @retval others             Errors, some events might or might not be sent.
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_sync_doit(ldap_instance_t *inst, ldap_connection_t *conn,
+ldap_sync_doit(ldap_syncsess_t *sess, ldap_connection_t *conn,
 	       const char * const filter_objcs, int mode) {
 	isc_result_t result;
+	ldap_instance_t *inst = sess->inst;
 	int ret;
 	ldap_sync_t *ldap_sync = NULL;
 	const char *err_hint = "";
@@ -4611,9 +9290,14 @@ ldap_sync_doit(ldap_instance_t *inst, ldap_connection_t *conn,
 		")";
 	const char *server_id = NULL;
 
-	/* request idnsServerConfig object only if server_id is specified */
-	CHECK(setting_get_str("server_id", inst->server_ldap_settings, &server_id));
-	if (strlen(server_id) == 0)
+	/* additional sessions do not request configuration objects,
+	 * request idnsServerConfig object only if server_id is specified */
+	CHECK(setting_get_str(SETTING_SERVER_ID, inst->server_ldap_settings,
+			      &server_id));
+	if (sess->primary == ISC_FALSE)
+		CHECK(isc_string_printf(filter, sizeof(filter), "%s",
+					filter_objcs));
+	else if (strlen(server_id) == 0)
 		CHECK(isc_string_printf(filter, sizeof(filter), config_template,
 				        "", "", "", filter_objcs));
 	else
@@ -4622,8 +9306,7 @@ ldap_sync_doit(ldap_instance_t *inst, ldap_connection_t *conn,
 				        "    (idnsServerId=", server_id, "))",
 					filter_objcs));
 
-	result = ldap_sync_prepare(inst, inst->server_ldap_settings,
-				   filter, conn, &ldap_sync);
+	result = ldap_sync_prepare(sess, filter, conn, &ldap_sync);
 	if (result != ISC_R_SUCCESS) {
 		log_error_r("ldap_sync_prepare() failed, retrying "
 			    "in 1 second");
@@ -4631,6 +9314,8 @@ ldap_sync_doit(ldap_instance_t *inst, ldap_connection_t *conn,
 		goto cleanup;
 	}
 
+	/* zone events from refresh phase are processed in batches */
+	sess->zone_batch_enabled = ISC_TF(mode == LDAP_SYNC_REFRESH_AND_PERSIST);
 	ret = ldap_sync_init(ldap_sync, mode);
 	/* TODO: error handling, set tainted flag & do full reload? */
 	if (ret != LDAP_SUCCESS) {
@@ -4657,10 +9342,340 @@ ldap_sync_doit(ldap_instance_t *inst, ldap_connection_t *conn,
 	}
 
 cleanup:
+	/* do not lose zone events received before the session ended */
+	sess->zone_batch_enabled = ISC_FALSE;
+	if (zone_batch_flush(sess) != ISC_R_SUCCESS)
+		log_error("zone changes received before end of SyncRepl "
+			  "session were not processed");
 	ldap_sync_cleanup(&ldap_sync);
 	return result;
 }
 
+#define LDAPDB_EVENT_ZONE_READY	(LDAPDB_EVENTCLASS + 8)
+
+/**
+ * Event signalling that all records of a zone from per-zone synchronization
+ * were processed. It travels through the zone task to the instance task.
+ */
+typedef struct ldap_zonereadyev ldap_zonereadyev_t;
+struct ldap_zonereadyev {
+	ISC_EVENT_COMMON(ldap_zonereadyev_t);
+	ldap_instance_t	*inst;
+	dns_fixedname_t	name;
+};
+
+/**
+ * Activate zones collected by zone_ready_publish(). Runs on the instance
+ * task, zones are published in batches by activate_zone() and loaded
+ * by their own tasks.
+ */
+static void ATTR_NONNULLS
+zone_ready_activate(isc_task_t *task, isc_event_t *event) {
+	ldap_zonereadyev_t *zevent = (ldap_zonereadyev_t *)event;
+	ldap_instance_t *inst = zevent->inst;
+	zone_sync_list_t zones;
+	zone_sync_item_t *item;
+	dns_name_t *name;
+	isc_result_t result;
+	settings_set_t *zone_settings;
+	isc_boolean_t active;
+	dns_zone_t *zone_in_view;
+	activation_batch_t batch = ACTIVATION_BATCH_INIT;
+	zone_activation_t *za = NULL;
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	INSIST(task == inst->task); /* For task-exclusive mode */
+
+	zones = inst->zones_ready;
+	INIT_LIST(inst->zones_ready);
+	inst->zones_ready_queued = ISC_FALSE;
+
+	if (inst->exiting)
+		CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
+
+	CHECK(zone_activation_create(inst, &za));
+	for (item = HEAD(zones); item != NULL; item = NEXT(item, link)) {
+		name = dns_fixedname_name(&item->name);
+		/* re-synchronization of a zone which is already served */
+		zone_in_view = NULL;
+		if (dns_view_findzone(inst->view, name, &zone_in_view)
+		    == ISC_R_SUCCESS) {
+			dns_zone_detach(&zone_in_view);
+			continue;
+		}
+		zone_settings = NULL;
+		result = zr_get_zone_settings(inst->zone_register, name,
+					      &zone_settings);
+		if (result == ISC_R_SUCCESS)
+			result = setting_get_bool(SETTING_ACTIVE,
+						  zone_settings, &active);
+		if (result != ISC_R_SUCCESS) {
+			dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+			log_error_r("zone '%s': early activation failed, zone "
+				    "will be activated after initial "
+				    "synchronization", zone_name);
+			continue;
+		}
+
+		LOCK(&za->lock);
+		++za->total_cnt;
+		if (active == ISC_TRUE)
+			++za->active_cnt;
+		UNLOCK(&za->lock);
+		if (active == ISC_TRUE)
+			activation_batch_add(task, inst, &batch, name,
+					     zone_settings, za);
+	}
+	activation_batch_end(inst, &batch);
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	if (result != ISC_R_SUCCESS && result != ISC_R_SHUTTINGDOWN)
+		log_error_r("early activation failed, zones will be "
+			    "activated after initial synchronization");
+	if (za != NULL)
+		zone_activation_detach(&za, NULL, ISC_FALSE);
+	zone_sync_list_free(inst->mctx, &zones);
+	isc_event_free(&event);
+}
+
+/**
+ * Queue zone which was synchronized by ldap_sync_zones() or re-activated
+ * zone which was re-synchronized by zone_resync() for activation.
+ * The first zone schedules zone_ready_activate() behind events which are
+ * already waiting for the instance task so zones which become ready
+ * at the same time share exclusive sections.
+ */
+static void ATTR_NONNULLS
+zone_ready_publish(isc_task_t *task, isc_event_t *event) {
+	ldap_zonereadyev_t *zevent = (ldap_zonereadyev_t *)event;
+	ldap_instance_t *inst = zevent->inst;
+	dns_name_t *name = dns_fixedname_name(&zevent->name);
+	zone_sync_item_t *item = NULL;
+	isc_result_t result;
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	INSIST(task == inst->task); /* zones_ready is not locked */
+
+	if (inst->exiting)
+		CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
+
+	CHECKED_MEM_GET_PTR(inst->mctx, item);
+	ZERO_PTR(item);
+	INIT_LINK(item, link);
+	dns_fixedname_init(&item->name);
+	CHECK(dns_name_copy(name, dns_fixedname_name(&item->name), NULL));
+	APPEND(inst->zones_ready, item, link);
+	item = NULL;
+
+	if (inst->zones_ready_queued == ISC_FALSE) {
+		inst->zones_ready_queued = ISC_TRUE;
+		event->ev_action = zone_ready_activate;
+		isc_task_send(task, &event);
+		return;
+	}
+
+cleanup:
+	if (result != ISC_R_SUCCESS && result != ISC_R_SHUTTINGDOWN) {
+		dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+		log_error_r("zone '%s': early activation failed, zone will be "
+			    "activated after initial synchronization",
+			    zone_name);
+	}
+	if (item != NULL)
+		SAFE_MEM_PUT_PTR(inst->mctx, item);
+	isc_event_free(&event);
+}
+
+/**
+ * All record events sent to the zone task before this event were
+ * processed so the zone data are complete. Pass the event to
+ * the instance task which can publish the zone.
+ */
+static void ATTR_NONNULLS
+zone_ready_forward(isc_task_t *task, isc_event_t *event) {
+	ldap_zonereadyev_t *zevent = (ldap_zonereadyev_t *)event;
+
+	UNUSED(task);
+
+	event->ev_action = zone_ready_publish;
+	isc_task_send(zevent->inst->task, &event);
+}
+
+/**
+ * Activate zone after all record events which were already sent
+ * to the zone task are processed.
+ */
+static isc_result_t
+zone_ready_send(ldap_instance_t *inst, dns_name_t *name) {
+	isc_result_t result;
+	dns_zone_t *raw = NULL;
+	isc_task_t *task = NULL;
+	ldap_zonereadyev_t *zevent = NULL;
+
+	/* zone task processes events in FIFO order so the marker
+	 * comes after all records of the zone */
+	CHECK(zr_get_zone_ptr(inst->zone_register, name, &raw, NULL));
+	zevent = (ldap_zonereadyev_t *)isc_event_allocate(inst->mctx,
+				inst, LDAPDB_EVENT_ZONE_READY,
+				zone_ready_forward, NULL,
+				sizeof(ldap_zonereadyev_t));
+	if (zevent == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+	zevent->inst = inst;
+	dns_fixedname_init(&zevent->name);
+	CHECK(dns_name_copy(name, dns_fixedname_name(&zevent->name), NULL));
+	dns_zone_gettask(raw, &task);
+	isc_task_send(task, (isc_event_t **)&zevent);
+	isc_task_detach(&task);
+
+cleanup:
+	if (zevent != NULL)
+		isc_event_free((isc_event_t **)&zevent);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	return result;
+}
+
+/**
+ * Read all entries matching filter from subtree and process them
+ * as if they were delivered by SyncRepl refresh. Entries are read
+ * in pages so server size limit does not apply and each page is
+ * processed as soon as it arrives.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_sync_search_plain(ldap_syncsess_t *sess, ldap_connection_t *conn,
+		       const char *base, const char *filter) {
+	isc_result_t result;
+	ldap_instance_t *inst = sess->inst;
+	struct berval cookie = { 0, NULL };
+	LDAPMessage *msg = NULL;
+	LDAPMessage *entry;
+	uuid_t uuid;
+	struct berval entryUUID = { .bv_len = sizeof(uuid),
+				    .bv_val = (char *)uuid };
+
+	if (conn->handle == NULL)
+		CLEANUP_WITH(ISC_R_NOTCONNECTED);
+
+	do {
+		if (inst->exiting)
+			CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
+		CHECK(ldap_search_page(conn->handle, base, filter, &cookie,
+				       &msg));
+		for (entry = ldap_first_entry(conn->handle, msg);
+		     entry != NULL && !inst->exiting;
+		     entry = ldap_next_entry(conn->handle, entry)) {
+			CHECK(ldap_entry_uuid_read(conn->handle, entry, base,
+						   uuid));
+			sync_entry_process(sess, conn->handle, entry,
+					   &entryUUID, LDAP_SYNC_CAPI_ADD);
+		}
+		ldap_msgfree(msg);
+		msg = NULL;
+	} while (cookie.bv_len > 0);
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	if (cookie.bv_val != NULL)
+		ber_memfree(cookie.bv_val);
+	if (msg != NULL)
+		ldap_msgfree(msg);
+	return result;
+}
+
+/**
+ * Read all records of a zone and publish the zone when the records
+ * are processed by the zone task.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_records_sync(ldap_syncsess_t *sess, ldap_connection_t *conn,
+		  zone_sync_item_t *item) {
+	isc_result_t result;
+
+	/* zone object itself is already processed */
+	CHECK(ldap_sync_search_plain(sess, conn, item->dn,
+				     "(&(objectClass=idnsRecord)"
+				     "  (!(objectClass=idnsZone)))"));
+	CHECK(zone_ready_send(sess->inst, dns_fixedname_name(&item->name)));
+
+cleanup:
+	return result;
+}
+
+/**
+ * Synchronize zone objects and then records zone by zone. Each zone is
+ * published as soon as its own records are processed so time-to-serve
+ * of small zones does not depend on the largest zone.
+ *
+ * Regular SyncRepl refresh follows and delivers all entries again.
+ * Zones which could not be activated here are activated when the initial
+ * synchronization is finished.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_sync_zones(ldap_syncsess_t *sess, ldap_connection_t *conn) {
+	isc_result_t result;
+	ldap_instance_t *inst = sess->inst;
+	rbt_iterator_t *iter = NULL;
+	DECLARE_BUFFERED_NAME(name);
+	zone_sync_list_t zones;
+	zone_sync_item_t *item = NULL;
+	const char *dn;
+	isc_boolean_t insubtree;
+	unsigned int zone_cnt = 0;
+
+	INIT_LIST(zones);
+
+	sess->zone_batch_enabled = ISC_TRUE;
+	result = ldap_sync_search_plain(sess, conn, sess->base,
+					"(|(objectClass=idnsZone)"
+					"  (objectClass=idnsForwardZone))");
+	sess->zone_batch_enabled = ISC_FALSE;
+	if (result == ISC_R_SUCCESS)
+		result = zone_batch_flush(sess);
+	else
+		(void)zone_batch_flush(sess);
+	CHECK(result);
+
+	/* Copy zone list, iterator cannot be held during LDAP searches. */
+	INIT_BUFFERED_NAME(name);
+	for (result = zr_rbt_iter_init(inst->zone_register, &iter, &name);
+	     result == ISC_R_SUCCESS;
+	     dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
+		dn = NULL;
+		CHECK(zr_get_zone_dn(inst->zone_register, &name, &dn));
+		/* records from other sessions would end up in wrong metaDB */
+		CHECK(ldap_dn_insubtree(dn, sess->base, &insubtree));
+		if (insubtree == ISC_FALSE)
+			continue;
+		CHECKED_MEM_GET_PTR(inst->mctx, item);
+		ZERO_PTR(item);
+		INIT_LINK(item, link);
+		dns_fixedname_init(&item->name);
+		APPEND(zones, item, link);
+		CHECK(dns_name_copy(&name, dns_fixedname_name(&item->name),
+				    NULL));
+		CHECKED_MEM_STRDUP(inst->mctx, dn, item->dn);
+		item = NULL;
+	}
+	if (result != ISC_R_NOMORE && result != ISC_R_NOTFOUND)
+		goto cleanup;
+
+	for (item = HEAD(zones); item != NULL; item = NEXT(item, link)) {
+		CHECK_EXIT;
+		CHECK(zone_records_sync(sess, conn, item));
+		zone_cnt++;
+	}
+	log_info("%u zones from LDAP instance '%s' synchronized individually",
+		 zone_cnt, inst->db_name);
+
+cleanup:
+	if (iter != NULL)
+		rbt_iter_stop(&iter);
+	zone_sync_list_free(inst->mctx, &zones);
+	return result;
+}
+
 /*
  * NOTE:
  * Every blocking call in syncrepl_watcher thread must be preemptible.
@@ -4669,12 +9684,14 @@ static isc_threadresult_t
 ldap_syncrepl_watcher(isc_threadarg_t arg)
 {
 	ldap_instance_t *inst = (ldap_instance_t *)arg;
+	ldap_syncsess_t *sess = HEAD(inst->sessions);
 	ldap_connection_t *conn = NULL;
 	int ret;
 	isc_result_t result;
 	sigset_t sigset;
 	isc_uint32_t reconnect_interval;
 	sync_state_t state;
+	isc_boolean_t per_zone_sync;
 
 	log_debug(1, "Entering ldap_syncrepl_watcher");
 
@@ -4703,7 +9720,7 @@ ldap_syncrepl_watcher(isc_threadarg_t arg)
 		}
 		/* synchronize configuration first so configuration variables
 		 * are already available during data processing */
-		result = ldap_sync_doit(inst, conn, "", LDAP_SYNC_REFRESH_ONLY);
+		result = ldap_sync_doit(sess, conn, "", LDAP_SYNC_REFRESH_ONLY);
 		if (result != ISC_R_SUCCESS) {
 			log_error_r("LDAP configuration synchronization failed");
 			goto retry;
@@ -4719,11 +9736,20 @@ ldap_syncrepl_watcher(isc_threadarg_t arg)
 		sync_state_get(inst->sctx, &state);
 		if (state != sync_finished)
 			CHECK(sync_task_add(inst->sctx, inst->task));
-		mldap_cur_generation_bump(inst->mldapdb);
+		CHECK(setting_get_bool(SETTING_PER_ZONE_SYNC,
+				       inst->local_settings, &per_zone_sync));
+		if (state == sync_datainit && per_zone_sync == ISC_TRUE) {
+			result = ldap_sync_zones(sess, conn);
+			if (result != ISC_R_SUCCESS)
+				log_error_r("per-zone synchronization failed, "
+					    "zones will be activated after "
+					    "initial synchronization");
+		}
+		mldap_cur_generation_bump(sess->mldapdb);
 		log_info("LDAP data for instance '%s' are being synchronized, "
 			 "please ignore message 'all zones loaded'",
 			 inst->db_name);
-		result = ldap_sync_doit(inst, conn,
+		result = ldap_sync_doit(sess, conn,
 				        "(|(objectClass=idnsZone)"
 					"  (objectClass=idnsForwardZone)"
 					"  (objectClass=idnsRecord))",
@@ -4739,7 +9765,7 @@ retry:
 		/* Try to connect. */
 		while (conn->handle == NULL) {
 			CHECK_EXIT;
-			CHECK(setting_get_uint("reconnect_interval",
+			CHECK(setting_get_uint(SETTING_RECONNECT_INTERVAL,
 					       inst->server_ldap_settings,
 					       &reconnect_interval));
 
@@ -4760,6 +9786,93 @@ cleanup:
 	return (isc_threadresult_t)0;
 }
 
+/*
+ * Thread of additional SyncRepl session. It synchronizes only data
+ * from its own base, configuration is synchronized by the watcher.
+ * The session waits until the watcher finishes initial configuration
+ * synchronization and then goes through its own data barrier,
+ * see ldap_sync_intermediate().
+ *
+ * NOTE:
+ * Every blocking call in this thread must be preemptible.
+ */
+static isc_threadresult_t
+ldap_syncrepl_session(isc_threadarg_t arg)
+{
+	ldap_syncsess_t *sess = (ldap_syncsess_t *)arg;
+	ldap_instance_t *inst = sess->inst;
+	ldap_connection_t *conn = NULL;
+	int ret;
+	isc_result_t result;
+	sigset_t sigset;
+	isc_uint32_t reconnect_interval;
+	sync_state_t state;
+
+	log_debug(1, "Entering SyncRepl session for '%s'", sess->base);
+
+	install_usr1handler();
+
+	/* see ldap_syncrepl_watcher() */
+	sigemptyset(&sigset);
+	sigaddset(&sigset, SIGUSR1);
+	ret = pthread_sigmask(SIG_UNBLOCK, &sigset, NULL);
+	/* pthread_sigmask fails only due invalid args */
+	RUNTIME_CHECK(ret == 0);
+
+	/* Pick connection, one is reserved purely for this thread */
+	CHECK(ldap_pool_getconnection(inst->pool, &conn));
+
+	while (!inst->exiting) {
+		sync_state_get(sess->sctx, &state);
+		if (state != sync_finished) {
+			/* configuration variables have to be available
+			 * during data processing */
+			log_debug(1, "SyncRepl session for '%s' waits for "
+				  "configuration synchronization", sess->base);
+			CHECK(sync_state_wait(inst->sctx, sync_datainit));
+			sync_state_reset(sess->sctx);
+			/* this session does not synchronize configuration,
+			 * the configuration barrier is passed immediately */
+			CHECK(sync_task_add(sess->sctx, inst->task));
+			CHECK(sync_barrier_wait(sess->sctx, inst));
+			CHECK(sync_task_add(sess->sctx, inst->task));
+		}
+		mldap_cur_generation_bump(sess->mldapdb);
+		result = ldap_sync_doit(sess, conn,
+				        "(|(objectClass=idnsZone)"
+					"  (objectClass=idnsForwardZone)"
+					"  (objectClass=idnsRecord))",
+					LDAP_SYNC_REFRESH_AND_PERSIST);
+		if (result != ISC_R_SUCCESS)
+			log_error_r("LDAP data synchronization from '%s' failed",
+				    sess->base);
+
+		CHECK_EXIT;
+
+		/* Try to connect. */
+		while (conn->handle == NULL) {
+			CHECK_EXIT;
+			CHECK(setting_get_uint(SETTING_RECONNECT_INTERVAL,
+					       inst->server_ldap_settings,
+					       &reconnect_interval));
+
+			log_error("SyncRepl session for '%s' will reconnect "
+				  "in %d second%s", sess->base,
+				  reconnect_interval,
+				  reconnect_interval == 1 ? "": "s");
+			if (!sane_sleep(inst, reconnect_interval))
+				CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
+			handle_connection_error(inst, conn, ISC_TRUE);
+		}
+	}
+
+cleanup:
+	log_debug(1, "Ending SyncRepl session for '%s'", sess->base);
+	ldap_pool_putconnection(inst->pool, &conn);
+
+	return (isc_threadresult_t)0;
+}
+
 settings_set_t *
 ldap_instance_getsettings_local(ldap_instance_t *ldap_inst)
 {
@@ -4784,6 +9897,12 @@ ldap_instance_getzr(ldap_instance_t *ldap_inst)
 	return ldap_inst->zone_register;
 }
 
+fwd_cache_t *
+ldap_instance_getfwdcache(ldap_instance_t *ldap_inst)
+{
+	return ldap_inst->fwd_cache;
+}
+
 isc_task_t *
 ldap_instance_gettask(ldap_instance_t *ldap_inst)
 {
@@ -45,6 +45,7 @@ new_ldap_instance(isc_mem_t *mctx, const char *db_name, const char *parameters,
 		  const char *file, unsigned long line,
 		  const dns_dyndbctx_t *dctx, ldap_instance_t **ldap_instp) ATTR_NONNULLS;
 void destroy_ldap_instance(ldap_instance_t **ldap_inst) ATTR_NONNULLS;
+void park_ldap_instance(ldap_instance_t **ldap_inst) ATTR_NONNULLS;
 
 isc_result_t
 ldap_delete_zone2(ldap_instance_t *inst, dns_name_t *name, isc_boolean_t lock)
@@ -84,7 +85,10 @@ const char * ldap_instance_getdbname(ldap_instance_t *ldap_inst) ATTR_NONNULLS;
 
 zone_register_t * ldap_instance_getzr(ldap_instance_t *ldap_inst) ATTR_NONNULLS;
 
-isc_result_t activate_zones(isc_task_t *task, ldap_instance_t *inst) ATTR_NONNULLS;
+fwd_cache_t * ldap_instance_getfwdcache(ldap_instance_t *ldap_inst) ATTR_NONNULLS;
+
+isc_result_t activate_zones(isc_task_t *task, ldap_instance_t *inst,
+			    sync_ctx_t *sctx) ATTR_NONNULLS;
 
 isc_task_t * ldap_instance_gettask(ldap_instance_t *ldap_inst);
 
@@ -98,6 +102,18 @@ ldap_instance_untaint_start(ldap_instance_t *ldap_inst);
 isc_result_t
 ldap_instance_untaint_finish(ldap_instance_t *ldap_inst, unsigned int count);
 
+isc_result_t
+ldap_zone_resync(ldap_instance_t *inst, dns_name_t *name)
+		 ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+ldap_zone_mirror_update(ldap_instance_t *inst, dns_name_t *name) ATTR_NONNULLS;
+
+isc_result_t
+ldap_zone_import(ldap_instance_t *inst, dns_name_t *name,
+		 const char *filename, isc_boolean_t remove)
+		 ATTR_NONNULLS ATTR_CHECKRESULT;
+
 void
 ldap_instance_attachview(ldap_instance_t *ldap_inst, dns_view_t **view) ATTR_NONNULLS;
 
@@ -3,59 +3,313 @@
  *
  * Meta-database for LDAP-specific information which are not represented in
  * DNS data.
+ *
+ * Entries are stored in open-addressing hash table keyed by raw 16-byte
+ * entryUUID. Each slot is a fixed-size record. DNS names are stored
+ * in wire format in a separate arena shared by all records.
+ *
+ * The database is modified by the SyncRepl thread of its session and by
+ * zone re-synchronization, which uses mldap_trynewversion() so it never
+ * waits for the SyncRepl thread. Re-synchronization also backs off while
+ * the SyncRepl thread sweeps dead nodes, otherwise it could store again
+ * an entry which the sweep is about to delete. Changes done between mldap_newversion()
+ * and mldap_closeversion() are queued in a journal and applied at once when
+ * the version is committed, so readers never see partially applied changes
+ * and rollback is just a journal reset.
+ *
+ * Used records are also linked into an age list sorted by generation number:
+ * every store moves the record to the tail. Entries which were not refreshed
+ * in the current generation form a prefix of the list, so the sweep after
+ * SyncRepl refresh visits only dead entries and nothing else.
  */
 
 #include <ldap.h>
 #include <stddef.h>
-#include <uuid/uuid.h>
 
 #include <isc/boolean.h>
-#include <isc/net.h>
+#include <isc/buffer.h>
+#include <isc/mutex.h>
 #include <isc/refcount.h>
 #include <isc/result.h>
+#include <isc/rwlock.h>
 #include <isc/util.h>
 #include <isc/serial.h>
 
-#include <dns/db.h>
-#include <dns/dbiterator.h>
-#include <dns/enumclass.h>
 #include <dns/name.h>
-#include <dns/types.h>
-#include <dns/update.h>
+#include <dns/rbt.h>
 
 #include "ldap_entry.h"
-#include "metadb.h"
 #include "mldap.h"
 #include "util.h"
 
-/* name "ldap.uuid." */
-static unsigned char uuid_rootname_ndata[]
-	= { 4, 'u', 'u', 'i', 'd', 4, 'l', 'd', 'a', 'p', 0 };
-static unsigned char uuid_rootname_offsets[] = { 0, 5, 10 };
-static dns_name_t uuid_rootname =
-{
-	DNS_NAME_MAGIC,
-	uuid_rootname_ndata,
-	sizeof(uuid_rootname_ndata),
-	sizeof(uuid_rootname_offsets),
-	DNS_NAMEATTR_READONLY | DNS_NAMEATTR_ABSOLUTE,
-	uuid_rootname_offsets,
-	NULL,
-	{ (void *)-1, (void *)-1 },
-	{ NULL, NULL }
-};
+/** RFC 4530 section 2.1 format = 16 octets is required */
+#define MLDAP_UUID_LEN		16
+/** Initial number of slots in hash table, has to be power of 2. */
+#define MLDAP_INIT_SLOTS	1024
+/** Initial size of name arena in bytes. */
+#define MLDAP_INIT_ARENA	(64 * 1024)
+/** Initial number of operations in journal of a version. */
+#define MLDAP_INIT_JOURNAL	4
+/** Terminator for age list links. */
+#define MLDAP_NIL		ISC_UINT32_MAX
+
+typedef enum {
+	mldap_slot_empty = 0,	/**< never used, terminates probing */
+	mldap_slot_used,
+	mldap_slot_deleted	/**< tombstone, probing continues */
+} mldap_slot_state_t;
+
+/**
+ * Fixed-size record for one LDAP entry.
+ */
+typedef struct mldap_rec {
+	unsigned char		uuid[MLDAP_UUID_LEN];
+	isc_uint32_t		generation;
+	/** Age list links, i.e. slot indexes of neighbours or MLDAP_NIL. */
+	isc_uint32_t		older;
+	isc_uint32_t		newer;
+	/** Offset of FQDN followed by zone name in name arena. */
+	isc_uint32_t		names;
+	/** Length of both names in wire format, 0 if names are not stored. */
+	isc_uint16_t		names_len;
+	ldap_entryclass_t	class;
+	unsigned char		state;	/**< mldap_slot_state_t */
+} mldap_rec_t;
+
+/**
+ * Pending change in a version which was not committed yet.
+ * Names for stores are in journal_names buffer.
+ */
+typedef struct mldap_op {
+	isc_boolean_t		delete;
+	mldap_rec_t		rec;	/**< names is offset in journal_names */
+} mldap_op_t;
+
+/** List of used records sorted from the oldest generation to the newest. */
+typedef struct mldap_agelist {
+	isc_uint32_t		oldest;
+	isc_uint32_t		newest;
+} mldap_agelist_t;
 
 struct mldapdb {
 	isc_mem_t	*mctx;
-	metadb_t	*mdb;
 	isc_refcount_t	generation;
+
+	/** Guards slots and arena. Readers never wait for the SyncRepl
+	 *  thread longer than it takes to apply one committed version. */
+	isc_rwlock_t	lock;
+	mldap_rec_t	*slots;
+	isc_uint32_t	nslots;		/**< always power of 2 */
+	isc_uint32_t	used;		/**< slots in state used */
+	isc_uint32_t	deleted;	/**< slots in state deleted */
+	mldap_agelist_t	age;
+
+	unsigned char	*arena;
+	isc_uint32_t	arena_size;
+	isc_uint32_t	arena_used;
+	/** Bytes in arena which belong to deleted or replaced records. */
+	isc_uint32_t	arena_garbage;
+
+	/**
+	 * Guard for journal. Only one version can be open for writing
+	 * at any time. See functions newversion and closeversion.
+	 */
+	isc_mutex_t	newversion_lock;
+	isc_boolean_t	version_open;
+	/** Dead node iteration is in progress, see mldap_trynewversion(). */
+	isc_boolean_t	sweeping;
+	mldap_op_t	*journal;
+	unsigned int	journal_size;
+	unsigned int	journal_len;
+	/** Number of stores in journal, deletes do not need new slots. */
+	unsigned int	journal_stores;
+	isc_buffer_t	*journal_names;
 };
 
+/**
+ * Iteration state: UUIDs of dead nodes copied when the iteration started.
+ * Slot indexes are never kept because zone re-synchronization can commit
+ * a version and re-arrange the slots between two calls.
+ */
+struct mldap_iter {
+	isc_uint32_t	generation;
+	unsigned char	*uuids;		/**< count * MLDAP_UUID_LEN bytes */
+	isc_uint32_t	count;
+	isc_uint32_t	next;
+};
+
+static isc_uint32_t
+uuid_hash(const unsigned char *uuid) {
+	/* FNV-1a */
+	isc_uint32_t hash = 2166136261U;
+
+	for (unsigned int i = 0; i < MLDAP_UUID_LEN; i++) {
+		hash ^= uuid[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static void ATTR_NONNULLS
+age_append(mldap_rec_t *slots, mldap_agelist_t *age, isc_uint32_t idx) {
+	slots[idx].older = age->newest;
+	slots[idx].newer = MLDAP_NIL;
+	if (age->newest != MLDAP_NIL)
+		slots[age->newest].newer = idx;
+	else
+		age->oldest = idx;
+	age->newest = idx;
+}
+
+static void ATTR_NONNULLS
+age_unlink(mldap_rec_t *slots, mldap_agelist_t *age, isc_uint32_t idx) {
+	mldap_rec_t *rec = &slots[idx];
+
+	if (rec->older != MLDAP_NIL)
+		slots[rec->older].newer = rec->newer;
+	else
+		age->oldest = rec->newer;
+	if (rec->newer != MLDAP_NIL)
+		slots[rec->newer].older = rec->older;
+	else
+		age->newest = rec->older;
+	rec->older = rec->newer = MLDAP_NIL;
+}
+
+/**
+ * Find slot with given UUID or slot where the UUID should be inserted.
+ *
+ * @pre mldap->lock is locked.
+ *
+ * @retval ISC_R_SUCCESS  UUID is present in slot *idxp.
+ * @retval ISC_R_NOTFOUND UUID is not present, *idxp is the first free slot
+ *                        on probe path.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+slot_find(const mldap_rec_t *slots, isc_uint32_t nslots,
+	  const unsigned char *uuid, isc_uint32_t *idxp) {
+	isc_uint32_t mask = nslots - 1;
+	isc_uint32_t idx = uuid_hash(uuid) & mask;
+	isc_boolean_t free_found = ISC_FALSE;
+	isc_uint32_t free_idx = 0;
+
+	for (isc_uint32_t i = 0; i < nslots; i++, idx = (idx + 1) & mask) {
+		if (slots[idx].state == mldap_slot_empty) {
+			*idxp = (free_found == ISC_TRUE) ? free_idx : idx;
+			return ISC_R_NOTFOUND;
+		} else if (slots[idx].state == mldap_slot_deleted) {
+			if (free_found == ISC_FALSE) {
+				free_idx = idx;
+				free_found = ISC_TRUE;
+			}
+		} else if (memcmp(slots[idx].uuid, uuid, MLDAP_UUID_LEN) == 0) {
+			*idxp = idx;
+			return ISC_R_SUCCESS;
+		}
+	}
+
+	/* table is never full, see ensure_capacity() */
+	INSIST(free_found == ISC_TRUE);
+	*idxp = free_idx;
+	return ISC_R_NOTFOUND;
+}
+
+/**
+ * Re-hash all used records into a new table with nslots and copy their
+ * names into a new arena. This drops all tombstones and arena garbage.
+ *
+ * @pre mldap->lock is locked for writing.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+rehash(mldapdb_t *mldap, isc_uint32_t nslots, isc_uint32_t arena_size) {
+	isc_result_t result;
+	mldap_rec_t *slots = NULL;
+	unsigned char *arena = NULL;
+	isc_uint32_t arena_used = 0;
+	mldap_agelist_t age = { MLDAP_NIL, MLDAP_NIL };
+	isc_uint32_t idx;
+	mldap_rec_t *rec;
+
+	CHECKED_MEM_GET(mldap->mctx, slots, nslots * sizeof(*slots));
+	memset(slots, 0, nslots * sizeof(*slots));
+	CHECKED_MEM_GET(mldap->mctx, arena, arena_size);
+
+	/* walk in age order so the new age list stays sorted */
+	for (isc_uint32_t i = mldap->age.oldest; i != MLDAP_NIL;
+	     i = rec->newer) {
+		rec = &mldap->slots[i];
+		INSIST(rec->state == mldap_slot_used);
+		INSIST(slot_find(slots, nslots, rec->uuid, &idx)
+		       == ISC_R_NOTFOUND);
+		slots[idx] = *rec;
+		age_append(slots, &age, idx);
+		if (rec->names_len > 0) {
+			INSIST(arena_used + rec->names_len <= arena_size);
+			memcpy(arena + arena_used, mldap->arena + rec->names,
+			       rec->names_len);
+			slots[idx].names = arena_used;
+			arena_used += rec->names_len;
+		}
+	}
+
+	SAFE_MEM_PUT(mldap->mctx, mldap->slots,
+		     mldap->nslots * sizeof(*mldap->slots));
+	SAFE_MEM_PUT(mldap->mctx, mldap->arena, mldap->arena_size);
+	mldap->slots = slots;
+	mldap->nslots = nslots;
+	mldap->deleted = 0;
+	mldap->age = age;
+	mldap->arena = arena;
+	mldap->arena_size = arena_size;
+	mldap->arena_used = arena_used;
+	mldap->arena_garbage = 0;
+
+	return ISC_R_SUCCESS;
+
+cleanup:
+	SAFE_MEM_PUT(mldap->mctx, slots, nslots * sizeof(*slots));
+	return result;
+}
+
+/**
+ * Make sure that journal can be applied without any further allocation:
+ * load factor stays under 3/4 and arena has enough space for all names.
+ *
+ * @pre mldap->lock is locked for writing.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ensure_capacity(mldapdb_t *mldap) {
+	isc_uint32_t nslots = mldap->nslots;
+	isc_uint32_t arena_size = mldap->arena_size;
+	isc_uint32_t names_len;
+	isc_uint64_t live_names;
+
+	names_len = isc_buffer_usedlength(mldap->journal_names);
+	if ((isc_uint64_t)mldap->used + mldap->deleted + mldap->journal_stores
+	    <= (isc_uint64_t)nslots * 3 / 4
+	    && (isc_uint64_t)mldap->arena_used + names_len <= arena_size)
+		return ISC_R_SUCCESS;
+
+	while ((isc_uint64_t)mldap->used + mldap->journal_stores
+	       > (isc_uint64_t)nslots / 2)
+		nslots *= 2;
+
+	live_names = (isc_uint64_t)mldap->arena_used - mldap->arena_garbage
+		     + names_len;
+	if (live_names > ISC_UINT32_MAX / 4)
+		return ISC_R_NOSPACE;
+	while (live_names > (isc_uint64_t)arena_size / 2)
+		arena_size *= 2;
+
+	return rehash(mldap, nslots, arena_size);
+}
 
 isc_result_t
 mldap_new(isc_mem_t *mctx, mldapdb_t **mldapp) {
 	isc_result_t result;
 	mldapdb_t *mldap = NULL;
+	isc_boolean_t lock_ready = ISC_FALSE;
+	isc_boolean_t version_lock_ready = ISC_FALSE;
 
 	REQUIRE(mldapp != NULL && *mldapp == NULL);
 
@@ -64,13 +318,39 @@ mldap_new(isc_mem_t *mctx, mldapdb_t **mldapp) {
 	isc_mem_attach(mctx, &mldap->mctx);
 
 	CHECK(isc_refcount_init(&mldap->generation, 0));
-	CHECK(metadb_new(mctx, &mldap->mdb));
+	CHECK(isc_rwlock_init(&mldap->lock, 0, 0));
+	lock_ready = ISC_TRUE;
+	CHECK(isc_mutex_init(&mldap->newversion_lock));
+	version_lock_ready = ISC_TRUE;
+
+	CHECKED_MEM_GET(mctx, mldap->slots,
+			MLDAP_INIT_SLOTS * sizeof(*mldap->slots));
+	memset(mldap->slots, 0, MLDAP_INIT_SLOTS * sizeof(*mldap->slots));
+	mldap->nslots = MLDAP_INIT_SLOTS;
+	mldap->age.oldest = mldap->age.newest = MLDAP_NIL;
+	CHECKED_MEM_GET(mctx, mldap->arena, MLDAP_INIT_ARENA);
+	mldap->arena_size = MLDAP_INIT_ARENA;
+	CHECKED_MEM_GET(mctx, mldap->journal,
+			MLDAP_INIT_JOURNAL * sizeof(*mldap->journal));
+	mldap->journal_size = MLDAP_INIT_JOURNAL;
+	CHECK(isc_buffer_allocate(mctx, &mldap->journal_names,
+				  2 * DNS_NAME_MAXWIRE));
+	isc_buffer_setautorealloc(mldap->journal_names, ISC_TRUE);
 
 	*mldapp = mldap;
 	return result;
 
 cleanup:
-	metadb_destroy(&mldap->mdb);
+	if (mldap == NULL)
+		return result;
+	SAFE_MEM_PUT(mctx, mldap->journal,
+		     mldap->journal_size * sizeof(*mldap->journal));
+	SAFE_MEM_PUT(mctx, mldap->arena, mldap->arena_size);
+	SAFE_MEM_PUT(mctx, mldap->slots, mldap->nslots * sizeof(*mldap->slots));
+	if (version_lock_ready == ISC_TRUE)
+		DESTROYLOCK(&mldap->newversion_lock);
+	if (lock_ready == ISC_TRUE)
+		isc_rwlock_destroy(&mldap->lock);
 	MEM_PUT_AND_DETACH(mldap);
 	return result;
 }
@@ -85,20 +365,159 @@ mldap_destroy(mldapdb_t **mldapp) {
 	if (mldap == NULL)
 		return;
 
-	metadb_destroy(&mldap->mdb);
+	if (mldap->journal_names != NULL)
+		isc_buffer_free(&mldap->journal_names);
+	SAFE_MEM_PUT(mldap->mctx, mldap->journal,
+		     mldap->journal_size * sizeof(*mldap->journal));
+	SAFE_MEM_PUT(mldap->mctx, mldap->arena, mldap->arena_size);
+	SAFE_MEM_PUT(mldap->mctx, mldap->slots,
+		     mldap->nslots * sizeof(*mldap->slots));
+	DESTROYLOCK(&mldap->newversion_lock);
+	isc_rwlock_destroy(&mldap->lock);
 	MEM_PUT_AND_DETACH(mldap);
 
 	*mldapp = NULL;
 }
 
+/**
+ * Open new version for writing. Only one version can be open at any time.
+ */
 isc_result_t
 mldap_newversion(mldapdb_t *mldap) {
-	return metadb_newversion(mldap->mdb);
+	LOCK(&mldap->newversion_lock);
+	INSIST(mldap->version_open == ISC_FALSE);
+	INSIST(mldap->journal_len == 0 && mldap->journal_stores == 0);
+	mldap->version_open = ISC_TRUE;
+
+	return ISC_R_SUCCESS;
 }
 
+/**
+ * Open new version for writing like mldap_newversion() but do not wait
+ * for version opened by somebody else.
+ *
+ * @retval ISC_R_SUCCESS
+ * @retval ISC_R_LOCKBUSY Another version is open or dead nodes are being
+ *                        swept, try again later.
+ */
+isc_result_t
+mldap_trynewversion(mldapdb_t *mldap) {
+	if (isc_mutex_trylock(&mldap->newversion_lock) != ISC_R_SUCCESS)
+		return ISC_R_LOCKBUSY;
+	if (mldap->sweeping == ISC_TRUE) {
+		UNLOCK(&mldap->newversion_lock);
+		return ISC_R_LOCKBUSY;
+	}
+	INSIST(mldap->version_open == ISC_FALSE);
+	INSIST(mldap->journal_len == 0 && mldap->journal_stores == 0);
+	mldap->version_open = ISC_TRUE;
+
+	return ISC_R_SUCCESS;
+}
+
+/**
+ * Close version opened by mldap_newversion() and optionally apply
+ * all changes done in it.
+ *
+ * Failure to apply the changes is equivalent to rollback, an error
+ * is logged.
+ */
 void
 mldap_closeversion(mldapdb_t *mldap, isc_boolean_t commit) {
-	return metadb_closeversion(mldap->mdb, commit);
+	isc_result_t result = ISC_R_SUCCESS;
+	mldap_op_t *op;
+	mldap_rec_t *rec;
+	isc_uint32_t idx;
+	const unsigned char *names;
+
+	INSIST(mldap->version_open == ISC_TRUE);
+
+	if (commit == ISC_FALSE || mldap->journal_len == 0)
+		goto cleanup;
+
+	RWLOCK(&mldap->lock, isc_rwlocktype_write);
+	result = ensure_capacity(mldap);
+	if (result != ISC_R_SUCCESS) {
+		RWUNLOCK(&mldap->lock, isc_rwlocktype_write);
+		log_error_r("unable to commit metaLDAP changes, "
+			    "run rndc reload");
+		goto cleanup;
+	}
+	names = isc_buffer_base(mldap->journal_names);
+	for (unsigned int i = 0; i < mldap->journal_len; i++) {
+		op = &mldap->journal[i];
+		result = slot_find(mldap->slots, mldap->nslots, op->rec.uuid,
+				   &idx);
+		rec = &mldap->slots[idx];
+		if (result == ISC_R_SUCCESS) {
+			/* old record is removed or replaced */
+			mldap->arena_garbage += rec->names_len;
+			age_unlink(mldap->slots, &mldap->age, idx);
+			if (op->delete == ISC_TRUE) {
+				rec->state = mldap_slot_deleted;
+				mldap->used--;
+				mldap->deleted++;
+				continue;
+			}
+		} else if (op->delete == ISC_TRUE) {
+			continue;
+		} else {
+			if (rec->state == mldap_slot_deleted)
+				mldap->deleted--;
+			mldap->used++;
+		}
+		*rec = op->rec;
+		rec->state = mldap_slot_used;
+		age_append(mldap->slots, &mldap->age, idx);
+		if (rec->names_len > 0) {
+			memcpy(mldap->arena + mldap->arena_used,
+			       names + op->rec.names, rec->names_len);
+			rec->names = mldap->arena_used;
+			mldap->arena_used += rec->names_len;
+		}
+	}
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_write);
+
+cleanup:
+	mldap->journal_len = 0;
+	mldap->journal_stores = 0;
+	isc_buffer_clear(mldap->journal_names);
+	mldap->version_open = ISC_FALSE;
+	UNLOCK(&mldap->newversion_lock);
+}
+
+/**
+ * Get free operation in journal of currently open version.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+journal_append(mldapdb_t *mldap, struct berval *uuid, mldap_op_t **opp) {
+	isc_result_t result;
+	mldap_op_t *journal = NULL;
+	unsigned int size;
+	mldap_op_t *op;
+
+	REQUIRE(uuid->bv_len == MLDAP_UUID_LEN && uuid->bv_val != NULL);
+	INSIST(mldap->version_open == ISC_TRUE);
+
+	if (mldap->journal_len == mldap->journal_size) {
+		size = 2 * mldap->journal_size;
+		CHECKED_MEM_GET(mldap->mctx, journal, size * sizeof(*journal));
+		memcpy(journal, mldap->journal,
+		       mldap->journal_len * sizeof(*journal));
+		SAFE_MEM_PUT(mldap->mctx, mldap->journal,
+			     mldap->journal_size * sizeof(*journal));
+		mldap->journal = journal;
+		mldap->journal_size = size;
+	}
+
+	op = &mldap->journal[mldap->journal_len++];
+	memset(op, 0, sizeof(*op));
+	memcpy(op->rec.uuid, uuid->bv_val, MLDAP_UUID_LEN);
+	*opp = op;
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	return result;
 }
 
 /**
@@ -141,270 +560,182 @@ mldap_cur_generation_get(mldapdb_t *mldap) {
 }
 
 /**
- * Convert UUID to "01234567-89ab-cdef-0123-456789abcdef.uuid.ldap." DNS name.
+ * Store information from LDAP entry into meta-database. Current generation
+ * number is stored together with the entry.
  *
- * @param[in]  beruuid
- * @param[out] nameuuid
- */
-void
-ldap_uuid_to_mname(struct berval *beruuid, dns_name_t *nameuuid) {
-	/* UUID string representation according to RFC 4122 section 3 */
-	char label_buf[sizeof("01234567-89ab-cdef-0123-456789abcdef") + 1];
-	/* uncompressed label format, length 36 octets; RFC 1034 section 3.1 */
-	label_buf[0] = 36;
-
-	isc_region_t label_reg;
-	label_reg.base = (unsigned char *)label_buf;
-	label_reg.length = sizeof(label_buf) - 1; /* omit final \0 */
-
-	dns_name_t relative_name;
-	DNS_NAME_INIT(&relative_name, NULL);
-
-	/* RFC 4530 section 2.1 format = 16 octets is required */
-	REQUIRE(beruuid != NULL && beruuid->bv_len == 16);
-
-	/* fill-in string representation into label buffer */
-	uuid_unparse((*(const uuid_t *) beruuid->bv_val), label_buf + 1);
-	dns_name_fromregion(&relative_name, &label_reg);
-
-	INSIST(dns_name_concatenate(&relative_name, &uuid_rootname,
-				    nameuuid, NULL) == ISC_R_SUCCESS);
-
-	return;
-}
-
-STATIC_ASSERT((sizeof(ldap_entryclass_t) <= sizeof(struct in6_addr)), \
-		"ldap_entryclass_t is too big for AAAA rdata type");
-/**
- * ldap_entryclass_t is stored inside AAAA record type
+ * The change is not visible until mldap_closeversion() commits it.
+ *
+ * @param[in] fqdn Name of the DNS node or NULL for configuration objects.
+ * @param[in] zone Name of the zone, has to be NULL iff fqdn is NULL.
  */
-static isc_result_t
-mldap_class_store(ldap_entryclass_t class, metadb_node_t *node) {
-	unsigned char buff[sizeof(struct in6_addr)];
-	isc_region_t region = { .base = buff, .length = sizeof(buff) };
-	dns_rdata_t rdata;
-
-	dns_rdata_init(&rdata);
-	memset(buff, 0, sizeof(buff));
-
-	/* Bytes should be in network-order but we do not care because:
-	 * 1) It is used only internally.  2) Class is unsigned char. */
-	memcpy(buff, &class, sizeof(class));
-	dns_rdata_fromregion(&rdata, dns_rdataclass_in, dns_rdatatype_aaaa,
-			     &region);
-
-	return metadb_rdata_store(&rdata, node);
-}
-
 isc_result_t
-mldap_class_get(metadb_node_t *node, ldap_entryclass_t *classp) {
+mldap_entry_create(ldap_entry_t *entry, mldapdb_t *mldap, dns_name_t *fqdn,
+		   dns_name_t *zone) {
 	isc_result_t result;
-	dns_rdataset_t rdataset;
-	dns_rdata_t rdata;
+	mldap_op_t *op = NULL;
 	isc_region_t region;
-
-	REQUIRE(classp != NULL);
-
-	dns_rdata_init(&rdata);
-	dns_rdataset_init(&rdataset);
-
-	CHECK(metadb_rdataset_get(node, dns_rdatatype_aaaa, &rdataset));
-	dns_rdataset_current(&rdataset, &rdata);
-	dns_rdata_toregion(&rdata, &region);
-	/* Bytes should be in network-order but we do not care because:
-	 * 1) It is used only internally.  2) Class is unsigned char. */
-	memcpy(classp, region.base, sizeof(*classp));
-
-cleanup:
-	if (dns_rdataset_isassociated(&rdataset))
-		dns_rdataset_disassociate(&rdataset);
-	return result;
-}
-
-/**
- * mldapdb_t->generation is stored inside A record type
- */
-static isc_result_t
-mldap_generation_store(mldapdb_t *mldap, metadb_node_t *node) {
-	isc_result_t result;
-	unsigned char buff[sizeof(mldap->generation)];
-	isc_region_t region = { .base = buff, .length = sizeof(buff) };
-	dns_rdata_t rdata;
-	isc_uint32_t generation;
-
-	STATIC_ASSERT(sizeof(mldap_cur_generation_get(mldap)) == sizeof(struct in_addr), \
-		      "mldapdb_t->generation value is too big for A rdata type");
-	STATIC_ASSERT(sizeof(mldap_cur_generation_get(mldap)) == sizeof(generation), \
-		      "mldapdb_t->generation and local generation sizes do not match");
-
-	dns_rdata_init(&rdata);
-
-	/* Bytes should be in network-order but we do not care because:
-	 * 1) It is used only internally and always compared on this machine. */
-	generation = mldap_cur_generation_get(mldap);
-	memcpy(buff, &generation, sizeof(generation));
-	dns_rdata_fromregion(&rdata, dns_rdataclass_in, dns_rdatatype_a, &region);
-	CHECK(metadb_rdata_store(&rdata, node));
-
-cleanup:
-	return result;
-}
-
-static isc_result_t
-mldap_generation_get(metadb_node_t *node, isc_uint32_t *generationp) {
-	isc_result_t result;
-	dns_rdataset_t rdataset;
-	dns_rdata_t rdata;
-	isc_region_t region;
-
-	REQUIRE(generationp != NULL);
-
-	dns_rdata_init(&rdata);
-	dns_rdataset_init(&rdataset);
-
-	CHECK(metadb_rdataset_get(node, dns_rdatatype_a, &rdataset));
-	dns_rdataset_current(&rdataset, &rdata);
-	dns_rdata_toregion(&rdata, &region);
-	memcpy(generationp, region.base, sizeof(*generationp));
-
-cleanup:
-	if (dns_rdataset_isassociated(&rdataset))
-		dns_rdataset_disassociate(&rdataset);
-	return result;
-}
-
-/**
- * FQDN and zone name are stored inside RP record type
- */
-isc_result_t
-mldap_dnsname_store(dns_name_t *fqdn, dns_name_t *zone, metadb_node_t *node) {
-	isc_result_t result;
-	dns_rdata_rp_t rp;
-	dns_rdata_t rdata;
-	unsigned char wirebuf[2 * DNS_NAME_MAXWIRE];
-	isc_buffer_t rdatabuf;
-
-	REQUIRE(fqdn != NULL);
-	REQUIRE(zone != NULL);
-
-	dns_rdata_init(&rdata);
-	DNS_RDATACOMMON_INIT(&rp, dns_rdatatype_rp, dns_rdataclass_in);
-	isc_buffer_init(&rdatabuf, wirebuf, sizeof(wirebuf));
-
-	/* Bytes should be in network-order but we do not care because:
-	 * 1) It is used only internally and always compared on this machine. */
-	rp.mail = *fqdn;
-	rp.text = *zone;
-	CHECK(dns_rdata_fromstruct(&rdata, dns_rdataclass_in, dns_rdatatype_rp,
-				   &rp, &rdatabuf));
-	CHECK(metadb_rdata_store(&rdata, node));
+	isc_uint32_t offset;
+
+	REQUIRE((fqdn == NULL) == (zone == NULL));
+
+	CHECK(journal_append(mldap, entry->uuid, &op));
+	op->delete = ISC_FALSE;
+	op->rec.class = entry->class;
+	op->rec.generation = mldap_cur_generation_get(mldap);
+	if (fqdn != NULL) {
+		/* names are absolute so they can be split again using
+		 * dns_name_fromregion() */
+		REQUIRE(dns_name_isabsolute(fqdn) && dns_name_isabsolute(zone));
+		offset = isc_buffer_usedlength(mldap->journal_names);
+		dns_name_toregion(fqdn, &region);
+		CHECK(isc_buffer_copyregion(mldap->journal_names, &region));
+		dns_name_toregion(zone, &region);
+		CHECK(isc_buffer_copyregion(mldap->journal_names, &region));
+		op->rec.names = offset;
+		op->rec.names_len = isc_buffer_usedlength(mldap->journal_names)
+				    - offset;
+	}
+	mldap->journal_stores++;
 
 cleanup:
+	if (result != ISC_R_SUCCESS && op != NULL)
+		mldap->journal_len--;
 	return result;
 }
 
 /**
- * Retrieve FQDN and zone name from RP record in metaDB.
- * @param[in]  node
- * @param[out] fqdn
- * @param[out] zone
+ * Read committed information about LDAP entry from meta-database.
+ *
+ * @param[out] classp Class of LDAP entry.
+ * @param[out] fqdn   Name of the DNS node. Ignored if NULL or if the entry
+ *                    does not have any names stored.
+ * @param[out] zone   Name of the zone. Ignored if NULL or if the entry
+ *                    does not have any names stored.
  *
  * @pre DNS names fqdn and zone have dedicated buffer.
+ *
+ * @retval ISC_R_SUCCESS
+ * @retval ISC_R_NOTFOUND Entry with given UUID is not in meta-database.
  */
 isc_result_t
-mldap_dnsname_get(metadb_node_t *node, dns_name_t *fqdn, dns_name_t *zone) {
+mldap_entry_read(mldapdb_t *mldap, struct berval *uuid,
+		 ldap_entryclass_t *classp, dns_name_t *fqdn, dns_name_t *zone) {
 	isc_result_t result;
-	dns_rdata_rp_t rp;
-	dns_rdataset_t rdataset;
-	dns_rdata_t rdata;
+	isc_uint32_t idx;
+	mldap_rec_t *rec;
+	isc_region_t region;
+	dns_name_t name;
+
+	REQUIRE(uuid->bv_len == MLDAP_UUID_LEN && uuid->bv_val != NULL);
 
-	REQUIRE(fqdn != NULL);
-	REQUIRE(zone != NULL);
+	dns_name_init(&name, NULL);
 
-	dns_rdataset_init(&rdataset);
-	dns_rdata_init(&rdata);
+	RWLOCK(&mldap->lock, isc_rwlocktype_read);
+	CHECK(slot_find(mldap->slots, mldap->nslots,
+			(const unsigned char *)uuid->bv_val, &idx));
+	rec = &mldap->slots[idx];
+	*classp = rec->class;
+	if (rec->names_len == 0)
+		goto cleanup;
 
-	CHECK(metadb_rdataset_get(node, dns_rdatatype_rp, &rdataset));
-	dns_rdataset_current(&rdataset, &rdata);
-	CHECK(dns_rdata_tostruct(&rdata, &rp, NULL));
-	CHECK(dns_name_copy(&rp.mail, fqdn, NULL));
-	CHECK(dns_name_copy(&rp.text, zone, NULL));
+	region.base = mldap->arena + rec->names;
+	region.length = rec->names_len;
+	dns_name_fromregion(&name, &region);
+	if (fqdn != NULL)
+		CHECK(dns_name_copy(&name, fqdn, NULL));
+	isc_region_consume(&region, name.length);
+	dns_name_fromregion(&name, &region);
+	if (zone != NULL)
+		CHECK(dns_name_copy(&name, zone, NULL));
 
 cleanup:
-	if (dns_rdataset_isassociated(&rdataset))
-		dns_rdataset_disassociate(&rdataset);
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_read);
 	return result;
 }
 
 /**
- * Store information from LDAP entry into meta-database.
+ * Delete metaLDAP entry.
+ *
+ * The change is not visible until mldap_closeversion() commits it.
  */
 isc_result_t
-mldap_entry_create(ldap_entry_t *entry, mldapdb_t *mldap, metadb_node_t **nodep) {
+mldap_entry_delete(mldapdb_t *mldap, struct berval *uuid) {
 	isc_result_t result;
-	metadb_node_t *node = NULL;
-	DECLARE_BUFFERED_NAME(mname);
-
-	REQUIRE(nodep != NULL && *nodep == NULL);
-
-	INIT_BUFFERED_NAME(mname);
+	mldap_op_t *op = NULL;
 
-	ldap_uuid_to_mname(entry->uuid, &mname);
-	CHECK(metadb_writenode_create(mldap->mdb, &mname, &node));
-
-	CHECK(mldap_class_store(entry->class, node));
-	CHECK(mldap_generation_store(mldap, node));
-
-	*nodep = node;
+	CHECK(journal_append(mldap, uuid, &op));
+	op->delete = ISC_TRUE;
 
 cleanup:
-	if (result != ISC_R_SUCCESS)
-		metadb_node_close(&node);
 	return result;
 }
 
 /**
- * Open metaLDAP entry for reading.
- * All notes about metadb_readnode_open() apply equally here.
- */
-isc_result_t
-mldap_entry_read(mldapdb_t *mldap, struct berval *uuid, metadb_node_t **nodep) {
-	DECLARE_BUFFERED_NAME(mname);
-
-	INIT_BUFFERED_NAME(mname);
-
-	ldap_uuid_to_mname(uuid, &mname);
-
-	return metadb_readnode_open(mldap->mdb, &mname, nodep);
-}
-
-/**
- * Delete metaLDAP entry.
- * All notes about metadb_writenode_open() apply equally here.
+ * Delete records of entries from given zone which do not define any name
+ * in the set of names. Node data in names are entryUUIDs of the entries
+ * which define respective names, nodes with other data are ignored.
+ *
+ * The change is not visible until mldap_closeversion() commits it.
+ *
+ * @param[out] cntp Number of deleted records.
  */
 isc_result_t
-mldap_entry_delete(mldapdb_t *mldap, struct berval *uuid) {
-	isc_result_t result;
-	metadb_node_t *node = NULL;
-	DECLARE_BUFFERED_NAME(mname);
-
-	INIT_BUFFERED_NAME(mname);
-
-	ldap_uuid_to_mname(uuid, &mname);
-
-	CHECK(metadb_writenode_open(mldap->mdb, &mname, &node));
-	CHECK(metadb_node_delete(&node));
+mldap_zone_prune(mldapdb_t *mldap, dns_name_t *zone, dns_rbt_t *names,
+		 void *ignore, unsigned int *cntp) {
+	isc_result_t result = ISC_R_SUCCESS;
+	mldap_rec_t *rec;
+	isc_region_t region;
+	dns_name_t fqdn;
+	dns_name_t rec_zone;
+	void *data;
+	struct berval uuid;
+
+	*cntp = 0;
+	dns_name_init(&fqdn, NULL);
+	dns_name_init(&rec_zone, NULL);
+	uuid.bv_len = MLDAP_UUID_LEN;
+
+	RWLOCK(&mldap->lock, isc_rwlocktype_read);
+	for (isc_uint32_t i = 0; i < mldap->nslots; i++) {
+		rec = &mldap->slots[i];
+		if (rec->state != mldap_slot_used || rec->names_len == 0)
+			continue;
+		region.base = mldap->arena + rec->names;
+		region.length = rec->names_len;
+		dns_name_fromregion(&fqdn, &region);
+		isc_region_consume(&region, fqdn.length);
+		dns_name_fromregion(&rec_zone, &region);
+		if (!dns_name_equal(&rec_zone, zone))
+			continue;
+		data = NULL;
+		if (dns_rbt_findname(names, &fqdn, 0, NULL, &data)
+		    == ISC_R_SUCCESS && data != ignore
+		    && memcmp(data, rec->uuid, MLDAP_UUID_LEN) == 0)
+			continue;
+		/* journal is not protected by the lock */
+		uuid.bv_val = (char *)rec->uuid;
+		CHECK(mldap_entry_delete(mldap, &uuid));
+		(*cntp)++;
+	}
 
 cleanup:
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_read);
 	return result;
 }
 
 /**
- * Start iteration over UUID's of dead nodes stored in uuid.ldap. sub-tree
- * of metaLDAP.
+ * Start iteration over UUID's of dead nodes in metaLDAP.
  *
  * Dead node is a node with generation number lower than global generation
- * number in in metaLDAP.
+ * number in in metaLDAP. Only dead nodes are visited so the cost does not
+ * depend on number of live entries.
+ *
+ * UUIDs of all dead nodes are copied under a single read lock so other
+ * writers can commit versions during the iteration. A node which was stored
+ * again in the meantime is skipped by mldap_iter_deadnodes_next().
+ * Until the iteration ends mldap_trynewversion() returns ISC_R_LOCKBUSY
+ * so zone re-synchronization cannot revive a node between
+ * mldap_iter_deadnodes_next() and its deletion.
  *
  * @param[in]  mldap
  * @param[out] iterp
@@ -422,41 +753,72 @@ cleanup:
  *          This is safety check to prevent hard-to-debug inconsistencies.
  */
 isc_result_t
-mldap_iter_deadnodes_start(mldapdb_t *mldap, metadb_iter_t **iterp,
+mldap_iter_deadnodes_start(mldapdb_t *mldap, mldap_iter_t **iterp,
 			   struct berval *uuid) {
 	isc_result_t result;
-	metadb_iter_t *iter = NULL;
+	mldap_iter_t *iter = NULL;
+	mldap_rec_t *rec;
+	isc_uint32_t count = 0;
+	isc_boolean_t locked = ISC_FALSE;
 
 	REQUIRE(iterp != NULL && *iterp == NULL);
 
-	CHECK(metadb_iterator_create(mldap->mdb, &iter));
-	CHECKED_MEM_GET(mldap->mctx, iter->state, sizeof(isc_uint32_t));
-	result = dns_dbiterator_seek(iter->iter, &uuid_rootname);
-	if (result == ISC_R_NOTFOUND) /* metaLDAP is empty */
-		CLEANUP_WITH(ISC_R_NOMORE);
-	else if (result != ISC_R_SUCCESS)
-		goto cleanup;
+	CHECKED_MEM_GET_PTR(mldap->mctx, iter);
+	ZERO_PTR(iter);
 	/* store current generation value for sanity checking */
-	*(isc_uint32_t *)iter->state = mldap_cur_generation_get(mldap);
-
-	CHECK(mldap_iter_deadnodes_next(mldap, &iter, uuid));
+	iter->generation = mldap_cur_generation_get(mldap);
+
+	LOCK(&mldap->newversion_lock);
+	INSIST(mldap->sweeping == ISC_FALSE);
+	mldap->sweeping = ISC_TRUE;
+	UNLOCK(&mldap->newversion_lock);
+
+	RWLOCK(&mldap->lock, isc_rwlocktype_read);
+	locked = ISC_TRUE;
+	/* age list is sorted so the first 'fresh' node ends the prefix */
+	for (isc_uint32_t i = mldap->age.oldest; i != MLDAP_NIL;
+	     i = rec->newer) {
+		rec = &mldap->slots[i];
+		if (!isc_serial_lt(rec->generation, iter->generation))
+			break;
+		count++;
+	}
+	if (count > 0) {
+		CHECKED_MEM_GET(mldap->mctx, iter->uuids,
+				count * MLDAP_UUID_LEN);
+		iter->count = count;
+		count = 0;
+		for (isc_uint32_t i = mldap->age.oldest;
+		     count < iter->count; i = rec->newer) {
+			rec = &mldap->slots[i];
+			memcpy(iter->uuids + count * MLDAP_UUID_LEN, rec->uuid,
+			       MLDAP_UUID_LEN);
+			count++;
+		}
+	}
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_read);
+	locked = ISC_FALSE;
 
 	*iterp = iter;
-	return result;
+	return mldap_iter_deadnodes_next(mldap, iterp, uuid);
 
 cleanup:
+	if (locked == ISC_TRUE)
+		RWUNLOCK(&mldap->lock, isc_rwlocktype_read);
 	if (iter != NULL) {
-		SAFE_MEM_PUT(mldap->mctx, iter->state, sizeof(isc_uint32_t));
-		iter->state = NULL;
-		metadb_iterator_destroy(&iter);
+		LOCK(&mldap->newversion_lock);
+		mldap->sweeping = ISC_FALSE;
+		UNLOCK(&mldap->newversion_lock);
 	}
-
+	SAFE_MEM_PUT_PTR(mldap->mctx, iter);
 	return result;
 }
 
 /**
- * Continue iteration over UUID's of dead nodes stored in uuid.ldap. sub-tree
- * of metaLDAP.
+ * Continue iteration over UUID's of dead nodes in metaLDAP.
+ *
+ * Nodes which were deleted or stored again since the iteration started
+ * are skipped.
  *
  * @param[in]     mldap
  * @param[in,out] iterp
@@ -473,67 +835,44 @@ cleanup:
  *          This is safety check to prevent hard-to-debug inconsistencies.
  */
 isc_result_t
-mldap_iter_deadnodes_next(mldapdb_t *mldap, metadb_iter_t **iterp,
+mldap_iter_deadnodes_next(mldapdb_t *mldap, mldap_iter_t **iterp,
 		   struct berval *uuid) {
-	isc_result_t result;
-	dns_dbnode_t *rbt_node = NULL;
-	metadb_iter_t *iter = NULL;
-	isc_uint32_t node_generation;
-	isc_uint32_t cur_generation;
-	metadb_node_t metadb_node;
-	DECLARE_BUFFERED_NAME(name);
-	isc_region_t name_region;
+	isc_result_t result = ISC_R_NOMORE;
+	mldap_iter_t *iter = NULL;
+	const unsigned char *next_uuid;
+	isc_uint32_t idx;
 
 	REQUIRE(uuid != NULL);
-	REQUIRE(uuid->bv_len == 16 && uuid->bv_val != NULL);
+	REQUIRE(uuid->bv_len == MLDAP_UUID_LEN && uuid->bv_val != NULL);
 
-	INIT_BUFFERED_NAME(name);
 	iter = *iterp;
-
-	/* create fake metaDB node for use with metaDB interface */
-	metadb_node.mctx = iter->mctx;
-	metadb_node.version = iter->version;
-	metadb_node.rbtdb = iter->rbtdb;
-
-	/* skip nodes which do not belong to UUID sub-tree or are 'fresh' */
-	while (ISC_TRUE) {
-		if (rbt_node != NULL)
-			dns_db_detachnode(iter->rbtdb, &rbt_node);
-		dns_name_reset(&name);
-
-		CHECK(dns_dbiterator_next(iter->iter));
-		CHECK(dns_dbiterator_current(iter->iter, &rbt_node, &name));
-		if (dns_name_issubdomain(&name, &uuid_rootname) == ISC_FALSE)
+	/* sanity check: generation number cannot change during iteration */
+	INSIST(iter->generation == mldap_cur_generation_get(mldap));
+
+	RWLOCK(&mldap->lock, isc_rwlocktype_read);
+	while (result != ISC_R_SUCCESS && iter->next < iter->count) {
+		next_uuid = iter->uuids + iter->next * MLDAP_UUID_LEN;
+		iter->next++;
+		if (slot_find(mldap->slots, mldap->nslots, next_uuid, &idx)
+		    != ISC_R_SUCCESS)
 			continue;
-		metadb_node.dbnode = rbt_node;
-
-		INSIST(mldap_generation_get(&metadb_node, &node_generation)
-		       == ISC_R_SUCCESS);
-		cur_generation = mldap_cur_generation_get(mldap);
-		/* sanity check: generation number cannot change during iteration */
-		INSIST(*(isc_uint32_t *)(*iterp)->state == cur_generation);
-
-		if (isc_serial_lt(node_generation, cur_generation))
-			break; /* this node is from previous mLDAP generation */
+		if (!isc_serial_lt(mldap->slots[idx].generation,
+				   iter->generation))
+			continue;
+		/* this node is from previous mLDAP generation */
+		memcpy(uuid->bv_val, next_uuid, MLDAP_UUID_LEN);
+		result = ISC_R_SUCCESS;
 	}
-	DNS_NAME_TOREGION(&name, &name_region);
-	/* parse UUID from DNS name
-	 * "$e4113e03-03b4-11e5-b478-c78116fa7f8b\004uuid\004ldap"
-	 * - first byte of any label is length
-	 * - names derived from UUID has to have constant length */
-	INSIST(name_region.length == 37 + sizeof(uuid_rootname_ndata));
-	INSIST(name_region.base[0] == 36);
-	name_region.base[37] = '\0';
-	INSIST(uuid_parse((const char *)name_region.base + 1,
-			  *(uuid_t *)(uuid->bv_val)) == 0);
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_read);
 
-cleanup:
-	if (rbt_node != NULL)
-		dns_db_detachnode(iter->rbtdb, &rbt_node);
 	if (result != ISC_R_SUCCESS) {
-		SAFE_MEM_PUT(iter->mctx, iter->state, sizeof(isc_uint32_t));
-		iter->state = NULL;
-		metadb_iterator_destroy(iterp);
+		LOCK(&mldap->newversion_lock);
+		mldap->sweeping = ISC_FALSE;
+		UNLOCK(&mldap->newversion_lock);
+		SAFE_MEM_PUT(mldap->mctx, iter->uuids,
+			     iter->count * MLDAP_UUID_LEN);
+		SAFE_MEM_PUT_PTR(mldap->mctx, iter);
+		*iterp = NULL;
 	}
 	return result;
 }
@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 2016  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Generators of formulaic records from idnsRangeGenerator values.
+ *
+ * Each value describes a range of records in syntax borrowed from
+ * $GENERATE directive in master files:
+ *
+ *   <start>-<stop>[/<step>] <owner> <type> <rdata>
+ *
+ * Every '$' in owner and rdata is replaced by the iterator value, '\$'
+ * produces literal '$'. Modifier ${offset[,width[,base]]} adds offset
+ * to the value and formats it to given minimal width in base
+ * d (decimal), o (octal), x or X (hexadecimal).
+ *
+ * Records are expanded inside the plugin so a range of thousands
+ * of records is represented by a single LDAP entry.
+ */
+
+#include <isc/ht.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/util.h>
+
+#include <dns/rdatatype.h>
+#include <dns/result.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "rr_range.h"
+#include "str.h"
+#include "util.h"
+
+/** Number of bits used for hash table with generators of entries. */
+#define RR_RANGE_HT_BITS	6
+/** Maximal width in ${offset,width,base} modifier. */
+#define RR_RANGE_WIDTH_MAX	64
+
+/**
+ * Generator values of all entries with idnsRangeObject, keyed by entryUUID.
+ *
+ * Values are needed for removal of records generated by previous version
+ * of an entry because modified and deleted entries do not carry
+ * the old values.
+ */
+struct rr_range_register {
+	isc_mem_t		*mctx;
+	isc_mutex_t		lock;
+	isc_ht_t		*ht;
+};
+
+static const char *
+skip_space(const char *str) {
+	while (*str == ' ' || *str == '\t')
+		str++;
+	return str;
+}
+
+static size_t
+token_len(const char *str) {
+	size_t len;
+
+	for (len = 0; str[len] != '\0' && str[len] != ' ' && str[len] != '\t';
+	     len++)
+		;
+	return len;
+}
+
+static isc_boolean_t ATTR_NONNULLS
+parse_num(const char *str, char **end, unsigned long *value) {
+	if (!isdigit((unsigned char)*str))
+		return ISC_FALSE;
+	*value = strtoul(str, end, 10);
+	return ISC_TRUE;
+}
+
+/**
+ * Parse range "start-stop[/step]".
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+range_parse(const char *spec, const char *text, size_t len,
+	    unsigned long *startp, unsigned long *stopp,
+	    unsigned long *stepp) {
+	char buf[64];
+	char *end;
+
+	if (len >= sizeof(buf))
+		goto syntax;
+	memcpy(buf, text, len);
+	buf[len] = '\0';
+
+	if (!parse_num(buf, &end, startp) || *end != '-')
+		goto syntax;
+	if (!parse_num(end + 1, &end, stopp))
+		goto syntax;
+	*stepp = 1;
+	if (*end == '/' && !parse_num(end + 1, &end, stepp))
+		goto syntax;
+	if (*end != '\0' || *stepp == 0 || *startp > *stopp)
+		goto syntax;
+
+	if ((*stopp - *startp) / *stepp >= RR_RANGE_MAX) {
+		log_error("range generator '%s': range is longer than "
+			  "%u records", spec, RR_RANGE_MAX);
+		return ISC_R_RANGE;
+	}
+	return ISC_R_SUCCESS;
+
+syntax:
+	log_error("range generator '%s': invalid range '%.*s'",
+		  spec, (int)len, text);
+	return DNS_R_SYNTAX;
+}
+
+/**
+ * Parse modifier "offset[,width[,base]]}" following "${".
+ *
+ * @param[out] mod_len Length of the modifier including closing brace.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+modifier_parse(const char *spec, const char *text, size_t len,
+	       long *offsetp, int *widthp, char *basep, size_t *mod_len) {
+	char buf[64];
+	const char *brace;
+	int n;
+
+	brace = memchr(text, '}', len);
+	if (brace == NULL || (size_t)(brace - text) >= sizeof(buf))
+		goto syntax;
+	memcpy(buf, text, brace - text);
+	buf[brace - text] = '\0';
+
+	*widthp = 0;
+	*basep = 'd';
+	n = sscanf(buf, "%ld,%d,%c", offsetp, widthp, basep);
+	if (n < 1 || *widthp < 0 || *widthp > RR_RANGE_WIDTH_MAX
+	    || strchr("doxX", *basep) == NULL)
+		goto syntax;
+
+	*mod_len = brace - text + 1;
+	return ISC_R_SUCCESS;
+
+syntax:
+	log_error("range generator '%s': invalid modifier", spec);
+	return DNS_R_SYNTAX;
+}
+
+/**
+ * Replace all '$' in template by the value.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+range_subst(const char *spec, const char *tmpl, size_t len,
+	    unsigned long value, ld_string_t *output) {
+	isc_result_t result = ISC_R_SUCCESS;
+	char num[RR_RANGE_WIDTH_MAX + 32];
+	size_t lit_start = 0;
+	size_t mod_len;
+	long offset;
+	int width;
+	char base;
+	size_t i;
+
+	str_clear(output);
+	for (i = 0; i < len; i++) {
+		if (tmpl[i] == '\\' && i + 1 < len && tmpl[i + 1] == '$') {
+			/* escaped dollar, skip the backslash */
+			CHECK(str_cat_char_len(output, tmpl + lit_start,
+					       i - lit_start));
+			lit_start = ++i;
+			continue;
+		} else if (tmpl[i] != '$') {
+			continue;
+		}
+
+		CHECK(str_cat_char_len(output, tmpl + lit_start,
+				       i - lit_start));
+		offset = 0;
+		width = 0;
+		base = 'd';
+		if (i + 1 < len && tmpl[i + 1] == '{') {
+			CHECK(modifier_parse(spec, tmpl + i + 2, len - i - 2,
+					     &offset, &width, &base,
+					     &mod_len));
+			i += mod_len + 1;
+		}
+		if (offset < 0 && (unsigned long)-offset > value) {
+			log_error("range generator '%s': offset %ld "
+				  "produces negative value", spec, offset);
+			CLEANUP_WITH(ISC_R_RANGE);
+		}
+		switch (base) {
+		case 'o':
+			snprintf(num, sizeof(num), "%0*lo", width,
+				 value + offset);
+			break;
+		case 'x':
+			snprintf(num, sizeof(num), "%0*lx", width,
+				 value + offset);
+			break;
+		case 'X':
+			snprintf(num, sizeof(num), "%0*lX", width,
+				 value + offset);
+			break;
+		default:
+			snprintf(num, sizeof(num), "%0*lu", width,
+				 value + offset);
+			break;
+		}
+		CHECK(str_cat_char(output, num));
+		lit_start = i + 1;
+	}
+	CHECK(str_cat_char_len(output, tmpl + lit_start, len - lit_start));
+
+cleanup:
+	return result;
+}
+
+/**
+ * Get number of records described by generator spec without expanding it.
+ * Only the range is parsed, other parts are checked by rr_range_expand().
+ *
+ * @retval DNS_R_SYNTAX Range is not valid, details were logged.
+ * @retval ISC_R_RANGE  Range is longer than RR_RANGE_MAX.
+ */
+isc_result_t
+rr_range_count(const char *spec, unsigned long *countp) {
+	isc_result_t result;
+	const char *range;
+	unsigned long start, stop, step;
+
+	range = skip_space(spec);
+	CHECK(range_parse(spec, range, token_len(range), &start, &stop, &step));
+	*countp = (stop - start) / step + 1;
+
+cleanup:
+	return result;
+}
+
+/**
+ * Call action for each record described by generator spec.
+ *
+ * @retval DNS_R_SYNTAX Spec is not valid, details were logged.
+ * @retval others       Errors from action.
+ */
+isc_result_t
+rr_range_expand(isc_mem_t *mctx, const char *spec, rr_range_action_t action,
+		void *arg) {
+	isc_result_t result;
+	ld_string_t *owner = NULL;
+	ld_string_t *rdata = NULL;
+	const char *range, *lhs, *type_text, *rhs;
+	size_t range_len, lhs_len, type_len, rhs_len;
+	isc_textregion_t type_region;
+	dns_rdatatype_t type;
+	unsigned long start, stop, step, value;
+
+	range = skip_space(spec);
+	range_len = token_len(range);
+	lhs = skip_space(range + range_len);
+	lhs_len = token_len(lhs);
+	type_text = skip_space(lhs + lhs_len);
+	type_len = token_len(type_text);
+	rhs = skip_space(type_text + type_len);
+	rhs_len = strlen(rhs);
+	if (range_len == 0 || lhs_len == 0 || type_len == 0 || rhs_len == 0) {
+		log_error("range generator '%s': expected "
+			  "'<start>-<stop>[/<step>] <owner> <type> <rdata>'",
+			  spec);
+		CLEANUP_WITH(DNS_R_SYNTAX);
+	}
+
+	CHECK(range_parse(spec, range, range_len, &start, &stop, &step));
+	DE_CONST(type_text, type_region.base);
+	type_region.length = type_len;
+	result = dns_rdatatype_fromtext(&type, &type_region);
+	if (result != ISC_R_SUCCESS || type == dns_rdatatype_soa) {
+		log_error("range generator '%s': unsupported type '%.*s'",
+			  spec, (int)type_len, type_text);
+		CLEANUP_WITH(DNS_R_SYNTAX);
+	}
+
+	CHECK(str_new(mctx, &owner));
+	CHECK(str_new(mctx, &rdata));
+	for (value = start; ; value += step) {
+		CHECK(range_subst(spec, lhs, lhs_len, value, owner));
+		CHECK(range_subst(spec, rhs, rhs_len, value, rdata));
+		CHECK(action(arg, str_buf(owner), type, str_buf(rdata)));
+		if (stop - value < step)
+			break;
+	}
+
+cleanup:
+	str_destroy(&owner);
+	str_destroy(&rdata);
+	return result;
+}
+
+isc_result_t
+rr_range_register_create(isc_mem_t *mctx, rr_range_register_t **regp) {
+	isc_result_t result;
+	rr_range_register_t *reg = NULL;
+	isc_boolean_t lock_ready = ISC_FALSE;
+
+	REQUIRE(regp != NULL && *regp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, reg);
+	ZERO_PTR(reg);
+	isc_mem_attach(mctx, &reg->mctx);
+	CHECK(isc_mutex_init(&reg->lock));
+	lock_ready = ISC_TRUE;
+	CHECK(isc_ht_init(&reg->ht, mctx, RR_RANGE_HT_BITS));
+
+	*regp = reg;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (reg != NULL) {
+		if (lock_ready == ISC_TRUE)
+			DESTROYLOCK(&reg->lock);
+		MEM_PUT_AND_DETACH(reg);
+	}
+	return result;
+}
+
+void
+rr_range_register_destroy(rr_range_register_t **regp) {
+	rr_range_register_t *reg;
+	isc_ht_iter_t *iter = NULL;
+	isc_result_t result;
+	void *value;
+
+	if (regp == NULL || *regp == NULL)
+		return;
+
+	reg = *regp;
+
+	LOCK(&reg->lock);
+	RUNTIME_CHECK(isc_ht_iter_create(reg->ht, &iter) == ISC_R_SUCCESS);
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_delcurrent_next(iter)) {
+		value = NULL;
+		isc_ht_iter_current(iter, &value);
+		isc_mem_free(reg->mctx, value);
+	}
+	isc_ht_iter_destroy(&iter);
+	isc_ht_destroy(&reg->ht);
+	UNLOCK(&reg->lock);
+	DESTROYLOCK(&reg->lock);
+
+	MEM_PUT_AND_DETACH(reg);
+	*regp = NULL;
+}
+
+/**
+ * Get copy of generator values applied for given entry.
+ * Values are separated by newline.
+ *
+ * @param[out] specsp Copy allocated from mctx, free with isc_mem_free().
+ *
+ * @retval ISC_R_NOTFOUND Entry does not generate any records.
+ */
+isc_result_t
+rr_range_get(rr_range_register_t *reg, isc_mem_t *mctx, struct berval *uuid,
+	     char **specsp) {
+	isc_result_t result;
+	void *value = NULL;
+
+	REQUIRE(specsp != NULL && *specsp == NULL);
+
+	LOCK(&reg->lock);
+	result = isc_ht_find(reg->ht, (const unsigned char *)uuid->bv_val,
+			     uuid->bv_len, &value);
+	if (result == ISC_R_SUCCESS)
+		CHECKED_MEM_STRDUP(mctx, value, *specsp);
+
+cleanup:
+	UNLOCK(&reg->lock);
+	return result;
+}
+
+/**
+ * Remember generator values applied for given entry.
+ */
+isc_result_t
+rr_range_set(rr_range_register_t *reg, struct berval *uuid,
+	     const char *specs) {
+	isc_result_t result;
+	char *new_specs = NULL;
+	void *value = NULL;
+
+	CHECKED_MEM_STRDUP(reg->mctx, specs, new_specs);
+
+	LOCK(&reg->lock);
+	if (isc_ht_find(reg->ht, (const unsigned char *)uuid->bv_val,
+			uuid->bv_len, &value) == ISC_R_SUCCESS) {
+		RUNTIME_CHECK(isc_ht_delete(reg->ht,
+					    (const unsigned char *)uuid->bv_val,
+					    uuid->bv_len) == ISC_R_SUCCESS);
+		isc_mem_free(reg->mctx, value);
+	}
+	result = isc_ht_add(reg->ht, (const unsigned char *)uuid->bv_val,
+			    uuid->bv_len, new_specs);
+	if (result == ISC_R_SUCCESS)
+		new_specs = NULL;
+	UNLOCK(&reg->lock);
+
+cleanup:
+	if (new_specs != NULL)
+		isc_mem_free(reg->mctx, new_specs);
+	return result;
+}
+
+void
+rr_range_remove(rr_range_register_t *reg, struct berval *uuid) {
+	void *value = NULL;
+
+	LOCK(&reg->lock);
+	if (isc_ht_find(reg->ht, (const unsigned char *)uuid->bv_val,
+			uuid->bv_len, &value) == ISC_R_SUCCESS) {
+		RUNTIME_CHECK(isc_ht_delete(reg->ht,
+					    (const unsigned char *)uuid->bv_val,
+					    uuid->bv_len) == ISC_R_SUCCESS);
+		isc_mem_free(reg->mctx, value);
+	}
+	UNLOCK(&reg->lock);
+}
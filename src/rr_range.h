@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2016  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Generators of formulaic records from idnsRangeGenerator values.
+ */
+
+#ifndef _LD_RR_RANGE_H_
+#define _LD_RR_RANGE_H_
+
+#include <dns/types.h>
+
+#include "types.h"
+#include "util.h"
+
+#define LDAP_DEPRECATED 1
+#include <ldap.h>
+
+/** Maximal number of records produced by generators of one entry. */
+#define RR_RANGE_MAX	65536
+
+typedef struct rr_range_register	rr_range_register_t;
+
+/**
+ * Callback called for each generated record.
+ *
+ * @param[in] owner Owner name in text form, relative names are relative
+ *                  to zone origin.
+ * @param[in] rdata Record data in text form.
+ */
+typedef isc_result_t
+(*rr_range_action_t)(void *arg, const char *owner, dns_rdatatype_t type,
+		     const char *rdata);
+
+isc_result_t
+rr_range_count(const char *spec, unsigned long *countp)
+	       ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+rr_range_expand(isc_mem_t *mctx, const char *spec, rr_range_action_t action,
+		void *arg) ATTR_NONNULL(1,2,3) ATTR_CHECKRESULT;
+
+isc_result_t
+rr_range_register_create(isc_mem_t *mctx, rr_range_register_t **regp)
+			 ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+rr_range_register_destroy(rr_range_register_t **regp) ATTR_NONNULLS;
+
+isc_result_t
+rr_range_get(rr_range_register_t *reg, isc_mem_t *mctx, struct berval *uuid,
+	     char **specsp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+rr_range_set(rr_range_register_t *reg, struct berval *uuid,
+	     const char *specs) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+rr_range_remove(rr_range_register_t *reg, struct berval *uuid) ATTR_NONNULLS;
+
+#endif /* !_LD_RR_RANGE_H_ */
@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2016  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Set of DNS record attributes supported by LDAP schema.
+ *
+ * Record of a type without type-specific attribute like "URIRecord" has to be
+ * stored in generic attribute "UnknownRecord;TYPE256". The set of supported
+ * attributes is read from LDAP subschema subentry so the right attribute
+ * can be chosen without a failed LDAP write.
+ */
+
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/stdtime.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/rdatatype.h>
+
+#include <ldap_schema.h>
+#include <string.h>
+#include <strings.h>
+
+#include "ldap_convert.h"
+#include "log.h"
+#include "rr_schema.h"
+#include "util.h"
+
+/** Bitmap with one bit for each RR type. */
+#define RR_SCHEMA_BITMAP_SIZE	(65536 / 8)
+/** Minimal interval between re-reads of unchanged schema in seconds. */
+#define RR_SCHEMA_RECHECK_INTERVAL	60
+
+struct rr_schema {
+	isc_mem_t		*mctx;
+	isc_mutex_t		lock;
+	/** ISC_FALSE if schema was not read yet or could not be read. */
+	isc_boolean_t		valid;
+	/** modifyTimestamp of subschema entry which was read last time. */
+	char			*stamp;
+	isc_stdtime_t		last_check;
+	/** Bit is set if type-specific attribute is present in schema. */
+	unsigned char		present[RR_SCHEMA_BITMAP_SIZE];
+};
+
+static inline isc_boolean_t
+bit_get(const unsigned char *bitmap, dns_rdatatype_t rdtype) {
+	return ISC_TF((bitmap[rdtype / 8] & (1 << (rdtype % 8))) != 0);
+}
+
+static inline void
+bit_set(unsigned char *bitmap, dns_rdatatype_t rdtype, isc_boolean_t value) {
+	if (value == ISC_TRUE)
+		bitmap[rdtype / 8] |= (1 << (rdtype % 8));
+	else
+		bitmap[rdtype / 8] &= ~(1 << (rdtype % 8));
+}
+
+isc_result_t
+rr_schema_create(isc_mem_t *mctx, rr_schema_t **schemap) {
+	isc_result_t result;
+	rr_schema_t *schema = NULL;
+
+	REQUIRE(schemap != NULL && *schemap == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, schema);
+	ZERO_PTR(schema);
+	isc_mem_attach(mctx, &schema->mctx);
+	result = isc_mutex_init(&schema->lock);
+	if (result != ISC_R_SUCCESS) {
+		MEM_PUT_AND_DETACH(schema);
+		return result;
+	}
+
+	*schemap = schema;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+void
+rr_schema_destroy(rr_schema_t **schemap) {
+	rr_schema_t *schema = *schemap;
+
+	if (schema == NULL)
+		return;
+
+	if (schema->stamp != NULL)
+		isc_mem_free(schema->mctx, schema->stamp);
+	DESTROYLOCK(&schema->lock);
+	MEM_PUT_AND_DETACH(schema);
+	*schemap = NULL;
+}
+
+/**
+ * Read the first value of attribute 'attr' from entry 'dn'.
+ *
+ * @retval ISC_R_NOTFOUND Entry or attribute does not exist.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+entry_value_get(isc_mem_t *mctx, LDAP *ld, const char *dn, char *attr,
+		char **valuep) {
+	isc_result_t result;
+	char *attrs[] = { attr, NULL };
+	LDAPMessage *msg = NULL;
+	LDAPMessage *entry;
+	struct berval **values = NULL;
+	char *value = NULL;
+	int ret;
+
+	REQUIRE(*valuep == NULL);
+
+	ret = ldap_search_ext_s(ld, dn, LDAP_SCOPE_BASE, "(objectClass=*)",
+				attrs, 0, NULL, NULL, NULL, LDAP_NO_LIMIT,
+				&msg);
+	if (ret == LDAP_NO_SUCH_OBJECT)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+	else if (ret != LDAP_SUCCESS) {
+		log_ldap_error(ld, "while reading entry '%s'", dn);
+		CLEANUP_WITH(ISC_R_FAILURE);
+	}
+
+	entry = ldap_first_entry(ld, msg);
+	if (entry == NULL)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+	values = ldap_get_values_len(ld, entry, attr);
+	if (values == NULL || values[0] == NULL)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+
+	CHECKED_MEM_ALLOCATE(mctx, value, values[0]->bv_len + 1);
+	memcpy(value, values[0]->bv_val, values[0]->bv_len);
+	value[values[0]->bv_len] = '\0';
+	*valuep = value;
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	if (values != NULL)
+		ldap_value_free_len(values);
+	if (msg != NULL)
+		ldap_msgfree(msg);
+	return result;
+}
+
+/**
+ * Get RR type from name of type-specific attribute like "URIRecord".
+ * Unlike ldap_attribute_to_rdatatype() it does not complain about
+ * unrelated attributes which are present in schema.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+attribute_rdatatype(const char *attr, dns_rdatatype_t *rdtype) {
+	size_t len = strlen(attr);
+	isc_textregion_t region;
+
+	if (len <= LDAP_RDATATYPE_SUFFIX_LEN
+	    || strcasecmp(attr + len - LDAP_RDATATYPE_SUFFIX_LEN,
+			  LDAP_RDATATYPE_SUFFIX) != 0)
+		return ISC_R_NOTFOUND;
+
+	region.base = (char *)attr;
+	region.length = len - LDAP_RDATATYPE_SUFFIX_LEN;
+	/* "UnknownRecord" is not recognized as RR type */
+	return dns_rdatatype_fromtext(rdtype, &region);
+}
+
+/**
+ * Fill bitmap with RR types which have type-specific attribute
+ * in attributeTypes of subschema subentry 'dn'.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+attributes_read(LDAP *ld, const char *dn, unsigned char *present) {
+	isc_result_t result;
+	char *attrs[] = { "attributeTypes", NULL };
+	LDAPMessage *msg = NULL;
+	LDAPMessage *entry;
+	struct berval **values = NULL;
+	LDAPAttributeType *at;
+	dns_rdatatype_t rdtype;
+	const char *err;
+	int code;
+	int ret;
+
+	ret = ldap_search_ext_s(ld, dn, LDAP_SCOPE_BASE,
+				"(objectClass=subschema)", attrs, 0, NULL,
+				NULL, NULL, LDAP_NO_LIMIT, &msg);
+	if (ret != LDAP_SUCCESS) {
+		log_ldap_error(ld, "while reading schema from '%s'", dn);
+		CLEANUP_WITH(ISC_R_FAILURE);
+	}
+	entry = ldap_first_entry(ld, msg);
+	if (entry == NULL)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+	values = ldap_get_values_len(ld, entry, attrs[0]);
+	if (values == NULL)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+
+	for (unsigned int i = 0; values[i] != NULL; i++) {
+		at = ldap_str2attributetype(values[i]->bv_val, &code, &err,
+					    LDAP_SCHEMA_ALLOW_ALL);
+		if (at == NULL)
+			continue;
+		for (unsigned int j = 0;
+		     at->at_names != NULL && at->at_names[j] != NULL;
+		     j++) {
+			if (attribute_rdatatype(at->at_names[j], &rdtype)
+			    == ISC_R_SUCCESS)
+				bit_set(present, rdtype, ISC_TRUE);
+		}
+		ldap_attributetype_free(at);
+	}
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	if (values != NULL)
+		ldap_value_free_len(values);
+	if (msg != NULL)
+		ldap_msgfree(msg);
+	return result;
+}
+
+/**
+ * Re-read the set of supported record attributes if LDAP schema changed
+ * since the last call. Schema which cannot be read is considered unknown
+ * and callers have to try type-specific attribute first.
+ *
+ * @param[in] ld Bound LDAP connection.
+ */
+isc_result_t
+rr_schema_refresh(rr_schema_t *schema, LDAP *ld) {
+	isc_result_t result;
+	char *subschema_dn = NULL;
+	char *stamp = NULL;
+	unsigned char *present = NULL;
+	isc_boolean_t changed;
+	isc_stdtime_t now;
+
+	isc_stdtime_get(&now);
+	LOCK(&schema->lock);
+	schema->last_check = now;
+	UNLOCK(&schema->lock);
+
+	CHECK(entry_value_get(schema->mctx, ld, "", "subschemaSubentry",
+			      &subschema_dn));
+	result = entry_value_get(schema->mctx, ld, subschema_dn,
+				 "modifyTimestamp", &stamp);
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
+		goto cleanup;
+
+	LOCK(&schema->lock);
+	changed = ISC_TF(schema->valid == ISC_FALSE || stamp == NULL
+			 || schema->stamp == NULL
+			 || strcmp(stamp, schema->stamp) != 0);
+	UNLOCK(&schema->lock);
+	if (changed == ISC_FALSE)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+
+	CHECKED_MEM_GET(schema->mctx, present, RR_SCHEMA_BITMAP_SIZE);
+	memset(present, 0, RR_SCHEMA_BITMAP_SIZE);
+	CHECK(attributes_read(ld, subschema_dn, present));
+
+	LOCK(&schema->lock);
+	memcpy(schema->present, present, RR_SCHEMA_BITMAP_SIZE);
+	if (schema->stamp != NULL)
+		isc_mem_free(schema->mctx, schema->stamp);
+	schema->stamp = stamp;
+	stamp = NULL;
+	schema->valid = ISC_TRUE;
+	UNLOCK(&schema->lock);
+	log_debug(2, "record attributes were read from LDAP schema '%s'",
+		  subschema_dn);
+
+cleanup:
+	if (result != ISC_R_SUCCESS) {
+		log_error_r("unable to read record attributes from LDAP schema: "
+			    "trying type-specific attributes first");
+		LOCK(&schema->lock);
+		schema->valid = ISC_FALSE;
+		UNLOCK(&schema->lock);
+	}
+	if (present != NULL)
+		isc_mem_put(schema->mctx, present, RR_SCHEMA_BITMAP_SIZE);
+	if (stamp != NULL)
+		isc_mem_free(schema->mctx, stamp);
+	if (subschema_dn != NULL)
+		isc_mem_free(schema->mctx, subschema_dn);
+	return result;
+}
+
+/**
+ * @retval ISC_TRUE if the schema was not checked for a while and should be
+ *         re-read because some write did not match the known schema.
+ */
+isc_boolean_t
+rr_schema_recheck(rr_schema_t *schema) {
+	isc_stdtime_t now;
+	isc_boolean_t recheck;
+
+	isc_stdtime_get(&now);
+	LOCK(&schema->lock);
+	recheck = ISC_TF(now - schema->last_check
+			 >= RR_SCHEMA_RECHECK_INTERVAL);
+	UNLOCK(&schema->lock);
+
+	return recheck;
+}
+
+/**
+ * Decide which attribute should be tried first for records of given type.
+ *
+ * @retval ISC_TRUE  use generic attribute "UnknownRecord;TYPE256"
+ * @retval ISC_FALSE use type-specific attribute like "URIRecord"
+ *                   or the schema is not known
+ */
+isc_boolean_t
+rr_schema_use_unknown(rr_schema_t *schema, dns_rdatatype_t rdtype) {
+	isc_boolean_t unknown;
+
+	LOCK(&schema->lock);
+	unknown = ISC_TF(schema->valid == ISC_TRUE
+			 && bit_get(schema->present, rdtype) == ISC_FALSE);
+	UNLOCK(&schema->lock);
+
+	return unknown;
+}
+
+/**
+ * Remember attribute which was accepted by LDAP server for given type
+ * even if the schema read last time says otherwise. Access control can
+ * refuse type-specific attribute which is present in the schema.
+ */
+void
+rr_schema_learn(rr_schema_t *schema, dns_rdatatype_t rdtype,
+		isc_boolean_t unknown) {
+	LOCK(&schema->lock);
+	if (schema->valid == ISC_TRUE)
+		bit_set(schema->present, rdtype, ISC_TF(unknown == ISC_FALSE));
+	UNLOCK(&schema->lock);
+}
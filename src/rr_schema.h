@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2016  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Set of DNS record attributes supported by LDAP schema.
+ */
+
+#ifndef _LD_RR_SCHEMA_H_
+#define _LD_RR_SCHEMA_H_
+
+#include <dns/types.h>
+
+#include "types.h"
+#include "util.h"
+
+#define LDAP_DEPRECATED 1
+#include <ldap.h>
+
+isc_result_t
+rr_schema_create(isc_mem_t *mctx, rr_schema_t **schemap)
+		 ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+rr_schema_destroy(rr_schema_t **schemap) ATTR_NONNULLS;
+
+isc_result_t
+rr_schema_refresh(rr_schema_t *schema, LDAP *ld) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_boolean_t
+rr_schema_recheck(rr_schema_t *schema) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_boolean_t
+rr_schema_use_unknown(rr_schema_t *schema, dns_rdatatype_t rdtype)
+		      ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+rr_schema_learn(rr_schema_t *schema, dns_rdatatype_t rdtype,
+		isc_boolean_t unknown) ATTR_NONNULLS;
+
+#endif /* !_LD_RR_SCHEMA_H_ */
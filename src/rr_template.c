@@ -0,0 +1,941 @@
+/*
+ * Copyright (C) 2016  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Pre-compiled templates for idnsTemplateAttribute values.
+ */
+
+#include <isc/ht.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/rwlock.h>
+#include <isc/util.h>
+
+#include "ldap_entry.h"
+#include "rr_template.h"
+#include "settings.h"
+#include "str.h"
+#include "util.h"
+
+/** Number of bits used for hash table with compiled templates. */
+#define RR_TEMPLATE_HT_BITS	8
+/** Number of bits used for hash table with variable names. */
+#define RR_TEMPLATE_VARS_HT_BITS	4
+/** Number of bits used for hash table with entries using one variable. */
+#define RR_TEMPLATE_DEPS_HT_BITS	10
+/** Number of bits used for hash table with copies of dependent entries. */
+#define RR_TEMPLATE_ENTRIES_HT_BITS	10
+/** Number of bits used for hash table with renderings of one template. */
+#define RR_TEMPLATE_RENDERS_HT_BITS	6
+
+typedef enum {
+	rr_tseg_literal,	/**< text copied verbatim to the output */
+	rr_tseg_variable	/**< name of setting substituted into output */
+} rr_tseg_type_t;
+
+typedef struct rr_tseg {
+	rr_tseg_type_t	type;
+	char		*text;	/**< literal text or variable name */
+	size_t		len;
+} rr_tseg_t;
+
+/**
+ * Output of a template rendered for one set of settings.
+ */
+typedef struct rr_trender {
+	isc_uint32_t		generation;
+	isc_result_t		result;
+	char			*rendered; /**< NULL unless result is SUCCESS */
+} rr_trender_t;
+
+/**
+ * Template string split into a sequence of literal and variable segments.
+ *
+ * Rendered output is stored for each set of settings the template was
+ * rendered for, together with generation of the set, so subsequent
+ * rendering with unchanged settings is just a copy. Zones which share
+ * a template do not evict each other's output. Outputs are keyed
+ * by settings_set_id() so an output rendered for a freed set cannot be
+ * returned for a new set allocated on the same address.
+ */
+typedef struct rr_template {
+	unsigned int		nsegs;
+	rr_tseg_t		*segs;
+
+	isc_mutex_t		lock;	/**< guards renders */
+	isc_ht_t		*renders; /**< settings_set_id() -> rr_trender_t */
+} rr_template_t;
+
+/**
+ * Cache of compiled templates keyed by template string.
+ *
+ * Templates are never removed from the cache before the cache itself is
+ * destroyed. The number of distinct template strings is limited by
+ * data in LDAP and templates are typically used in very few objects.
+ *
+ * Dependency index maps variable name to set of entries which use
+ * the variable in some template. Each set is a hash table of
+ * rr_template_dep_t keyed by entryUUID. The index allows to re-render
+ * only affected entries when a variable changes.
+ *
+ * Copy of each dependent entry is kept so the entry can be re-rendered
+ * without reading it from LDAP again, see rr_template_entry_get().
+ */
+struct rr_template_cache {
+	isc_mem_t		*mctx;
+	isc_rwlock_t		rwlock;
+	isc_ht_t		*ht;
+
+	isc_mutex_t		deps_lock;
+	isc_ht_t		*deps;
+	isc_ht_t		*entries; /**< entryUUID -> ldap_entry_t */
+};
+
+static isc_boolean_t
+isvarchar(const char c) {
+	return ISC_TF((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+		      || (c >= '0' && c <= '9') || c == '_' || c == '-');
+}
+
+/**
+ * Test if string at offset pos starts with \{variable_name\}.
+ *
+ * @param[out] name_len Length of variable name.
+ */
+static isc_boolean_t ATTR_NONNULLS
+template_isref(const char *str, size_t pos, size_t *name_len) {
+	size_t i;
+
+	if (str[pos] != '\\' || str[pos + 1] != '{')
+		return ISC_FALSE;
+
+	for (i = pos + 2; isvarchar(str[i]); i++)
+		;
+	if (i == pos + 2 || str[i] != '\\' || str[i + 1] != '}')
+		return ISC_FALSE;
+
+	*name_len = i - (pos + 2);
+	return ISC_TRUE;
+}
+
+/**
+ * Find next \{variable_name\} in the string. \{ and \} must not be
+ * double-escaped like \\{ or \\}.
+ *
+ * Matching rules are equivalent to regular expression
+ * "\(^\|[^\]\)\\{\([a-zA-Z0-9_-]\+\)\\}" applied to string starting at pos.
+ *
+ * @param[in]  pos      Offset where search starts.
+ * @param[out] lit_len  Length of verbatim text preceding the reference.
+ * @param[out] name_len Length of variable name. The name starts at offset
+ *                      pos + lit_len + 2.
+ *
+ * @retval ISC_TRUE  Reference was found.
+ * @retval ISC_FALSE No more references, rest of the string is verbatim text.
+ */
+static isc_boolean_t ATTR_NONNULLS
+template_nextref(const char *str, size_t pos, size_t *lit_len,
+		 size_t *name_len) {
+	if (template_isref(str, pos, name_len)) {
+		*lit_len = 0;
+		return ISC_TRUE;
+	}
+
+	for (size_t i = pos; str[i] != '\0'; i++) {
+		if (str[i] != '\\' && template_isref(str, i + 1, name_len)) {
+			*lit_len = i + 1 - pos;
+			return ISC_TRUE;
+		}
+	}
+
+	return ISC_FALSE;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+tseg_fill(isc_mem_t *mctx, rr_tseg_t *seg, rr_tseg_type_t type,
+	  const char *text, size_t len) {
+	isc_result_t result;
+
+	CHECKED_MEM_ALLOCATE(mctx, seg->text, len + 1);
+	memcpy(seg->text, text, len);
+	seg->text[len] = '\0';
+	seg->len = len;
+	seg->type = type;
+
+cleanup:
+	return result;
+}
+
+static void ATTR_NONNULLS
+trender_free(isc_mem_t *mctx, rr_trender_t **renderp) {
+	rr_trender_t *render = *renderp;
+
+	if (render == NULL)
+		return;
+
+	if (render->rendered != NULL)
+		isc_mem_free(mctx, render->rendered);
+	SAFE_MEM_PUT_PTR(mctx, render);
+	*renderp = NULL;
+}
+
+static void ATTR_NONNULLS
+template_free(isc_mem_t *mctx, rr_template_t **tmplp) {
+	rr_template_t *tmpl = *tmplp;
+	isc_ht_iter_t *iter = NULL;
+	isc_result_t result;
+	void *value;
+	rr_trender_t *render;
+
+	if (tmpl == NULL)
+		return;
+
+	for (unsigned int i = 0; i < tmpl->nsegs; i++) {
+		if (tmpl->segs[i].text != NULL)
+			isc_mem_free(mctx, tmpl->segs[i].text);
+	}
+	SAFE_MEM_PUT(mctx, tmpl->segs, tmpl->nsegs * sizeof(*tmpl->segs));
+	if (tmpl->renders != NULL) {
+		RUNTIME_CHECK(isc_ht_iter_create(tmpl->renders, &iter)
+			      == ISC_R_SUCCESS);
+		for (result = isc_ht_iter_first(iter);
+		     result == ISC_R_SUCCESS;
+		     result = isc_ht_iter_delcurrent_next(iter)) {
+			value = NULL;
+			isc_ht_iter_current(iter, &value);
+			render = value;
+			trender_free(mctx, &render);
+		}
+		isc_ht_iter_destroy(&iter);
+		isc_ht_destroy(&tmpl->renders);
+	}
+	DESTROYLOCK(&tmpl->lock);
+	SAFE_MEM_PUT_PTR(mctx, tmpl);
+	*tmplp = NULL;
+}
+
+/**
+ * Split template string into literal and variable segments.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+template_compile(isc_mem_t *mctx, const char *template_str,
+		 rr_template_t **tmplp) {
+	isc_result_t result;
+	rr_template_t *tmpl = NULL;
+	isc_boolean_t lock_ready = ISC_FALSE;
+	unsigned int nsegs = 0;
+	unsigned int seg = 0;
+	size_t pos;
+	size_t lit_len;
+	size_t name_len;
+
+	REQUIRE(tmplp != NULL && *tmplp == NULL);
+
+	/* count segments first */
+	for (pos = 0;
+	     template_nextref(template_str, pos, &lit_len, &name_len);
+	     pos += lit_len + name_len + 4) {
+		nsegs += (lit_len > 0) ? 2 : 1;
+	}
+	if (template_str[pos] != '\0')
+		nsegs++;
+
+	CHECKED_MEM_GET_PTR(mctx, tmpl);
+	ZERO_PTR(tmpl);
+	CHECK(isc_mutex_init(&tmpl->lock));
+	lock_ready = ISC_TRUE;
+	CHECK(isc_ht_init(&tmpl->renders, mctx, RR_TEMPLATE_RENDERS_HT_BITS));
+	if (nsegs > 0) {
+		CHECKED_MEM_GET(mctx, tmpl->segs, nsegs * sizeof(*tmpl->segs));
+		memset(tmpl->segs, 0, nsegs * sizeof(*tmpl->segs));
+		tmpl->nsegs = nsegs;
+	}
+
+	for (pos = 0;
+	     template_nextref(template_str, pos, &lit_len, &name_len);
+	     pos += lit_len + name_len + 4) {
+		if (lit_len > 0)
+			CHECK(tseg_fill(mctx, &tmpl->segs[seg++],
+					rr_tseg_literal, template_str + pos,
+					lit_len));
+		CHECK(tseg_fill(mctx, &tmpl->segs[seg++], rr_tseg_variable,
+				template_str + pos + lit_len + 2, name_len));
+	}
+	if (template_str[pos] != '\0')
+		CHECK(tseg_fill(mctx, &tmpl->segs[seg++], rr_tseg_literal,
+				template_str + pos, strlen(template_str + pos)));
+	INSIST(seg == nsegs);
+
+	*tmplp = tmpl;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (tmpl != NULL) {
+		if (lock_ready == ISC_TRUE)
+			template_free(mctx, &tmpl);
+		else
+			SAFE_MEM_PUT_PTR(mctx, tmpl);
+	}
+	return result;
+}
+
+/**
+ * Concatenate segments of compiled template and values of variables
+ * from settings tree.
+ *
+ * @retval ISC_R_SUCCESS  Output contains complete result.
+ * @retval ISC_R_IGNORE   Some variables are not defined in settings tree.
+ * @retval others         Unexpected errors.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+template_expand(const rr_template_t *tmpl, const settings_set_t *set,
+		const char *template_str, ld_string_t *output) {
+	isc_result_t result = ISC_R_SUCCESS;
+	setting_t *setting;
+	const rr_tseg_t *seg;
+
+	for (unsigned int i = 0; i < tmpl->nsegs; i++) {
+		seg = &tmpl->segs[i];
+		if (seg->type == rr_tseg_literal) {
+			CHECK(str_cat_char_len(output, seg->text, seg->len));
+			continue;
+		}
+
+		/* find value for given variable name in settings tree */
+		setting = NULL;
+		result = setting_find(seg->text, set, isc_boolean_true,
+				      isc_boolean_true, &setting);
+		if (result != ISC_R_SUCCESS) {
+			log_debug(3, "setting '%s' is not defined so it "
+				  "cannot be substituted into template '%s'",
+				  seg->text, template_str);
+			CLEANUP_WITH(ISC_R_IGNORE);
+		}
+		if (setting->type != ST_STRING) {
+			log_bug("setting '%s' it not string so it cannot be "
+				"substituted", seg->text);
+			CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
+		}
+		CHECK(str_cat_char(output, setting->value.value_char));
+	}
+
+cleanup:
+	return result;
+}
+
+/**
+ * Find compiled template in cache or compile the template and store it
+ * in the cache.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+template_get(rr_template_cache_t *cache, const char *template_str,
+	     rr_template_t **tmplp) {
+	isc_result_t result;
+	rr_template_t *new_tmpl = NULL;
+	void *value = NULL;
+	const unsigned char *key = (const unsigned char *)template_str;
+	isc_uint32_t keysize = strlen(template_str);
+
+	REQUIRE(keysize > 0);
+
+	RWLOCK(&cache->rwlock, isc_rwlocktype_read);
+	result = isc_ht_find(cache->ht, key, keysize, &value);
+	RWUNLOCK(&cache->rwlock, isc_rwlocktype_read);
+	if (result == ISC_R_SUCCESS) {
+		*tmplp = value;
+		return result;
+	} else if (result != ISC_R_NOTFOUND) {
+		return result;
+	}
+
+	/* compile outside of the lock, conflicts are resolved below */
+	CHECK(template_compile(cache->mctx, template_str, &new_tmpl));
+	log_debug(10, "template '%s' compiled into %u segments",
+		  template_str, new_tmpl->nsegs);
+
+	RWLOCK(&cache->rwlock, isc_rwlocktype_write);
+	result = isc_ht_add(cache->ht, key, keysize, new_tmpl);
+	if (result == ISC_R_SUCCESS) {
+		value = new_tmpl;
+		new_tmpl = NULL;
+	} else if (result == ISC_R_EXISTS) {
+		/* other thread was faster */
+		result = isc_ht_find(cache->ht, key, keysize, &value);
+	}
+	RWUNLOCK(&cache->rwlock, isc_rwlocktype_write);
+	if (result == ISC_R_SUCCESS)
+		*tmplp = value;
+
+cleanup:
+	template_free(cache->mctx, &new_tmpl);
+	return result;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+dep_create(isc_mem_t *mctx, struct berval *uuid, const char *dn,
+	   rr_template_dep_t **depp) {
+	isc_result_t result;
+	rr_template_dep_t *dep = NULL;
+
+	REQUIRE(depp != NULL && *depp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, dep);
+	ZERO_PTR(dep);
+	INIT_LINK(dep, link);
+	CHECKED_MEM_STRDUP(mctx, dn, dep->dn);
+	dep->uuid = ber_dupbv(NULL, uuid);
+	if (dep->uuid == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+
+	*depp = dep;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (dep != NULL) {
+		if (dep->dn != NULL)
+			isc_mem_free(mctx, dep->dn);
+		SAFE_MEM_PUT_PTR(mctx, dep);
+	}
+	return result;
+}
+
+void
+rr_template_dep_free(isc_mem_t *mctx, rr_template_dep_t **depp) {
+	rr_template_dep_t *dep = *depp;
+
+	if (dep == NULL)
+		return;
+
+	if (dep->uuid != NULL)
+		ber_bvfree(dep->uuid);
+	if (dep->dn != NULL)
+		isc_mem_free(mctx, dep->dn);
+	SAFE_MEM_PUT_PTR(mctx, dep);
+	*depp = NULL;
+}
+
+/**
+ * Destroy set of entries using one variable.
+ */
+static void ATTR_NONNULLS
+depset_destroy(isc_mem_t *mctx, isc_ht_t **setp) {
+	isc_ht_iter_t *iter = NULL;
+	isc_result_t result;
+	void *value;
+	rr_template_dep_t *dep;
+
+	RUNTIME_CHECK(isc_ht_iter_create(*setp, &iter) == ISC_R_SUCCESS);
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_delcurrent_next(iter)) {
+		value = NULL;
+		isc_ht_iter_current(iter, &value);
+		dep = value;
+		rr_template_dep_free(mctx, &dep);
+	}
+	isc_ht_iter_destroy(&iter);
+	isc_ht_destroy(setp);
+}
+
+/**
+ * Record that entry with given UUID uses given variable.
+ *
+ * @pre cache->deps_lock is locked.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+deps_add_variable(rr_template_cache_t *cache, const rr_tseg_t *var,
+		  struct berval *uuid, const char *dn) {
+	isc_result_t result;
+	isc_ht_t *set = NULL;
+	rr_template_dep_t *dep = NULL;
+	void *value = NULL;
+	char *new_dn = NULL;
+
+	result = isc_ht_find(cache->deps, (const unsigned char *)var->text,
+			     var->len, &value);
+	if (result == ISC_R_NOTFOUND) {
+		CHECK(isc_ht_init(&set, cache->mctx, RR_TEMPLATE_DEPS_HT_BITS));
+		result = isc_ht_add(cache->deps,
+				    (const unsigned char *)var->text,
+				    var->len, set);
+		if (result != ISC_R_SUCCESS) {
+			isc_ht_destroy(&set);
+			goto cleanup;
+		}
+	} else if (result == ISC_R_SUCCESS) {
+		set = value;
+	} else {
+		goto cleanup;
+	}
+
+	value = NULL;
+	result = isc_ht_find(set, (const unsigned char *)uuid->bv_val,
+			     uuid->bv_len, &value);
+	if (result == ISC_R_SUCCESS) {
+		/* entry is already known, just refresh its DN */
+		dep = value;
+		if (strcmp(dep->dn, dn) != 0) {
+			CHECKED_MEM_STRDUP(cache->mctx, dn, new_dn);
+			isc_mem_free(cache->mctx, dep->dn);
+			dep->dn = new_dn;
+		}
+		dep = NULL;
+	} else if (result == ISC_R_NOTFOUND) {
+		CHECK(dep_create(cache->mctx, uuid, dn, &dep));
+		CHECK(isc_ht_add(set, (const unsigned char *)uuid->bv_val,
+				 uuid->bv_len, dep));
+		dep = NULL;
+	}
+
+cleanup:
+	rr_template_dep_free(cache->mctx, &dep);
+	return result;
+}
+
+isc_result_t
+rr_template_cache_create(isc_mem_t *mctx, rr_template_cache_t **cachep) {
+	isc_result_t result;
+	rr_template_cache_t *cache = NULL;
+	isc_boolean_t lock_ready = ISC_FALSE;
+	isc_boolean_t deps_lock_ready = ISC_FALSE;
+
+	REQUIRE(cachep != NULL && *cachep == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, cache);
+	ZERO_PTR(cache);
+	isc_mem_attach(mctx, &cache->mctx);
+	CHECK(isc_rwlock_init(&cache->rwlock, 0, 0));
+	lock_ready = ISC_TRUE;
+	CHECK(isc_mutex_init(&cache->deps_lock));
+	deps_lock_ready = ISC_TRUE;
+	CHECK(isc_ht_init(&cache->ht, mctx, RR_TEMPLATE_HT_BITS));
+	CHECK(isc_ht_init(&cache->deps, mctx, RR_TEMPLATE_VARS_HT_BITS));
+	CHECK(isc_ht_init(&cache->entries, mctx, RR_TEMPLATE_ENTRIES_HT_BITS));
+
+	*cachep = cache;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (cache != NULL) {
+		if (cache->ht != NULL)
+			isc_ht_destroy(&cache->ht);
+		if (cache->deps != NULL)
+			isc_ht_destroy(&cache->deps);
+		if (deps_lock_ready == ISC_TRUE)
+			DESTROYLOCK(&cache->deps_lock);
+		if (lock_ready == ISC_TRUE)
+			isc_rwlock_destroy(&cache->rwlock);
+		MEM_PUT_AND_DETACH(cache);
+	}
+	return result;
+}
+
+void
+rr_template_cache_destroy(rr_template_cache_t **cachep) {
+	rr_template_cache_t *cache;
+	isc_ht_iter_t *iter = NULL;
+	isc_result_t result;
+	void *value;
+	rr_template_t *tmpl;
+	isc_ht_t *set;
+	ldap_entry_t *entry;
+
+	if (cachep == NULL || *cachep == NULL)
+		return;
+
+	cache = *cachep;
+
+	LOCK(&cache->deps_lock);
+	RUNTIME_CHECK(isc_ht_iter_create(cache->deps, &iter) == ISC_R_SUCCESS);
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_delcurrent_next(iter)) {
+		value = NULL;
+		isc_ht_iter_current(iter, &value);
+		set = value;
+		depset_destroy(cache->mctx, &set);
+	}
+	isc_ht_iter_destroy(&iter);
+	isc_ht_destroy(&cache->deps);
+
+	RUNTIME_CHECK(isc_ht_iter_create(cache->entries, &iter)
+		      == ISC_R_SUCCESS);
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_delcurrent_next(iter)) {
+		value = NULL;
+		isc_ht_iter_current(iter, &value);
+		entry = value;
+		ldap_entry_destroy(&entry);
+	}
+	isc_ht_iter_destroy(&iter);
+	isc_ht_destroy(&cache->entries);
+	UNLOCK(&cache->deps_lock);
+	DESTROYLOCK(&cache->deps_lock);
+
+	RWLOCK(&cache->rwlock, isc_rwlocktype_write);
+	RUNTIME_CHECK(isc_ht_iter_create(cache->ht, &iter) == ISC_R_SUCCESS);
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_delcurrent_next(iter)) {
+		value = NULL;
+		isc_ht_iter_current(iter, &value);
+		tmpl = value;
+		template_free(cache->mctx, &tmpl);
+	}
+	isc_ht_iter_destroy(&iter);
+	isc_ht_destroy(&cache->ht);
+	RWUNLOCK(&cache->rwlock, isc_rwlocktype_write);
+	isc_rwlock_destroy(&cache->rwlock);
+	MEM_PUT_AND_DETACH(cache);
+
+	*cachep = NULL;
+}
+
+/**
+ * Replace occurrences of \{variable_name\} with respective strings from
+ * settings tree. Remaining parts of the original string are just copied
+ * into the output.
+ *
+ * Double-escaped strings \\{ \\} do not trigger substitution.
+ * Nested references will expand only innermost variable: \{\{var1\}\}
+ * Non-matching parentheses and other garbage will be copied verbatim
+ * without trigerring an error.
+ *
+ * Each distinct template string is parsed only once. Output is re-used
+ * as long as the same set of settings is used and no value visible from
+ * the set was changed.
+ *
+ * @retval  ISC_R_SUCCESS  Output string is valid. Caller must deallocate output.
+ * @retval  ISC_R_IGNORE   Some variables used in the template are not defined
+ *                         in settings tree. Substitution was terminated
+ *                         prematurely and output is not available.
+ * @retval  others         Unexpected errors.
+ */
+isc_result_t
+rr_template_render(rr_template_cache_t *cache, const settings_set_t *set,
+		   const char *template_str, ld_string_t **output) {
+	isc_result_t result;
+	rr_template_t *tmpl = NULL;
+	rr_trender_t *render = NULL;
+	rr_trender_t *new_render = NULL;
+	ld_string_t *replaced = NULL;
+	isc_uint32_t generation;
+	isc_boolean_t locked = ISC_FALSE;
+	void *value = NULL;
+	isc_uint64_t set_id = settings_set_id(set);
+	const unsigned char *key = (const unsigned char *)&set_id;
+
+	REQUIRE(output != NULL && *output == NULL);
+
+	CHECK(str_new(cache->mctx, &replaced));
+	/* output has to be valid even if the template expands to nothing */
+	CHECK(str_init_char(replaced, ""));
+	if (*template_str == '\0')
+		goto done;
+
+	CHECK(template_get(cache, template_str, &tmpl));
+
+	/* read generation before expansion so changes done in the middle
+	 * of expansion invalidate the result */
+	generation = settings_set_generation(set);
+	LOCK(&tmpl->lock);
+	locked = ISC_TRUE;
+	result = isc_ht_find(tmpl->renders, key, sizeof(set_id), &value);
+	if (result == ISC_R_SUCCESS) {
+		render = value;
+		if (render->generation == generation
+		    && (render->result == ISC_R_SUCCESS
+			|| render->result == ISC_R_IGNORE)) {
+			CHECK(render->result);
+			CHECK(str_cat_char(replaced, render->rendered));
+			goto done;
+		}
+	} else if (result != ISC_R_NOTFOUND) {
+		goto cleanup;
+	}
+
+	result = template_expand(tmpl, set, template_str, replaced);
+	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
+		goto cleanup;
+	if (render == NULL) {
+		CHECKED_MEM_GET_PTR(cache->mctx, new_render);
+		ZERO_PTR(new_render);
+		new_render->result = ISC_R_NOTFOUND;
+		CHECK(isc_ht_add(tmpl->renders, key, sizeof(set_id),
+				 new_render));
+		render = new_render;
+		new_render = NULL;
+	}
+	if (render->rendered != NULL)
+		isc_mem_free(cache->mctx, render->rendered);
+	render->rendered = NULL;
+	render->result = ISC_R_NOTFOUND;
+	if (result == ISC_R_SUCCESS)
+		CHECKED_MEM_STRDUP(cache->mctx, str_buf(replaced),
+				   render->rendered);
+	render->generation = generation;
+	render->result = result;
+	CHECK(render->result);
+
+done:
+	*output = replaced;
+	replaced = NULL;
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	if (locked == ISC_TRUE)
+		UNLOCK(&tmpl->lock);
+	trender_free(cache->mctx, &new_render);
+	str_destroy(&replaced);
+	return result;
+}
+
+/**
+ * Forget output rendered for given set of settings. Call it before the set
+ * is freed so outputs for sets which do not exist anymore do not accumulate
+ * in the cache. Output added by a render which runs concurrently is never
+ * used because identifier of the set is not re-used.
+ */
+void
+rr_template_cache_forget(rr_template_cache_t *cache, const settings_set_t *set)
+{
+	isc_ht_iter_t *iter = NULL;
+	isc_result_t result;
+	void *value;
+	rr_template_t *tmpl;
+	rr_trender_t *render;
+	isc_uint64_t set_id = settings_set_id(set);
+	const unsigned char *key = (const unsigned char *)&set_id;
+
+	RWLOCK(&cache->rwlock, isc_rwlocktype_read);
+	RUNTIME_CHECK(isc_ht_iter_create(cache->ht, &iter) == ISC_R_SUCCESS);
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_next(iter)) {
+		value = NULL;
+		isc_ht_iter_current(iter, &value);
+		tmpl = value;
+
+		LOCK(&tmpl->lock);
+		value = NULL;
+		if (isc_ht_find(tmpl->renders, key, sizeof(set_id), &value)
+		    == ISC_R_SUCCESS) {
+			render = value;
+			RUNTIME_CHECK(isc_ht_delete(tmpl->renders, key,
+						    sizeof(set_id))
+				      == ISC_R_SUCCESS);
+			trender_free(cache->mctx, &render);
+		}
+		UNLOCK(&tmpl->lock);
+	}
+	isc_ht_iter_destroy(&iter);
+	RWUNLOCK(&cache->rwlock, isc_rwlocktype_read);
+}
+
+/**
+ * Record that entry with given UUID and DN uses the template. The entry
+ * will be returned by rr_template_deps_get() for each variable
+ * referenced from the template.
+ *
+ * Call rr_template_deps_remove() before the entry is parsed again
+ * so variables which are not used anymore are forgotten.
+ */
+isc_result_t
+rr_template_deps_add(rr_template_cache_t *cache, const char *template_str,
+		     struct berval *uuid, const char *dn) {
+	isc_result_t result = ISC_R_SUCCESS;
+	rr_template_t *tmpl = NULL;
+
+	if (*template_str == '\0')
+		return ISC_R_SUCCESS;
+
+	CHECK(template_get(cache, template_str, &tmpl));
+
+	LOCK(&cache->deps_lock);
+	for (unsigned int i = 0; i < tmpl->nsegs; i++) {
+		if (tmpl->segs[i].type != rr_tseg_variable)
+			continue;
+		result = deps_add_variable(cache, &tmpl->segs[i], uuid, dn);
+		if (result != ISC_R_SUCCESS)
+			break;
+	}
+	UNLOCK(&cache->deps_lock);
+
+cleanup:
+	return result;
+}
+
+/**
+ * Forget all variables used by entry with given UUID
+ * and the copy of the entry.
+ */
+void
+rr_template_deps_remove(rr_template_cache_t *cache, struct berval *uuid) {
+	isc_ht_iter_t *iter = NULL;
+	isc_result_t result;
+	void *value;
+	isc_ht_t *set;
+	rr_template_dep_t *dep;
+	ldap_entry_t *entry;
+
+	LOCK(&cache->deps_lock);
+	value = NULL;
+	if (isc_ht_find(cache->entries, (const unsigned char *)uuid->bv_val,
+			uuid->bv_len, &value) == ISC_R_SUCCESS) {
+		entry = value;
+		RUNTIME_CHECK(isc_ht_delete(cache->entries,
+					    (const unsigned char *)uuid->bv_val,
+					    uuid->bv_len) == ISC_R_SUCCESS);
+		ldap_entry_destroy(&entry);
+	}
+
+	RUNTIME_CHECK(isc_ht_iter_create(cache->deps, &iter) == ISC_R_SUCCESS);
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_next(iter)) {
+		value = NULL;
+		isc_ht_iter_current(iter, &value);
+		set = value;
+
+		value = NULL;
+		if (isc_ht_find(set, (const unsigned char *)uuid->bv_val,
+				uuid->bv_len, &value) != ISC_R_SUCCESS)
+			continue;
+		dep = value;
+		RUNTIME_CHECK(isc_ht_delete(set,
+					    (const unsigned char *)uuid->bv_val,
+					    uuid->bv_len) == ISC_R_SUCCESS);
+		rr_template_dep_free(cache->mctx, &dep);
+	}
+	isc_ht_iter_destroy(&iter);
+	UNLOCK(&cache->deps_lock);
+}
+
+/**
+ * Keep copy of entry which uses some variable so the entry can be
+ * re-rendered when the variable changes. Copy stored before is replaced.
+ *
+ * @pre entry->uuid != NULL
+ */
+isc_result_t
+rr_template_entry_save(rr_template_cache_t *cache, const ldap_entry_t *entry) {
+	isc_result_t result;
+	ldap_entry_t *copy = NULL;
+	ldap_entry_t *old;
+	void *value = NULL;
+	struct berval *uuid = entry->uuid;
+
+	REQUIRE(uuid != NULL);
+
+	CHECK(ldap_entry_copy(cache->mctx, entry, ISC_FALSE, &copy));
+
+	LOCK(&cache->deps_lock);
+	if (isc_ht_find(cache->entries, (const unsigned char *)uuid->bv_val,
+			uuid->bv_len, &value) == ISC_R_SUCCESS) {
+		old = value;
+		RUNTIME_CHECK(isc_ht_delete(cache->entries,
+					    (const unsigned char *)uuid->bv_val,
+					    uuid->bv_len) == ISC_R_SUCCESS);
+		ldap_entry_destroy(&old);
+	}
+	result = isc_ht_add(cache->entries, (const unsigned char *)uuid->bv_val,
+			    uuid->bv_len, copy);
+	if (result == ISC_R_SUCCESS)
+		copy = NULL;
+	UNLOCK(&cache->deps_lock);
+
+cleanup:
+	ldap_entry_destroy(&copy);
+	return result;
+}
+
+/**
+ * Get copy of entry stored by rr_template_entry_save().
+ * The copy can be parsed in the same way as entries read from LDAP.
+ *
+ * @param[out] entryp Resulting entry. Caller has to free it.
+ *
+ * @retval ISC_R_SUCCESS
+ * @retval ISC_R_NOTFOUND No copy is stored, i.e. entry does not use
+ *                        any variable or it was deleted.
+ */
+isc_result_t
+rr_template_entry_get(rr_template_cache_t *cache, isc_mem_t *mctx,
+		      struct berval *uuid, ldap_entry_t **entryp) {
+	isc_result_t result;
+	void *value = NULL;
+
+	LOCK(&cache->deps_lock);
+	result = isc_ht_find(cache->entries, (const unsigned char *)uuid->bv_val,
+			     uuid->bv_len, &value);
+	if (result == ISC_R_SUCCESS)
+		result = ldap_entry_copy(mctx, value, ISC_TRUE, entryp);
+	UNLOCK(&cache->deps_lock);
+
+	return result;
+}
+
+/**
+ * Get copy of list of entries which use given variable in some template.
+ *
+ * @param[in]  mctx     Memory context used for the list.
+ * @param[out] deps     Empty initialized list. Caller must deallocate it using
+ *                      rr_template_deplist_free().
+ *
+ * @retval ISC_R_SUCCESS  List is complete. It can be empty if no entry
+ *                        uses the variable.
+ * @retval others         Unexpected errors. List is empty.
+ */
+isc_result_t
+rr_template_deps_get(rr_template_cache_t *cache, isc_mem_t *mctx,
+		     const char *variable, rr_template_deplist_t *deps) {
+	isc_result_t result;
+	isc_ht_iter_t *iter = NULL;
+	void *value = NULL;
+	isc_ht_t *set;
+	rr_template_dep_t *dep;
+	rr_template_dep_t *new_dep = NULL;
+
+	REQUIRE(EMPTY(*deps));
+
+	LOCK(&cache->deps_lock);
+	result = isc_ht_find(cache->deps, (const unsigned char *)variable,
+			     strlen(variable), &value);
+	if (result == ISC_R_NOTFOUND)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	else if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	set = value;
+
+	CHECK(isc_ht_iter_create(set, &iter));
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_next(iter)) {
+		value = NULL;
+		isc_ht_iter_current(iter, &value);
+		dep = value;
+		CHECK(dep_create(mctx, dep->uuid, dep->dn, &new_dep));
+		APPEND(*deps, new_dep, link);
+		new_dep = NULL;
+	}
+	if (result == ISC_R_NOMORE)
+		result = ISC_R_SUCCESS;
+
+cleanup:
+	if (iter != NULL)
+		isc_ht_iter_destroy(&iter);
+	UNLOCK(&cache->deps_lock);
+	if (result != ISC_R_SUCCESS)
+		rr_template_deplist_free(mctx, deps);
+	return result;
+}
+
+void
+rr_template_deplist_free(isc_mem_t *mctx, rr_template_deplist_t *deps) {
+	rr_template_dep_t *dep;
+
+	while ((dep = HEAD(*deps)) != NULL) {
+		UNLINK(*deps, dep, link);
+		rr_template_dep_free(mctx, &dep);
+	}
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2016  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Pre-compiled templates for idnsTemplateAttribute values.
+ */
+
+#ifndef _LD_RR_TEMPLATE_H_
+#define _LD_RR_TEMPLATE_H_
+
+#include "settings.h"
+#include "str.h"
+#include "types.h"
+#include "util.h"
+
+#define LDAP_DEPRECATED 1
+#include <ldap.h>
+
+typedef struct rr_template_cache	rr_template_cache_t;
+
+/** Entry which uses a template referring to some variable. */
+typedef struct rr_template_dep		rr_template_dep_t;
+typedef LIST(rr_template_dep_t)		rr_template_deplist_t;
+struct rr_template_dep {
+	struct berval			*uuid;
+	char				*dn;
+	LINK(rr_template_dep_t)		link;
+};
+
+isc_result_t
+rr_template_cache_create(isc_mem_t *mctx, rr_template_cache_t **cachep)
+			 ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+rr_template_cache_destroy(rr_template_cache_t **cachep) ATTR_NONNULLS;
+
+isc_result_t
+rr_template_render(rr_template_cache_t *cache, const settings_set_t *set,
+		   const char *template_str, ld_string_t **output)
+		   ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+rr_template_cache_forget(rr_template_cache_t *cache, const settings_set_t *set)
+			 ATTR_NONNULLS;
+
+isc_result_t
+rr_template_deps_add(rr_template_cache_t *cache, const char *template_str,
+		     struct berval *uuid, const char *dn)
+		     ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+rr_template_deps_remove(rr_template_cache_t *cache, struct berval *uuid)
+			ATTR_NONNULLS;
+
+isc_result_t
+rr_template_entry_save(rr_template_cache_t *cache, const ldap_entry_t *entry)
+		       ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+rr_template_entry_get(rr_template_cache_t *cache, isc_mem_t *mctx,
+		      struct berval *uuid, ldap_entry_t **entryp)
+		      ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+rr_template_deps_get(rr_template_cache_t *cache, isc_mem_t *mctx,
+		     const char *variable, rr_template_deplist_t *deps)
+		     ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+rr_template_dep_free(isc_mem_t *mctx, rr_template_dep_t **depp) ATTR_NONNULLS;
+
+void
+rr_template_deplist_free(isc_mem_t *mctx, rr_template_deplist_t *deps)
+			 ATTR_NONNULLS;
+
+#endif /* !_LD_RR_TEMPLATE_H_ */
@@ -4,6 +4,8 @@
 
 #include <isc/util.h>
 #include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/refcount.h>
 #include <isc/task.h>
 #include <isc/result.h>
 #include <isc/string.h>
@@ -17,6 +19,7 @@
 #include <string.h>
 #include <strings.h>
 
+#include "atomic.h"
 #include "log.h"
 #include "settings.h"
 #include "str.h"
@@ -27,6 +30,9 @@
 
 isc_boolean_t verbose_checks = ISC_FALSE; /* log each failure in CHECK() macro */
 
+/** Last identifier assigned by settings_set_create(). */
+static isc_uint64_t set_id_last = 0;
+
 /** Built-in defaults. */
 static const setting_t settings_default[] = {
 	{ "default_ttl",		default_uint(86400)		}, /* Seconds */
@@ -38,6 +44,8 @@ static const setting_t settings_default[] = {
 	{ "cache_ttl",			default_string("")		}, /* No longer supported */
 	{ "timeout",			default_uint(10)		},
 	{ "base",	 		no_default_string		}, /* User have to set this */
+	{ "extra_bases",		default_string("")		},
+	{ "data_source",		default_string("")		}, /* Own SyncRepl */
 	{ "auth_method",		default_string("none")		},
 	{ "bind_dn",			default_string("")		},
 	{ "password",			default_string("")		},
@@ -53,6 +61,9 @@ static const setting_t settings_default[] = {
 	{ "ldap_hostname",		default_string("")		},
 	{ "sync_ptr",			default_boolean(ISC_FALSE)	},
 	{ "dyn_update",			default_boolean(ISC_FALSE)	},
+	{ "per_zone_sync",		default_boolean(ISC_FALSE)	},
+	{ "zone_shards",		default_uint(1)			}, /* No sharding */
+	{ "zone_shard_index",		default_uint(0)			},
 	/* Empty string as default update_policy declares zone as 'dynamic'
 	 * for dns_zone_isdynamic() to prevent unwanted
 	 * zone_postload() calls and warnings about serial and so on.
@@ -67,6 +78,52 @@ static const setting_t settings_default[] = {
 	end_of_settings
 };
 
+/** Names of settings indexed by setting_id_t. */
+static const char * const setting_names[SETTING_COUNT] = {
+	[SETTING_ACTIVE] = "active",
+	[SETTING_ALLOW_QUERY] = "allow_query",
+	[SETTING_ALLOW_TRANSFER] = "allow_transfer",
+	[SETTING_AUTH_METHOD] = "auth_method",
+	[SETTING_AUTH_METHOD_ENUM] = "auth_method_enum",
+	[SETTING_BASE] = "base",
+	[SETTING_BIND_DN] = "bind_dn",
+	[SETTING_CACHE_TTL] = "cache_ttl",
+	[SETTING_CONNECTIONS] = "connections",
+	[SETTING_DATA_SOURCE] = "data_source",
+	[SETTING_DEFAULT_TTL] = "default_ttl",
+	[SETTING_DIRECTORY] = "directory",
+	[SETTING_DYN_UPDATE] = "dyn_update",
+	[SETTING_EXTRA_BASES] = "extra_bases",
+	[SETTING_FAKE_MNAME] = "fake_mname",
+	[SETTING_FORWARD_POLICY] = "forward_policy",
+	[SETTING_FORWARDERS] = "forwarders",
+	[SETTING_KRB5_KEYTAB] = "krb5_keytab",
+	[SETTING_KRB5_PRINCIPAL] = "krb5_principal",
+	[SETTING_LDAP_HOSTNAME] = "ldap_hostname",
+	[SETTING_NSEC3PARAM] = "nsec3param",
+	[SETTING_PASSWORD] = "password",
+	[SETTING_PER_ZONE_SYNC] = "per_zone_sync",
+	[SETTING_PSEARCH] = "psearch",
+	[SETTING_RECONNECT_INTERVAL] = "reconnect_interval",
+	[SETTING_SASL_AUTH_NAME] = "sasl_auth_name",
+	[SETTING_SASL_MECH] = "sasl_mech",
+	[SETTING_SASL_PASSWORD] = "sasl_password",
+	[SETTING_SASL_REALM] = "sasl_realm",
+	[SETTING_SASL_USER] = "sasl_user",
+	[SETTING_SERIAL_AUTOINCREMENT] = "serial_autoincrement",
+	[SETTING_SERVER_ID] = "server_id",
+	[SETTING_SOA_MNAME] = "soa_mname",
+	[SETTING_SUBSTITUTIONVARIABLE_IPALOCATION] = "substitutionvariable_ipalocation",
+	[SETTING_SYNC_PTR] = "sync_ptr",
+	[SETTING_TIMEOUT] = "timeout",
+	[SETTING_UPDATE_POLICY] = "update_policy",
+	[SETTING_URI] = "uri",
+	[SETTING_VERBOSE_CHECKS] = "verbose_checks",
+	[SETTING_ZONE_REFRESH] = "zone_refresh",
+	[SETTING_ZONE_SHARD_INDEX] = "zone_shard_index",
+	[SETTING_ZONE_SHARDS] = "zone_shards",
+};
+
 /** Settings set for built-in defaults. */
 const settings_set_t settings_default_set = {
 	NULL,
@@ -77,52 +134,176 @@ const settings_set_t settings_default_set = {
 };
 
 /**
- * @param[in] name Setting name.
+ * Verify that setting_names[] is sorted, setting_name_to_id() depends on it.
+ *
+ * @retval ISC_R_SUCCESS
+ * @retval ISC_R_UNEXPECTED setting_names[] is not sorted.
+ */
+isc_result_t
+settings_check_names(void) {
+	for (unsigned int i = 1; i < SETTING_COUNT; i++) {
+		if (strcmp(setting_names[i - 1], setting_names[i]) >= 0) {
+			log_bug("setting names '%s' and '%s' are not sorted",
+				setting_names[i - 1], setting_names[i]);
+			return ISC_R_UNEXPECTED;
+		}
+	}
+	return ISC_R_SUCCESS;
+}
+
+/**
+ * Atomically increment generation number of the set.
+ * Sets which are not allocated by settings_set_create() cannot be modified
+ * so they do not have generation number.
+ */
+static void ATTR_NONNULLS
+generation_bump(const settings_set_t *set) {
+	isc_refcount_increment0(&((settings_set_t *)set)->generation, NULL);
+}
+
+/**
+ * Translate setting name to setting_id_t using binary search
+ * in setting_names[].
+ *
+ * @retval ISC_R_SUCCESS
+ * @retval ISC_R_NOTFOUND Name does not belong to any known setting.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+setting_name_to_id(const char *name, setting_id_t *id) {
+	unsigned int low = 0;
+	unsigned int high = SETTING_COUNT;
+	unsigned int mid;
+	int cmp;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+		cmp = strcmp(name, setting_names[mid]);
+		if (cmp == 0) {
+			*id = mid;
+			return ISC_R_SUCCESS;
+		} else if (cmp < 0) {
+			high = mid;
+		} else {
+			low = mid + 1;
+		}
+	}
+	return ISC_R_NOTFOUND;
+}
+
+/**
+ * Get setting with given ID from a single set (parent sets are ignored).
+ *
+ * Statically initialized sets (e.g. built-in defaults) do not have slots
+ * so these sets have to be searched linearly.
+ */
+static setting_t * ATTR_NONNULLS
+settings_set_slot(const settings_set_t *set, const setting_id_t id) {
+	if (set->mctx != NULL)
+		return set->slots[id];
+
+	for (setting_t *setting = set->first_setting;
+	     setting->name != NULL;
+	     setting++) {
+		if (strcmp(setting_names[id], setting->name) == 0)
+			return setting;
+	}
+	return NULL;
+}
+
+/**
+ * @param[in] id Setting ID.
  * @param[in] set Set of settings to start search in.
  * @param[in] recursive Continue with search in parent sets if setting was
  *                      not found in set passed by caller.
  * @param[in] filled_only Consider settings without value as non-existent.
  * @param[out] found Pointer to found setting_t. Ignored if found is NULL.
  *
+ * Result of recursive search for filled settings is cached in the set
+ * passed by caller. Change in the set or any of its parents invalidates
+ * the cache so subsequent searches have to walk the settings tree again,
+ * see settings_set_generation().
+ *
  * @pre found == NULL || (found != NULL && *found == NULL)
  *
  * @retval ISC_R_SUCCESS
  * @retval ISC_R_NOTFOUND
  */
 isc_result_t
-setting_find(const char *name, const settings_set_t *set,
-	     isc_boolean_t recursive, isc_boolean_t filled_only,
-	     setting_t **found) {
+setting_find_id(const setting_id_t id, const settings_set_t *set,
+		isc_boolean_t recursive, isc_boolean_t filled_only,
+		setting_t **found) {
+	const settings_set_t *const leaf = set;
+	isc_boolean_t cacheable;
+	isc_uint32_t generation = 0;
+	setting_t *setting = NULL;
 
-	REQUIRE(name != NULL);
+	REQUIRE(id < SETTING_COUNT);
 	REQUIRE(found == NULL || *found == NULL);
 
+	cacheable = ISC_TF(set != NULL && set->mctx != NULL
+			   && recursive && filled_only);
+	if (cacheable == ISC_TRUE) {
+		/* read generation before search so changes done in the middle
+		 * of search invalidate the result */
+		generation = settings_set_generation(set);
+		LOCK(set->lock);
+		if (set->cache_generation[id] == generation)
+			setting = set->cache[id];
+		UNLOCK(set->lock);
+		if (setting != NULL && setting->filled)
+			goto found;
+	}
+
+	setting = NULL;
 	while (set != NULL) {
 		log_debug(20, "examining set of settings '%s'", set->name);
-		for (setting_t *setting = set->first_setting;
-				setting->name;
-				setting++) {
-
-			if (strcmp(name, setting->name) == 0) {
-				if (setting->filled || !filled_only) {
-					if (found != NULL)
-						*found = setting;
-					log_debug(20, "setting '%s' was found "
-						      "in set '%s'", name,
-						      set->name);
-					return ISC_R_SUCCESS;
-				} else {
-					break; /* continue with parent set */
-				}
-			}
-
+		setting = settings_set_slot(set, id);
+		if (setting != NULL && (setting->filled || !filled_only)) {
+			log_debug(20, "setting '%s' was found in set '%s'",
+				  setting_names[id], set->name);
+			break;
 		}
+		setting = NULL;
 		if (recursive)
 			set = set->parent_set;
 		else
 			break;
 	}
-	return ISC_R_NOTFOUND;
+	if (setting == NULL)
+		return ISC_R_NOTFOUND;
+
+	if (cacheable == ISC_TRUE) {
+		LOCK(leaf->lock);
+		((settings_set_t *)leaf)->cache[id] = setting;
+		((settings_set_t *)leaf)->cache_generation[id] = generation;
+		UNLOCK(leaf->lock);
+	}
+
+found:
+	if (found != NULL)
+		*found = setting;
+	return ISC_R_SUCCESS;
+}
+
+/**
+ * Same as setting_find_id() but setting is identified by name.
+ *
+ * @retval ISC_R_SUCCESS
+ * @retval ISC_R_NOTFOUND
+ */
+isc_result_t
+setting_find(const char *name, const settings_set_t *set,
+	     isc_boolean_t recursive, isc_boolean_t filled_only,
+	     setting_t **found) {
+	setting_id_t id;
+
+	REQUIRE(name != NULL);
+	REQUIRE(found == NULL || *found == NULL);
+
+	if (setting_name_to_id(name, &id) != ISC_R_SUCCESS)
+		return ISC_R_NOTFOUND;
+
+	return setting_find_id(id, set, recursive, filled_only, found);
 }
 
 /**
@@ -145,20 +326,21 @@ setting_find(const char *name, const settings_set_t *set,
  *                          error.)
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-setting_get(const char *const name, const setting_type_t type,
+setting_get(const setting_id_t id, const setting_type_t type,
 	    const settings_set_t *const set, void *target)
 {
 	isc_result_t result;
 	setting_t *setting = NULL;
 
-	REQUIRE(name != NULL);
 	REQUIRE(target != NULL);
 
-	CHECK(setting_find(name, set, isc_boolean_true, isc_boolean_true, &setting));
+	CHECK(setting_find_id(id, set, isc_boolean_true, isc_boolean_true,
+			      &setting));
 
 	if (setting->type != type) {
 		log_bug("incompatible setting data type requested "
-			"for name '%s' in set of settings '%s'", name, set->name);				\
+			"for name '%s' in set of settings '%s'",
+			setting_names[id], set->name);
 		return ISC_R_UNEXPECTED;
 	}
 
@@ -181,29 +363,30 @@ setting_get(const char *const name, const setting_type_t type,
 	return ISC_R_SUCCESS;
 
 cleanup:
-	log_bug("setting '%s' was not found in settings tree", name);
+	log_bug("setting '%s' was not found in settings tree",
+		setting_names[id]);
 	return result;
 }
 
 isc_result_t
-setting_get_uint(const char *const name, const settings_set_t *const set,
+setting_get_uint(const setting_id_t id, const settings_set_t *const set,
 		 isc_uint32_t *target)
 {
-	return setting_get(name, ST_UNSIGNED_INTEGER, set, target);
+	return setting_get(id, ST_UNSIGNED_INTEGER, set, target);
 }
 
 isc_result_t
-setting_get_str(const char *const name, const settings_set_t *const set,
+setting_get_str(const setting_id_t id, const settings_set_t *const set,
 		const char **target)
 {
-	return setting_get(name, ST_STRING, set, target);
+	return setting_get(id, ST_STRING, set, target);
 }
 
 isc_result_t
-setting_get_bool(const char *const name, const settings_set_t *const set,
+setting_get_bool(const setting_id_t id, const settings_set_t *const set,
 		 isc_boolean_t *target)
 {
-	return setting_get(name, ST_BOOLEAN, set, target);
+	return setting_get(id, ST_BOOLEAN, set, target);
 }
 
 /**
@@ -301,6 +484,7 @@ set_value(isc_mem_t *mctx, const settings_set_t *set, setting_t *setting,
 		break;
 	}
 	setting->filled = 1;
+	generation_bump(set);
 	result = ISC_R_SUCCESS;
 
 cleanup:
@@ -363,7 +547,12 @@ setting_unset(const char *const name, const settings_set_t *set)
 	isc_result_t result;
 	setting_t *setting = NULL;
 
-	CHECK(setting_find(name, set, ISC_FALSE, ISC_FALSE, &setting));
+	result = setting_find(name, set, ISC_FALSE, ISC_FALSE, &setting);
+	if (result == ISC_R_NOTFOUND)
+		log_bug("setting '%s' was not found in set of settings '%s'",
+			name, set->name);
+	if (result != ISC_R_SUCCESS)
+		return result;
 
 	if (!setting->filled)
 		return ISC_R_IGNORE;
@@ -386,14 +575,10 @@ setting_unset(const char *const name, const settings_set_t *set)
 		break;
 	}
 	setting->filled = 0;
-
-cleanup:
+	generation_bump(set);
 	UNLOCK(set->lock);
-	if (result == ISC_R_NOTFOUND)
-		log_bug("setting '%s' was not found in set of settings '%s'",
-			name, set->name);
 
-	return result;
+	return ISC_R_SUCCESS;
 }
 
 /**
@@ -404,7 +589,8 @@ cleanup:
  *
  * @retval ISC_R_SUCCESS  Setting was changed (set or unset).
  * @retval ISC_R_IGNORE   Setting wasn't changed because value in settings set
- *                        and LDAP entry was same.
+ *                        and LDAP entry was same or because the value
+ *                        is missing in both.
  * @retval ISC_R_NOTFOUND Required setting was not found in given set.
  * @retval Others         Memory allocation or conversion errors.
  */
@@ -418,10 +604,12 @@ setting_update_from_ldap_entry(const char *name, settings_set_t *set,
 	CHECK(setting_find(name, set, ISC_FALSE, ISC_FALSE, &setting));
 	result = ldap_entry_getvalues(entry, attr_name, &values);
 	if (result == ISC_R_NOTFOUND || HEAD(values) == NULL) {
-		CHECK(setting_unset(name, set));
-		log_debug(2, "setting '%s' (%s) was deleted in object %s",
-			  name, attr_name, ldap_entry_logname(entry));
-		return ISC_R_SUCCESS;
+		/* ISC_R_IGNORE is returned if the setting was not set */
+		result = setting_unset(name, set);
+		if (result == ISC_R_SUCCESS)
+			log_debug(2, "setting '%s' (%s) was deleted in object %s",
+				  name, attr_name, ldap_entry_logname(entry));
+		return result;
 
 	} else if (result != ISC_R_SUCCESS) {
 		goto cleanup;
@@ -487,12 +675,13 @@ settings_set_create(isc_mem_t *mctx, const setting_t default_settings[],
 		    settings_set_t **target) {
 	isc_result_t result = ISC_R_FAILURE;
 	settings_set_t *new_set = NULL;
+	setting_id_t id;
 
 	REQUIRE(target != NULL && *target == NULL);
 	REQUIRE(default_settings != NULL);
 	REQUIRE(default_set_length > 0);
 
-	CHECKED_MEM_ALLOCATE(mctx, new_set, default_set_length);
+	CHECKED_MEM_ALLOCATE(mctx, new_set, sizeof(*new_set));
 	ZERO_PTR(new_set);
 	isc_mem_attach(mctx, &new_set->mctx);
 
@@ -500,7 +689,13 @@ settings_set_create(isc_mem_t *mctx, const setting_t default_settings[],
 	result = isc_mutex_init(new_set->lock);
 	INSIST(result == ISC_R_SUCCESS);
 
+	/* generation is valid whenever the lock is allocated,
+	 * see settings_set_free() */
+	result = isc_refcount_init(&new_set->generation, 0);
+	INSIST(result == ISC_R_SUCCESS);
+
 	new_set->parent_set = parent_set;
+	new_set->id = ATOMIC_FETCH_INCREMENT_RELAXED(&set_id_last) + 1;
 
 	CHECKED_MEM_ALLOCATE(mctx, new_set->first_setting, default_set_length);
 	memcpy(new_set->first_setting, default_settings, default_set_length);
@@ -508,6 +703,19 @@ settings_set_create(isc_mem_t *mctx, const setting_t default_settings[],
 	CHECKED_MEM_ALLOCATE(mctx, new_set->name, strlen(set_name) + 1);
 	strcpy(new_set->name, set_name);
 
+	for (setting_t *setting = new_set->first_setting;
+	     setting->name != NULL;
+	     setting++) {
+		result = setting_name_to_id(setting->name, &id);
+		if (result != ISC_R_SUCCESS) {
+			log_bug("setting '%s' is not listed in setting_id_t",
+				setting->name);
+			CLEANUP_WITH(ISC_R_UNEXPECTED);
+		}
+		if (new_set->slots[id] == NULL)
+			new_set->slots[id] = setting;
+	}
+
 	*target = new_set;
 	result = ISC_R_SUCCESS;
 
@@ -537,6 +745,12 @@ settings_set_free(settings_set_t **set) {
 		if ((*set)->lock != NULL) {
 			DESTROYLOCK((*set)->lock);
 			SAFE_MEM_PUT_PTR(mctx, (*set)->lock);
+			/* generation only grows but isc_refcount_destroy()
+			 * requires zero */
+			while (isc_refcount_current(&(*set)->generation) > 0)
+				isc_refcount_decrement(&(*set)->generation,
+						       NULL);
+			isc_refcount_destroy(&(*set)->generation);
 		}
 
 		for (s = (*set)->first_setting; s->name != NULL; s++) {
@@ -651,6 +865,53 @@ settings_set_isfilled(settings_set_t *set) {
 	return isfiled;
 }
 
+/**
+ * Get generation number which describes current state of all values visible
+ * from given set of settings, i.e. values from the set and all its parents.
+ *
+ * Every change in a set of settings increments generation number of the set
+ * so changes in unrelated sets do not affect the result. The sum over
+ * the chain of parent sets differs from any previously returned value
+ * if and only if some value visible from the set was changed in the meantime.
+ *
+ * Use it for invalidation of values derived from settings, e.g.:
+ * @code
+ * if (cached_generation != settings_set_generation(set))
+ *	recompute();
+ * @endcode
+ *
+ * @warning Generation numbers of distinct sets are not comparable.
+ *          A new set can be allocated on the same address as a freed set,
+ *          key cached values by settings_set_id() instead of the address.
+ */
+isc_uint32_t
+settings_set_generation(const settings_set_t *set) {
+	isc_uint32_t generation = 0;
+
+	REQUIRE(set != NULL);
+
+	for (; set != NULL; set = set->parent_set) {
+		if (set->mctx != NULL)
+			generation += (isc_uint32_t)
+				isc_refcount_current(&set->generation);
+	}
+	return generation;
+}
+
+/**
+ * Get identifier of the set which is unique for the whole life of the
+ * process. Use it instead of address of the set as a key for values
+ * derived from the set which might outlive the set itself.
+ *
+ * @retval 0 for sets which were not created by settings_set_create().
+ */
+isc_uint64_t
+settings_set_id(const settings_set_t *set) {
+	REQUIRE(set != NULL);
+
+	return set->id;
+}
+
 /**
  * Parse string with dyndb configuration and fill in settings_set_t structure.
  *
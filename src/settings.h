@@ -5,6 +5,7 @@
 #ifndef _LD_SETTINGS_H_
 #define _LD_SETTINGS_H_
 
+#include <isc/refcount.h>
 #include <isc/types.h>
 
 #include <isccfg/grammar.h>
@@ -20,6 +21,57 @@
 
 typedef struct setting	setting_t;
 
+/**
+ * Identifiers of all known settings. Names are in setting_names[]
+ * in settings.c. Keep both lists sorted alphabetically.
+ */
+typedef enum {
+	SETTING_ACTIVE,
+	SETTING_ALLOW_QUERY,
+	SETTING_ALLOW_TRANSFER,
+	SETTING_AUTH_METHOD,
+	SETTING_AUTH_METHOD_ENUM,
+	SETTING_BASE,
+	SETTING_BIND_DN,
+	SETTING_CACHE_TTL,
+	SETTING_CONNECTIONS,
+	SETTING_DATA_SOURCE,
+	SETTING_DEFAULT_TTL,
+	SETTING_DIRECTORY,
+	SETTING_DYN_UPDATE,
+	SETTING_EXTRA_BASES,
+	SETTING_FAKE_MNAME,
+	SETTING_FORWARD_POLICY,
+	SETTING_FORWARDERS,
+	SETTING_KRB5_KEYTAB,
+	SETTING_KRB5_PRINCIPAL,
+	SETTING_LDAP_HOSTNAME,
+	SETTING_NSEC3PARAM,
+	SETTING_PASSWORD,
+	SETTING_PER_ZONE_SYNC,
+	SETTING_PSEARCH,
+	SETTING_RECONNECT_INTERVAL,
+	SETTING_SASL_AUTH_NAME,
+	SETTING_SASL_MECH,
+	SETTING_SASL_PASSWORD,
+	SETTING_SASL_REALM,
+	SETTING_SASL_USER,
+	SETTING_SERIAL_AUTOINCREMENT,
+	SETTING_SERVER_ID,
+	SETTING_SOA_MNAME,
+	SETTING_SUBSTITUTIONVARIABLE_IPALOCATION,
+	SETTING_SYNC_PTR,
+	SETTING_TIMEOUT,
+	SETTING_UPDATE_POLICY,
+	SETTING_URI,
+	SETTING_VERBOSE_CHECKS,
+	SETTING_ZONE_REFRESH,
+	SETTING_ZONE_SHARD_INDEX,
+	SETTING_ZONE_SHARDS,
+	SETTING_COUNT
+} setting_id_t;
+
+
 /* Make sure that cases in get_value_ptr() are synchronized */
 typedef enum {
 	ST_STRING,
@@ -45,6 +97,20 @@ struct settings_set {
 	const settings_set_t	*parent_set;
 	isc_mutex_t		*lock;  /**< locks only values */
 	setting_t		*first_setting;
+	/** Incremented whenever a value in this set changes,
+	 *  see settings_set_generation(). */
+	isc_refcount_t		generation;
+	/** Unique identifier which is never re-used, unlike address
+	 *  of the set, see settings_set_id(). */
+	isc_uint64_t		id;
+
+	/* Members below are used only by sets from settings_set_create(). */
+	/** Setting with given setting_id_t in this set or NULL. */
+	setting_t		*slots[SETTING_COUNT];
+	/** Setting with value effective for this set (this or parent set),
+	 *  valid if the respective cache_generation is current. */
+	setting_t		*cache[SETTING_COUNT];
+	isc_uint32_t		cache_generation[SETTING_COUNT];
 };
 
 /*
@@ -91,21 +157,35 @@ setting_set_parse_conf(isc_mem_t *mctx, const char *name,
 isc_boolean_t
 settings_set_isfilled(settings_set_t *set) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+isc_result_t
+settings_check_names(void) ATTR_CHECKRESULT;
+
+isc_uint32_t
+settings_set_generation(const settings_set_t *set) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_uint64_t
+settings_set_id(const settings_set_t *set) ATTR_NONNULLS ATTR_CHECKRESULT;
+
 isc_result_t
 setting_find(const char *name, const settings_set_t *set,
 	     isc_boolean_t recursive, isc_boolean_t filled_only,
 	     setting_t **found) ATTR_CHECKRESULT;
 
 isc_result_t
-setting_get_uint(const char * const name, const settings_set_t * const set,
+setting_find_id(const setting_id_t id, const settings_set_t *set,
+		isc_boolean_t recursive, isc_boolean_t filled_only,
+		setting_t **found) ATTR_CHECKRESULT;
+
+isc_result_t
+setting_get_uint(const setting_id_t id, const settings_set_t * const set,
 		 isc_uint32_t * target) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 isc_result_t
-setting_get_str(const char * const name, const settings_set_t * const set,
+setting_get_str(const setting_id_t id, const settings_set_t * const set,
 		const char ** target) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 isc_result_t
-setting_get_bool(const char * const name, const settings_set_t * const set,
+setting_get_bool(const setting_id_t id, const settings_set_t * const set,
 		 isc_boolean_t * target) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 isc_result_t
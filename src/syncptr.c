@@ -7,7 +7,10 @@
 #include <sys/socket.h>
 
 #include <isc/event.h>
+#include <isc/ht.h>
+#include <isc/mutex.h>
 #include <isc/netaddr.h>
+#include <isc/refcount.h>
 #include <isc/task.h>
 #include <isc/types.h>
 
@@ -22,29 +25,59 @@
 #include "ldap_convert.h"
 #include "ldap_entry.h"
 #include "ldap_helper.h"
+#include "syncptr.h"
 #include "zone.h"
 #include "zone_register.h"
 
 #define LDAPDB_EVENT_SYNCPTR	(LDAPDB_EVENTCLASS + 4)
 
+/** Maximal number of PTR record changes applied in one transaction. */
+#define SYNCPTR_BATCH_MAX	1024
+#define SYNCPTR_QUEUE_HT_BITS	6
+
 #define SYNCPTR_PREF    "PTR record synchronization "
 #define SYNCPTR_FMTPRE  SYNCPTR_PREF "(%s) for '%s A/AAAA %s' "
 #define SYNCPTR_FMTPOST ldap_modop_str(mod_op), a_name_str, ip_str
 
 /*
- * Event for asynchronous PTR record synchronization.
+ * Request for synchronization of a single PTR record.
  */
-typedef struct sync_ptrev sync_ptrev_t;
-struct sync_ptrev {
-	ISC_EVENT_COMMON(sync_ptrev_t);
-	isc_mem_t *mctx;
+typedef struct sync_ptrreq sync_ptrreq_t;
+struct sync_ptrreq {
 	char a_name_str[DNS_NAME_FORMATSIZE];
 	char ip_str[INET6_ADDRSTRLEN + 1];
 	DECLARE_BUFFERED_NAME(a_name);
 	DECLARE_BUFFERED_NAME(ptr_name);
-	dns_zone_t *ptr_zone;
 	int mod_op;
 	dns_ttl_t ttl;
+	LINK(sync_ptrreq_t) link;
+};
+
+/*
+ * Event for asynchronous PTR record synchronization. All requests for
+ * the reverse zone which arrive before the event is processed by zone task
+ * are applied in a single transaction.
+ */
+typedef struct sync_ptrev sync_ptrev_t;
+struct sync_ptrev {
+	ISC_EVENT_COMMON(sync_ptrev_t);
+	isc_mem_t *mctx;
+	sync_ptrqueue_t *queue;
+	dns_zone_t *ptr_zone;
+	LIST(sync_ptrreq_t) reqs;
+	unsigned int nreqs;
+};
+
+/*
+ * Events which were sent to zone tasks but not processed yet,
+ * keyed by pointer to reverse zone. Each event holds a reference
+ * to the queue because it can outlive the LDAP instance.
+ */
+struct sync_ptrqueue {
+	isc_mem_t *mctx;
+	isc_refcount_t refs;
+	isc_mutex_t lock;
+	isc_ht_t *pending;
 };
 
 static void ATTR_NONNULLS
@@ -335,9 +368,72 @@ cleanup:
 	return result;
 }
 
+isc_result_t
+sync_ptr_queue_create(isc_mem_t *mctx, sync_ptrqueue_t **queuep) {
+	isc_result_t result;
+	sync_ptrqueue_t *queue = NULL;
+	isc_boolean_t lock_ready = ISC_FALSE;
+
+	REQUIRE(queuep != NULL && *queuep == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, queue);
+	ZERO_PTR(queue);
+	isc_mem_attach(mctx, &queue->mctx);
+	CHECK(isc_mutex_init(&queue->lock));
+	lock_ready = ISC_TRUE;
+	CHECK(isc_ht_init(&queue->pending, mctx, SYNCPTR_QUEUE_HT_BITS));
+	CHECK(isc_refcount_init(&queue->refs, 1));
+
+	*queuep = queue;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (queue != NULL) {
+		if (queue->pending != NULL)
+			isc_ht_destroy(&queue->pending);
+		if (lock_ready == ISC_TRUE)
+			DESTROYLOCK(&queue->lock);
+		MEM_PUT_AND_DETACH(queue);
+	}
+	return result;
+}
+
+static void ATTR_NONNULLS
+sync_ptr_queue_attach(sync_ptrqueue_t *source, sync_ptrqueue_t **targetp) {
+	REQUIRE(*targetp == NULL);
+
+	isc_refcount_increment(&source->refs, NULL);
+	*targetp = source;
+}
+
+/**
+ * Release reference to the queue. Pending events hold own references
+ * so the queue is destroyed when the last of them is processed.
+ */
+void
+sync_ptr_queue_detach(sync_ptrqueue_t **queuep) {
+	sync_ptrqueue_t *queue = *queuep;
+	unsigned int refs;
+
+	if (queue == NULL)
+		return;
+	*queuep = NULL;
+
+	isc_refcount_decrement(&queue->refs, &refs);
+	if (refs > 0)
+		return;
+
+	/* every pending event holds a reference */
+	isc_ht_destroy(&queue->pending);
+	DESTROYLOCK(&queue->lock);
+	isc_refcount_destroy(&queue->refs);
+	MEM_PUT_AND_DETACH(queue);
+}
+
 static void ATTR_NONNULLS
 sync_ptr_destroyev(sync_ptrev_t **eventp) {
 	sync_ptrev_t *ev = NULL;
+	sync_ptrreq_t *req;
 
 	REQUIRE(eventp != NULL);
 
@@ -345,20 +441,109 @@ sync_ptr_destroyev(sync_ptrev_t **eventp) {
 	if (ev == NULL)
 		return;
 
+	while ((req = HEAD(ev->reqs)) != NULL) {
+		UNLINK(ev->reqs, req, link);
+		isc_mem_put(ev->mctx, req, sizeof(*req));
+	}
 	if (ev->ptr_zone != NULL)
 		dns_zone_detach(&ev->ptr_zone);
+	sync_ptr_queue_detach(&ev->queue);
 	if (ev->mctx != NULL)
 		isc_mem_detach(&ev->mctx);
 	isc_event_free((isc_event_t **)eventp);
 }
 
+/**
+ * Add request to the event which was not processed yet or send a new event
+ * to the task of the reverse zone.
+ *
+ * @pre Caller holds queue->lock.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_ptr_enqueue(sync_ptrqueue_t *queue, dns_zone_t *zone,
+		 sync_ptrreq_t **reqp) {
+	isc_result_t result;
+	sync_ptrev_t *ev = NULL;
+	void *value = NULL;
+	isc_task_t *task = NULL;
+
+	result = isc_ht_find(queue->pending, (unsigned char *)&zone,
+			     sizeof(zone), &value);
+	if (result == ISC_R_SUCCESS) {
+		ev = value;
+		if (ev->nreqs < SYNCPTR_BATCH_MAX) {
+			APPEND(ev->reqs, *reqp, link);
+			ev->nreqs++;
+			*reqp = NULL;
+			return ISC_R_SUCCESS;
+		}
+		/* full event stays in the task queue, start a new one */
+		RUNTIME_CHECK(isc_ht_delete(queue->pending,
+					    (unsigned char *)&zone,
+					    sizeof(zone)) == ISC_R_SUCCESS);
+		ev = NULL;
+	}
+
+	ev = (sync_ptrev_t *)isc_event_allocate(queue->mctx, NULL,
+						LDAPDB_EVENT_SYNCPTR,
+						sync_ptr_handler, NULL,
+						sizeof(sync_ptrev_t));
+	if (ev == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+
+	ev->mctx = NULL;
+	isc_mem_attach(queue->mctx, &ev->mctx);
+	ev->queue = NULL;
+	sync_ptr_queue_attach(queue, &ev->queue);
+	ev->ptr_zone = NULL;
+	dns_zone_attach(zone, &ev->ptr_zone);
+	INIT_LIST(ev->reqs);
+	ev->nreqs = 0;
+
+	CHECK(isc_ht_add(queue->pending, (unsigned char *)&zone, sizeof(zone),
+			 ev));
+	APPEND(ev->reqs, *reqp, link);
+	ev->nreqs++;
+	*reqp = NULL;
+
+	/* Run PTR record update asynchronously. */
+	dns_zone_gettask(zone, &task);
+	isc_task_sendanddetach(&task, (isc_event_t **)&ev);
+
+cleanup:
+	sync_ptr_destroyev(&ev);
+	return result;
+}
+
+/**
+ * Remove the event from set of pending events so no more requests
+ * are added to it.
+ */
+static void ATTR_NONNULLS
+sync_ptr_dequeue(sync_ptrev_t *ev) {
+	sync_ptrqueue_t *queue = ev->queue;
+	void *value = NULL;
+
+	LOCK(&queue->lock);
+	if (isc_ht_find(queue->pending, (unsigned char *)&ev->ptr_zone,
+			sizeof(ev->ptr_zone), &value) == ISC_R_SUCCESS
+	    && value == ev)
+		RUNTIME_CHECK(isc_ht_delete(queue->pending,
+					    (unsigned char *)&ev->ptr_zone,
+					    sizeof(ev->ptr_zone))
+			      == ISC_R_SUCCESS);
+	UNLOCK(&queue->lock);
+}
+
 /**
  * Start PTR record synchronization. Actual synchronization will be done
  * by sync_ptr_handler() in the context of task associated with
- * affected reverse zone.
+ * affected reverse zone. Requests for the same reverse zone are queued
+ * and applied together if the zone task did not process them yet.
  *
  * @pre Reverse zone allows dynamic updates.
  *
+ * @param[in]  queue   Queue of pending synchronization events
  * @param[in]  zonetable  Zone table from current DNS view
  * @param[in]  a_name  DNS domain of modified A/AAAA record
  * @param[in]  af      Address family
@@ -366,15 +551,15 @@ sync_ptr_destroyev(sync_ptrev_t **eventp) {
  * @param[in]  mod_op  LDAP_MOD_DELETE if A/AAAA record is being deleted
  *                     or LDAP_MOD_ADD if A/AAAA record is being added.
  *
- * @retval ISC_R_SUCCESS Synchronization event was created and sent
- *                       to affected reverse zone.
+ * @retval ISC_R_SUCCESS Synchronization request was queued for
+ *                       affected reverse zone.
  *                       Synchronization may fail later in sync_ptr_handler()
  *                       call but caller will not see this error.
  * @retval other	 Synchronization failed - reverse zone doesn't exist,
  * 			 is not active, or is not managed by this LDAP instance.
  */
 isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-sync_ptr_init(isc_mem_t *mctx, dns_zt_t * zonetable,
+sync_ptr_init(sync_ptrqueue_t *queue, dns_zt_t * zonetable,
 	      zone_register_t *zone_register, dns_name_t *a_name, const int af,
 	      const char *ip_str, dns_ttl_t ttl, const int mod_op) {
 	isc_result_t result;
@@ -383,28 +568,21 @@ sync_ptr_init(isc_mem_t *mctx, dns_zt_t * zonetable,
 	isc_boolean_t zone_dyn_update;
 	char *a_name_str = NULL;
 
-	sync_ptrev_t *ev = NULL;
-	isc_task_t *task = NULL;
+	sync_ptrreq_t *req = NULL;
+	dns_zone_t *ptr_zone = NULL;
 
 	REQUIRE(mod_op == LDAP_MOD_DELETE || mod_op == LDAP_MOD_ADD);
 
-	ev = (sync_ptrev_t *)isc_event_allocate(mctx, NULL,
-						LDAPDB_EVENT_SYNCPTR,
-						sync_ptr_handler, NULL,
-						sizeof(sync_ptrev_t));
-	if (ev == NULL)
-		CLEANUP_WITH(ISC_R_NOMEMORY);
-
-	ev->mctx = NULL;
-	isc_mem_attach(mctx, &ev->mctx);
-	INIT_BUFFERED_NAME(ev->a_name);
-	INIT_BUFFERED_NAME(ev->ptr_name);
-	CHECK(dns_name_copy(a_name, &ev->a_name, NULL));
-	ev->mod_op = mod_op;
-	strncpy(ev->ip_str, ip_str, sizeof(ev->ip_str));
-	ev->ip_str[sizeof(ev->ip_str) - 1] = '\0';
-	ev->ptr_zone = NULL;
-	ev->ttl = ttl;
+	CHECKED_MEM_GET_PTR(queue->mctx, req);
+	ZERO_PTR(req);
+	INIT_BUFFERED_NAME(req->a_name);
+	INIT_BUFFERED_NAME(req->ptr_name);
+	INIT_LINK(req, link);
+	CHECK(dns_name_copy(a_name, &req->a_name, NULL));
+	req->mod_op = mod_op;
+	strncpy(req->ip_str, ip_str, sizeof(req->ip_str));
+	req->ip_str[sizeof(req->ip_str) - 1] = '\0';
+	req->ttl = ttl;
 
 	/**
 	 * Get string representation of PTR record value.
@@ -412,49 +590,53 @@ sync_ptr_init(isc_mem_t *mctx, dns_zt_t * zonetable,
 	 * a_name_str = "host.example.com."
 	 * @endcode
 	 */
-	dns_name_format(a_name, ev->a_name_str, sizeof(ev->a_name_str));
-	append_trailing_dot(ev->a_name_str, sizeof(ev->a_name_str));
-	a_name_str = ev->a_name_str;
+	dns_name_format(a_name, req->a_name_str, sizeof(req->a_name_str));
+	append_trailing_dot(req->a_name_str, sizeof(req->a_name_str));
+	a_name_str = req->a_name_str;
 
 	result = sync_ptr_find(zonetable, zone_register, af, ip_str,
-			       &ev->ptr_name, &zone_settings, &ev->ptr_zone);
+			       &req->ptr_name, &zone_settings, &ptr_zone);
 	if (result != ISC_R_SUCCESS) {
 		log_error_r(SYNCPTR_FMTPRE "refused: unable to find "
 			    "active reverse zone", SYNCPTR_FMTPOST);
 		goto cleanup;
 	}
 
-	CHECK(setting_get_bool("dyn_update", zone_settings, &zone_dyn_update));
+	CHECK(setting_get_bool(SETTING_DYN_UPDATE, zone_settings,
+			       &zone_dyn_update));
 	if (!zone_dyn_update) {
-		dns_zone_log(ev->ptr_zone, ISC_LOG_ERROR,
+		dns_zone_log(ptr_zone, ISC_LOG_ERROR,
 			     SYNCPTR_FMTPRE "refused: dynamic updates are not "
 			     "allowed for the reverse zone", SYNCPTR_FMTPOST);
 		CLEANUP_WITH(ISC_R_NOPERM);
 	}
 
-	/* Run PTR record update asynchronously. */
-	dns_zone_gettask(ev->ptr_zone, &task);
-	isc_task_sendanddetach(&task, (isc_event_t **)&ev);
+	LOCK(&queue->lock);
+	result = sync_ptr_enqueue(queue, ptr_zone, &req);
+	UNLOCK(&queue->lock);
 
 cleanup:
-	sync_ptr_destroyev(&ev);
+	if (ptr_zone != NULL)
+		dns_zone_detach(&ptr_zone);
+	if (req != NULL)
+		isc_mem_put(queue->mctx, req, sizeof(*req));
 	return result;
 }
 
 /**
- * Update PTR record to match A/AAAA record. This function is running
- * in context of the task associated with affected reverse zone.
+ * Update PTR record to match A/AAAA record. Changes are applied to given
+ * database version and appended to diff.
  *
  * @retval ISC_R_SUCCESS PTR record matches A/AAAA record.
- * @retval other	 Synchronization failed: Old value in PTR record
- *                       doesn't match A/AAAA node name, etc.
+ * @retval ISC_R_IGNORE  No change is required or the request was refused:
+ *                       Old value in PTR record doesn't match A/AAAA node
+ *                       name, etc.
+ * @retval other	 Version cannot be used anymore.
  */
-static void ATTR_NONNULLS
-sync_ptr_handler(isc_task_t *task, isc_event_t *event) {
-	sync_ptrev_t *ev = (sync_ptrev_t *)event;
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_ptr_apply(isc_mem_t *mctx, dns_zone_t *ptr_zone, dns_db_t *ldapdb,
+	       dns_dbversion_t *version, sync_ptrreq_t *req, dns_diff_t *diff) {
 	isc_result_t result;
-	dns_db_t *ldapdb = NULL;
-	dns_dbversion_t *version = NULL;
 
 	dns_rdataset_t old_rdataset;
 	dns_rdata_ptr_t new_ptr_rdata;
@@ -462,59 +644,118 @@ sync_ptr_handler(isc_task_t *task, isc_event_t *event) {
 	isc_buffer_t new_rdatabuf;
 	dns_rdata_t new_rdata;
 
-	dns_diff_t diff;
+	dns_diff_t req_diff;
 	dns_difftuple_t *difftp = NULL;
 
-	UNUSED(task);
-
 	dns_rdataset_init(&old_rdataset);
 
 	DNS_RDATACOMMON_INIT(&new_ptr_rdata, dns_rdatatype_ptr, dns_rdataclass_in);
 	isc_buffer_init(&new_rdatabuf, new_buf, sizeof(new_buf));
 	dns_rdata_init(&new_rdata);
-	dns_diff_init(ev->mctx, &diff);
+	dns_diff_init(mctx, &req_diff);
 
-	CHECK(dns_zone_getdb(ev->ptr_zone, &ldapdb));
-	CHECK(dns_db_newversion(ldapdb, &version));
-	result = sync_ptr_validate(&ev->a_name, ev->a_name_str, ev->ip_str,
-				   &ev->ptr_name, ev->ptr_zone, ldapdb, version,
-				   ev->mod_op, &old_rdataset);
-	if (result == ISC_R_IGNORE)
-		CLEANUP_WITH(ISC_R_SUCCESS);
-	else if (result != ISC_R_SUCCESS)
-		goto cleanup;
+	result = sync_ptr_validate(&req->a_name, req->a_name_str, req->ip_str,
+				   &req->ptr_name, ptr_zone, ldapdb, version,
+				   req->mod_op, &old_rdataset);
+	if (result != ISC_R_SUCCESS) /* reason was logged already */
+		CLEANUP_WITH(ISC_R_IGNORE);
 
 	/* Delete old PTR record if it exists in RBTDB. */
 	if (dns_rdataset_isassociated(&old_rdataset))
-		CHECK(rdataset_to_diff(ev->mctx, DNS_DIFFOP_DEL,
-				       &ev->ptr_name,
-				       &old_rdataset, &diff));
+		CHECK(rdataset_to_diff(mctx, DNS_DIFFOP_DEL, &req->ptr_name,
+				       &old_rdataset, &req_diff));
 
-	if (ev->mod_op == LDAP_MOD_ADD) {
-		new_ptr_rdata.ptr = ev->a_name;
+	if (req->mod_op == LDAP_MOD_ADD) {
+		new_ptr_rdata.ptr = req->a_name;
 		CHECK(dns_rdata_fromstruct(&new_rdata, dns_rdataclass_in,
 					   dns_rdatatype_ptr, &new_ptr_rdata,
 					   &new_rdatabuf));
-		CHECK(dns_difftuple_create(ev->mctx, DNS_DIFFOP_ADD,
-					   &ev->ptr_name,
-					   ev->ttl, &new_rdata, &difftp));
-		dns_diff_appendminimal(&diff, &difftp);
+		CHECK(dns_difftuple_create(mctx, DNS_DIFFOP_ADD,
+					   &req->ptr_name,
+					   req->ttl, &new_rdata, &difftp));
+		dns_diff_appendminimal(&req_diff, &difftp);
 	}
 
-	if (!EMPTY(diff.tuples)) {
-		CHECK(zone_soaserial_addtuple(ev->mctx, ldapdb, version, &diff,
-		      NULL));
-		CHECK(zone_journal_adddiff(ev->mctx, ev->ptr_zone, &diff));
+	/* Following requests in the batch have to see this change. */
+	CHECK(dns_diff_apply(&req_diff, ldapdb, version));
+	/* Changes to the same PTR record cancel each other in the batch. */
+	while ((difftp = HEAD(req_diff.tuples)) != NULL) {
+		UNLINK(req_diff.tuples, difftp, link);
+		dns_diff_appendminimal(diff, &difftp);
 	}
 
-	CHECK(dns_diff_apply(&diff, ldapdb, version));
-	dns_db_closeversion(ldapdb, &version, ISC_TRUE);
-
 cleanup:
 	if (dns_rdataset_isassociated(&old_rdataset))
 		dns_rdataset_disassociate(&old_rdataset);
 	if (difftp != NULL)
 		dns_difftuple_free(&difftp);
+	dns_diff_clear(&req_diff);
+
+	return result;
+}
+
+/**
+ * Apply all queued PTR record changes for the reverse zone in a single
+ * transaction, i.e. with one SOA serial increment and one journal entry.
+ * This function is running in context of the task associated with affected
+ * reverse zone.
+ */
+static void ATTR_NONNULLS
+sync_ptr_handler(isc_task_t *task, isc_event_t *event) {
+	sync_ptrev_t *ev = (sync_ptrev_t *)event;
+	isc_result_t result;
+	sync_ptrreq_t *req;
+	dns_db_t *ldapdb = NULL;
+	dns_dbversion_t *version = NULL;
+	unsigned int applied = 0;
+
+	dns_diff_t diff;
+	dns_diff_t soa_diff;
+	dns_difftuple_t *difftp = NULL;
+
+	UNUSED(task);
+
+	dns_diff_init(ev->mctx, &diff);
+	dns_diff_init(ev->mctx, &soa_diff);
+
+	/* New requests have to go to a new event from now on. */
+	sync_ptr_dequeue(ev);
+
+	CHECK(dns_zone_getdb(ev->ptr_zone, &ldapdb));
+	CHECK(dns_db_newversion(ldapdb, &version));
+	for (req = HEAD(ev->reqs); req != NULL; req = NEXT(req, link)) {
+		result = sync_ptr_apply(ev->mctx, ev->ptr_zone, ldapdb,
+					version, req, &diff);
+		if (result == ISC_R_SUCCESS)
+			applied++;
+		else if (result != ISC_R_IGNORE)
+			goto cleanup;
+	}
+	result = ISC_R_SUCCESS;
+
+	if (!EMPTY(diff.tuples)) {
+		CHECK(zone_soaserial_addtuple(ev->mctx, ldapdb, version,
+					      &soa_diff, NULL));
+		CHECK(dns_diff_apply(&soa_diff, ldapdb, version));
+		while ((difftp = HEAD(soa_diff.tuples)) != NULL) {
+			UNLINK(soa_diff.tuples, difftp, link);
+			dns_diff_append(&diff, &difftp);
+		}
+		CHECK(zone_journal_adddiff(ev->mctx, ev->ptr_zone, &diff));
+	}
+
+	dns_db_closeversion(ldapdb, &version, ISC_TRUE);
+	if (ev->nreqs > 1)
+		dns_zone_log(ev->ptr_zone, ISC_LOG_DEBUG(3), SYNCPTR_PREF
+			     "applied %u of %u queued changes in one "
+			     "transaction", applied, ev->nreqs);
+
+cleanup:
+	if (result != ISC_R_SUCCESS)
+		dns_zone_log(ev->ptr_zone, ISC_LOG_ERROR, SYNCPTR_PREF
+			     "failed for %u queued changes: %s",
+			     ev->nreqs, isc_result_totext(result));
+	dns_diff_clear(&soa_diff);
 	dns_diff_clear(&diff);
 	if (ldapdb != NULL) {
 		/* rollback if something bad happened */
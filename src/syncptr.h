@@ -5,10 +5,17 @@
 #ifndef SRC_SYNCPTR_H_
 #define SRC_SYNCPTR_H_
 
+#include "types.h"
 #include "util.h"
 
 isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-sync_ptr_init(isc_mem_t *mctx, dns_zt_t * zonetable,
+sync_ptr_queue_create(isc_mem_t *mctx, sync_ptrqueue_t **queuep);
+
+void ATTR_NONNULLS
+sync_ptr_queue_detach(sync_ptrqueue_t **queuep);
+
+isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_ptr_init(sync_ptrqueue_t *queue, dns_zt_t * zonetable,
 	      zone_register_t *zone_register, dns_name_t *a_name, const int af,
 	      const char *ip_str, dns_ttl_t ttl, const int mod_op);
 
@@ -149,7 +149,7 @@ finish(isc_task_t *task, isc_event_t *event) {
 	BROADCAST(&bev->sctx->cond);
 	UNLOCK(&bev->sctx->mutex);
 	if (new_state == sync_finished)
-		activate_zones(task, bev->inst);
+		activate_zones(task, bev->inst, bev->sctx);
 
 	if (result != ISC_R_SUCCESS)
 		log_error_r("syncrepl finish() failed");
@@ -436,6 +436,38 @@ sync_state_reset(sync_ctx_t *sctx) {
 	UNLOCK(&sctx->mutex);
 }
 
+/**
+ * Wait until synchronization reaches at least the given state.
+ * Synchronization contexts of other SyncRepl sessions use this to wait
+ * for configuration synchronized by the primary session.
+ *
+ * @retval ISC_R_SUCCESS      State was reached.
+ * @retval ISC_R_SHUTTINGDOWN Instance is exiting.
+ */
+isc_result_t
+sync_state_wait(sync_ctx_t *sctx, sync_state_t state) {
+	isc_result_t result;
+	isc_time_t abs_timeout;
+
+	REQUIRE(sctx != NULL);
+
+	LOCK(&sctx->mutex);
+	while (sctx->state < state) {
+		if (ldap_instance_isexiting(sctx->inst) == ISC_TRUE)
+			CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
+
+		result = isc_time_nowplusinterval(&abs_timeout, &shutdown_timeout);
+		INSIST(result == ISC_R_SUCCESS);
+
+		WAITUNTIL(&sctx->cond, &sctx->mutex, &abs_timeout);
+	}
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	UNLOCK(&sctx->mutex);
+	return result;
+}
+
 /**
  * @brief Add task to task list in synchronization context.
  *
@@ -12,7 +12,6 @@
  * Before modifying at other places, switch to single-thread mode via
  * isc_task_beginexclusive() and then return back via isc_task_endexclusive()!
  */
-typedef struct sync_ctx		sync_ctx_t;
 typedef enum sync_state		sync_state_t;
 typedef struct sync_barrierev	sync_barrierev_t;
 
@@ -45,6 +44,9 @@ sync_state_change(sync_ctx_t *sctx, sync_state_t new_state, isc_boolean_t lock)
 void
 sync_state_reset(sync_ctx_t *sctx) ATTR_NONNULLS;
 
+isc_result_t
+sync_state_wait(sync_ctx_t *sctx, sync_state_t state) ATTR_NONNULLS ATTR_CHECKRESULT;
+
 isc_result_t
 sync_task_add(sync_ctx_t *sctx, isc_task_t *task) ATTR_NONNULLS ATTR_CHECKRESULT;
 
@@ -36,6 +36,11 @@ typedef struct zone_register	zone_register_t;
 typedef struct mldapdb		mldapdb_t;
 typedef struct ldap_entry	ldap_entry_t;
 typedef struct settings_set	settings_set_t;
+typedef struct ldap_syncsess	ldap_syncsess_t;
+typedef struct fwd_cache	fwd_cache_t;
+typedef struct rr_schema	rr_schema_t;
+typedef struct sync_ptrqueue	sync_ptrqueue_t;
+typedef struct sync_ctx		sync_ctx_t;
 
 
 #define LDAPDB_EVENT_SYNCREPL_UPDATE	(LDAPDB_EVENTCLASS + 1)
@@ -44,10 +49,14 @@ struct ldap_syncreplevent {
 	ISC_EVENT_COMMON(ldap_syncreplevent_t);
 	isc_mem_t *mctx;
 	ldap_instance_t	*inst;
+	ldap_syncsess_t	*sess;
 	char *prevdn;
 	int chgtype;
 	ldap_entry_t *entry;
 	isc_uint32_t seqid;
+	/* Zone events processed together, only if entry is NULL. */
+	LIST(ldap_syncreplevent_t) batch;
+	LINK(ldap_syncreplevent_t) batch_link;
 };
 
 #endif /* !_LD_TYPES_H_ */
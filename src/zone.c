@@ -2,6 +2,8 @@
  * Copyright (C) 2014-2015  bind-dyndb-ldap authors; see COPYING for license
  */
 
+#include <ctype.h>
+
 #include <isc/types.h>
 #include <isc/util.h>
 
@@ -99,6 +101,53 @@ cleanup:
 	return result;
 }
 
+/**
+ * Generate delete-add tuples for SOA record with given MNAME.
+ *
+ * @param[in]  db		Database to generate new SOA record for.
+ * @param[in]  version		Database version to read SOA from.
+ * @param[in]  mname		New value of MNAME field.
+ * @param[out] diff		Diff to append delete-add tuples to.
+ *
+ * @retval ISC_R_IGNORE	SOA record already contains given MNAME,
+ *			nothing was added to the diff.
+ */
+isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_soamname_addtuple(isc_mem_t *mctx, dns_db_t *db,
+		       dns_dbversion_t *version, dns_name_t *mname,
+		       dns_diff_t *diff) {
+	isc_result_t result;
+	dns_difftuple_t *del = NULL;
+	dns_difftuple_t *add = NULL;
+	dns_rdata_soa_t soa;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	unsigned char buf[DNS_SOA_BUFFERSIZE];
+	isc_buffer_t buffer;
+
+	CHECK(dns_db_createsoatuple(db, version, mctx, DNS_DIFFOP_DEL, &del));
+	/* no memory context, soa points to data in the tuple */
+	CHECK(dns_rdata_tostruct(&del->rdata, &soa, NULL));
+	if (dns_name_equal(&soa.origin, mname))
+		CLEANUP_WITH(ISC_R_IGNORE);
+
+	dns_name_init(&soa.origin, NULL);
+	dns_name_clone(mname, &soa.origin);
+	isc_buffer_init(&buffer, buf, sizeof(buf));
+	CHECK(dns_rdata_fromstruct(&rdata, del->rdata.rdclass,
+				   dns_rdatatype_soa, &soa, &buffer));
+	CHECK(dns_difftuple_create(mctx, DNS_DIFFOP_ADD, &del->name, del->ttl,
+				   &rdata, &add));
+	dns_diff_appendminimal(diff, &del);
+	dns_diff_appendminimal(diff, &add);
+
+cleanup:
+	if (del != NULL)
+		dns_difftuple_free(&del);
+	if (add != NULL)
+		dns_difftuple_free(&add);
+	return result;
+}
+
 /**
  * Add all RRs from rdataset to the diff. Create strictly minimal diff.
  */
@@ -146,3 +195,25 @@ rdatalist_to_diff(isc_mem_t *mctx, dns_diffop_t op, dns_name_t *name,
 cleanup:
 	return result;
 }
+
+/**
+ * Hash of zone name used to split zones among servers.
+ *
+ * The hash has to be stable across processes and versions so all servers
+ * configured with the same zone_shards value agree on the assignment,
+ * dns_name_hash() cannot be used.
+ *
+ * @return FNV-1a hash of case-folded wire format of the name.
+ */
+isc_uint32_t ATTR_NONNULLS
+zone_shard_hash(const dns_name_t *name) {
+	isc_uint32_t hash = 2166136261U;
+	unsigned int i;
+
+	/* label lengths are < 'A' so they are not affected by tolower() */
+	for (i = 0; i < name->length; i++) {
+		hash ^= tolower(name->ndata[i]);
+		hash *= 16777619U;
+	}
+	return hash;
+}
@@ -26,6 +26,11 @@ zone_soaserial_addtuple(isc_mem_t *mctx, dns_db_t *db,
 			dns_dbversion_t *version, dns_diff_t *diff,
 			isc_uint32_t *new_serial);
 
+isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_soamname_addtuple(isc_mem_t *mctx, dns_db_t *db,
+		       dns_dbversion_t *version, dns_name_t *mname,
+		       dns_diff_t *diff);
+
 isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
 rdatalist_to_diff(isc_mem_t *mctx, dns_diffop_t op, dns_name_t *name,
 		  dns_rdatalist_t *rdatalist, dns_diff_t *diff);
@@ -34,4 +39,7 @@ isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
 rdataset_to_diff(isc_mem_t *mctx, dns_diffop_t op, dns_name_t *name,
 		dns_rdataset_t *rds, dns_diff_t *diff);
 
+isc_uint32_t ATTR_NONNULLS
+zone_shard_hash(const dns_name_t *name);
+
 #endif /* SRC_ZONE_H_ */
@@ -2,17 +2,24 @@
  * Copyright (C) 2009-2014  bind-dyndb-ldap authors; see COPYING for license
  */
 
+#include <stdint.h>
+
+#include <isc/ht.h>
 #include <isc/mem.h>
+#include <isc/mutex.h>
 #include <isc/rwlock.h>
 #include <isc/util.h>
 #include <isc/md5.h>
 #include <isc/string.h>
+#include <isc/once.h>
+#include <isc/thread.h>
 
 #include <dns/db.h>
 #include <dns/rbt.h>
 #include <dns/result.h>
 #include <dns/zone.h>
 
+#include "atomic.h"
 #include "fs.h"
 #include "ldap_driver.h"
 #include "log.h"
@@ -34,26 +41,124 @@
  * (idnsZoneActive = FALSE). Iterators return all zones including disabled ones.
  * Disabled zones are identified by "active" boolean = FALSE in settings_set_t
  * of the particular zone.
+ *
+ * The RBT is used only by writers and iterators. Lookups by zone origin
+ * go to an immutable hash table snapshot. Readers do not take any lock,
+ * they only announce their presence in a per-thread reader slot.
+ *
+ * Snapshots are rebuilt in batches. Zones added since the last snapshot
+ * are kept on the pending list and readers which miss in the snapshot
+ * fall back to the RBT while the list is not empty. Deleted zones stay
+ * in the snapshot marked as retired until the next rebuild.
+ * zr_publish() rebuilds the snapshot at the end of a batch, e.g. before
+ * zones are activated, and zr_add_zone()/zr_del_zone() rebuild it
+ * only when the number of changes reaches size of the snapshot,
+ * so the cost of rebuilds is linear in the number of changes.
+ *
+ * Old snapshots and deleted zone_info_t are not freed immediately. They are
+ * put on a retire list of the current epoch and freed by a later writer
+ * once no reader from that epoch remains, writers never wait for readers.
+ */
+
+/** Number of reader slots, threads share slots if there are more of them. */
+#define ZR_READER_SLOTS		32
+#define ZR_CACHELINE		64
+/** Minimal number of buckets in a snapshot, has to be power of 2. */
+#define ZR_SNAPSHOT_MINBUCKETS	16
+/** Minimal number of changes which trigger implicit snapshot rebuild. */
+#define ZR_SNAPSHOT_MINBATCH	64
+/** Owner DN cache of a zone is flushed when it reaches this size. */
+#define ZR_DNCACHE_MAX		1024
+#define ZR_DNCACHE_HT_BITS	8
+
+/**
+ * Number of readers currently inside a read section, one counter
+ * for each parity of zone_register.epoch.
  */
+typedef union {
+	unsigned int	active[2];
+	char		pad[ZR_CACHELINE];
+} zr_reader_t;
+
+typedef struct zone_info zone_info_t;
+struct zone_info {
+	dns_zone_t	*raw;
+	dns_zone_t	*secure;
+	char		*dn;
+	/** dns_name_hash() of the zone origin */
+	unsigned int	hash;
+	/** Zone was deleted, snapshots may still reference it. */
+	isc_boolean_t	retired;
+	/** Zone was added after the current snapshot was built. */
+	isc_boolean_t	pending;
+	/** Link in pending or retire list. */
+	LINK(zone_info_t) link;
+	settings_set_t	*settings;
+	dns_db_t	*ldapdb;
+	/** Zone data might differ from LDAP, guarded by rwlock. */
+	isc_boolean_t	tainted;
+	/**
+	 * Owner name -> LDAP DN cache, see zr_get_owner_dn().
+	 * Zone DN never changes during zone_info_t lifetime so the cache
+	 * is invalidated implicitly when the zone is re-added with new DN.
+	 */
+	isc_mutex_t	dncache_lock;
+	isc_ht_t	*dncache;
+	unsigned int	dncache_count;
+};
 
+typedef struct {
+	unsigned int	hash;
+	zone_info_t	*zinfo;		/**< NULL for empty bucket */
+} zr_bucket_t;
+
+/** Immutable open-addressing hash table of registered zones. */
+typedef struct zr_snapshot zr_snapshot_t;
+struct zr_snapshot {
+	zr_snapshot_t	*retired_next;	/**< link in retire list */
+	unsigned int	nbuckets;	/**< always power of 2 */
+	unsigned int	count;
+	zr_bucket_t	buckets[];
+};
+
+/** Objects which were unlinked during one epoch. */
+typedef struct {
+	zr_snapshot_t		*snapshots;
+	LIST(zone_info_t)	zinfos;
+} zr_retired_t;
+
+/**
+ * Members below rwlock are guarded by it, readers access only snapshot,
+ * pending_cnt and epoch using atomic operations.
+ */
 struct zone_register {
 	isc_mem_t	*mctx;
 	isc_rwlock_t	rwlock;
 	dns_rbt_t	*rbt;
 	settings_set_t	*global_settings;
 	ldap_instance_t *ldap_inst;
+	/** Current snapshot, replaced only with rwlock locked for writing. */
+	zr_snapshot_t	*snapshot;
+	/** Zones added since the current snapshot was built. */
+	LIST(zone_info_t) pending;
+	unsigned int	pending_cnt;
+	/** Retired zones referenced by the current snapshot. */
+	LIST(zone_info_t) tombstones;
+	unsigned int	retired_cnt;
+	/** Objects retired in epochs with the respective parity. */
+	zr_retired_t	retired[2];
+	unsigned int	epoch;
+	zr_reader_t	readers[ZR_READER_SLOTS];
 };
 
-typedef struct {
-	dns_zone_t	*raw;
-	dns_zone_t	*secure;
-	char		*dn;
-	settings_set_t	*settings;
-	dns_db_t	*ldapdb;
-} zone_info_t;
+/** Thread-specific reader slot index + 1, NULL if not assigned yet. */
+static isc_thread_key_t zr_thread_key;
+static isc_once_t zr_thread_key_once = ISC_ONCE_INIT;
+static unsigned int zr_next_slot;
 
-/* Callback for dns_rbt_create(). */
 static void delete_zone_info(void *arg1, void *arg2);
+/* Callback for dns_rbt_create(). */
+static void retire_zone_info(void *arg1, void *arg2);
 
 /**
  * Zone specific settings from idnsZone object:
@@ -79,9 +184,305 @@ static const setting_t zone_settings[] = {
 	{ "forward_policy",		no_default_string	},
 	{ "forwarders",			no_default_string	},
 	{ "nsec3param",			no_default_string	},
+	{ "soa_mname",			no_default_string	}, /* idnsSOAmName */
 	end_of_settings
 };
 
+static void
+zr_thread_key_init(void) {
+	/* key is never deleted, module is not unloaded (-z nodelete) */
+	RUNTIME_CHECK(isc_thread_key_create(&zr_thread_key, NULL) == 0);
+}
+
+static zr_reader_t * ATTR_NONNULLS
+reader_get(zone_register_t * const zr) {
+	uintptr_t slot;
+
+	slot = (uintptr_t)isc_thread_key_getspecific(zr_thread_key);
+	if (slot == 0) {
+		slot = ATOMIC_FETCH_INCREMENT_RELAXED(&zr_next_slot)
+		       % ZR_READER_SLOTS + 1;
+		RUNTIME_CHECK(isc_thread_key_setspecific(zr_thread_key,
+							 (void *)slot) == 0);
+	}
+	return &zr->readers[slot - 1];
+}
+
+/**
+ * Enter read section and get current snapshot. Snapshot and zone_info_t
+ * structures referenced by it are valid until snapshot_leave() is called.
+ *
+ * @warning Read section must not block, writers are waiting for it.
+ */
+static zr_snapshot_t * ATTR_NONNULLS ATTR_CHECKRESULT
+snapshot_enter(zone_register_t * const zr, unsigned int **counterp) {
+	zr_reader_t *reader = reader_get(zr);
+	unsigned int epoch;
+	unsigned int *counter;
+
+	REQUIRE(*counterp == NULL);
+
+	/* Retry if the writer moved to next epoch before it could see
+	 * our counter. */
+	do {
+		epoch = ATOMIC_LOAD(&zr->epoch);
+		counter = &reader->active[epoch & 1];
+		ATOMIC_INCREMENT(counter);
+		if (ATOMIC_LOAD(&zr->epoch) == epoch)
+			break;
+		ATOMIC_DECREMENT(counter);
+	} while (1);
+
+	*counterp = counter;
+	return ATOMIC_LOAD_ACQUIRE(&zr->snapshot);
+}
+
+static void ATTR_NONNULLS
+snapshot_leave(unsigned int **counterp) {
+	if (*counterp == NULL)
+		return;
+
+	ATOMIC_DECREMENT_RELEASE(*counterp);
+	*counterp = NULL;
+}
+
+static void ATTR_NONNULLS
+snapshot_destroy(isc_mem_t *mctx, zr_snapshot_t **snapp) {
+	zr_snapshot_t *snap = *snapp;
+
+	if (snap == NULL)
+		return;
+
+	isc_mem_put(mctx, snap, sizeof(*snap)
+		    + snap->nbuckets * sizeof(snap->buckets[0]));
+	*snapp = NULL;
+}
+
+static void ATTR_NONNULLS
+snapshot_insert(zr_snapshot_t *snap, zone_info_t *zinfo) {
+	unsigned int mask = snap->nbuckets - 1;
+	unsigned int i;
+
+	for (i = zinfo->hash & mask;
+	     snap->buckets[i].zinfo != NULL;
+	     i = (i + 1) & mask)
+		;
+	snap->buckets[i].hash = zinfo->hash;
+	snap->buckets[i].zinfo = zinfo;
+	snap->count++;
+	INSIST(snap->count < snap->nbuckets);
+}
+
+/**
+ * Build a new snapshot with all zones from the current snapshot except
+ * retired ones and with all pending zones.
+ *
+ * @pre Zone register is locked for writing.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+snapshot_build(zone_register_t * const zr, zr_snapshot_t **snapp) {
+	isc_result_t result;
+	const zr_snapshot_t *old = zr->snapshot;
+	zr_snapshot_t *snap = NULL;
+	zone_info_t *zinfo;
+	unsigned int count = zr->pending_cnt;
+	unsigned int nbuckets = ZR_SNAPSHOT_MINBUCKETS;
+	size_t size;
+
+	REQUIRE(snapp != NULL && *snapp == NULL);
+
+	if (old != NULL)
+		count += old->count - zr->retired_cnt;
+	/* load factor <= 1/2 keeps probe sequences short */
+	while (nbuckets < 2 * count)
+		nbuckets *= 2;
+
+	size = sizeof(*snap) + nbuckets * sizeof(snap->buckets[0]);
+	CHECKED_MEM_GET(zr->mctx, snap, size);
+	memset(snap, 0, size);
+	snap->nbuckets = nbuckets;
+
+	for (unsigned int i = 0; old != NULL && i < old->nbuckets; i++) {
+		zinfo = old->buckets[i].zinfo;
+		if (zinfo != NULL && zinfo->retired == ISC_FALSE)
+			snapshot_insert(snap, zinfo);
+	}
+	for (zinfo = HEAD(zr->pending);
+	     zinfo != NULL;
+	     zinfo = NEXT(zinfo, link))
+		snapshot_insert(snap, zinfo);
+	INSIST(snap->count == count);
+
+	*snapp = snap;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+/**
+ * Find a zone in snapshot with origin exactly matching 'name'.
+ * Retired zones are skipped.
+ */
+static isc_result_t ATTR_NONNULL(2,3) ATTR_CHECKRESULT
+snapshot_find(const zr_snapshot_t *snap, dns_name_t *name,
+	      zone_info_t **zinfop) {
+	unsigned int mask;
+	unsigned int hash;
+	const zr_bucket_t *bucket;
+
+	REQUIRE(dns_name_isabsolute(name));
+	REQUIRE(*zinfop == NULL);
+
+	if (snap == NULL)
+		return ISC_R_NOTFOUND;
+
+	mask = snap->nbuckets - 1;
+	hash = dns_name_hash(name, ISC_FALSE);
+	for (unsigned int i = hash & mask; snap->buckets[i].zinfo != NULL;
+	     i = (i + 1) & mask) {
+		bucket = &snap->buckets[i];
+		if (bucket->hash == hash
+		    && ATOMIC_LOAD_ACQUIRE(&bucket->zinfo->retired)
+		       == ISC_FALSE
+		    && dns_name_equal(dns_zone_getorigin(bucket->zinfo->raw),
+				      name)) {
+			*zinfop = bucket->zinfo;
+			return ISC_R_SUCCESS;
+		}
+	}
+
+	return ISC_R_NOTFOUND;
+}
+
+/**
+ * Free all objects retired in epochs with given parity.
+ */
+static void ATTR_NONNULLS
+retired_free(zone_register_t * const zr, unsigned int parity) {
+	zr_retired_t *retired = &zr->retired[parity];
+	zr_snapshot_t *snap;
+	zone_info_t *zinfo;
+
+	while ((snap = retired->snapshots) != NULL) {
+		retired->snapshots = snap->retired_next;
+		snapshot_destroy(zr->mctx, &snap);
+	}
+	while ((zinfo = HEAD(retired->zinfos)) != NULL) {
+		UNLINK(retired->zinfos, zinfo, link);
+		delete_zone_info(zinfo, zr->mctx);
+	}
+}
+
+/**
+ * Move to the next epoch if no reader from the previous epoch remains.
+ * Objects retired in the previous epoch cannot be referenced by anyone
+ * at that point so they are freed. Readers are never waited for,
+ * if some of them are still active the attempt is repeated
+ * by the next writer.
+ *
+ * Readers of the current epoch are always gone before the epoch after next
+ * starts so objects retired in the current epoch are freed two
+ * epochs later at the latest.
+ *
+ * @pre Zone register is locked for writing.
+ */
+static void ATTR_NONNULLS
+epoch_try_advance(zone_register_t * const zr) {
+	unsigned int epoch = zr->epoch;
+	unsigned int prev = (epoch - 1) & 1;
+
+	for (unsigned int i = 0; i < ZR_READER_SLOTS; i++) {
+		if (ATOMIC_LOAD(&zr->readers[i].active[prev]) != 0)
+			return;
+	}
+
+	retired_free(zr, prev);
+	ATOMIC_STORE(&zr->epoch, epoch + 1);
+}
+
+/**
+ * Replace current snapshot with a new one built from the current one
+ * and pending zones. The old snapshot and zones deleted from it
+ * are retired.
+ *
+ * @pre Zone register is locked for writing.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+snapshot_publish(zone_register_t * const zr) {
+	isc_result_t result;
+	zr_snapshot_t *snap = NULL;
+	zr_snapshot_t *old = zr->snapshot;
+	zr_retired_t *retired = &zr->retired[zr->epoch & 1];
+	zone_info_t *zinfo;
+
+	CHECK(snapshot_build(zr, &snap));
+	while ((zinfo = HEAD(zr->pending)) != NULL) {
+		UNLINK(zr->pending, zinfo, link);
+		zinfo->pending = ISC_FALSE;
+	}
+	ATOMIC_STORE_RELEASE(&zr->snapshot, snap);
+	ATOMIC_STORE_RELEASE(&zr->pending_cnt, 0);
+	while ((zinfo = HEAD(zr->tombstones)) != NULL) {
+		UNLINK(zr->tombstones, zinfo, link);
+		APPEND(retired->zinfos, zinfo, link);
+	}
+	zr->retired_cnt = 0;
+
+	if (old != NULL) {
+		old->retired_next = retired->snapshots;
+		retired->snapshots = old;
+	}
+	epoch_try_advance(zr);
+
+cleanup:
+	return result;
+}
+
+/**
+ * Rebuild the snapshot if the number of changes since the last rebuild
+ * reached size of the snapshot. Failure is not fatal, the snapshot
+ * is still consistent with the RBT thanks to the pending list.
+ *
+ * @pre Zone register is locked for writing.
+ */
+static void ATTR_NONNULLS
+snapshot_maybe_publish(zone_register_t * const zr) {
+	isc_result_t result;
+	unsigned int changes = zr->pending_cnt + zr->retired_cnt;
+	unsigned int threshold = ZR_SNAPSHOT_MINBATCH;
+
+	if (zr->snapshot != NULL && zr->snapshot->count > threshold)
+		threshold = zr->snapshot->count;
+	if (changes < threshold)
+		return;
+
+	result = snapshot_publish(zr);
+	if (result != ISC_R_SUCCESS)
+		log_error_r("unable to rebuild zone register snapshot");
+}
+
+/**
+ * Rebuild lock-free snapshot of the zone register so lookups of zones added
+ * since the last rebuild do not need to fall back to the locked RBT.
+ * Call it when a batch of zones was added, e.g. before zone activation.
+ */
+isc_result_t
+zr_publish(zone_register_t * const zr) {
+	isc_result_t result = ISC_R_SUCCESS;
+
+	REQUIRE(zr != NULL);
+
+	RWLOCK(&zr->rwlock, isc_rwlocktype_write);
+	if (zr->pending_cnt != 0 || zr->retired_cnt != 0)
+		result = snapshot_publish(zr);
+	else
+		epoch_try_advance(zr);
+	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
+
+	return result;
+}
+
 isc_result_t
 zr_rbt_iter_init(zone_register_t *zr, rbt_iterator_t **iter,
 		 dns_name_t *nodename) {
@@ -112,11 +513,17 @@ zr_create(isc_mem_t *mctx, ldap_instance_t *ldap_inst,
 	REQUIRE(glob_settings != NULL);
 	REQUIRE(zrp != NULL && *zrp == NULL);
 
+	RUNTIME_CHECK(isc_once_do(&zr_thread_key_once, zr_thread_key_init)
+		      == ISC_R_SUCCESS);
 	CHECKED_MEM_GET_PTR(mctx, zr);
 	ZERO_PTR(zr);
 	isc_mem_attach(mctx, &zr->mctx);
-	CHECK(dns_rbt_create(mctx, delete_zone_info, mctx, &zr->rbt));
+	CHECK(dns_rbt_create(mctx, retire_zone_info, zr, &zr->rbt));
 	CHECK(isc_rwlock_init(&zr->rwlock, 0, 0));
+	INIT_LIST(zr->pending);
+	INIT_LIST(zr->tombstones);
+	INIT_LIST(zr->retired[0].zinfos);
+	INIT_LIST(zr->retired[1].zinfos);
 	zr->global_settings = glob_settings;
 	zr->ldap_inst = ldap_inst;
 
@@ -148,6 +555,7 @@ zr_destroy(zone_register_t **zrp)
 	zone_register_t *zr;
 	rbt_iterator_t *iter = NULL;
 	isc_result_t result;
+	zone_info_t *zinfo;
 
 	if (zrp == NULL || *zrp == NULL)
 		return;
@@ -170,6 +578,14 @@ zr_destroy(zone_register_t **zrp)
 
 	RWLOCK(&zr->rwlock, isc_rwlocktype_write);
 	dns_rbt_destroy(&zr->rbt);
+	/* there are no readers anymore */
+	retired_free(zr, 0);
+	retired_free(zr, 1);
+	snapshot_destroy(zr->mctx, &zr->snapshot);
+	while ((zinfo = HEAD(zr->tombstones)) != NULL) {
+		UNLINK(zr->tombstones, zinfo, link);
+		delete_zone_info(zinfo, zr->mctx);
+	}
 	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
 	isc_rwlock_destroy(&zr->rwlock);
 	MEM_PUT_AND_DETACH(zr);
@@ -236,7 +652,7 @@ zr_get_zone_path(isc_mem_t *mctx, settings_set_t *settings,
 	isc_buffer_putuint8(&name_buf, '\0');
 	INSIST(isc_buffer_usedlength(&name_buf) >= 2);
 
-	CHECK(setting_get_str("directory", settings, &inst_dir));
+	CHECK(setting_get_str(SETTING_DIRECTORY, settings, &inst_dir));
 	CHECK(str_cat_char(zone_path, inst_dir));
 	CHECK(str_cat_char(zone_path, "master/"));
 	CHECK(str_cat_char(zone_path, isc_buffer_base(&name_buf)));
@@ -276,6 +692,12 @@ create_zone_info(isc_mem_t * const mctx, dns_zone_t * const raw,
 	CHECKED_MEM_GET_PTR(mctx, zinfo);
 	ZERO_PTR(zinfo);
 	CHECKED_MEM_STRDUP(mctx, dn, zinfo->dn);
+	CHECK(isc_mutex_init(&zinfo->dncache_lock));
+	result = isc_ht_init(&zinfo->dncache, mctx, ZR_DNCACHE_HT_BITS);
+	if (result != ISC_R_SUCCESS) {
+		DESTROYLOCK(&zinfo->dncache_lock);
+		goto cleanup;
+	}
 	dns_zone_attach(raw, &zinfo->raw);
 	if (secure != NULL)
 		dns_zone_attach(secure, &zinfo->secure);
@@ -312,8 +734,32 @@ cleanup:
 }
 
 /**
- * Delete a zone info structure. The two arguments are of type void * so the
- * function can be used as a node deleter for the red-black tree.
+ * Remove all entries from owner DN cache of the zone.
+ *
+ * @pre zinfo->dncache_lock is locked or zinfo is not reachable by others.
+ */
+static void ATTR_NONNULLS
+dncache_flush(isc_mem_t *mctx, zone_info_t *zinfo)
+{
+	isc_result_t result;
+	isc_ht_iter_t *iter = NULL;
+	void *value = NULL;
+
+	RUNTIME_CHECK(isc_ht_iter_create(zinfo->dncache, &iter)
+		      == ISC_R_SUCCESS);
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_delcurrent_next(iter)) {
+		value = NULL;
+		isc_ht_iter_current(iter, &value);
+		isc_mem_free(mctx, value);
+	}
+	isc_ht_iter_destroy(&iter);
+	zinfo->dncache_count = 0;
+}
+
+/**
+ * Delete a zone info structure.
  */
 static void ATTR_NONNULL(2)
 delete_zone_info(void *arg1, void *arg2)
@@ -325,6 +771,11 @@ delete_zone_info(void *arg1, void *arg2)
 		return;
 
 	settings_set_free(&zinfo->settings);
+	if (zinfo->dncache != NULL) {
+		dncache_flush(mctx, zinfo);
+		isc_ht_destroy(&zinfo->dncache);
+		DESTROYLOCK(&zinfo->dncache_lock);
+	}
 	if (zinfo->dn != NULL)
 		isc_mem_free(mctx, zinfo->dn);
 	if (zinfo->raw != NULL)
@@ -336,6 +787,37 @@ delete_zone_info(void *arg1, void *arg2)
 	SAFE_MEM_PUT_PTR(mctx, zinfo);
 }
 
+/**
+ * Unlink zone info structure deleted from the RBT. The structure is freed
+ * when no reader can reference it anymore, see epoch_try_advance().
+ * The two arguments are of type void * so the function can be used
+ * as a node deleter for the red-black tree.
+ *
+ * @pre Zone register is locked for writing.
+ */
+static void ATTR_NONNULL(2)
+retire_zone_info(void *arg1, void *arg2)
+{
+	zone_info_t *zinfo = arg1;
+	zone_register_t *zr = arg2;
+
+	if (zinfo == NULL)
+		return;
+
+	ATOMIC_STORE_RELEASE(&zinfo->retired, ISC_TRUE);
+	if (zinfo->pending == ISC_TRUE) {
+		/* only readers which fell back to the RBT can see it */
+		UNLINK(zr->pending, zinfo, link);
+		zinfo->pending = ISC_FALSE;
+		ATOMIC_STORE_RELEASE(&zr->pending_cnt, zr->pending_cnt - 1);
+		APPEND(zr->retired[zr->epoch & 1].zinfos, zinfo, link);
+	} else {
+		/* retired together with the snapshot, see snapshot_publish() */
+		APPEND(zr->tombstones, zinfo, link);
+		zr->retired_cnt++;
+	}
+}
+
 /**
  * Find a zone in ZR with origin exactly matching 'name'.
  *
@@ -395,7 +877,14 @@ zr_add_zone(zone_register_t * const zr, dns_db_t * const ldapdb,
 
 	CHECK(create_zone_info(zr->mctx, raw, secure, dn, zr->global_settings,
 			       zr->ldap_inst, ldapdb, &new_zinfo));
+	new_zinfo->hash = dns_name_hash(name, ISC_FALSE);
 	CHECK(dns_rbt_addname(zr->rbt, name, new_zinfo));
+	/* readers find the zone in the RBT until the snapshot is rebuilt */
+	new_zinfo->pending = ISC_TRUE;
+	APPEND(zr->pending, new_zinfo, link);
+	ATOMIC_STORE_RELEASE(&zr->pending_cnt, zr->pending_cnt + 1);
+	new_zinfo = NULL;
+	snapshot_maybe_publish(zr);
 
 cleanup:
 	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
@@ -412,13 +901,17 @@ isc_result_t
 zr_del_zone(zone_register_t *zr, dns_name_t *origin)
 {
 	isc_result_t result;
+	zone_info_t *zinfo = NULL;
 
 	REQUIRE(zr != NULL);
 	REQUIRE(origin != NULL);
 
 	RWLOCK(&zr->rwlock, isc_rwlocktype_write);
 
+	CHECK(getzinfo(zr, origin, &zinfo));
+	/* retire_zone_info() hides the zone from readers */
 	CHECK(dns_rbt_deletename(zr->rbt, origin, ISC_FALSE));
+	snapshot_maybe_publish(zr);
 
 cleanup:
 	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
@@ -429,6 +922,60 @@ cleanup:
 	return result;
 }
 
+/**
+ * Set or clear mark of a zone which data might differ from LDAP,
+ * see ldap_zone_resync().
+ *
+ * @param[out] wasp Previous state of the mark (optional).
+ */
+isc_result_t
+zr_set_zone_tainted(zone_register_t *zr, dns_name_t *name,
+		    isc_boolean_t tainted, isc_boolean_t *wasp)
+{
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(name != NULL);
+
+	RWLOCK(&zr->rwlock, isc_rwlocktype_write);
+
+	CHECK(getzinfo(zr, name, &zinfo));
+	if (wasp != NULL)
+		*wasp = zinfo->tainted;
+	zinfo->tainted = tainted;
+
+cleanup:
+	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
+
+	return result;
+}
+
+/**
+ * Find a zone in snapshot and fall back to the RBT if some zones were added
+ * after the snapshot was built.
+ *
+ * @pre Caller is in read section, see snapshot_enter(). The zone info
+ *      stays valid until the read section ends even if the RBT lookup
+ *      was used.
+ */
+static isc_result_t ATTR_NONNULL(1,3,4) ATTR_CHECKRESULT
+reader_find(zone_register_t * const zr, const zr_snapshot_t *snap,
+	    dns_name_t *name, zone_info_t **zinfop) {
+	isc_result_t result;
+
+	result = snapshot_find(snap, name, zinfop);
+	if (result != ISC_R_NOTFOUND
+	    || ATOMIC_LOAD_ACQUIRE(&zr->pending_cnt) == 0)
+		return result;
+
+	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+	result = getzinfo(zr, name, zinfop);
+	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+
+	return result;
+}
+
 /**
  * Find a zone with 'name' within in the zone register 'zr'. If an
  * exact match is found, the pointer to the LDAP DB and internal
@@ -445,14 +992,16 @@ zr_get_zone_dbs(zone_register_t *zr, dns_name_t *name, dns_db_t **ldapdbp,
 	isc_result_t result;
 	zone_info_t *zinfo = NULL;
 	dns_db_t *ldapdb = NULL;
+	zr_snapshot_t *snap;
+	unsigned int *reader = NULL;
 
 	REQUIRE(zr != NULL);
 	REQUIRE(name != NULL);
 	REQUIRE(ldapdbp != NULL || rbtdbp != NULL);
 
-	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+	snap = snapshot_enter(zr, &reader);
 
-	CHECK(getzinfo(zr, name, &zinfo));
+	CHECK(reader_find(zr, snap, name, &zinfo));
 	dns_db_attach(zinfo->ldapdb, &ldapdb);
 	if (ldapdbp != NULL)
 		dns_db_attach(ldapdb, ldapdbp);
@@ -460,7 +1009,7 @@ zr_get_zone_dbs(zone_register_t *zr, dns_name_t *name, dns_db_t **ldapdbp,
 		dns_db_attach(ldapdb_get_rbtdb(ldapdb), rbtdbp);
 
 cleanup:
-	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+	snapshot_leave(&reader);
 
 	if (ldapdb != NULL)
 		dns_db_detach(&ldapdb);
@@ -479,18 +1028,104 @@ zr_get_zone_dn(zone_register_t *zr, dns_name_t *name, const char **dn)
 {
 	isc_result_t result;
 	zone_info_t *zinfo = NULL;
+	zr_snapshot_t *snap;
+	unsigned int *reader = NULL;
 
 	REQUIRE(zr != NULL);
 	REQUIRE(name != NULL);
 	REQUIRE(dn != NULL && *dn == NULL);
 
-	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+	snap = snapshot_enter(zr, &reader);
 
-	result = getzinfo(zr, name, &zinfo);
+	result = reader_find(zr, snap, name, &zinfo);
 	if (result == ISC_R_SUCCESS)
 		*dn = zinfo->dn;
 
-	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+	snapshot_leave(&reader);
+
+	return result;
+}
+
+/**
+ * Find cached LDAP DN of record 'owner' in zone 'zone'. Cached DN is appended
+ * to 'dn' string.
+ *
+ * @retval ISC_R_NOTFOUND Zone does not exist or the owner is not cached.
+ */
+isc_result_t
+zr_get_owner_dn(zone_register_t *zr, dns_name_t *zone, dns_name_t *owner,
+		ld_string_t *dn)
+{
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+	zr_snapshot_t *snap;
+	unsigned int *reader = NULL;
+	isc_region_t key;
+	void *value = NULL;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(zone != NULL);
+	REQUIRE(owner != NULL);
+	REQUIRE(dn != NULL);
+
+	dns_name_toregion(owner, &key);
+	snap = snapshot_enter(zr, &reader);
+
+	CHECK(reader_find(zr, snap, zone, &zinfo));
+	LOCK(&zinfo->dncache_lock);
+	result = isc_ht_find(zinfo->dncache, key.base, key.length, &value);
+	if (result == ISC_R_SUCCESS)
+		result = str_cat_char(dn, value);
+	UNLOCK(&zinfo->dncache_lock);
+
+cleanup:
+	snapshot_leave(&reader);
+
+	return result;
+}
+
+/**
+ * Remember LDAP DN of record 'owner' in zone 'zone'. The cache is bounded,
+ * it is flushed as a whole when it reaches ZR_DNCACHE_MAX entries.
+ */
+isc_result_t
+zr_set_owner_dn(zone_register_t *zr, dns_name_t *zone, dns_name_t *owner,
+		const char *dn)
+{
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+	zr_snapshot_t *snap;
+	unsigned int *reader = NULL;
+	isc_region_t key;
+	char *value = NULL;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(zone != NULL);
+	REQUIRE(owner != NULL);
+	REQUIRE(dn != NULL);
+
+	dns_name_toregion(owner, &key);
+	CHECKED_MEM_STRDUP(zr->mctx, dn, value);
+	snap = snapshot_enter(zr, &reader);
+
+	CHECK(reader_find(zr, snap, zone, &zinfo));
+	LOCK(&zinfo->dncache_lock);
+	if (zinfo->dncache_count >= ZR_DNCACHE_MAX)
+		dncache_flush(zr->mctx, zinfo);
+	result = isc_ht_add(zinfo->dncache, key.base, key.length, value);
+	if (result == ISC_R_SUCCESS) {
+		zinfo->dncache_count++;
+		value = NULL;
+	} else if (result == ISC_R_EXISTS) {
+		/* another thread was faster */
+		result = ISC_R_SUCCESS;
+	}
+	UNLOCK(&zinfo->dncache_lock);
+
+cleanup:
+	snapshot_leave(&reader);
+	if (value != NULL)
+		isc_mem_free(zr->mctx, value);
 
 	return result;
 }
@@ -512,6 +1147,8 @@ zr_get_zone_ptr(zone_register_t * const zr, dns_name_t * const name,
 {
 	isc_result_t result;
 	zone_info_t *zinfo = NULL;
+	zr_snapshot_t *snap;
+	unsigned int *reader = NULL;
 
 	REQUIRE(zr != NULL);
 	REQUIRE(name != NULL);
@@ -519,9 +1156,9 @@ zr_get_zone_ptr(zone_register_t * const zr, dns_name_t * const name,
 	REQUIRE(rawp == NULL || *rawp == NULL);
 	REQUIRE(securep == NULL || *securep == NULL);
 
-	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+	snap = snapshot_enter(zr, &reader);
 
-	result = getzinfo(zr, name, &zinfo);
+	result = reader_find(zr, snap, name, &zinfo);
 	if (result == ISC_R_SUCCESS) {
 		if (rawp != NULL)
 			dns_zone_attach(zinfo->raw, rawp);
@@ -529,7 +1166,7 @@ zr_get_zone_ptr(zone_register_t * const zr, dns_name_t * const name,
 			dns_zone_attach(zinfo->secure, securep);
 	}
 
-	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+	snapshot_leave(&reader);
 
 	return result;
 }
@@ -544,18 +1181,20 @@ zr_get_zone_settings(zone_register_t *zr, dns_name_t *name, settings_set_t **set
 {
 	isc_result_t result;
 	zone_info_t *zinfo = NULL;
+	zr_snapshot_t *snap;
+	unsigned int *reader = NULL;
 
 	REQUIRE(zr != NULL);
 	REQUIRE(name != NULL);
 	REQUIRE(set != NULL && *set == NULL);
 
-	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+	snap = snapshot_enter(zr, &reader);
 
-	result = getzinfo(zr, name, &zinfo);
+	result = reader_find(zr, snap, name, &zinfo);
 	if (result == ISC_R_SUCCESS)
 		*set = zinfo->settings;
 
-	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+	snapshot_leave(&reader);
 
 	return result;
 }
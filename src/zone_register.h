@@ -24,9 +24,17 @@ zr_add_zone(zone_register_t * const zr, dns_db_t * const ldapdb,
 	    const char * const dn)
 	    ATTR_NONNULL(1,3,5) ATTR_CHECKRESULT;
 
+isc_result_t
+zr_publish(zone_register_t * const zr) ATTR_NONNULLS ATTR_CHECKRESULT;
+
 isc_result_t
 zr_del_zone(zone_register_t *zr, dns_name_t *origin) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+isc_result_t
+zr_set_zone_tainted(zone_register_t *zr, dns_name_t *name,
+		    isc_boolean_t tainted, isc_boolean_t *wasp)
+		    ATTR_NONNULL(1,2) ATTR_CHECKRESULT;
+
 isc_result_t
 zr_get_zone_dbs(zone_register_t *zr, dns_name_t *name, dns_db_t **ldapdbp,
 		dns_db_t **rbtdbp) ATTR_NONNULL(1, 2) ATTR_CHECKRESULT;
@@ -34,6 +42,14 @@ zr_get_zone_dbs(zone_register_t *zr, dns_name_t *name, dns_db_t **ldapdbp,
 isc_result_t
 zr_get_zone_dn(zone_register_t *zr, dns_name_t *name, const char **dn) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+isc_result_t
+zr_get_owner_dn(zone_register_t *zr, dns_name_t *zone, dns_name_t *owner,
+		ld_string_t *dn) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+zr_set_owner_dn(zone_register_t *zr, dns_name_t *zone, dns_name_t *owner,
+		const char *dn) ATTR_NONNULLS ATTR_CHECKRESULT;
+
 isc_result_t
 zr_get_zone_ptr(zone_register_t * const zr, dns_name_t * const name,
 		dns_zone_t ** const rawp, dns_zone_t ** const securep)
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2016  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Unit tests and benchmark for conversion of DNs to DNS names.
+ * Fast parser of simple DNs has to return the same values as ldap_str2dn().
+ */
+
+#include "test_util.h"
+
+#include <strings.h>
+#include <time.h>
+
+#include <isc/buffer.h>
+
+#include <dns/fixedname.h>
+#include <dns/name.h>
+
+#define LDAP_DEPRECATED 1
+#include <ldap.h>
+
+#include "ldap_convert.h"
+
+#define BENCH_ROUNDS	100000
+
+static isc_mem_t *mctx;
+
+/**
+ * Leading idnsName values parsed by ldap_str2dn(), at most two.
+ */
+typedef struct ref_dn {
+	LDAPDN		dn;
+	int		cnt;
+	struct berval	*values[2];
+} ref_dn_t;
+
+static void
+ref_parse(const char *dn_str, ref_dn_t *ref) {
+	LDAPAVA *ava;
+
+	memset(ref, 0, sizeof(*ref));
+	TEST_ASSERT(ldap_str2dn(dn_str, &ref->dn, LDAP_DN_FORMAT_LDAPV3)
+		    == LDAP_SUCCESS);
+	for (ref->cnt = 0; ref->cnt < 2 && ref->dn[ref->cnt] != NULL;
+	     ref->cnt++) {
+		ava = ref->dn[ref->cnt][0];
+		if (ref->dn[ref->cnt][1] != NULL
+		    || strncasecmp(ava->la_attr.bv_val, "idnsName",
+				   ava->la_attr.bv_len) != 0)
+			break;
+		ref->values[ref->cnt] = &ava->la_value;
+	}
+}
+
+static void
+check_value(isc_buffer_t *buf, struct berval *expected) {
+	TEST_ASSERT(isc_buffer_usedlength(buf) == expected->bv_len);
+	TEST_ASSERT(memcmp(isc_buffer_base(buf), expected->bv_val,
+			   expected->bv_len) == 0);
+}
+
+/**
+ * Compare fast parser and dn_to_dnsname() with values from ldap_str2dn().
+ *
+ * @param[in] fast ISC_TRUE if DN has to be handled by the fast parser.
+ */
+static void
+check_dn(const char *dn_str, isc_boolean_t fast) {
+	isc_buffer_t name_buf;
+	isc_buffer_t origin_buf;
+	isc_buffer_t buf;
+	int idx = 0;
+	ref_dn_t ref;
+	dns_name_t name;
+	dns_name_t origin;
+	isc_boolean_t iszone;
+	dns_fixedname_t fexp_name;
+	dns_fixedname_t fexp_origin;
+	dns_name_t *exp_name;
+	dns_name_t *exp_origin;
+
+	ref_parse(dn_str, &ref);
+	TEST_ASSERT(ref.cnt > 0);
+
+	isc_buffer_initnull(&name_buf);
+	isc_buffer_initnull(&origin_buf);
+	if (fast == ISC_TRUE) {
+		TEST_SUCCESS(dn_idnsname_fast(dn_str, &name_buf, &origin_buf,
+					      &idx));
+		TEST_ASSERT(idx == ref.cnt);
+		check_value(&name_buf, ref.values[0]);
+		if (idx == 2)
+			check_value(&origin_buf, ref.values[1]);
+	} else {
+		TEST_RESULT(dn_idnsname_fast(dn_str, &name_buf, &origin_buf,
+					     &idx), ISC_R_IGNORE);
+	}
+
+	/* names from the reference values */
+	dns_fixedname_init(&fexp_name);
+	dns_fixedname_init(&fexp_origin);
+	exp_name = dns_fixedname_name(&fexp_name);
+	exp_origin = dns_fixedname_name(&fexp_origin);
+	if (ref.cnt == 2) {
+		isc_buffer_init(&buf, ref.values[1]->bv_val,
+				ref.values[1]->bv_len);
+		isc_buffer_add(&buf, ref.values[1]->bv_len);
+		TEST_SUCCESS(dns_name_fromtext(exp_origin, &buf, dns_rootname,
+					       0, NULL));
+	} else {
+		TEST_SUCCESS(dns_name_copy(dns_rootname, exp_origin, NULL));
+	}
+	isc_buffer_init(&buf, ref.values[0]->bv_val, ref.values[0]->bv_len);
+	isc_buffer_add(&buf, ref.values[0]->bv_len);
+	TEST_SUCCESS(dns_name_fromtext(exp_name, &buf, exp_origin, 0, NULL));
+
+	dns_name_init(&name, NULL);
+	dns_name_init(&origin, NULL);
+	TEST_SUCCESS(dn_to_dnsname(mctx, dn_str, &name, &origin, &iszone));
+	TEST_ASSERT(iszone == ISC_TF(ref.cnt == 1));
+	TEST_ASSERT(dns_name_equal(&name, exp_name));
+	TEST_ASSERT(dns_name_equal(&origin, exp_origin));
+	dns_name_free(&name, mctx);
+	dns_name_free(&origin, mctx);
+	ldap_dnfree(ref.dn);
+}
+
+static void
+test_simple(void) {
+	check_dn("idnsName=foo.bar, idnsName=example.org., cn=dns, "
+		 "dc=example, dc=org", ISC_TRUE);
+	check_dn("idnsname=89,idnsname=4.34.10.in-addr.arpa,cn=dns,"
+		 "dc=example,dc=org", ISC_TRUE);
+	check_dn("IDNSNAME=Third.Test., idnsName=test., cn=dns", ISC_TRUE);
+	check_dn("idnsName=example.org.,cn=dns,dc=example,dc=org", ISC_TRUE);
+	check_dn("idnsName=_ldap._tcp, idnsName=example.org., cn=dns",
+		 ISC_TRUE);
+	/* only the first two idnsNames are used */
+	check_dn("idnsName=a, idnsName=b.example., idnsName=example., "
+		 "cn=dns", ISC_TRUE);
+}
+
+static void
+test_idn(void) {
+	check_dn("idnsName=xn--bcher-kva, idnsName=xn--caf-dma.example., "
+		 "cn=dns", ISC_TRUE);
+	/* raw UTF-8 values are not escaped in DN */
+	check_dn("idnsName=b\xc3\xbc" "cher, idnsName=caf\xc3\xa9.example., "
+		 "cn=dns", ISC_TRUE);
+}
+
+/**
+ * Special cases are left for ldap_str2dn().
+ */
+static void
+test_escaped(void) {
+	isc_buffer_t name_buf;
+	isc_buffer_t origin_buf;
+	int idx;
+
+	check_dn("idnsName=a\\,b, idnsName=example., cn=dns", ISC_FALSE);
+	check_dn("idnsName=\\41bc, idnsName=example., cn=dns", ISC_FALSE);
+	check_dn("idnsName=a\\2Bb, idnsName=example., cn=dns", ISC_FALSE);
+	check_dn("idnsName=b\\C3\\BC" "cher, idnsName=example., cn=dns",
+		 ISC_FALSE);
+	/* escaped value in the zone component */
+	check_dn("idnsName=a, idnsName=ex\\61mple., cn=dns", ISC_FALSE);
+	/* multi-valued RDN is rejected by the generic parser */
+	TEST_RESULT(dn_idnsname_fast("idnsName=a+cn=b, idnsName=example.",
+				     &name_buf, &origin_buf, &idx),
+		    ISC_R_IGNORE);
+}
+
+static double
+elapsed_ns(const struct timespec *start, const struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) * 1e9
+	       + (end->tv_nsec - start->tv_nsec);
+}
+
+/**
+ * Print time spent by the fast parser and by ldap_str2dn(). Nothing
+ * is asserted, numbers depend on the machine.
+ */
+static void
+test_benchmark(void) {
+	const char *dn_str = "idnsName=host42, idnsName=example.org., "
+			     "cn=dns, dc=example, dc=org";
+	isc_buffer_t name_buf;
+	isc_buffer_t origin_buf;
+	LDAPDN dn = NULL;
+	struct timespec start, end;
+	double fast_ns, ldap_ns;
+	int idx;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < BENCH_ROUNDS; i++)
+		TEST_SUCCESS(dn_idnsname_fast(dn_str, &name_buf, &origin_buf,
+					      &idx));
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fast_ns = elapsed_ns(&start, &end) / BENCH_ROUNDS;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		TEST_ASSERT(ldap_str2dn(dn_str, &dn, LDAP_DN_FORMAT_LDAPV3)
+			    == LDAP_SUCCESS);
+		ldap_dnfree(dn);
+		dn = NULL;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ldap_ns = elapsed_ns(&start, &end) / BENCH_ROUNDS;
+
+	fprintf(stderr, "fast parser: %.0f ns/DN, ldap_str2dn: %.0f ns/DN\n",
+		fast_ns, ldap_ns);
+}
+
+int
+main(void) {
+	mctx = test_mem_create();
+	TEST_RUN(test_simple);
+	TEST_RUN(test_idn);
+	TEST_RUN(test_escaped);
+	TEST_RUN(test_benchmark);
+	test_mem_destroy(&mctx);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2016  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Unit tests for expansion of idnsRangeGenerator values and for register
+ * of applied values.
+ */
+
+#include "test_util.h"
+
+#include <dns/rdatatype.h>
+
+#include "rr_range.h"
+
+static isc_mem_t *mctx;
+
+/** Records produced by expansion, one "owner type rdata" per line. */
+static char output[4096];
+static unsigned int record_cnt;
+/** Number of records after which collect() fails, 0 means never. */
+static unsigned int fail_after;
+
+static isc_result_t
+collect(void *arg, const char *owner, dns_rdatatype_t type,
+	const char *rdata) {
+	size_t len = strlen(output);
+	char type_text[DNS_RDATATYPE_FORMATSIZE];
+
+	UNUSED(arg);
+
+	if (fail_after != 0 && record_cnt == fail_after)
+		return ISC_R_QUOTA;
+	record_cnt++;
+	dns_rdatatype_format(type, type_text, sizeof(type_text));
+	snprintf(output + len, sizeof(output) - len, "%s%s %s %s",
+		 (len > 0) ? "\n" : "", owner, type_text, rdata);
+	return ISC_R_SUCCESS;
+}
+
+static void
+expand(const char *spec, isc_result_t expected_result) {
+	output[0] = '\0';
+	record_cnt = 0;
+	TEST_RESULT(rr_range_expand(mctx, spec, collect, NULL),
+		    expected_result);
+}
+
+static void
+check_expand(const char *spec, const char *expected) {
+	expand(spec, ISC_R_SUCCESS);
+	TEST_STREQ(output, expected);
+}
+
+static void
+setup(void) {
+	mctx = test_mem_create();
+}
+
+static void
+teardown(void) {
+	test_mem_destroy(&mctx);
+}
+
+static void
+test_expand(void) {
+	check_expand("1-3 host-$ A 10.0.0.$",
+		     "host-1 A 10.0.0.1\n"
+		     "host-2 A 10.0.0.2\n"
+		     "host-3 A 10.0.0.3");
+	check_expand("0-10/5 $ PTR h$.example.",
+		     "0 PTR h0.example.\n"
+		     "5 PTR h5.example.\n"
+		     "10 PTR h10.example.");
+	/* stop which is not reached by step */
+	check_expand("1-4/2 $ PTR h$.", "1 PTR h1.\n3 PTR h3.");
+	check_expand("  7-7 \t$ PTR h$. ", "7 PTR h7. ");
+	check_expand("4294967295-4294967295 $ TXT $",
+		     "4294967295 TXT 4294967295");
+}
+
+static void
+test_modifier(void) {
+	check_expand("1-2 h${10,3,d} TXT ${0,2,x}",
+		     "h011 TXT 01\nh012 TXT 02");
+	check_expand("10-11 h${0,0,X} TXT ${0,0,x}",
+		     "hA TXT a\nhB TXT b");
+	check_expand("8-8 h${0,3,o} TXT $", "h010 TXT 8");
+	check_expand("5-6 h${-5} TXT $", "h0 TXT 5\nh1 TXT 6");
+	check_expand("1-1 a\\$b A 10.0.0.$", "a$b A 10.0.0.1");
+	check_expand("1-1 a\\$${1} TXT \\$", "a$2 TXT $");
+}
+
+static void
+test_syntax(void) {
+	expand("", DNS_R_SYNTAX);
+	expand("1-2 x A", DNS_R_SYNTAX);
+	expand("3-1 x A 10.0.0.1", DNS_R_SYNTAX);
+	expand("1-2/0 x A 10.0.0.1", DNS_R_SYNTAX);
+	expand("a-b x A 10.0.0.1", DNS_R_SYNTAX);
+	expand("-1-2 x A 10.0.0.1", DNS_R_SYNTAX);
+	expand("1-2x x A 10.0.0.1", DNS_R_SYNTAX);
+	expand("1-2 x BOGUS 10.0.0.1", DNS_R_SYNTAX);
+	expand("1-2 x SOA a. b. 1 2 3 4 5", DNS_R_SYNTAX);
+	expand("1-2 x${1,2,q} A 10.0.0.1", DNS_R_SYNTAX);
+	expand("1-2 x${1 A 10.0.0.1", DNS_R_SYNTAX);
+	expand("1-2 x${1,65} A 10.0.0.1", DNS_R_SYNTAX);
+	TEST_ASSERT(record_cnt == 0);
+	/* offset below zero */
+	expand("0-1 x${-1} A 10.0.0.1", ISC_R_RANGE);
+}
+
+static void
+test_limits(void) {
+	unsigned long count = 0;
+
+	TEST_SUCCESS(rr_range_count("0-65535 $ A 10.0.0.1", &count));
+	TEST_ASSERT(count == RR_RANGE_MAX);
+	TEST_RESULT(rr_range_count("0-65536 $ A 10.0.0.1", &count),
+		    ISC_R_RANGE);
+	TEST_SUCCESS(rr_range_count("0-131070/2 $ A 10.0.0.1", &count));
+	TEST_ASSERT(count == RR_RANGE_MAX);
+	TEST_RESULT(rr_range_count("0-131072/2 $ A 10.0.0.1", &count),
+		    ISC_R_RANGE);
+	TEST_SUCCESS(rr_range_count(" 0-10/3 $ A 10.0.0.1", &count));
+	TEST_ASSERT(count == 4);
+	TEST_RESULT(rr_range_count("x $ A 10.0.0.1", &count), DNS_R_SYNTAX);
+
+	expand("0-65536 $ A 10.0.0.1", ISC_R_RANGE);
+	TEST_ASSERT(record_cnt == 0);
+	expand("0-65535 $ TXT $", ISC_R_SUCCESS);
+	TEST_ASSERT(record_cnt == RR_RANGE_MAX);
+}
+
+/**
+ * Error from action stops the expansion.
+ */
+static void
+test_action_error(void) {
+	fail_after = 3;
+	expand("1-10 $ TXT $", ISC_R_QUOTA);
+	TEST_ASSERT(record_cnt == 3);
+	fail_after = 0;
+}
+
+static void
+test_register(void) {
+	rr_range_register_t *reg = NULL;
+	struct berval uuid1 = { 4, (char *)"\x01\x02\x03\x04" };
+	struct berval uuid2 = { 4, (char *)"\x05\x06\x07\x08" };
+	char *specs = NULL;
+
+	TEST_SUCCESS(rr_range_register_create(mctx, &reg));
+	TEST_RESULT(rr_range_get(reg, mctx, &uuid1, &specs), ISC_R_NOTFOUND);
+	TEST_ASSERT(specs == NULL);
+
+	TEST_SUCCESS(rr_range_set(reg, &uuid1, "1-2 $ PTR a$."));
+	TEST_SUCCESS(rr_range_set(reg, &uuid2, "1-2 $ PTR b$."));
+	TEST_SUCCESS(rr_range_get(reg, mctx, &uuid1, &specs));
+	TEST_STREQ(specs, "1-2 $ PTR a$.");
+	isc_mem_free(mctx, specs);
+	specs = NULL;
+
+	/* new values replace the old ones */
+	TEST_SUCCESS(rr_range_set(reg, &uuid1,
+				  "1-2 $ PTR a$.\n3-4 $ PTR c$."));
+	TEST_SUCCESS(rr_range_get(reg, mctx, &uuid1, &specs));
+	TEST_STREQ(specs, "1-2 $ PTR a$.\n3-4 $ PTR c$.");
+	isc_mem_free(mctx, specs);
+	specs = NULL;
+
+	rr_range_remove(reg, &uuid1);
+	rr_range_remove(reg, &uuid1);
+	TEST_RESULT(rr_range_get(reg, mctx, &uuid1, &specs), ISC_R_NOTFOUND);
+	TEST_SUCCESS(rr_range_get(reg, mctx, &uuid2, &specs));
+	TEST_STREQ(specs, "1-2 $ PTR b$.");
+	isc_mem_free(mctx, specs);
+
+	/* remaining values are released with the register */
+	rr_range_register_destroy(&reg);
+	TEST_ASSERT(reg == NULL);
+}
+
+int
+main(void) {
+	setup();
+	TEST_RUN(test_expand);
+	TEST_RUN(test_modifier);
+	TEST_RUN(test_syntax);
+	TEST_RUN(test_limits);
+	TEST_RUN(test_action_error);
+	TEST_RUN(test_register);
+	teardown();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2016  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Unit tests for pre-compiled RR templates.
+ */
+
+#include "test_util.h"
+
+#include "rr_template.h"
+#include "settings.h"
+#include "str.h"
+
+#define LOCATION_VAR	"substitutionvariable_ipalocation"
+
+static const setting_t global_defaults[] = {
+	{ LOCATION_VAR,		no_default_string		},
+	{ "server_id",		default_string("srv1")		},
+	end_of_settings
+};
+
+static const setting_t zone_defaults[] = {
+	{ LOCATION_VAR,		no_default_string		},
+	end_of_settings
+};
+
+static isc_mem_t *mctx;
+static rr_template_cache_t *cache;
+static settings_set_t *global_set;
+static settings_set_t *zone1_set;
+static settings_set_t *zone2_set;
+
+/**
+ * Render template and compare output with expected value.
+ * Expected value NULL means that rendering has to be ignored.
+ */
+static void
+check_render(const settings_set_t *set, const char *template_str,
+	     const char *expected) {
+	ld_string_t *output = NULL;
+	isc_result_t result;
+
+	result = rr_template_render(cache, set, template_str, &output);
+	if (expected == NULL) {
+		TEST_RESULT(result, ISC_R_IGNORE);
+		TEST_ASSERT(output == NULL);
+		return;
+	}
+	TEST_SUCCESS(result);
+	TEST_STREQ(str_buf(output), expected);
+	str_destroy(&output);
+}
+
+static void
+setup(void) {
+	mctx = test_mem_create();
+	TEST_SUCCESS(rr_template_cache_create(mctx, &cache));
+	TEST_SUCCESS(settings_set_create(mctx, global_defaults,
+					 sizeof(global_defaults), "global",
+					 NULL, &global_set));
+	TEST_SUCCESS(settings_set_create(mctx, zone_defaults,
+					 sizeof(zone_defaults), "zone1",
+					 global_set, &zone1_set));
+	TEST_SUCCESS(settings_set_create(mctx, zone_defaults,
+					 sizeof(zone_defaults), "zone2",
+					 global_set, &zone2_set));
+}
+
+static void
+teardown(void) {
+	settings_set_free(&zone2_set);
+	settings_set_free(&zone1_set);
+	settings_set_free(&global_set);
+	rr_template_cache_destroy(&cache);
+	test_mem_destroy(&mctx);
+}
+
+static void
+test_literal(void) {
+	check_render(zone1_set, "", "");
+	check_render(zone1_set, "10 mail.example.", "10 mail.example.");
+	/* double-escaped references and garbage are copied verbatim */
+	check_render(zone1_set, "a\\\\{server_id\\\\}b",
+		     "a\\\\{server_id\\\\}b");
+	check_render(zone1_set, "\\{ \\} \\{\\}", "\\{ \\} \\{\\}");
+}
+
+static void
+test_substitution(void) {
+	check_render(zone1_set, "\\{server_id\\}", "srv1");
+	check_render(zone1_set, "a\\{server_id\\}b\\{server_id\\}",
+		     "asrv1bsrv1");
+	/* only the innermost reference is expanded */
+	check_render(zone1_set, "\\{\\{server_id\\}\\}", "\\{srv1\\}");
+}
+
+static void
+test_undefined(void) {
+	check_render(zone1_set, "\\{" LOCATION_VAR "\\}.example.", NULL);
+	/* unknown setting name */
+	check_render(zone1_set, "\\{no_such_variable\\}", NULL);
+}
+
+static void
+test_invalidation(void) {
+	const char *tmpl = "\\{" LOCATION_VAR "\\}._locations.example.";
+
+	TEST_SUCCESS(setting_set(LOCATION_VAR, global_set, "prague"));
+	check_render(zone1_set, tmpl, "prague._locations.example.");
+	check_render(zone2_set, tmpl, "prague._locations.example.");
+
+	/* value in the zone set overrides the value inherited from parent */
+	TEST_SUCCESS(setting_set(LOCATION_VAR, zone1_set, "brno"));
+	check_render(zone1_set, tmpl, "brno._locations.example.");
+	check_render(zone2_set, tmpl, "prague._locations.example.");
+
+	/* change in parent is visible only where it is not overridden */
+	TEST_SUCCESS(setting_set(LOCATION_VAR, global_set, "vienna"));
+	check_render(zone1_set, tmpl, "brno._locations.example.");
+	check_render(zone2_set, tmpl, "vienna._locations.example.");
+
+	TEST_SUCCESS(setting_unset(LOCATION_VAR, zone1_set));
+	check_render(zone1_set, tmpl, "vienna._locations.example.");
+	TEST_SUCCESS(setting_unset(LOCATION_VAR, global_set));
+	check_render(zone1_set, tmpl, NULL);
+	check_render(zone2_set, tmpl, NULL);
+}
+
+/**
+ * Zones which share a template must not see each other's output.
+ */
+static void
+test_shared_template(void) {
+	const char *tmpl = "\\{" LOCATION_VAR "\\}";
+
+	TEST_SUCCESS(setting_set(LOCATION_VAR, zone1_set, "one"));
+	TEST_SUCCESS(setting_set(LOCATION_VAR, zone2_set, "two"));
+	for (int i = 0; i < 4; i++) {
+		check_render(zone1_set, tmpl, "one");
+		check_render(zone2_set, tmpl, "two");
+	}
+
+	/* forgotten set renders from scratch */
+	rr_template_cache_forget(cache, zone1_set);
+	check_render(zone1_set, tmpl, "one");
+	check_render(zone2_set, tmpl, "two");
+	TEST_SUCCESS(setting_unset(LOCATION_VAR, zone1_set));
+	TEST_SUCCESS(setting_unset(LOCATION_VAR, zone2_set));
+}
+
+/**
+ * Output rendered for a freed set must not be returned for a new set,
+ * even if it is allocated on the same address and has the same generation.
+ */
+static void
+test_freed_set(void) {
+	const char *tmpl = "\\{" LOCATION_VAR "\\}";
+	settings_set_t *set = NULL;
+
+	TEST_SUCCESS(settings_set_create(mctx, zone_defaults,
+					 sizeof(zone_defaults), "zone3",
+					 global_set, &set));
+	TEST_SUCCESS(setting_set(LOCATION_VAR, set, "old"));
+	check_render(set, tmpl, "old");
+	/* render cache is not told about the set */
+	settings_set_free(&set);
+
+	TEST_SUCCESS(settings_set_create(mctx, zone_defaults,
+					 sizeof(zone_defaults), "zone3",
+					 global_set, &set));
+	TEST_SUCCESS(setting_set(LOCATION_VAR, set, "new"));
+	check_render(set, tmpl, "new");
+	rr_template_cache_forget(cache, set);
+	settings_set_free(&set);
+}
+
+static void
+test_deps(void) {
+	struct berval uuid1 = { 4, (char *)"\x01\x02\x03\x04" };
+	struct berval uuid2 = { 4, (char *)"\x05\x06\x07\x08" };
+	rr_template_deplist_t deps;
+	rr_template_dep_t *dep;
+
+	TEST_SUCCESS(rr_template_deps_add(cache, "\\{" LOCATION_VAR "\\}",
+					  &uuid1, "idnsName=a,dc=test"));
+	TEST_SUCCESS(rr_template_deps_add(cache, "x\\{" LOCATION_VAR "\\}x"
+					  "\\{server_id\\}", &uuid2,
+					  "idnsName=b,dc=test"));
+
+	INIT_LIST(deps);
+	TEST_SUCCESS(rr_template_deps_get(cache, mctx, "server_id", &deps));
+	dep = HEAD(deps);
+	TEST_ASSERT(dep != NULL && NEXT(dep, link) == NULL);
+	TEST_STREQ(dep->dn, "idnsName=b,dc=test");
+	rr_template_deplist_free(mctx, &deps);
+
+	TEST_SUCCESS(rr_template_deps_get(cache, mctx, LOCATION_VAR, &deps));
+	dep = HEAD(deps);
+	TEST_ASSERT(dep != NULL && NEXT(dep, link) != NULL);
+	rr_template_deplist_free(mctx, &deps);
+
+	rr_template_deps_remove(cache, &uuid2);
+	TEST_SUCCESS(rr_template_deps_get(cache, mctx, "server_id", &deps));
+	TEST_ASSERT(EMPTY(deps));
+	TEST_SUCCESS(rr_template_deps_get(cache, mctx, LOCATION_VAR, &deps));
+	dep = HEAD(deps);
+	TEST_ASSERT(dep != NULL && NEXT(dep, link) == NULL);
+	TEST_STREQ(dep->dn, "idnsName=a,dc=test");
+	rr_template_deplist_free(mctx, &deps);
+}
+
+int
+main(void) {
+	setup();
+	TEST_RUN(test_literal);
+	TEST_RUN(test_substitution);
+	TEST_RUN(test_undefined);
+	TEST_RUN(test_invalidation);
+	TEST_RUN(test_shared_template);
+	TEST_RUN(test_freed_set);
+	TEST_RUN(test_deps);
+	teardown();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2016  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Unit tests for lookup of settings and its cache.
+ */
+
+#include "test_util.h"
+
+#include "settings.h"
+
+static const setting_t global_defaults[] = {
+	{ "default_ttl",	default_uint(86400)		},
+	{ "fake_mname",		default_string("")		},
+	{ "sync_ptr",		default_boolean(ISC_FALSE)	},
+	end_of_settings
+};
+
+static const setting_t zone_defaults[] = {
+	{ "default_ttl",	no_default_uint			},
+	{ "fake_mname",		no_default_string		},
+	end_of_settings
+};
+
+static isc_mem_t *mctx;
+static settings_set_t *global_set;
+static settings_set_t *zone1_set;
+static settings_set_t *zone2_set;
+
+static void
+check_uint(const settings_set_t *set, setting_id_t id, isc_uint32_t expected) {
+	isc_uint32_t value = 0;
+
+	TEST_SUCCESS(setting_get_uint(id, set, &value));
+	TEST_ASSERT(value == expected);
+}
+
+static void
+check_str(const settings_set_t *set, setting_id_t id, const char *expected) {
+	const char *value = NULL;
+
+	TEST_SUCCESS(setting_get_str(id, set, &value));
+	TEST_STREQ(value, expected);
+}
+
+static void
+setup(void) {
+	mctx = test_mem_create();
+	TEST_SUCCESS(settings_set_create(mctx, global_defaults,
+					 sizeof(global_defaults), "global",
+					 NULL, &global_set));
+	TEST_SUCCESS(settings_set_create(mctx, zone_defaults,
+					 sizeof(zone_defaults), "zone1",
+					 global_set, &zone1_set));
+	TEST_SUCCESS(settings_set_create(mctx, zone_defaults,
+					 sizeof(zone_defaults), "zone2",
+					 global_set, &zone2_set));
+}
+
+static void
+teardown(void) {
+	settings_set_free(&zone2_set);
+	settings_set_free(&zone1_set);
+	settings_set_free(&global_set);
+	test_mem_destroy(&mctx);
+}
+
+static void
+test_names(void) {
+	setting_t *setting = NULL;
+
+	TEST_SUCCESS(settings_check_names());
+	TEST_RESULT(setting_find("no_such_setting", zone1_set, ISC_TRUE,
+				 ISC_FALSE, &setting), ISC_R_NOTFOUND);
+	/* setting exists in the tree but not in the set itself */
+	TEST_RESULT(setting_find("sync_ptr", zone1_set, ISC_FALSE,
+				 ISC_FALSE, &setting), ISC_R_NOTFOUND);
+	TEST_SUCCESS(setting_find("sync_ptr", zone1_set, ISC_TRUE,
+				  ISC_FALSE, &setting));
+	TEST_STREQ(setting->name, "sync_ptr");
+}
+
+/**
+ * Repeated lookups are served from cache, the cache must not return
+ * stale values after a change in the set or in its parent.
+ */
+static void
+test_cache(void) {
+	for (int i = 0; i < 3; i++) {
+		check_uint(zone1_set, SETTING_DEFAULT_TTL, 86400);
+		check_str(zone1_set, SETTING_FAKE_MNAME, "");
+	}
+
+	TEST_SUCCESS(setting_set("default_ttl", global_set, "3600"));
+	check_uint(zone1_set, SETTING_DEFAULT_TTL, 3600);
+	check_uint(zone2_set, SETTING_DEFAULT_TTL, 3600);
+
+	TEST_SUCCESS(setting_set("default_ttl", zone1_set, "60"));
+	check_uint(zone1_set, SETTING_DEFAULT_TTL, 60);
+	check_uint(zone2_set, SETTING_DEFAULT_TTL, 3600);
+
+	/* value overridden in the zone set hides changes in parent */
+	TEST_SUCCESS(setting_set("default_ttl", global_set, "7200"));
+	check_uint(zone1_set, SETTING_DEFAULT_TTL, 60);
+	check_uint(zone2_set, SETTING_DEFAULT_TTL, 7200);
+
+	TEST_SUCCESS(setting_unset("default_ttl", zone1_set));
+	check_uint(zone1_set, SETTING_DEFAULT_TTL, 7200);
+	TEST_RESULT(setting_unset("default_ttl", zone1_set), ISC_R_IGNORE);
+
+	TEST_SUCCESS(setting_set("fake_mname", zone2_set, "ns.example."));
+	check_str(zone2_set, SETTING_FAKE_MNAME, "ns.example.");
+	check_str(zone1_set, SETTING_FAKE_MNAME, "");
+	TEST_RESULT(setting_set("fake_mname", zone2_set, "ns.example."),
+		    ISC_R_IGNORE);
+}
+
+/**
+ * Generation changes only if a value visible from the set changed.
+ */
+static void
+test_generation(void) {
+	isc_uint32_t gen1 = settings_set_generation(zone1_set);
+	isc_uint32_t gen2 = settings_set_generation(zone2_set);
+
+	TEST_SUCCESS(setting_set("default_ttl", zone2_set, "300"));
+	TEST_ASSERT(settings_set_generation(zone1_set) == gen1);
+	TEST_ASSERT(settings_set_generation(zone2_set) != gen2);
+	gen2 = settings_set_generation(zone2_set);
+
+	/* no change, no new generation */
+	TEST_RESULT(setting_set("default_ttl", zone2_set, "300"),
+		    ISC_R_IGNORE);
+	TEST_ASSERT(settings_set_generation(zone2_set) == gen2);
+
+	TEST_SUCCESS(setting_set("sync_ptr", global_set, "yes"));
+	TEST_ASSERT(settings_set_generation(zone1_set) != gen1);
+	TEST_ASSERT(settings_set_generation(zone2_set) != gen2);
+}
+
+int
+main(void) {
+	setup();
+	TEST_RUN(test_names);
+	TEST_RUN(test_cache);
+	TEST_RUN(test_generation);
+	teardown();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2016  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Helpers shared by unit tests run by `make check`.
+ */
+
+#ifndef _LD_TEST_UTIL_H_
+#define _LD_TEST_UTIL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <isc/mem.h>
+#include <isc/result.h>
+#include <isc/util.h>
+
+#include <dns/result.h>
+
+#define TEST_ASSERT(cond)						\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: assertion '%s' failed\n", \
+				__FILE__, __LINE__, #cond);		\
+			exit(EXIT_FAILURE);				\
+		}							\
+	} while (0)
+
+#define TEST_RESULT(op, expected)					\
+	do {								\
+		isc_result_t test__result = (op);			\
+		if (test__result != (expected)) {			\
+			fprintf(stderr, "%s:%d: '%s' returned %s, "	\
+				"expected %s\n", __FILE__, __LINE__, #op, \
+				isc_result_totext(test__result),	\
+				isc_result_totext(expected));		\
+			exit(EXIT_FAILURE);				\
+		}							\
+	} while (0)
+
+#define TEST_SUCCESS(op)	TEST_RESULT((op), ISC_R_SUCCESS)
+
+#define TEST_STREQ(actual, expected)					\
+	do {								\
+		const char *test__actual = (actual);			\
+		const char *test__expected = (expected);		\
+		if (strcmp(test__actual, test__expected) != 0) {	\
+			fprintf(stderr, "%s:%d: '%s' is '%s', "		\
+				"expected '%s'\n", __FILE__, __LINE__,	\
+				#actual, test__actual, test__expected);	\
+			exit(EXIT_FAILURE);				\
+		}							\
+	} while (0)
+
+#define TEST_RUN(test_fn)						\
+	do {								\
+		fprintf(stderr, "%s\n", #test_fn);			\
+		test_fn();						\
+	} while (0)
+
+static inline isc_mem_t *
+test_mem_create(void) {
+	isc_mem_t *mctx = NULL;
+
+	dns_result_register();
+	TEST_SUCCESS(isc_mem_create(0, 0, &mctx));
+	return mctx;
+}
+
+/**
+ * Destroy memory context, tests fail if some memory was not released.
+ */
+static inline void
+test_mem_destroy(isc_mem_t **mctxp) {
+	TEST_ASSERT(isc_mem_inuse(*mctxp) == 0);
+	isc_mem_destroy(mctxp);
+}
+
+#endif /* !_LD_TEST_UTIL_H_ */
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2016  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Unit tests for assignment of zones to servers by hash of zone name.
+ */
+
+#include "test_util.h"
+
+#include <dns/fixedname.h>
+#include <dns/name.h>
+
+#include "zone.h"
+
+#define SHARDS		4
+#define NAME_CNT	4000
+
+static isc_uint32_t
+hash_str(const char *str) {
+	dns_fixedname_t fname;
+	dns_name_t *name;
+
+	dns_fixedname_init(&fname);
+	name = dns_fixedname_name(&fname);
+	TEST_SUCCESS(dns_name_fromstring(name, str, 0, NULL));
+	return zone_shard_hash(name);
+}
+
+/**
+ * Servers of different versions and architectures have to agree
+ * on the assignment so the hash values must never change.
+ */
+static void
+test_stable(void) {
+	TEST_ASSERT(hash_str(".") == 84696351U);
+	TEST_ASSERT(hash_str("example.com.") == 790511238U);
+	TEST_ASSERT(hash_str("1.168.192.in-addr.arpa.") == 3155161112U);
+}
+
+static void
+test_case(void) {
+	TEST_ASSERT(hash_str("EXAMPLE.com.") == hash_str("example.com."));
+	TEST_ASSERT(hash_str("Example.COM.") == hash_str("example.com."));
+	TEST_ASSERT(hash_str("example.com.") != hash_str("example.net."));
+	/* label boundaries are part of the hash */
+	TEST_ASSERT(hash_str("ab.c.") != hash_str("a.bc."));
+}
+
+/**
+ * Similar names are spread evenly so no server gets much more zones
+ * than the others.
+ */
+static void
+test_distribution(void) {
+	unsigned int counts[SHARDS] = { 0 };
+	char str[64];
+	unsigned int i;
+
+	for (i = 0; i < NAME_CNT; i++) {
+		snprintf(str, sizeof(str), "zone%u.example.", i);
+		counts[hash_str(str) % SHARDS]++;
+	}
+	for (i = 0; i < SHARDS; i++)
+		TEST_ASSERT(counts[i] > NAME_CNT / SHARDS * 9 / 10 &&
+			    counts[i] < NAME_CNT / SHARDS * 11 / 10);
+}
+
+int
+main(void) {
+	isc_mem_t *mctx = test_mem_create();
+
+	TEST_RUN(test_stable);
+	TEST_RUN(test_case);
+	TEST_RUN(test_distribution);
+	test_mem_destroy(&mctx);
+	return EXIT_SUCCESS;
+}